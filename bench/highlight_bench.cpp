@@ -0,0 +1,262 @@
+// Highlighter throughput benchmark. Runs DraculaCppSyntaxHighlighter over a set of corpora on an
+// offscreen QTextDocument and reports ns/byte, blocks/s and allocations per block, optionally
+// as JSON so runs can be compared between releases.
+//
+//   highlight_bench [--engine lexer|regex|all] [--iterations N] [--json FILE]
+//                   [--amalgamation FILE] [FILE...]
+//
+// --amalgamation takes a large single-file source such as sqlite3.c. Without it a synthetic
+// amalgamation is built by repeating the editor's own sources. Extra FILEs become corpora of
+// their own.
+
+#include <QCommandLineParser>
+#include <QDebug>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QGuiApplication>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTextDocument>
+#include <QTextStream>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <new>
+#include <vector>
+
+#include "highlight.hpp"
+#include "scan.hpp"
+
+// Every operator new call is counted, so allocations per block covers the highlighter, Qt's
+// QObject/format bookkeeping and the standard containers, but not QString/QList data.
+namespace {
+std::atomic<std::uint64_t> allocations{0};
+}
+
+void *operator new(std::size_t size) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void *p = std::malloc(size ? size : 1)) return p;
+  throw std::bad_alloc();
+}
+void *operator new[](std::size_t size) { return operator new(size); }
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void *p, std::size_t) noexcept { std::free(p); }
+
+namespace {
+
+using Engine = DraculaCppSyntaxHighlighter::Engine;
+
+struct Corpus {
+  QString name;
+  QString text;
+};
+
+struct Result {
+  QString corpus;
+  QString engine;
+  qint64 bytes;
+  int blocks;
+  qint64 bestNs;
+  double allocationsPerBlock;
+};
+
+QString readFile(const QString &path) {
+  QFile file(path);
+  if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+    qWarning().noquote() << "highlight_bench: cannot read" << path;
+    return {};
+  }
+  return QString::fromUtf8(file.readAll());
+}
+
+// The editor's own sources and the sample program stand in for small hand-written files.
+QStringList smallFiles() {
+  const QDir source(EDIT_SOURCE_DIR);
+  QStringList files;
+  for (const char *name : {"math.c", "lexer.cpp", "editor.cpp", "highlight.cpp", "main.cpp"}) {
+    if (source.exists(name)) files << source.filePath(name);
+  }
+  return files;
+}
+
+QString syntheticAmalgamation(const QStringList &files, qsizetype targetBytes) {
+  QString sources;
+  for (const QString &path : files) sources += readFile(path);
+  if (sources.isEmpty()) return {};
+
+  QString text;
+  text.reserve(targetBytes + sources.size());
+  while (text.size() < targetBytes) text += sources;
+  return text;
+}
+
+// Few very long lines: whole-line work and run merging dominate.
+QString longLines() {
+  const QString statement = "total = value + compute(x, \"label\", 42) * factor; /* note */ ";
+  QString line;
+  while (line.size() < 64 * 1024) line += statement;
+
+  QString text;
+  for (int i = 0; i < 64; ++i) text += line + '\n';
+  return text;
+}
+
+// Mostly block and line comments, with a little code in between.
+QString commentHeavy() {
+  QString unit = "/*\n";
+  for (int i = 0; i < 20; ++i) {
+    unit += QString(" * Line %1 of the docs, with \"quotes\" and code: x = y + z;\n").arg(i);
+  }
+  unit += " */\n"
+          "// Returns the answer.\n"
+          "int answer(void) { return 42; } // trailing comment\n\n";
+
+  QString text;
+  while (text.size() < 2 * 1024 * 1024) text += unit;
+  return text;
+}
+
+QString engineName(Engine engine) { return engine == Engine::Lexer ? "lexer" : "regex"; }
+
+// Highlights a fresh document once per iteration so the lexer's block cache never hits.
+Result run(const Corpus &corpus, Engine engine, int iterations) {
+  Result result{corpus.name, engineName(engine), corpus.text.toUtf8().size(), 0,
+                std::numeric_limits<qint64>::max(), 0};
+
+  for (int i = 0; i < iterations; ++i) {
+    QTextDocument document;
+    document.setPlainText(corpus.text);
+    result.blocks = document.blockCount();
+
+    // Attached after setup, so the only highlighting pass is the timed one
+    DraculaCppSyntaxHighlighter highlighter;
+    highlighter.setEngine(engine);
+    highlighter.setBackgroundThreshold(std::numeric_limits<int>::max());
+    highlighter.setDocument(&document);
+
+    const std::uint64_t allocationsBefore = allocations.load(std::memory_order_relaxed);
+    QElapsedTimer timer;
+    timer.start();
+    highlighter.rehighlight();
+    const qint64 elapsed = timer.nsecsElapsed();
+    const std::uint64_t allocated =
+        allocations.load(std::memory_order_relaxed) - allocationsBefore;
+
+    result.bestNs              = std::min(result.bestNs, elapsed);
+    result.allocationsPerBlock = static_cast<double>(allocated) / result.blocks;
+  }
+  return result;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  // QTextDocument needs a GUI application for fonts; no window is ever shown
+  if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) qputenv("QT_QPA_PLATFORM", "offscreen");
+  QGuiApplication app(argc, argv);
+  app.setApplicationName("highlight_bench");
+
+  QCommandLineParser parser;
+  parser.setApplicationDescription("Measures syntax highlighting throughput.");
+  parser.addHelpOption();
+  parser.addOption({"engine", "Engine to measure: lexer, regex or all.", "engine", "all"});
+  parser.addOption({"iterations", "Passes per corpus; the fastest is reported.", "n", "5"});
+  parser.addOption({"json", "Write machine-readable results to <file>.", "file"});
+  parser.addOption({"amalgamation", "Large single-file corpus such as sqlite3.c.", "file"});
+  parser.addPositionalArgument("files", "Extra corpus files.", "[FILE...]");
+  parser.process(app);
+
+  std::vector<Engine> engines;
+  const QString engineOption = parser.value("engine");
+  if (engineOption == "lexer" || engineOption == "all") engines.push_back(Engine::Lexer);
+  if (engineOption == "regex" || engineOption == "all") engines.push_back(Engine::Regex);
+  if (engines.empty()) {
+    qWarning().noquote() << "highlight_bench: unknown engine" << engineOption;
+    return 2;
+  }
+  const int iterations = std::max(1, parser.value("iterations").toInt());
+
+  std::vector<Corpus> corpora;
+  const QStringList small = smallFiles();
+  for (const QString &path : small) {
+    corpora.push_back({QFileInfo(path).fileName(), readFile(path)});
+  }
+
+  if (parser.isSet("amalgamation")) {
+    const QString path = parser.value("amalgamation");
+    corpora.push_back({QFileInfo(path).fileName(), readFile(path)});
+  } else {
+    corpora.push_back(
+        {"amalgamation (synthetic)", syntheticAmalgamation(small, 8 * 1024 * 1024)});
+  }
+  corpora.push_back({"long lines", longLines()});
+  corpora.push_back({"comment heavy", commentHeavy()});
+  for (const QString &path : parser.positionalArguments()) {
+    corpora.push_back({QFileInfo(path).fileName(), readFile(path)});
+  }
+
+  QTextStream out(stdout);
+  out << QString("scan kernels: %1, iterations: %2\n\n").arg(scan::isa()).arg(iterations);
+  out << QString("%1 %2 %3 %4 %5 %6 %7\n")
+             .arg("corpus", -26)
+             .arg("engine", -6)
+             .arg("bytes", 10)
+             .arg("blocks", 8)
+             .arg("ns/byte", 9)
+             .arg("blocks/s", 12)
+             .arg("allocs/block", 13);
+
+  QJsonArray results;
+  for (const Corpus &corpus : corpora) {
+    if (corpus.text.isEmpty()) continue;
+    for (Engine engine : engines) {
+      const Result result = run(corpus, engine, iterations);
+      const double nsPerByte    = static_cast<double>(result.bestNs) / result.bytes;
+      const double blocksPerSec = result.blocks * 1e9 / result.bestNs;
+
+      out << QString("%1 %2 %3 %4 %5 %6 %7\n")
+                 .arg(result.corpus.left(26), -26)
+                 .arg(result.engine, -6)
+                 .arg(result.bytes, 10)
+                 .arg(result.blocks, 8)
+                 .arg(nsPerByte, 9, 'f', 2)
+                 .arg(blocksPerSec, 12, 'f', 0)
+                 .arg(result.allocationsPerBlock, 13, 'f', 2);
+      out.flush();
+
+      results.append(QJsonObject{
+          {"corpus", result.corpus},
+          {"engine", result.engine},
+          {"bytes", result.bytes},
+          {"blocks", result.blocks},
+          {"best_ns", result.bestNs},
+          {"ns_per_byte", nsPerByte},
+          {"blocks_per_s", blocksPerSec},
+          {"allocs_per_block", result.allocationsPerBlock},
+      });
+    }
+  }
+
+  if (parser.isSet("json")) {
+    QFile file(parser.value("json"));
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+      qWarning().noquote() << "highlight_bench: cannot write" << file.fileName();
+      return 1;
+    }
+    const QJsonObject report{
+        {"qt", qVersion()},
+        {"scan", scan::isa()},
+        {"iterations", iterations},
+        {"results", results},
+    };
+    file.write(QJsonDocument(report).toJson());
+  }
+  return 0;
+}
@@ -0,0 +1,246 @@
+#include "buffersearch.hpp"
+
+#include <QTextBlock>
+#include <QTextCursor>
+#include <QTextDocument>
+#include <algorithm>
+
+#include "scan.hpp"
+
+namespace {
+
+bool isAscii(const QString &text) {
+  return std::all_of(text.begin(), text.end(), [](QChar c) { return c.unicode() < 0x80; });
+}
+
+bool lessThan(const BufferSearch::Match &a, const BufferSearch::Match &b) {
+  return a.block != b.block ? a.block < b.block : a.column < b.column;
+}
+
+} // namespace
+
+BufferSearch::BufferSearch(QTextDocument *document, QObject *parent)
+    : QObject(parent), document(document) {
+  connect(document, &QTextDocument::contentsChange, this, &BufferSearch::contentsChange);
+}
+
+BufferSearch::~BufferSearch() { stopWorker(); }
+
+bool BufferSearch::setQuery(const Query &query, QString *error) {
+  stopWorker();
+  pattern.clear();
+  found.clear();
+  if (query.pattern.isEmpty()) {
+    emit matchesChanged();
+    return true;
+  }
+
+  ignoreCase = !query.matchCase;
+  // scan::findText folds ASCII only
+  useRegex = query.regex || (ignoreCase && !isAscii(query.pattern));
+  if (useRegex) {
+    regex = QRegularExpression(query.regex ? query.pattern
+                                           : QRegularExpression::escape(query.pattern),
+                               ignoreCase ? QRegularExpression::CaseInsensitiveOption
+                                          : QRegularExpression::NoPatternOption);
+    if (!regex.isValid()) {
+      if (error) *error = regex.errorString();
+      emit matchesChanged();
+      return false;
+    }
+    regex.optimize();
+  }
+  needle  = query.pattern;
+  pattern = query.pattern;
+  startWorker();
+  return true;
+}
+
+int BufferSearch::nearest(int position, bool backward) const {
+  if (found.empty()) return -1;
+  const QTextBlock block = document->findBlock(position);
+  const Match key{block.blockNumber(), position - block.position(), 0};
+  const auto at   = std::lower_bound(found.begin(), found.end(), key, lessThan);
+  const int index = static_cast<int>(at - found.begin());
+  if (backward) return index > 0 ? index - 1 : static_cast<int>(found.size()) - 1;
+  return at == found.end() ? 0 : index;
+}
+
+int BufferSearch::position(const Match &match) const {
+  return document->findBlockByNumber(match.block).position() + match.column;
+}
+
+QString BufferSearch::replacementFor(const Match &match, const QString &replacement) const {
+  if (!useRegex) return replacement;
+
+  // Match again where the match was found, for its captured groups
+  const QString text                  = document->findBlockByNumber(match.block).text();
+  const QRegularExpressionMatch again = regex.match(
+      text, match.column, QRegularExpression::NormalMatch,
+      QRegularExpression::AnchorAtOffsetMatchOption);
+  QString expanded;
+  for (qsizetype i = 0; i < replacement.size(); ++i) {
+    if (replacement[i] != u'\\' || i + 1 == replacement.size()) {
+      expanded += replacement[i];
+      continue;
+    }
+    const QChar next = replacement[++i];
+    if (next.isDigit()) {
+      expanded += again.captured(next.digitValue());
+    } else {
+      expanded += next;
+    }
+  }
+  return expanded;
+}
+
+int BufferSearch::replaceAll(const QString &replacement) {
+  if (worker) return -1;
+  if (found.empty()) return 0;
+
+  // Worked out up front, since each replacement updates `found`
+  struct Edit {
+    int position;
+    int length;
+    QString text;
+  };
+  std::vector<Edit> edits;
+  edits.reserve(found.size());
+  for (const Match &match : found) {
+    edits.push_back({position(match), match.length, replacementFor(match, replacement)});
+  }
+
+  // Replacements have no line breaks, so the matches' blocks are the lines that change
+  QList<int> blocks;
+  for (const Match &match : found) {
+    if (blocks.isEmpty() || blocks.last() != match.block) blocks.append(match.block);
+  }
+
+  // Back to front, so that earlier positions stay valid; one edit block, so the document
+  // reports one change and the replacements are undone as one step
+  emit aboutToReplaceAll();
+  QTextCursor cursor(document);
+  cursor.beginEditBlock();
+  for (auto edit = edits.crbegin(); edit != edits.crend(); ++edit) {
+    cursor.setPosition(edit->position);
+    cursor.setPosition(edit->position + edit->length, QTextCursor::KeepAnchor);
+    cursor.insertText(edit->text);
+  }
+  cursor.endEditBlock();
+  emit replacedAll(blocks);
+  return static_cast<int>(edits.size());
+}
+
+void BufferSearch::startWorker() {
+  stopWorker();
+  restart = false;
+  found.clear();
+  revision = document->revision();
+  emit matchesChanged();
+
+  cancelled = false;
+  worker    = QThread::create([this, text = document->toPlainText()] {
+    // toPlainText() ends each block but the last with '\n'
+    std::vector<Match> matches;
+    const auto *data = reinterpret_cast<const char16_t *>(text.constData());
+    const int size   = static_cast<int>(text.size());
+    int block        = 0;
+    for (int start = 0; start <= size && !cancelled; ++block) {
+      const int end = scan::find(data, size, start, u'\n');
+      matchLine(block, text.constData() + start, end - start, matches);
+      start = end + 1;
+    }
+    result = std::move(matches);
+  });
+  connect(worker, &QThread::finished, this, [this, started = ++generation] {
+    if (started == generation) workerFinished();
+  });
+  worker->start();
+}
+
+void BufferSearch::workerFinished() {
+  worker->wait();
+  delete worker;
+  worker = nullptr;
+
+  if (restart) {
+    startWorker();
+    return;
+  }
+  found      = std::move(result);
+  result     = {};
+  blockCount = document->blockCount();
+  emit matchesChanged();
+}
+
+void BufferSearch::stopWorker() {
+  if (!worker) return;
+  cancelled = true;
+  worker->wait();
+  delete worker;
+  worker = nullptr;
+  ++generation;
+}
+
+void BufferSearch::contentsChange(int position, int charsRemoved, int charsAdded) {
+  Q_UNUSED(charsRemoved);
+  // The highlighter reports its formatting as changes too
+  if (!isActive() || document->revision() == revision) return;
+  if (worker) {
+    restart = true;
+    return;
+  }
+
+  // Blocks first to last are the edited ones now; they replaced first to oldLast
+  const int blocks  = document->blockCount();
+  const int first   = document->findBlock(position).blockNumber();
+  const int end     = std::min(position + charsAdded, document->characterCount() - 1);
+  const int last    = document->findBlock(end).blockNumber();
+  const int oldLast = last - (blocks - blockCount);
+  if (first < 0 || last - first >= maxEditedBlocks || oldLast - first >= maxEditedBlocks) {
+    startWorker();
+    return;
+  }
+
+  std::vector<Match> edited;
+  QTextBlock block = document->findBlockByNumber(first);
+  for (int number = first; number <= last && block.isValid(); ++number, block = block.next()) {
+    const QString text = block.text();
+    matchLine(number, text.constData(), static_cast<int>(text.size()), edited);
+  }
+
+  const auto byBlock = [](const Match &match, int number) { return match.block < number; };
+  const auto begin   = std::lower_bound(found.begin(), found.end(), first, byBlock);
+  const auto stale   = std::lower_bound(begin, found.end(), oldLast + 1, byBlock);
+  revision = document->revision();
+  if (edited.empty() && begin == stale && blocks == blockCount) return;
+
+  for (auto later = stale; later != found.end(); ++later) later->block += blocks - blockCount;
+  found.insert(found.erase(begin, stale), edited.begin(), edited.end());
+  blockCount = blocks;
+  emit matchesChanged();
+}
+
+void BufferSearch::matchLine(int block, const QChar *line, int length,
+                             std::vector<Match> &out) const {
+  if (!useRegex) {
+    const auto *text = reinterpret_cast<const char16_t *>(line);
+    const std::u16string_view literal(reinterpret_cast<const char16_t *>(needle.constData()),
+                                      static_cast<std::size_t>(needle.size()));
+    const int size = static_cast<int>(literal.size());
+    for (int at = scan::findText(text, length, 0, literal, ignoreCase); at < length;
+         at     = scan::findText(text, length, at + size, literal, ignoreCase)) {
+      out.push_back({block, at, size});
+    }
+    return;
+  }
+
+  const QString text = QString::fromRawData(line, length);
+  for (auto it = regex.globalMatch(text); it.hasNext();) {
+    const QRegularExpressionMatch match = it.next();
+    // An empty match cannot be shown or replaced
+    if (match.capturedLength() == 0) continue;
+    out.push_back({block, static_cast<int>(match.capturedStart()),
+                   static_cast<int>(match.capturedLength())});
+  }
+}
@@ -0,0 +1,98 @@
+#ifndef CED0A5B1_9823_41A4_B6A4_09B3D465FE0A
+#define CED0A5B1_9823_41A4_B6A4_09B3D465FE0A
+
+#include <QList>
+#include <QObject>
+#include <QRegularExpression>
+#include <QString>
+#include <QThread>
+#include <atomic>
+#include <vector>
+
+class QTextDocument;
+
+// Finds every match of a query in a QTextDocument and keeps the matches current as the
+// document is edited. The first search runs over a plain-text snapshot on a worker thread:
+// literals are found with scan::findText, regular expressions with QRegularExpression. After
+// it, each edit searches only the blocks it touched again; an edit that touches many blocks,
+// such as loading a file, starts a new snapshot search instead. Matches never span blocks.
+class BufferSearch : public QObject {
+  Q_OBJECT
+
+public:
+  struct Query {
+    QString pattern;
+    bool regex     = false;
+    bool matchCase = false;
+  };
+
+  // Sorted by block, then column. `column` and `length` are in UTF-16 code units of the block.
+  struct Match {
+    int block;
+    int column;
+    int length;
+  };
+
+  explicit BufferSearch(QTextDocument *document, QObject *parent = nullptr);
+  ~BufferSearch() override; // stops a running search
+
+  // Searches for `query` from scratch; an empty pattern clears the matches. Returns false,
+  // with `error` set, if the pattern is not a valid regular expression.
+  bool setQuery(const Query &query, QString *error = nullptr);
+  [[nodiscard]] bool isActive() const { return !pattern.isEmpty(); }
+  [[nodiscard]] bool isSearching() const { return worker != nullptr; }
+
+  [[nodiscard]] const std::vector<Match> &matches() const { return found; }
+  // Index of the first match that starts at or after document position `position`, or, going
+  // backward, of the last one that starts before it. Wraps around; -1 if there is none.
+  [[nodiscard]] int nearest(int position, bool backward) const;
+  // Document position of `match`.
+  [[nodiscard]] int position(const Match &match) const;
+
+  // The text `match` is replaced with: `replacement`, with \0 to \9 expanded to the captured
+  // groups for a regular expression.
+  [[nodiscard]] QString replacementFor(const Match &match, const QString &replacement) const;
+  // Replaces every match in one edit block, undone as one step. Returns how many there were,
+  // or -1 while a search is still running.
+  int replaceAll(const QString &replacement);
+
+signals:
+  // The matches, or only their number, changed.
+  void matchesChanged();
+  // replaceAll() is about to edit the document, and has edited it: `blocks` are the blocks it
+  // replaced matches on, in order. The document reports the edit as a single change that spans
+  // all of them.
+  void aboutToReplaceAll();
+  void replacedAll(const QList<int> &blocks);
+
+private:
+  // Blocks an edit may touch before it is searched on the worker instead
+  static constexpr int maxEditedBlocks = 2000;
+
+  QTextDocument *document;
+  QString pattern;
+  QString needle; // the literal, when not matching `regex`
+  bool ignoreCase = false;
+  bool useRegex   = false;
+  QRegularExpression regex;
+
+  std::vector<Match> found;
+  int blockCount = 0; // of the document the matches belong to
+  int revision   = 0; // QTextDocument::revision() of that document, which formatting leaves as is
+
+  QThread *worker = nullptr;
+  std::atomic<bool> cancelled{false};
+  quint64 generation = 0;     // tells a stopped worker's finished() from the current one's
+  bool restart       = false; // the document changed while the worker searched it
+  // Written by the worker, read once it has finished
+  std::vector<Match> result;
+
+  void startWorker();
+  void workerFinished();
+  void stopWorker();
+  void contentsChange(int position, int charsRemoved, int charsAdded);
+  // Appends the matches in `line`, block `block`, to `out`
+  void matchLine(int block, const QChar *line, int length, std::vector<Match> &out) const;
+};
+
+#endif /* CED0A5B1_9823_41A4_B6A4_09B3D465FE0A */
@@ -0,0 +1,150 @@
+#include "buffersymbols.hpp"
+
+#include <QTextBlock>
+#include <QTextDocument>
+#include <algorithm>
+#include <iterator>
+#include <unordered_map>
+
+namespace {
+
+bool isWordStart(QChar c) { return c.isLetter() || c == u'_'; }
+bool isWordPart(QChar c) { return c.isLetterOrNumber() || c == u'_'; }
+
+std::u16string_view view(const QString &text) {
+  return {reinterpret_cast<const char16_t *>(text.utf16()), static_cast<std::size_t>(text.size())};
+}
+
+// `base`, which may be null, with `changes` merged in. Both are in code unit order, so one pass
+// over them does it.
+std::shared_ptr<const SymbolArena>
+mergeChanges(const SymbolArena *base,
+             const std::vector<std::pair<std::u16string, std::uint32_t>> &changes) {
+  const std::size_t size = base ? base->size() : 0;
+  std::size_t units      = 0;
+  for (std::size_t i = 0; i < size; ++i) units += base->word(i).size();
+  for (const auto &[word, references] : changes) units += word.size();
+
+  auto merged = std::make_shared<SymbolArena>();
+  merged->reserve(size + changes.size(), units);
+  std::size_t i = 0;
+  for (const auto &[word, references] : changes) {
+    for (; i < size && base->word(i) < word; ++i) merged->add(base->word(i), base->references(i));
+    if (i < size && base->word(i) == word) ++i;
+    if (references > 0) merged->add(word, references);
+  }
+  for (; i < size; ++i) merged->add(base->word(i), base->references(i));
+  return merged;
+}
+
+} // namespace
+
+BufferSymbols::BufferSymbols(QTextDocument *document, QObject *parent)
+    : QObject(parent), document(document) {
+  connect(document, &QTextDocument::contentsChange, this, &BufferSymbols::contentsChange);
+  contentsChange(0, 0, document->characterCount() - 1);
+}
+
+void BufferSymbols::addPermanent(const QString &word) {
+  if (word.isEmpty()) return;
+  noteChanges({{std::u16string(view(word)), trie.add(view(word))}});
+}
+
+std::shared_ptr<const SymbolArena> BufferSymbols::symbols() const {
+  std::shared_ptr<const SymbolArena> base;
+  std::vector<std::pair<std::u16string, std::uint32_t>> merging;
+  {
+    const std::lock_guard<std::mutex> lock(mutex);
+    const auto now = std::chrono::steady_clock::now();
+    if (changes.empty() || building || (arena && now - built < rebuildDelay)) return arena;
+    building = true;
+    base     = arena;
+    merging.assign(std::make_move_iterator(changes.begin()),
+                   std::make_move_iterator(changes.end()));
+    changes.clear();
+  }
+
+  // Edits go on meanwhile; what they change is merged into the next arena
+  std::sort(merging.begin(), merging.end());
+  std::shared_ptr<const SymbolArena> merged = mergeChanges(base.get(), merging);
+
+  const std::lock_guard<std::mutex> lock(mutex);
+  arena    = merged;
+  built    = std::chrono::steady_clock::now();
+  building = false;
+  return merged;
+}
+
+void BufferSymbols::noteChanges(
+    const std::vector<std::pair<std::u16string, SymbolTrie::Id>> &changed) {
+  const std::lock_guard<std::mutex> lock(mutex);
+  for (const auto &[word, id] : changed) changes[word] = trie.references(id);
+}
+
+void BufferSymbols::contentsChange(int position, int charsRemoved, int charsAdded) {
+  Q_UNUSED(charsRemoved);
+  const int blocks = document->blockCount();
+  const int known  = static_cast<int>(blockWords.size());
+  // The highlighter reports its formatting as changes too
+  if (document->revision() == revision && blocks == known) return;
+  revision = document->revision();
+
+  // Blocks first to last are the edited ones now; they replaced first to oldLast
+  const int end = std::min(position + charsAdded, document->characterCount() - 1);
+  int first     = document->findBlock(position).blockNumber();
+  int last      = document->findBlock(end).blockNumber();
+  int oldLast   = last - (blocks - known);
+  if (first < 0 || last < first || oldLast < first - 1 || oldLast >= known) {
+    first   = 0;
+    last    = blocks - 1;
+    oldLast = known - 1;
+  }
+
+  // Adding first keeps words that are still there from being removed and added again
+  std::vector<std::vector<SymbolTrie::Id>> edited(static_cast<std::size_t>(last - first + 1));
+  QTextBlock block = document->findBlockByNumber(first);
+  std::unordered_map<SymbolTrie::Id, int> counted; // references added less those released
+  for (std::vector<SymbolTrie::Id> &words : edited) {
+    addWords(block.text(), words);
+    for (const SymbolTrie::Id id : words) ++counted[id];
+    block = block.next();
+  }
+
+  const auto oldBegin = blockWords.begin() + first;
+  const auto oldEnd   = blockWords.begin() + oldLast + 1;
+  for (auto words = oldBegin; words != oldEnd; ++words) {
+    for (const SymbolTrie::Id id : *words) --counted[id];
+  }
+  // Retyping a line leaves its words as they were, so there is usually little to note
+  std::vector<std::pair<std::u16string, SymbolTrie::Id>> changed;
+  for (const auto &[id, count] : counted) {
+    if (count != 0) changed.emplace_back(trie.word(id), id);
+  }
+  for (auto words = oldBegin; words != oldEnd; ++words) {
+    for (const SymbolTrie::Id id : *words) trie.release(id);
+  }
+  if (!changed.empty()) noteChanges(changed);
+  if (oldEnd - oldBegin == static_cast<std::ptrdiff_t>(edited.size())) {
+    std::move(edited.begin(), edited.end(), oldBegin);
+  } else {
+    blockWords.insert(blockWords.erase(oldBegin, oldEnd), std::make_move_iterator(edited.begin()),
+                      std::make_move_iterator(edited.end()));
+  }
+}
+
+void BufferSymbols::addWords(const QString &text, std::vector<SymbolTrie::Id> &words) {
+  const qsizetype size = text.size();
+  for (qsizetype i = 0; i < size;) {
+    if (!isWordStart(text[i])) {
+      // Skip the rest of a number too, so that 0x1f adds nothing
+      const bool number = text[i++].isDigit();
+      while (number && i < size && isWordPart(text[i])) ++i;
+      continue;
+    }
+    const qsizetype start = i;
+    while (i < size && isWordPart(text[i])) ++i;
+    if (i - start >= minWordLength) {
+      words.push_back(trie.add(view(text).substr(start, i - start)));
+    }
+  }
+}
@@ -0,0 +1,61 @@
+#ifndef F2C86E0B_91D7_4A3E_8B25_6D4F0A7C13E9
+#define F2C86E0B_91D7_4A3E_8B25_6D4F0A7C13E9
+
+#include <QObject>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "completionengine.hpp"
+#include "symboltrie.hpp"
+
+class QTextDocument;
+
+// Identifiers of a QTextDocument, for completion. Each block remembers the words it added to a
+// SymbolTrie; an edit releases the words of the blocks it touched and adds theirs again, so a
+// word goes away with its last occurrence and nothing is rescanned but the edited blocks.
+// The trie is only used on the GUI thread. The words whose references an edit changed are
+// noted for symbols(), which merges them into a copy of the last arena outside the lock, at
+// most once per rebuildDelay: while a word is typed the arena stays the same, so the
+// completion engine can narrow its last search instead of starting over.
+class BufferSymbols : public QObject, public CompletionSource {
+  Q_OBJECT
+
+public:
+  // Shorter identifiers are not worth completing
+  static constexpr int minWordLength = 3;
+  static constexpr std::chrono::milliseconds rebuildDelay{250};
+
+  explicit BufferSymbols(QTextDocument *document, QObject *parent = nullptr);
+
+  // Adds `word` for as long as the index lives, e.g. a keyword.
+  void addPermanent(const QString &word);
+
+  [[nodiscard]] std::shared_ptr<const SymbolArena> symbols() const override;
+
+private:
+  // Words whose references changed, with their references now; 0 if they are gone
+  using Changes = std::unordered_map<std::u16string, std::uint32_t>;
+
+  QTextDocument *document;
+  SymbolTrie trie;
+  std::vector<std::vector<SymbolTrie::Id>> blockWords; // per block of the document
+  int revision = -1; // QTextDocument::revision() that blockWords are of
+
+  mutable std::mutex mutex;                            // guards the members below
+  mutable Changes changes;                             // not in arena yet
+  mutable std::shared_ptr<const SymbolArena> arena;    // the trie's words, in code unit order
+  mutable std::chrono::steady_clock::time_point built; // when arena was
+  mutable bool building = false;                       // symbols() is making the next arena
+
+  void contentsChange(int position, int charsRemoved, int charsAdded);
+  void addWords(const QString &text, std::vector<SymbolTrie::Id> &words);
+  // Notes the references the words of `changed` have now; their ids must still be readable
+  void noteChanges(const std::vector<std::pair<std::u16string, SymbolTrie::Id>> &changed);
+};
+
+#endif /* F2C86E0B_91D7_4A3E_8B25_6D4F0A7C13E9 */
@@ -0,0 +1,67 @@
+#include "clangformat.hpp"
+
+#include <QFile>
+#include <QObject>
+#include <QXmlStreamReader>
+
+#include "utf8.hpp"
+
+QStringList clangFormatArguments(const QList<QPair<int, int>> &lines) {
+  QStringList args = {"-style=Google", "-output-replacements-xml"};
+
+  // if there is a .clang-format file in the current directory, use it
+  if (QFile::exists(".clang-format")) {
+    args.append("--assume-filename=.clang-format");
+  }
+
+  for (const auto &[first, last] : lines) {
+    args.append(QString("-lines=%1:%2").arg(first).arg(last));
+  }
+  return args;
+}
+
+bool parseFormatEdits(const QByteArray &xml, const QByteArray &input, QList<FormatEdit> &edits,
+                      QString *error) {
+  edits.clear();
+  QXmlStreamReader reader(xml);
+  if (!reader.readNextStartElement() || reader.name() != u"replacements") {
+    if (error) *error = QObject::tr("no replacements in clang-format output");
+    return false;
+  }
+
+  const auto units = [&input](qint64 from, qint64 to) {
+    return static_cast<qsizetype>(
+        utf16Length(input.constData() + from, static_cast<std::size_t>(to - from)));
+  };
+
+  // Byte offsets are converted to positions walking forward, from the end of the last edit
+  qint64 byte        = 0;
+  qsizetype position = 0;
+  while (reader.readNextStartElement()) {
+    if (reader.name() != u"replacement") {
+      reader.skipCurrentElement();
+      continue;
+    }
+
+    bool offsetOk       = false;
+    bool lengthOk       = false;
+    const qint64 offset = reader.attributes().value(u"offset").toLongLong(&offsetOk);
+    const qint64 length = reader.attributes().value(u"length").toLongLong(&lengthOk);
+    const QString text  = reader.readElementText();
+    if (!offsetOk || !lengthOk || offset < byte || length < 0 || offset + length > input.size()) {
+      if (error) *error = QObject::tr("invalid replacement at offset %1").arg(offset);
+      return false;
+    }
+
+    const qsizetype start = position + units(byte, offset);
+    position              = start + units(offset, offset + length);
+    byte                  = offset + length;
+    edits.append({start, position - start, text});
+  }
+
+  if (reader.hasError()) {
+    if (error) *error = reader.errorString();
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,27 @@
+#ifndef C12C2267_2249_4296_ADF5_B8270B06C4EA
+#define C12C2267_2249_4296_ADF5_B8270B06C4EA
+
+#include <QByteArray>
+#include <QList>
+#include <QPair>
+#include <QString>
+#include <QStringList>
+
+// One replacement from clang-format -output-replacements-xml, converted from UTF-8 byte
+// offsets in the formatted input to QString positions.
+struct FormatEdit {
+  qsizetype position;
+  qsizetype length;
+  QString text;
+};
+
+// Arguments that make clang-format report replacements for `lines` instead of printing the
+// formatted file. `lines` are 1-based inclusive ranges; an empty list formats everything.
+QStringList clangFormatArguments(const QList<QPair<int, int>> &lines);
+
+// Parses clang-format's replacement XML for `input`, the UTF-8 text it was given. Edits come
+// back in document order and do not overlap. Returns false, with `error` set, on bad output.
+bool parseFormatEdits(const QByteArray &xml, const QByteArray &input, QList<FormatEdit> &edits,
+                      QString *error = nullptr);
+
+#endif /* C12C2267_2249_4296_ADF5_B8270B06C4EA */
@@ -0,0 +1,150 @@
+#include "completionengine.hpp"
+
+#include <QSet>
+#include <algorithm>
+
+namespace {
+
+struct Ranked {
+  int score;
+  QString word;
+};
+
+// Higher scores first, then shorter words, then alphabetically
+bool better(const Ranked &a, const Ranked &b) {
+  if (a.score != b.score) return a.score > b.score;
+  if (a.word.size() != b.word.size()) return a.word.size() < b.word.size();
+  return a.word.compare(b.word, Qt::CaseInsensitive) < 0;
+}
+
+std::u16string_view view(const QString &text) {
+  return {reinterpret_cast<const char16_t *>(text.utf16()), static_cast<std::size_t>(text.size())};
+}
+
+} // namespace
+
+CompletionEngine::CompletionEngine(QObject *parent) : QObject(parent) {
+  // One worker: a new request waits at most for the stale one to give up
+  pool.setMaxThreadCount(1);
+
+  // Queued to the GUI thread, where only the latest request's results get through
+  connect(this, &CompletionEngine::workerReady, this,
+          [this](quint64 generation, const QString &prefix, const QStringList &words) {
+            if (generation != latest || requested.elapsed() > budgetMs) return;
+            emit ready(generation, prefix, words);
+          });
+}
+
+CompletionEngine::~CompletionEngine() {
+  cancel();
+  pool.waitForDone();
+}
+
+void CompletionEngine::addSource(const CompletionSource *source) { sources.push_back(source); }
+
+quint64 CompletionEngine::request(const QString &prefix) {
+  const quint64 generation = ++latest;
+  requested.start();
+  pool.clear();
+  pool.start([this, generation, prefix, from = sources] { work(generation, prefix, from); });
+  return generation;
+}
+
+void CompletionEngine::cancel() {
+  ++latest;
+  pool.clear();
+}
+
+void CompletionEngine::work(quint64 generation, const QString &prefix,
+                            const std::vector<const CompletionSource *> &from) {
+  const std::u16string_view query = view(prefix);
+  std::vector<Ranked> ranked;
+  for (const CompletionSource *source : from) {
+    if (generation != latest) return;
+    const std::shared_ptr<const SymbolArena> arena = source->symbols();
+    if (!arena) continue;
+
+    const std::size_t size  = arena->size();
+    const std::size_t parts = size < parallelSymbols
+                                  ? 1
+                                  : static_cast<std::size_t>(qMax(1, scorers.maxThreadCount()));
+    // The words that matched a query are the only ones that can match a longer one
+    Searched &last    = searched[source];
+    const bool narrow = last.arena == arena && !last.query.isEmpty() &&
+                        prefix.startsWith(last.query) && last.matched.size() == parts;
+
+    // One more than shown, in case the word being typed is among them
+    const std::size_t limit = maxResults + 1;
+    std::vector<std::vector<SymbolArena::Match>> found(parts);
+    std::vector<std::vector<std::uint32_t>> matched(parts);
+    const auto searchPart = [&](std::size_t part) {
+      found[part] = narrow ? arena->search(query, limit, last.matched[part], &matched[part])
+                           : arena->search(query, limit, size * part / parts,
+                                           size * (part + 1) / parts, &matched[part]);
+    };
+    for (std::size_t part = 1; part < parts; ++part) {
+      scorers.start([&searchPart, part] { searchPart(part); });
+    }
+    searchPart(0);
+    scorers.waitForDone();
+    last = {arena, prefix, std::move(matched)};
+
+    for (const SymbolArena::Match &match : arena->merge(std::move(found), limit)) {
+      const std::u16string_view word = arena->word(match.symbol);
+      if (arena->references(match.symbol) == 1 && word == query) continue;
+      ranked.push_back(
+          {match.score, QString::fromUtf16(word.data(), static_cast<qsizetype>(word.size()))});
+    }
+  }
+  if (generation != latest) return;
+
+  // Sources can share words; each is shown once, where it ranks best
+  std::sort(ranked.begin(), ranked.end(), better);
+  QStringList words;
+  QSet<QString> seen;
+  for (Ranked &candidate : ranked) {
+    if (words.size() == maxResults) break;
+    if (seen.contains(candidate.word)) continue;
+    seen.insert(candidate.word);
+    words.append(std::move(candidate.word));
+  }
+  emit workerReady(generation, prefix, words);
+}
+
+void CompletionModel::setWords(const QStringList &words) {
+  const qsizetype common = qMin(rows.size(), words.size());
+  qsizetype first        = -1;
+  qsizetype last         = -1;
+  for (qsizetype row = 0; row < common; ++row) {
+    if (rows[row] == words[row]) continue;
+    rows[row] = words[row];
+    if (first < 0) first = row;
+    last = row;
+  }
+  if (first >= 0) {
+    emit dataChanged(index(static_cast<int>(first)), index(static_cast<int>(last)),
+                     {Qt::DisplayRole, Qt::EditRole});
+  }
+
+  if (words.size() < rows.size()) {
+    beginRemoveRows(QModelIndex(), static_cast<int>(words.size()),
+                    static_cast<int>(rows.size() - 1));
+    rows.resize(words.size());
+    endRemoveRows();
+  } else if (words.size() > rows.size()) {
+    beginInsertRows(QModelIndex(), static_cast<int>(rows.size()),
+                    static_cast<int>(words.size() - 1));
+    rows.append(words.mid(rows.size()));
+    endInsertRows();
+  }
+}
+
+int CompletionModel::rowCount(const QModelIndex &parent) const {
+  return parent.isValid() ? 0 : static_cast<int>(rows.size());
+}
+
+QVariant CompletionModel::data(const QModelIndex &index, int role) const {
+  if (!index.isValid() || index.row() >= rows.size()) return {};
+  if (role == Qt::DisplayRole || role == Qt::EditRole) return rows[index.row()];
+  return {};
+}
@@ -0,0 +1,100 @@
+#ifndef E41B7C93_0D5A_4F28_9C6E_A3187F52D0B4
+#define E41B7C93_0D5A_4F28_9C6E_A3187F52D0B4
+
+#include <QAbstractListModel>
+#include <QElapsedTimer>
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QThreadPool>
+#include <atomic>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "symbolarena.hpp"
+
+// Something words to complete come from.
+class CompletionSource {
+public:
+  virtual ~CompletionSource() = default;
+
+  // The source's words as they are now, with how often each occurs. Called on the completion
+  // thread, so it has to be safe while the GUI thread goes on editing. The same arena should
+  // be returned for as long as the words have not changed: a query that extends the previous
+  // one then only scores the words that one matched.
+  [[nodiscard]] virtual std::shared_ptr<const SymbolArena> symbols() const = 0;
+};
+
+// Completes words off the GUI thread. Each request replaces the one before it: requests still
+// queued are dropped, and a running one gives up between sources once it is no longer the
+// latest. Words are fuzzy matched, so "vecpb" finds vector_push_back; large arenas are scored
+// in parts on a second pool, one per core. Results that come later than the latency budget
+// after their request are dropped rather than shown under a cursor that has moved on.
+class CompletionEngine : public QObject {
+  Q_OBJECT
+
+public:
+  static constexpr int maxResults      = 50;
+  static constexpr int defaultBudgetMs = 50;
+
+  explicit CompletionEngine(QObject *parent = nullptr);
+  ~CompletionEngine() override; // cancels and waits for the worker
+
+  // Sources are read by the worker, so they have to outlive the engine.
+  void addSource(const CompletionSource *source);
+  void setLatencyBudget(int ms) { budgetMs = ms; }
+  [[nodiscard]] int latencyBudget() const { return budgetMs; }
+
+  // Starts completing `prefix` and returns the request's generation, which ready() reports.
+  quint64 request(const QString &prefix);
+  void cancel();
+
+signals:
+  // Best completions for the latest request, best first.
+  void ready(quint64 generation, const QString &prefix, const QStringList &words);
+
+  // Emitted from the worker.
+  void workerReady(quint64 generation, const QString &prefix, const QStringList &words);
+
+private:
+  // Arenas smaller than this are scored by the worker alone
+  static constexpr std::size_t parallelSymbols = 32 * 1024;
+
+  // What the last search of a source matched, per part of its arena, to narrow the next one
+  struct Searched {
+    std::shared_ptr<const SymbolArena> arena;
+    QString query;
+    std::vector<std::vector<std::uint32_t>> matched;
+  };
+
+  QThreadPool scorers;
+  QThreadPool pool;
+  std::vector<const CompletionSource *> sources;
+  std::unordered_map<const CompletionSource *, Searched> searched; // used by the worker only
+  std::atomic<quint64> latest{0};
+  QElapsedTimer requested; // since the latest request
+  int budgetMs = defaultBudgetMs;
+
+  void work(quint64 generation, const QString &prefix,
+            const std::vector<const CompletionSource *> &from);
+};
+
+// The completions on show. setWords() updates the rows in place and signals only those that
+// changed, and nothing at all when a keystroke leaves the list as it was.
+class CompletionModel : public QAbstractListModel {
+  Q_OBJECT
+
+public:
+  using QAbstractListModel::QAbstractListModel;
+
+  void setWords(const QStringList &words);
+
+  [[nodiscard]] int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+  [[nodiscard]] QVariant data(const QModelIndex &index, int role) const override;
+
+private:
+  QStringList rows;
+};
+
+#endif /* E41B7C93_0D5A_4F28_9C6E_A3187F52D0B4 */
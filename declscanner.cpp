@@ -0,0 +1,578 @@
+#include "declscanner.hpp"
+
+#include <algorithm>
+#include <string>
+
+#include "keywords.hpp"
+#include "scan.hpp"
+#include "utf8.hpp"
+
+namespace {
+
+constexpr std::size_t kNone = static_cast<std::size_t>(-1);
+
+struct Token {
+  enum class Type : std::uint8_t { Identifier, Punctuation, Literal };
+
+  Type type;
+  std::uint32_t start;
+  std::uint32_t length;
+};
+
+bool isIdentifierStart(char c) {
+  return ((c | 0x20) >= 'a' && (c | 0x20) <= 'z') || c == '_' || c == '$' ||
+         static_cast<unsigned char>(c) >= 0x80;
+}
+bool isDigit(char c) { return c >= '0' && c <= '9'; }
+bool isIdentifierPart(char c) { return isIdentifierStart(c) || isDigit(c); }
+bool isSpace(char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\f' || c == '\v'; }
+
+// __x and _X belong to the compiler and the standard library
+bool isReserved(std::string_view name) {
+  return name.size() > 1 && name[0] == '_' &&
+         (name[1] == '_' || (name[1] >= 'A' && name[1] <= 'Z'));
+}
+
+bool isStringPrefix(std::string_view word) {
+  return word == "L" || word == "u" || word == "U" || word == "u8";
+}
+
+bool isRawStringPrefix(std::string_view word) {
+  return word == "R" || word == "LR" || word == "uR" || word == "UR" || word == "u8R";
+}
+
+// Splits a file into identifiers, punctuation and literals, leaving out comments and
+// preprocessor directives. Macro definitions are reported as they go by.
+class Lexer {
+public:
+  Lexer(std::string_view text, std::vector<Token> &tokens, std::vector<std::uint32_t> &macros)
+      : text(text), size(text.size()), tokens(tokens), macros(macros) {}
+
+  void run() {
+    bool lineStart = true;
+    while (at < size) {
+      const char c = text[at];
+      if (c == '\n') {
+        lineStart = true;
+        ++at;
+      } else if (isSpace(c)) {
+        ++at;
+      } else if (c == '/' && peek(1) == '/') {
+        skipLine();
+      } else if (c == '/' && peek(1) == '*') {
+        skipComment();
+      } else if (c == '#' && lineStart) {
+        directive();
+      } else {
+        lineStart = false;
+        token();
+      }
+    }
+  }
+
+private:
+  std::string_view text;
+  std::size_t size;
+  std::size_t at = 0;
+  std::vector<Token> &tokens;
+  std::vector<std::uint32_t> &macros;
+
+  [[nodiscard]] char peek(std::size_t ahead) const {
+    return at + ahead < size ? text[at + ahead] : '\0';
+  }
+
+  void add(Token::Type type, std::size_t start) {
+    tokens.push_back({type, static_cast<std::uint32_t>(start),
+                      static_cast<std::uint32_t>(at - start)});
+  }
+
+  // To the end of the line, which a backslash continues
+  void skipLine() {
+    for (; at < size && text[at] != '\n'; ++at) {
+      if (text[at] == '\\' && at + 1 < size && text[at + 1] == '\n') ++at;
+    }
+  }
+
+  void skipComment() {
+    const std::size_t end = text.find("*/", at + 2);
+    at                    = end == std::string_view::npos ? size : end + 2;
+  }
+
+  void skipSpaces() {
+    while (at < size && isSpace(text[at])) ++at;
+  }
+
+  std::string_view identifier() {
+    const std::size_t start = at;
+    while (at < size && isIdentifierPart(text[at])) ++at;
+    return text.substr(start, at - start);
+  }
+
+  void directive() {
+    ++at;
+    skipSpaces();
+    const std::string_view name = identifier();
+    if (name == "define") {
+      skipSpaces();
+      const std::size_t start = at;
+      if (!identifier().empty()) macros.push_back(static_cast<std::uint32_t>(start));
+    } else if (name == "else" || name == "elif" || name == "elifdef" || name == "elifndef") {
+      // Only the first branch is read, so that each brace is seen once
+      skipLine();
+      skipConditional(false);
+      return;
+    } else if (name == "if") {
+      skipSpaces();
+      if (peek(0) == '0' && !isIdentifierPart(peek(1))) {
+        skipLine();
+        skipConditional(true);
+        return;
+      }
+    }
+    // The rest of the directive, which may hold a comment that runs on
+    for (; at < size && text[at] != '\n'; ++at) {
+      if (text[at] == '\\' && at + 1 < size && text[at + 1] == '\n') {
+        ++at;
+      } else if (text[at] == '/' && peek(1) == '*') {
+        skipComment();
+        --at;
+      } else if (text[at] == '/' && peek(1) == '/') {
+        skipLine();
+        return;
+      }
+    }
+  }
+
+  // Skips lines up to the #endif that closes the current #if, or with `toElse` up to an #else
+  // or #elif of it, whose branch is then read.
+  void skipConditional(bool toElse) {
+    int depth = 0;
+    while (at < size) {
+      ++at; // past the newline
+      skipSpaces();
+      if (peek(0) != '#') {
+        skipLine();
+        continue;
+      }
+      ++at;
+      skipSpaces();
+      const std::string_view name = identifier();
+      skipLine();
+      if (name.substr(0, 2) == "if") {
+        ++depth;
+      } else if (name == "endif") {
+        if (depth-- == 0) return;
+      } else if (depth == 0 && toElse && name.substr(0, 2) == "el") {
+        return;
+      }
+    }
+  }
+
+  void quoted(char quote) {
+    for (++at; at < size && text[at] != quote && text[at] != '\n'; ++at) {
+      if (text[at] == '\\') ++at;
+    }
+    if (at < size && text[at] == quote) ++at;
+  }
+
+  void rawString() {
+    // R"delimiter( ... )delimiter"
+    const std::size_t open = text.find('(', at);
+    if (open == std::string_view::npos) {
+      at = size;
+      return;
+    }
+    std::string closing = ")";
+    closing.append(text.substr(at + 1, open - at - 1));
+    closing += '"';
+    const std::size_t end = text.find(closing, open);
+    at                    = end == std::string_view::npos ? size : end + closing.size();
+  }
+
+  void token() {
+    const std::size_t start = at;
+    const char c            = text[at];
+    if (isIdentifierStart(c)) {
+      const std::string_view word = identifier();
+      if (peek(0) == '"' && isRawStringPrefix(word)) {
+        rawString();
+        add(Token::Type::Literal, start);
+      } else if ((peek(0) == '"' || peek(0) == '\'') && isStringPrefix(word)) {
+        quoted(text[at]);
+        add(Token::Type::Literal, start);
+      } else {
+        add(Token::Type::Identifier, start);
+      }
+    } else if (isDigit(c) || (c == '.' && isDigit(peek(1)))) {
+      // A pp-number: 0x1p-3, 1'000, 1.5e+10f
+      for (++at; at < size; ++at) {
+        const char d        = text[at];
+        const char exponent = static_cast<char>(text[at - 1] | 0x20);
+        if ((d == '+' || d == '-') && (exponent == 'e' || exponent == 'p')) continue;
+        if (!isIdentifierPart(d) && d != '.' && d != '\'') break;
+      }
+      add(Token::Type::Literal, start);
+    } else if (c == '"' || c == '\'') {
+      quoted(c);
+      add(Token::Type::Literal, start);
+    } else {
+      // `::`, `->` and `&&` are kept whole, since the patterns look for them
+      const char next = peek(1);
+      at += (c == ':' && next == ':') || (c == '-' && next == '>') || (c == '&' && next == '&')
+                ? 2
+                : 1;
+      add(Token::Type::Punctuation, start);
+    }
+  }
+};
+
+// Walks the tokens of a file at namespace and class scope, skipping everything in braces that
+// is not a namespace, extern "C" block or class body.
+class Parser {
+public:
+  Parser(std::string_view text, const std::vector<Token> &tokens, std::vector<Declaration> &out)
+      : text(text), tokens(tokens), count(tokens.size()), out(out) {}
+
+  void run() {
+    for (std::size_t i = 0; i < count;) i = step(i);
+  }
+
+  // Adds the macro whose name starts at byte `start`.
+  void addMacro(std::uint32_t start) {
+    std::size_t end = start;
+    while (end < text.size() && isIdentifierPart(text[end])) ++end;
+    record(start, end - start, Declaration::Kind::Macro, true);
+  }
+
+private:
+  // What an open brace the parser went into was, and the statement it interrupted
+  struct Scope {
+    bool isClass;
+    bool typedefStatement;
+  };
+
+  std::string_view text;
+  const std::vector<Token> &tokens;
+  std::size_t count;
+  std::vector<Declaration> &out;
+  std::vector<Scope> scopes;
+
+  // The statement so far: from `statement` to the current token
+  std::size_t statement = 0;
+  bool typedefStatement = false;
+  bool initializer      = false; // has an `=` outside brackets
+
+  // Where the line of the last recorded name was found
+  std::size_t counted   = 0;
+  std::uint32_t line    = 0;
+  std::size_t lineStart = 0;
+
+  [[nodiscard]] std::string_view word(std::size_t i) const {
+    return text.substr(tokens[i].start, tokens[i].length);
+  }
+  [[nodiscard]] bool isPunctuation(std::size_t i, std::string_view punctuation) const {
+    return i < count && tokens[i].type == Token::Type::Punctuation && word(i) == punctuation;
+  }
+  [[nodiscard]] bool isIdentifier(std::size_t i) const {
+    return i < count && tokens[i].type == Token::Type::Identifier;
+  }
+
+  // An identifier that can name a function, as opposed to keywords and the builtins that
+  // take parentheses
+  [[nodiscard]] bool isName(std::size_t i) const {
+    if (!isIdentifier(i)) return false;
+    const std::string_view name = word(i);
+    return keywords::lookup(name) == keywords::Kind::None && !isReserved(name) &&
+           name != "typeof" && name != "asm" && name != "defined";
+  }
+
+  void reset(std::size_t next) {
+    statement        = next;
+    typedefStatement = false;
+    initializer      = false;
+  }
+
+  void record(std::size_t start, std::size_t length, Declaration::Kind kind, bool definition) {
+    const std::string_view name = text.substr(start, length);
+    if (isReserved(name)) return;
+
+    // Names come in order, so the lines are counted on from the last one
+    if (start < counted) {
+      counted   = 0;
+      line      = 0;
+      lineStart = 0;
+    }
+    line += static_cast<std::uint32_t>(
+        scan::countByte(text.data() + counted, start - counted, '\n'));
+    for (std::size_t k = start; k > counted; --k) {
+      if (text[k - 1] == '\n') {
+        lineStart = k;
+        break;
+      }
+    }
+    counted = start;
+
+    const auto column =
+        static_cast<std::uint32_t>(utf16Length(text.data() + lineStart, start - lineStart));
+    out.push_back({name, kind, definition, line, column});
+  }
+
+  void recordToken(std::size_t i, Declaration::Kind kind, bool definition) {
+    record(tokens[i].start, tokens[i].length, kind, definition);
+  }
+
+  // Index of the token that closes the bracket at `i`, or `count`
+  [[nodiscard]] std::size_t matching(std::size_t i) const {
+    const std::string_view open  = word(i);
+    const std::string_view close = open == "(" ? ")" : open == "[" ? "]" : open == "<" ? ">" : "}";
+    int depth                    = 0;
+    for (; i < count; ++i) {
+      if (tokens[i].type != Token::Type::Punctuation) continue;
+      const std::string_view w = word(i);
+      if (w == open) {
+        ++depth;
+      } else if (w == close && --depth == 0) {
+        return i;
+      } else if (open == "<" && (w == ";" || w == "{" || w == "}")) {
+        return i - 1; // a less-than after all
+      }
+    }
+    return count;
+  }
+
+  std::size_t step(std::size_t i) {
+    const Token &token = tokens[i];
+    if (token.type == Token::Type::Punctuation) return punctuation(i);
+    if (token.type != Token::Type::Identifier) return i + 1;
+
+    const std::string_view w = word(i);
+    if (w == "namespace") return enterNamespace(i);
+    if (w == "extern" && i + 2 < count && tokens[i + 1].type == Token::Type::Literal &&
+        isPunctuation(i + 2, "{")) {
+      scopes.push_back({false, false});
+      reset(i + 3);
+      return i + 3;
+    }
+    if (w == "class" || w == "struct" || w == "union" || w == "enum") return classHead(i);
+    if (w == "typedef") typedefStatement = true;
+    if (w == "using" && isIdentifier(i + 1) && isPunctuation(i + 2, "=")) {
+      recordToken(i + 1, Declaration::Kind::Type, true);
+      initializer = true;
+      return i + 3;
+    }
+    if (w == "template" && isPunctuation(i + 1, "<")) return matching(i + 1) + 1;
+    return i + 1;
+  }
+
+  std::size_t punctuation(std::size_t i) {
+    const std::string_view w = word(i);
+    if (w == ";") {
+      if (typedefStatement) typedefName(i);
+      reset(i + 1);
+      return i + 1;
+    }
+    if (w == "{") {
+      // An initializer or a body that was not recognized
+      const std::size_t close = matching(i);
+      if (!typedefStatement && !initializer) reset(close + 1);
+      return close + 1;
+    }
+    if (w == "}") {
+      if (!scopes.empty()) {
+        const Scope scope = scopes.back();
+        scopes.pop_back();
+        if (scope.isClass) {
+          // `} name;` goes on with the statement the class was declared in
+          statement        = i + 1;
+          typedefStatement = scope.typedefStatement;
+          initializer      = false;
+          return i + 1;
+        }
+      }
+      reset(i + 1);
+      return i + 1;
+    }
+    if (w == ":" && i > 0 && isIdentifier(i - 1)) {
+      const std::string_view label = word(i - 1);
+      if (label == "public" || label == "private" || label == "protected" || label == "signals" ||
+          label == "slots" || label == "Q_SIGNALS" || label == "Q_SLOTS") {
+        reset(i + 1);
+      }
+      return i + 1;
+    }
+    if (w == "=") initializer = true;
+    if (w == "(") return function(i);
+    if (w == "[") return matching(i) + 1;
+    return i + 1;
+  }
+
+  std::size_t enterNamespace(std::size_t i) {
+    std::size_t j = i + 1;
+    while (isIdentifier(j) || isPunctuation(j, "::")) {
+      ++j;
+      if (isPunctuation(j, "(")) j = matching(j) + 1; // std _GLIBCXX_VISIBILITY(default)
+    }
+    if (!isPunctuation(j, "{")) return i + 1; // an alias
+    scopes.push_back({false, false});
+    reset(j + 1);
+    return j + 1;
+  }
+
+  // At `class`, `struct`, `union` or `enum`: a definition if a body or base clause follows
+  std::size_t classHead(std::size_t i) {
+    const bool isEnum = word(i) == "enum";
+    std::size_t j     = i + 1;
+    if (isEnum && isIdentifier(j) && (word(j) == "class" || word(j) == "struct")) ++j;
+
+    // The name is the last identifier before the body; export macros come before it
+    std::size_t name = kNone;
+    while (j < count) {
+      if (isIdentifier(j) && word(j) != "final") {
+        if (isPunctuation(j + 1, "(")) {
+          j = matching(j + 1) + 1; // alignas(8), __attribute__((packed))
+          continue;
+        }
+        name = j++;
+      } else if (isPunctuation(j, "::")) {
+        ++j;
+      } else if (isPunctuation(j, "[") && isPunctuation(j + 1, "[")) {
+        j = matching(j) + 1;
+      } else if (isPunctuation(j, "<") && name != kNone) {
+        j = matching(j) + 1; // a specialization
+      } else {
+        break;
+      }
+    }
+    if (isIdentifier(j) && word(j) == "final") ++j;
+    if (isPunctuation(j, ":")) {
+      while (j < count && !isPunctuation(j, "{") && !isPunctuation(j, ";")) {
+        j = isPunctuation(j, "(") || isPunctuation(j, "<") ? matching(j) + 1 : j + 1;
+      }
+    }
+    if (!isPunctuation(j, "{")) return i + 1; // a declaration, or a variable of the type
+
+    if (name != kNone) recordToken(name, Declaration::Kind::Type, true);
+    if (isEnum) {
+      // Enumerators are not collected; the statement goes on after the body
+      const std::size_t close = matching(j);
+      statement               = close + 1;
+      return close + 1;
+    }
+    scopes.push_back({true, typedefStatement});
+    reset(j + 1);
+    return j + 1;
+  }
+
+  // At an opening parenthesis: a function if a name and a type come before it and a body or
+  // a semicolon after it
+  std::size_t function(std::size_t open) {
+    const std::size_t close = matching(open);
+    const std::size_t name  = open - 1;
+    if (open == 0 || name < statement || !isName(name) || initializer || typedefStatement ||
+        isPunctuation(name - 1, "~")) {
+      return close + 1;
+    }
+    // The suffix of a literal operator, operator""s
+    if (name > statement &&
+        (tokens[name - 1].type == Token::Type::Literal || word(name - 1) == "operator")) {
+      return close + 1;
+    }
+    // Without a type before it, only a constructor in a class body: all capitals is a macro
+    if (name == statement) {
+      const std::string_view w = word(name);
+      const bool capitals =
+          std::none_of(w.begin(), w.end(), [](char c) { return c >= 'a' && c <= 'z'; });
+      if (scopes.empty() || !scopes.back().isClass || capitals) return close + 1;
+    }
+
+    // Qualifiers, attributes and a trailing return type
+    std::size_t j = close + 1;
+    while (j < count) {
+      if (isIdentifier(j) || isPunctuation(j, "&") || isPunctuation(j, "&&")) {
+        ++j;
+        if (isPunctuation(j, "(")) j = matching(j) + 1; // noexcept(...), __attribute__((...))
+      } else if (isPunctuation(j, "[") && isPunctuation(j + 1, "[")) {
+        j = matching(j) + 1;
+      } else if (isPunctuation(j, "->")) {
+        for (++j; j < count && !isPunctuation(j, "{") && !isPunctuation(j, ";") &&
+                  !isPunctuation(j, "=");) {
+          j = isPunctuation(j, "(") || isPunctuation(j, "<") ? matching(j) + 1 : j + 1;
+        }
+      } else {
+        break;
+      }
+    }
+
+    if (isPunctuation(j, ";") || isPunctuation(j, "=")) {
+      // A prototype, or a pure, defaulted or deleted one
+      recordToken(name, Declaration::Kind::Function, false);
+      while (j < count && !isPunctuation(j, ";")) ++j;
+      reset(j + 1);
+      return j + 1;
+    }
+    if (isPunctuation(j, ":")) {
+      // A constructor's initializers: member(...) or member{...}, up to the body
+      for (++j; j < count && !isPunctuation(j, ";");) {
+        if (isPunctuation(j, "(") || isPunctuation(j, "<")) {
+          j = matching(j) + 1;
+        } else if (isPunctuation(j, "{")) {
+          if (!isPunctuation(j - 1, ")") && !isPunctuation(j - 1, "}")) {
+            j = matching(j) + 1;
+          } else {
+            break;
+          }
+        } else {
+          ++j;
+        }
+      }
+    }
+    if (!isPunctuation(j, "{")) return close + 1;
+
+    recordToken(name, Declaration::Kind::Function, true);
+    const std::size_t end = matching(j);
+    reset(end + 1);
+    return end + 1;
+  }
+
+  // At the semicolon that ends a typedef: the name is the one in `(*name)` for a function
+  // pointer, or else the last one outside brackets
+  void typedefName(std::size_t end) {
+    std::size_t name = kNone;
+    for (std::size_t j = statement; j < end;) {
+      if (isPunctuation(j, "(")) {
+        if (isPunctuation(j + 1, "*") && isName(j + 2)) {
+          name = j + 2;
+          break;
+        }
+        j = matching(j) + 1;
+      } else if (isPunctuation(j, "[") || isPunctuation(j, "{")) {
+        j = matching(j) + 1;
+      } else {
+        if (isName(j)) name = j;
+        ++j;
+      }
+    }
+    if (name != kNone) recordToken(name, Declaration::Kind::Type, true);
+  }
+};
+
+} // namespace
+
+void scanDeclarations(std::string_view text, std::vector<Declaration> &out) {
+  std::vector<Token> tokens;
+  std::vector<std::uint32_t> macros;
+  Lexer(text, tokens, macros).run();
+
+  // Macros and the rest are merged in order of position
+  const std::size_t first = out.size();
+  Parser parser(text, tokens, out);
+  parser.run();
+  const std::size_t middle = out.size();
+  for (const std::uint32_t macro : macros) parser.addMacro(macro);
+
+  std::inplace_merge(out.begin() + static_cast<std::ptrdiff_t>(first),
+                     out.begin() + static_cast<std::ptrdiff_t>(middle), out.end(),
+                     [](const Declaration &a, const Declaration &b) {
+                       return a.name.data() < b.name.data();
+                     });
+}
@@ -0,0 +1,26 @@
+#ifndef F7D05A64_8E1B_4C29_A3F6_2B9E70C4D851
+#define F7D05A64_8E1B_4C29_A3F6_2B9E70C4D851
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+struct Declaration {
+  enum class Kind : std::uint8_t { Function, Type, Macro };
+
+  std::string_view name; // points into the scanned text
+  Kind kind;
+  bool definition;      // has a body; macros always do
+  std::uint32_t line;   // 0-based
+  std::uint32_t column; // in UTF-16 code units
+};
+
+// Appends the functions, types and macros that the C or C++ source `text` declares at
+// namespace or class scope to `out`, in order. This is a tokenizer and a few patterns, not a
+// parser: function bodies and initializers are skipped by matching braces, and names reserved
+// for the implementation (__x, _X) are left out. One branch of each #if is read: the first,
+// except that an #if 0 branch is skipped and the #else or #elif branch after it is read.
+// Types are the class, struct, union and enum definitions, typedefs and using aliases.
+void scanDeclarations(std::string_view text, std::vector<Declaration> &out);
+
+#endif /* F7D05A64_8E1B_4C29_A3F6_2B9E70C4D851 */
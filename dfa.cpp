@@ -0,0 +1,411 @@
+#include "dfa.hpp"
+
+#include <algorithm>
+#include <bitset>
+#include <cstring>
+#include <map>
+
+namespace {
+
+constexpr int kAscii   = 128;
+constexpr int kSymbols = kAscii + 1;
+using CharSet          = std::bitset<kSymbols>;
+
+constexpr std::uint32_t kMagic   = 0x41464445; // "EDFA"
+constexpr std::uint32_t kVersion = 1;
+
+// Thompson NFA: every state has epsilon edges and at most one symbol edge.
+struct NfaState {
+  std::vector<int> epsilon;
+  CharSet symbols;
+  int target = -1;
+  int accept = -1;
+};
+
+struct Fragment {
+  int start;
+  int end;
+};
+
+CharSet range(int first, int last) {
+  CharSet set;
+  for (int c = first; c <= last; ++c) set.set(c);
+  return set;
+}
+
+int firstOf(const CharSet &set) {
+  int c = 0;
+  while (c < kAscii && !set[c]) ++c;
+  return c;
+}
+
+CharSet symbolOf(unsigned char c) {
+  CharSet set;
+  set.set(c < kAscii ? c : kAscii);
+  return set;
+}
+
+// Recursive descent over one pattern, building NFA states as it goes.
+class PatternParser {
+public:
+  PatternParser(std::vector<NfaState> &states, const std::string &pattern)
+      : nfa(states), p(pattern) {}
+
+  bool parse(Fragment &fragment, std::string &error) {
+    fragment = alternation();
+    if (failure.empty() && pos < p.size()) failure = "unbalanced ')'";
+    if (!failure.empty()) {
+      error = failure + " at offset " + std::to_string(pos) + " in '" + p + "'";
+      return false;
+    }
+    return true;
+  }
+
+  Fragment literal() {
+    Fragment f = empty();
+    for (unsigned char c : p) f = concat(f, edge(symbolOf(c)));
+    return f;
+  }
+
+private:
+  std::vector<NfaState> &nfa;
+  const std::string &p;
+  std::size_t pos = 0;
+  std::string failure;
+
+  int state() {
+    nfa.emplace_back();
+    return static_cast<int>(nfa.size() - 1);
+  }
+
+  Fragment empty() {
+    const int s = state();
+    return {s, s};
+  }
+
+  Fragment edge(const CharSet &symbols) {
+    const int s      = state();
+    const int e      = state();
+    nfa[s].symbols   = symbols;
+    nfa[s].target    = e;
+    return {s, e};
+  }
+
+  Fragment concat(Fragment a, Fragment b) {
+    nfa[a.end].epsilon.push_back(b.start);
+    return {a.start, b.end};
+  }
+
+  Fragment alternation() {
+    Fragment f = sequence();
+    while (failure.empty() && pos < p.size() && p[pos] == '|') {
+      ++pos;
+      const Fragment other = sequence();
+      const int s          = state();
+      const int e          = state();
+      nfa[s].epsilon       = {f.start, other.start};
+      nfa[f.end].epsilon.push_back(e);
+      nfa[other.end].epsilon.push_back(e);
+      f = {s, e};
+    }
+    return f;
+  }
+
+  Fragment sequence() {
+    Fragment f = empty();
+    while (failure.empty() && pos < p.size() && p[pos] != '|' && p[pos] != ')') {
+      f = concat(f, repetition());
+    }
+    return f;
+  }
+
+  Fragment repetition() {
+    Fragment f = atom();
+    while (failure.empty() && pos < p.size() &&
+           (p[pos] == '*' || p[pos] == '+' || p[pos] == '?')) {
+      const char op = p[pos++];
+      const int s   = state();
+      const int e   = state();
+      nfa[s].epsilon.push_back(f.start);
+      if (op != '+') nfa[s].epsilon.push_back(e);
+      if (op != '?') nfa[f.end].epsilon.push_back(f.start);
+      nfa[f.end].epsilon.push_back(e);
+      f = {s, e};
+    }
+    return f;
+  }
+
+  Fragment atom() {
+    const char c = p[pos++];
+    switch (c) {
+      case '(': {
+        const Fragment f = alternation();
+        if (pos >= p.size() || p[pos] != ')') {
+          if (failure.empty()) failure = "missing ')'";
+          return f;
+        }
+        ++pos;
+        return f;
+      }
+      case '[':
+        return edge(bracket());
+      case '.':
+        return edge(CharSet().set());
+      case '*':
+      case '+':
+      case '?':
+        failure = "nothing to repeat";
+        return empty();
+      case '\\':
+        return edge(escape());
+      default:
+        return edge(symbolOf(static_cast<unsigned char>(c)));
+    }
+  }
+
+  // Escape after a backslash, as a set so classes can share it.
+  CharSet escape() {
+    if (pos >= p.size()) {
+      failure = "trailing backslash";
+      return {};
+    }
+    const char c = p[pos++];
+    switch (c) {
+      case 'd':
+        return range('0', '9');
+      case 'D':
+        return ~range('0', '9');
+      case 'w':
+        return word();
+      case 'W':
+        return ~word();
+      case 's':
+        return space();
+      case 'S':
+        return ~space();
+      case 'n':
+        return symbolOf('\n');
+      case 't':
+        return symbolOf('\t');
+      case 'r':
+        return symbolOf('\r');
+      default:
+        return symbolOf(static_cast<unsigned char>(c));
+    }
+  }
+
+  static CharSet word() {
+    return range('a', 'z') | range('A', 'Z') | range('0', '9') | symbolOf('_');
+  }
+
+  static CharSet space() {
+    return symbolOf(' ') | symbolOf('\t') | symbolOf('\r') | symbolOf('\n') | symbolOf('\f') |
+           symbolOf('\v');
+  }
+
+  CharSet bracket() {
+    const bool negate = pos < p.size() && p[pos] == '^';
+    if (negate) ++pos;
+
+    CharSet set;
+    bool first = true;
+    while (pos < p.size() && (p[pos] != ']' || first)) {
+      first = false;
+      if (p[pos] == '\\') {
+        ++pos;
+        const bool single = pos < p.size() && std::strchr("dDwWsS", p[pos]) == nullptr;
+        const CharSet escaped = escape();
+        if (single && pos + 1 < p.size() && p[pos] == '-' && p[pos + 1] != ']') {
+          set |= rangeTo(firstOf(escaped));
+        } else {
+          set |= escaped;
+        }
+        continue;
+      }
+      const auto c = static_cast<unsigned char>(p[pos++]);
+      if (pos + 1 < p.size() && p[pos] == '-' && p[pos + 1] != ']') {
+        set |= rangeTo(c < kAscii ? c : kAscii);
+      } else {
+        set |= symbolOf(c);
+      }
+    }
+    if (pos >= p.size()) {
+      failure = "missing ']'";
+      return set;
+    }
+    ++pos;
+    return negate ? ~set : set;
+  }
+
+  // Range from `low` to the character after the '-' at `pos`.
+  CharSet rangeTo(int low) {
+    ++pos; // '-'
+    int high = static_cast<unsigned char>(p[pos++]);
+    if (high == '\\' && pos < p.size()) high = static_cast<unsigned char>(p[pos++]);
+    high = std::min(high, kAscii);
+    if (high < low) {
+      failure = "reversed range";
+      return {};
+    }
+    return range(low, high);
+  }
+};
+
+void closure(const std::vector<NfaState> &nfa, std::vector<int> &states) {
+  std::vector<char> seen(nfa.size(), 0);
+  for (int s : states) seen[s] = 1;
+  for (std::size_t i = 0; i < states.size(); ++i) {
+    for (int t : nfa[states[i]].epsilon) {
+      if (!seen[t]) {
+        seen[t] = 1;
+        states.push_back(t);
+      }
+    }
+  }
+  std::sort(states.begin(), states.end());
+}
+
+template <typename T>
+void append(std::vector<std::uint8_t> &out, const T &value) {
+  const auto *bytes = reinterpret_cast<const std::uint8_t *>(&value);
+  out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+template <typename T>
+bool read(const std::uint8_t *&data, const std::uint8_t *end, T &value) {
+  if (static_cast<std::size_t>(end - data) < sizeof(T)) return false;
+  std::memcpy(&value, data, sizeof(T));
+  data += sizeof(T);
+  return true;
+}
+
+} // namespace
+
+bool Dfa::compile(const std::vector<DfaRule> &rules, std::string &error) {
+  std::vector<NfaState> nfa(1); // 0 is the start state, branching to every rule
+  for (std::size_t i = 0; i < rules.size(); ++i) {
+    PatternParser parser(nfa, rules[i].pattern);
+    Fragment fragment{};
+    if (rules[i].literal) {
+      fragment = parser.literal();
+    } else if (!parser.parse(fragment, error)) {
+      return false;
+    }
+    nfa[fragment.end].accept = static_cast<int>(i);
+    nfa[0].epsilon.push_back(fragment.start);
+  }
+
+  // Symbols no edge tells apart share a class, which keeps the transition table narrow
+  std::vector<std::string> signatures(kSymbols);
+  for (const NfaState &s : nfa) {
+    if (s.target < 0) continue;
+    for (int c = 0; c < kSymbols; ++c) signatures[c] += s.symbols[c] ? '1' : '0';
+  }
+  std::map<std::string, int> classes;
+  std::vector<int> representative;
+  for (int c = 0; c < kSymbols; ++c) {
+    auto [it, inserted] = classes.emplace(signatures[c], static_cast<int>(classes.size()));
+    if (inserted) representative.push_back(c);
+    classOf[c] = static_cast<std::uint8_t>(it->second);
+  }
+  classCount = static_cast<int>(classes.size());
+
+  // Subset construction
+  std::map<std::vector<int>, int> ids;
+  std::vector<std::vector<int>> subsets;
+  accept.clear();
+  next.clear();
+
+  auto intern = [&](std::vector<int> subset) {
+    auto [it, inserted] = ids.emplace(subset, static_cast<int>(subsets.size()));
+    if (inserted) {
+      int rule = -1;
+      for (int s : subset) {
+        if (nfa[s].accept >= 0 && (rule < 0 || nfa[s].accept < rule)) rule = nfa[s].accept;
+      }
+      subsets.push_back(std::move(subset));
+      accept.push_back(static_cast<std::int16_t>(rule));
+      next.resize(next.size() + classCount, -1);
+    }
+    return it->second;
+  };
+
+  std::vector<int> start{0};
+  closure(nfa, start);
+  intern(std::move(start));
+
+  for (std::size_t d = 0; d < subsets.size(); ++d) {
+    if (subsets.size() > static_cast<std::size_t>(kMaxStates)) {
+      error = "grammar needs more than " + std::to_string(kMaxStates) + " DFA states";
+      *this = Dfa();
+      return false;
+    }
+    for (int cls = 0; cls < classCount; ++cls) {
+      std::vector<int> targets;
+      for (int s : subsets[d]) {
+        if (nfa[s].target >= 0 && nfa[s].symbols[representative[cls]]) {
+          targets.push_back(nfa[s].target);
+        }
+      }
+      if (targets.empty()) continue;
+      closure(nfa, targets);
+      targets.erase(std::unique(targets.begin(), targets.end()), targets.end());
+      const int id              = intern(std::move(targets));
+      next[d * classCount + cls] = id;
+    }
+  }
+  return true;
+}
+
+std::vector<std::uint8_t> Dfa::serialize() const {
+  std::vector<std::uint8_t> out;
+  append(out, kMagic);
+  append(out, kVersion);
+  append(out, static_cast<std::uint32_t>(classCount));
+  append(out, static_cast<std::uint32_t>(accept.size()));
+  out.insert(out.end(), classOf.begin(), classOf.end());
+  for (std::int16_t rule : accept) append(out, rule);
+  for (std::int32_t target : next) append(out, target);
+  return out;
+}
+
+bool Dfa::deserialize(const std::uint8_t *data, std::size_t size, int ruleCount) {
+  const std::uint8_t *end = data + size;
+  std::uint32_t magic = 0, version = 0, classes = 0, states = 0;
+  if (!read(data, end, magic) || !read(data, end, version) || !read(data, end, classes) ||
+      !read(data, end, states)) {
+    return false;
+  }
+  if (magic != kMagic || version != kVersion || classes == 0 || classes > kSymbols ||
+      states == 0 || states > static_cast<std::uint32_t>(kMaxStates)) {
+    return false;
+  }
+
+  const std::size_t expected = kSymbols + states * sizeof(std::int16_t) +
+                               std::size_t{states} * classes * sizeof(std::int32_t);
+  if (static_cast<std::size_t>(end - data) != expected) return false;
+
+  std::array<std::uint8_t, kSymbols> newClassOf{};
+  std::memcpy(newClassOf.data(), data, kSymbols);
+  data += kSymbols;
+  for (std::uint8_t cls : newClassOf) {
+    if (cls >= classes) return false;
+  }
+
+  std::vector<std::int16_t> newAccept(states);
+  for (std::int16_t &rule : newAccept) {
+    read(data, end, rule);
+    if (rule < -1 || rule >= ruleCount) return false;
+  }
+  std::vector<std::int32_t> newNext(std::size_t{states} * classes);
+  for (std::int32_t &target : newNext) {
+    read(data, end, target);
+    if (target < -1 || target >= static_cast<std::int32_t>(states)) return false;
+  }
+
+  classCount = static_cast<int>(classes);
+  classOf    = newClassOf;
+  accept     = std::move(newAccept);
+  next       = std::move(newNext);
+  return true;
+}
@@ -0,0 +1,66 @@
+#ifndef A1CB638D_4096_41B6_ABD3_DB7E4FF179D5
+#define A1CB638D_4096_41B6_ABD3_DB7E4FF179D5
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// One pattern of a grammar. Patterns use a small regex dialect that compiles to a DFA:
+// literals, `.`, `[...]` and `[^...]` classes with ranges, `\d \w \s` and their negations,
+// `\n \t \r`, grouping, `|`, `*`, `+` and `?`. There are no anchors, lookaround or
+// backreferences. Literal rules take the text as is.
+struct DfaRule {
+  std::string pattern;
+  bool literal = false;
+};
+
+// All rules of a grammar compiled into one deterministic automaton. Matching takes the
+// longest text any rule accepts; on equal length the rule listed first wins, so keywords go
+// before the identifier rule. Non-ASCII code units are one symbol that only `.` and negated
+// classes match.
+class Dfa {
+public:
+  static constexpr int kMaxStates = 1 << 14;
+
+  // Returns false with a message in `error` if a pattern does not parse or the automaton
+  // would exceed kMaxStates.
+  bool compile(const std::vector<DfaRule> &rules, std::string &error);
+
+  // Longest match starting at `from`. Returns the index of the rule that matched and sets
+  // `end`, or returns -1 if no rule matches a non-empty prefix.
+  int match(const char16_t *text, int from, int length, int &end) const {
+    int state = 0;
+    int rule  = -1;
+    for (int i = from; i < length; ++i) {
+      const char16_t c = text[i];
+      state            = next[state * classCount + classOf[c < kAscii ? c : kAscii]];
+      if (state < 0) break;
+      if (accept[state] >= 0) {
+        rule = accept[state];
+        end  = i + 1;
+      }
+    }
+    return rule;
+  }
+
+  // Flat binary form for the on-disk cache. deserialize validates every table index and that
+  // each accepted rule is below `ruleCount`, so a truncated, foreign or stale file is rejected
+  // rather than trusted.
+  [[nodiscard]] std::vector<std::uint8_t> serialize() const;
+  bool deserialize(const std::uint8_t *data, std::size_t size, int ruleCount);
+
+  [[nodiscard]] int stateCount() const { return static_cast<int>(accept.size()); }
+
+private:
+  static constexpr int kAscii   = 128;
+  static constexpr int kSymbols = kAscii + 1; // ASCII plus "anything else"
+
+  int classCount = 1;
+  std::array<std::uint8_t, kSymbols> classOf{};
+  std::vector<std::int16_t> accept{-1}; // rule accepted in each state, -1 for none
+  std::vector<std::int32_t> next{-1};   // state * classCount + class, -1 is the dead state
+};
+
+#endif /* A1CB638D_4096_41B6_ABD3_DB7E4FF179D5 */
@@ -0,0 +1,93 @@
+#include "dirlist.hpp"
+
+#ifdef __linux__
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cstring>
+#else
+#include <filesystem>
+#include <system_error>
+#endif
+
+#ifdef __linux__
+
+namespace {
+
+constexpr std::size_t kBufferBytes = 64 * 1024;
+
+bool statIsDir(int fd, const char *name) {
+  struct stat st;
+  return ::fstatat(fd, name, &st, 0) == 0 && S_ISDIR(st.st_mode);
+}
+
+// For file systems that leave d_type DT_UNKNOWN. The entry is looked at without following it,
+// so that a symbolic link is still reported as one, and followed only if it is a link.
+void statEntry(int fd, const char *name, bool &isDir, bool &isLink) {
+  struct stat st;
+  if (::fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) return;
+  isLink = S_ISLNK(st.st_mode);
+  isDir  = isLink ? statIsDir(fd, name) : S_ISDIR(st.st_mode);
+}
+
+} // namespace
+
+bool listDirectory(const std::string &path, std::vector<DirEntry> &entries) {
+  const int fd = ::open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0) return false;
+
+  // dirent64 has the layout of the records the kernel writes
+  alignas(struct dirent64) char buffer[kBufferBytes];
+  const std::size_t listed = entries.size();
+  for (;;) {
+    const long n = ::syscall(SYS_getdents64, fd, buffer, sizeof buffer);
+    if (n == 0) break;
+    if (n < 0) {
+      // Such as EIO, or ENOTDIR if the directory was replaced; a partial listing is no listing
+      entries.resize(listed);
+      ::close(fd);
+      return false;
+    }
+
+    for (long offset = 0; offset < n;) {
+      const auto *entry = reinterpret_cast<const struct dirent64 *>(buffer + offset);
+      offset += entry->d_reclen;
+
+      const char *name = entry->d_name;
+      if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) continue;
+
+      bool isDir  = entry->d_type == DT_DIR;
+      bool isLink = entry->d_type == DT_LNK;
+      if (isLink) isDir = statIsDir(fd, name);
+      if (entry->d_type == DT_UNKNOWN) statEntry(fd, name, isDir, isLink);
+      entries.push_back({std::string(name, std::strlen(name)), isDir, isLink});
+    }
+  }
+
+  ::close(fd);
+  return true;
+}
+
+#else
+
+bool listDirectory(const std::string &path, std::vector<DirEntry> &entries) {
+  namespace fs = std::filesystem;
+  std::error_code error;
+  fs::directory_iterator it(fs::u8path(path), error);
+  if (error) return false;
+
+  const std::size_t listed = entries.size();
+  for (; !error && it != fs::directory_iterator(); it.increment(error)) {
+    // An entry that cannot be queried is listed as a file, as on Linux
+    std::error_code ignored;
+    const bool isLink = it->is_symlink(ignored);
+    entries.push_back({it->path().filename().u8string(), it->is_directory(ignored), isLink});
+  }
+  if (error) entries.resize(listed);
+  return !error;
+}
+
+#endif
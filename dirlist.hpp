@@ -0,0 +1,20 @@
+#ifndef FE50560F_A67D_4585_88CF_69E213F90E96
+#define FE50560F_A67D_4585_88CF_69E213F90E96
+
+#include <string>
+#include <vector>
+
+struct DirEntry {
+  std::string name;
+  bool isDir;  // a directory, or a symbolic link to one
+  bool isLink; // walkers that recurse should not follow these
+};
+
+// Appends the entries of `path` to `entries`, without "." and "..", in no particular order.
+// On Linux the directory is read with getdents64 into a 64 KiB buffer, so a large directory
+// takes a few system calls and a stat only for entries whose type the file system did not
+// report. Returns false, with `entries` unchanged, if the directory cannot be opened or read
+// to the end.
+bool listDirectory(const std::string &path, std::vector<DirEntry> &entries);
+
+#endif /* FE50560F_A67D_4585_88CF_69E213F90E96 */
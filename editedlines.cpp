@@ -0,0 +1,33 @@
+#include "editedlines.hpp"
+
+#include <algorithm>
+
+void EditedLines::edit(int first, int removed, int added) {
+  const int shift = added - removed;
+  const Range marked{first, first + added};
+
+  std::vector<Range> next;
+  next.reserve(edited.size() + 2);
+  bool inserted = false;
+  const auto append = [&next](Range range) {
+    if (!next.empty() && range.first <= next.back().second + 1) {
+      next.back().second = std::max(next.back().second, range.second);
+    } else {
+      next.push_back(range);
+    }
+  };
+
+  // Ranges before the edit stay, the replaced lines go, and the ones after it move
+  for (const auto &[from, to] : edited) {
+    if (from < first) append({from, std::min(to, first - 1)});
+    if (to > first + removed) {
+      if (!inserted) {
+        append(marked);
+        inserted = true;
+      }
+      append({std::max(from, first + removed + 1) + shift, to + shift});
+    }
+  }
+  if (!inserted) append(marked);
+  edited = std::move(next);
+}
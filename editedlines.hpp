@@ -0,0 +1,26 @@
+#ifndef A3C81E5F_6D2B_4F97_8E14_0B7C9D62F5A1
+#define A3C81E5F_6D2B_4F97_8E14_0B7C9D62F5A1
+
+#include <utility>
+#include <vector>
+
+// The lines of a document edited since some point, such as its last format, as sorted ranges.
+// Each edit moves the ranges below it by the lines it added or removed, so the set follows the
+// text without touching anything stored in the document itself.
+class EditedLines {
+public:
+  using Range = std::pair<int, int>; // 0-based, inclusive
+
+  // An edit that started on line `first` and replaced `removed` line breaks with `added` ones:
+  // lines first..first + removed became first..first + added, which are all marked.
+  void edit(int first, int removed, int added);
+  void clear() { edited.clear(); }
+  [[nodiscard]] bool empty() const { return edited.empty(); }
+  // In order, neither overlapping nor adjacent.
+  [[nodiscard]] const std::vector<Range> &ranges() const { return edited; }
+
+private:
+  std::vector<Range> edited;
+};
+
+#endif /* A3C81E5F_6D2B_4F97_8E14_0B7C9D62F5A1 */
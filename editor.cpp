@@ -2,8 +2,15 @@
 
 #include <QFont>
 #include <QPainter>
+#include <QResizeEvent>
 #include <QScrollBar>
 #include <QTextBlock>
+#include <algorithm>
+
+#include "buffersearch.hpp"
+#include "buffersymbols.hpp"
+#include "completionengine.hpp"
+#include "keywords.hpp"
 
 AutoIndentTextEdit::AutoIndentTextEdit(QWidget *parent) : QTextEdit(parent) {
   setCursorWidth(2);
@@ -11,6 +18,8 @@ AutoIndentTextEdit::AutoIndentTextEdit(QWidget *parent) : QTextEdit(parent) {
   // highlight current line when cursor position changes
   connect(this, &AutoIndentTextEdit::cursorPositionChanged, this,
           &AutoIndentTextEdit::highlightCurrentLine);
+  connect(verticalScrollBar(), &QScrollBar::valueChanged, this,
+          &AutoIndentTextEdit::updateSearchSelections);
 
   QFont font = this->font();
   font.setFixedPitch(true);
@@ -76,13 +85,17 @@ AutoIndentTextEdit::AutoIndentTextEdit(QWidget *parent) : QTextEdit(parent) {
 
   // enable wheel zoom
 
-  wordList = {"auto",      "break",    "case",    "char",      "class",    "const",    "continue",
-              "default",   "delete",   "do",      "double",    "else",     "enum",     "extern",
-              "float",     "for",      "goto",    "if",        "inline",   "int",      "long",
-              "namespace", "operator", "private", "protected", "public",   "return",   "short",
-              "signed",    "sizeof",   "static",  "struct",    "switch",   "template", "this",
-              "throw",     "try",      "typedef", "union",     "unsigned", "virtual",  "void",
-              "volatile",  "while"};
+  // Completion words are the document's identifiers and the keyword table shared with the
+  // highlighter. The engine reads them on its own thread, so it is made first and destroyed,
+  // stopping that thread, first.
+  completions = new CompletionEngine(this);
+  symbols     = new BufferSymbols(document(), this);
+  for (const keywords::Entry &entry : keywords::kTable) {
+    symbols->addPermanent(
+        QString::fromLatin1(entry.word.data(), static_cast<qsizetype>(entry.word.size())));
+  }
+  completions->addSource(symbols);
+  connect(completions, &CompletionEngine::ready, this, &AutoIndentTextEdit::showCompletions);
 
   completerSetup();
 }
@@ -134,6 +147,66 @@ void AutoIndentTextEdit::insertCompletion(const QString &completion) {
 
 void AutoIndentTextEdit::setHighlighter(DraculaCppSyntaxHighlighter *highlighter) {
   this->highlighter = highlighter;
+  connect(verticalScrollBar(), &QScrollBar::valueChanged, this,
+          &AutoIndentTextEdit::updateVisibleBlocks, Qt::UniqueConnection);
+  updateVisibleBlocks();
+}
+
+DraculaCppSyntaxHighlighter *AutoIndentTextEdit::getHighlighter() const { return highlighter; }
+
+void AutoIndentTextEdit::setSearch(const BufferSearch *search) {
+  if (this->search) QObject::disconnect(this->search, nullptr, this, nullptr);
+  this->search = search;
+  if (search) {
+    connect(search, &BufferSearch::matchesChanged, this,
+            &AutoIndentTextEdit::updateSearchSelections);
+  }
+  updateSearchSelections();
+}
+
+void AutoIndentTextEdit::resizeEvent(QResizeEvent *event) {
+  QTextEdit::resizeEvent(event);
+  updateVisibleBlocks();
+  updateSearchSelections();
+}
+
+QPair<int, int> AutoIndentTextEdit::visibleBlockRange() const {
+  const QTextBlock first = cursorForPosition(QPoint(0, 0)).block();
+  const QTextBlock last  = cursorForPosition(QPoint(0, viewport()->height() - 1)).block();
+  return {first.blockNumber(), last.blockNumber()};
+}
+
+void AutoIndentTextEdit::updateVisibleBlocks() {
+  if (!highlighter) return;
+
+  const QPair<int, int> visible = visibleBlockRange();
+  highlighter->setVisibleBlocks(visible.first, visible.second);
+}
+
+void AutoIndentTextEdit::updateSearchSelections() {
+  searchSelections.clear();
+  if (search && !search->matches().empty()) {
+    // Only the matches on screen get a selection, however many there are in the document
+    const auto [first, last] = visibleBlockRange();
+    const std::vector<BufferSearch::Match> &matches = search->matches();
+    auto match = std::lower_bound(
+        matches.begin(), matches.end(), first,
+        [](const BufferSearch::Match &match, int number) { return match.block < number; });
+
+    QTextEdit::ExtraSelection selection;
+    selection.format.setBackground(QColor(255, 184, 108, 90)); // Dracula orange
+    QTextBlock block = document()->findBlockByNumber(first);
+    for (int number = first; match != matches.end() && match->block <= last; ++match) {
+      for (; number < match->block && block.isValid(); ++number) block = block.next();
+      if (!block.isValid()) break;
+      selection.cursor = QTextCursor(block);
+      selection.cursor.setPosition(block.position() + match->column);
+      selection.cursor.setPosition(block.position() + match->column + match->length,
+                                   QTextCursor::KeepAnchor);
+      searchSelections.append(selection);
+    }
+  }
+  highlightCurrentLine();
 }
 
 void AutoIndentTextEdit::keyPressEvent(QKeyEvent *event) {
@@ -213,55 +286,66 @@ void AutoIndentTextEdit::keyPressEvent(QKeyEvent *event) {
     QTextEdit::keyPressEvent(event);
   }
 
-  // Trigger completer after relevant keystrokes:
-  if (event->text().length() >= 1) {
-    QString completionPrefix = wordUnderCursor();
-    if (!completionPrefix.isEmpty()) {
-      completer->setCompletionPrefix(completionPrefix);
-
-      // Only show the popup if it isn't already visible
-      if (!completer->popup()->isVisible()) {
-        QRect rect = cursorRect();
-
-        // Adjust the width of the popup to fit the completions
-        int popupWidth = completer->popup()->sizeHintForColumn(0) +
-                         completer->popup()->verticalScrollBar()->sizeHint().width();
+  // Only typing asks for completions; the words come back in showCompletions()
+  const QString completionPrefix = event->text().isEmpty() ? QString() : wordUnderCursor();
+  if (completionPrefix.isEmpty()) {
+    completions->cancel();
+    requestedPrefix.clear();
+    completer->popup()->hide();
+    return;
+  }
 
-        rect.setWidth(popupWidth);
+  if (completer->model() == completerModel) {
+    completionRequest = completions->request(completionPrefix);
+    requestedPrefix   = completionPrefix;
+    emit completionRequested(textCursor().position());
+    return;
+  }
 
-        // Complete at the cursor position
-        completer->complete(rect);
-      }
+  // A completer set from outside brings its own model and filters it itself
+  if (completionPrefix != completer->completionPrefix()) {
+    completer->setCompletionPrefix(completionPrefix);
+    completer->popup()->setCurrentIndex(completer->completionModel()->index(0, 0));
+  }
+  QRect rect = cursorRect();
+  rect.setWidth(completer->popup()->sizeHintForColumn(0) +
+                completer->popup()->verticalScrollBar()->sizeHint().width());
+  completer->complete(rect);
+}
 
-      // If only one completion is available, auto-select it
-      if (completer->completionCount() == 1) {
-        completer->popup()->setCurrentIndex(completer->completionModel()->index(0, 0));
-      }
-    }
-  } else {
-    completer->popup()->hide(); // Hide popup if there's no input
+void AutoIndentTextEdit::refreshCompletions() {
+  if (requestedPrefix.isEmpty() || completer->model() != completerModel ||
+      wordUnderCursor() != requestedPrefix) {
+    return;
   }
+  completionRequest = completions->request(requestedPrefix);
+}
 
-  // if the user has type at least one character, show the completer
-  if (event->text().isEmpty()) {
+void AutoIndentTextEdit::showCompletions(quint64 generation, const QString &prefix,
+                                         const QStringList &words) {
+  if (generation != completionRequest || completer->model() != completerModel ||
+      wordUnderCursor() != prefix) {
     return;
   }
 
-  QString completionPrefix = wordUnderCursor();
-  if (completionPrefix.isEmpty() || event->text().isEmpty()) {
+  // Nothing left to offer once the word is a complete keyword and its only completion
+  if (words.isEmpty() ||
+      (words.size() == 1 && words.front() == prefix &&
+       keywords::lookup(reinterpret_cast<const char16_t *>(prefix.utf16()),
+                        static_cast<size_t>(prefix.size())) != keywords::Kind::None)) {
     completer->popup()->hide();
     return;
   }
 
-  if (completionPrefix != completer->completionPrefix()) {
-    completer->setCompletionPrefix(completionPrefix);
-    completer->popup()->setCurrentIndex(completer->completionModel()->index(0, 0));
-  }
+  completerModel->setWords(words);
+  completer->setCompletionPrefix(prefix);
 
   QRect rect = cursorRect();
   rect.setWidth(completer->popup()->sizeHintForColumn(0) +
                 completer->popup()->verticalScrollBar()->sizeHint().width());
   completer->complete(rect);
+  // The best match is first, whether or not it starts with the prefix
+  completer->popup()->setCurrentIndex(completer->completionModel()->index(0, 0));
 }
 
 // Extract the word under the cursor for completion
@@ -285,6 +369,8 @@ void AutoIndentTextEdit::highlightCurrentLine() {
     extraSelections.append(selection);
   }
 
+  // Matches go over the current line's background
+  extraSelections.append(searchSelections);
   setExtraSelections(extraSelections);
 }
 
@@ -296,15 +382,15 @@ void AutoIndentTextEdit::rehighlightCurrentLine() {
 }
 
 void AutoIndentTextEdit::completerSetup() {
-  completerModel = new QStringListModel(this);
-
-  completerModel->setStringList(wordList);
-  completer = new QCompleter(this);
+  // Filled by showCompletions() as words are typed
+  completerModel = new CompletionModel(this);
+  completer      = new QCompleter(this);
   completer->setModel(completerModel);
-  completer->setModelSorting(QCompleter::CaseInsensitivelySortedModel);
   completer->setCaseSensitivity(Qt::CaseInsensitive);
   completer->setWrapAround(false);
   setCompleter(completer);
+  // The model holds only the words matching the prefix, best first
+  completer->setCompletionMode(QCompleter::UnfilteredPopupCompletion);
 
   // set the same font as the text editor
   QFont font = this->font();
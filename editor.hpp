@@ -3,39 +3,75 @@
 
 #include <QAbstractItemView>
 #include <QCompleter>
-#include <QStringListModel>
 #include <QTextEdit>
 
 #include "autoindenttextedit.moc"
 #include "highlight.hpp"
 
+class BufferSearch;
+class BufferSymbols;
+class CompletionEngine;
+class CompletionModel;
+
 class AutoIndentTextEdit : public QTextEdit {
   Q_OBJECT
 
 public:
   explicit AutoIndentTextEdit(QWidget *parent = nullptr);
   void setHighlighter(DraculaCppSyntaxHighlighter *highlighter);
+  [[nodiscard]] DraculaCppSyntaxHighlighter *getHighlighter() const;
   void setCompleter(QCompleter *completer);
   [[nodiscard]] QCompleter *getCompleter() const;
+  // Works out the completions the built-in completer shows; more sources can be added to it.
+  [[nodiscard]] CompletionEngine *completionEngine() const { return completions; }
+
+  // Highlights the matches of `search` that are on screen, or none if it is null.
+  void setSearch(const BufferSearch *search);
+
+public slots:
+  // Asks for the word being completed again, after a completion source has new words for it
+  void refreshCompletions();
+
+signals:
+  // Typing asked the completion engine for the word that ends at `position`
+  void completionRequested(int position);
 
 protected:
   void keyPressEvent(QKeyEvent *event) override;
   void wheelEvent(QWheelEvent *event) override;
+  void resizeEvent(QResizeEvent *event) override;
 
 private slots:
   void highlightCurrentLine();
 
+  // Report the blocks on screen to the highlighter so they are colored first
+  void updateVisibleBlocks();
+
+  // Rebuild the match highlights for the blocks on screen
+  void updateSearchSelections();
+
 private slots:
   // Insert the selected completion into the text editor
   void insertCompletion(const QString &completion);
 
+  // Show the results of a completion request, unless the user has typed on since
+  void showCompletions(quint64 generation, const QString &prefix, const QStringList &words);
+
 private:
   QCompleter *completer                    = nullptr;
-  QStringListModel *completerModel         = nullptr;
-  QStringList wordList                     = QStringList{};
+  CompletionModel *completerModel          = nullptr;
+  CompletionEngine *completions            = nullptr; // made first, so destroyed before symbols
+  BufferSymbols *symbols                   = nullptr; // identifiers and keywords to complete
+  quint64 completionRequest                = 0;       // generation of the latest request
+  QString requestedPrefix;                            // the word it was for
   DraculaCppSyntaxHighlighter *highlighter = nullptr;
+  const BufferSearch *search               = nullptr;
+  QList<QTextEdit::ExtraSelection> searchSelections;
   void rehighlightCurrentLine();
 
+  // Numbers of the first and last blocks on screen
+  [[nodiscard]] QPair<int, int> visibleBlockRange() const;
+
   // completer
   void completerSetup();
   [[nodiscard]] QString wordUnderCursor() const;
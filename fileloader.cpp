@@ -0,0 +1,96 @@
+#include "fileloader.hpp"
+
+#include <QFile>
+
+#include "utf8.hpp"
+
+namespace {
+
+constexpr qint64 kFirstChunk = 16 * 1024; // more than a screenful of most files
+constexpr qint64 kChunk      = 1024 * 1024;
+
+} // namespace
+
+FileLoader::FileLoader(QObject *parent) : QObject(parent) {
+  // Queued to the GUI thread, where `load` tells current chunks from stale ones
+  connect(this, &FileLoader::readerChunk, this,
+          [this](quint64 from, const QString &text, qint64 bytesRead, qint64 totalBytes) {
+            if (from == load) emit chunkLoaded(text, bytesRead, totalBytes);
+          });
+  connect(this, &FileLoader::readerFinished, this,
+          [this](quint64 from, const QString &error, bool malformedUtf8) {
+            if (from != load) return;
+            loading = false;
+            emit finished(error, malformedUtf8);
+          });
+}
+
+FileLoader::~FileLoader() { stopReader(); }
+
+void FileLoader::start(const QString &fileName) {
+  stopReader();
+  cancelled = false;
+  loading   = true;
+
+  const quint64 current = ++load;
+  reader                = QThread::create([this, fileName, current] { read(fileName, current); });
+  reader->start();
+}
+
+void FileLoader::cancel() {
+  cancelled = true;
+  loading   = false;
+  ++load;
+}
+
+// The reader stops before its next chunk, so this waits for one read at most.
+void FileLoader::stopReader() {
+  if (!reader) return;
+  cancelled = true;
+  reader->wait();
+  delete reader;
+  reader = nullptr;
+}
+
+void FileLoader::read(const QString &fileName, quint64 current) {
+  QFile file(fileName);
+  if (!file.open(QIODevice::ReadOnly)) {
+    emit readerFinished(current, file.errorString(), false);
+    return;
+  }
+
+  const qint64 total = file.size();
+  QByteArray buffer(kChunk, Qt::Uninitialized);
+  Utf8Decoder decoder;
+  qint64 done         = 0;
+  qint64 chunk        = kFirstChunk;
+  bool carriageReturn = false; // a '\r' held back in case the next chunk starts with '\n'
+
+  while (!cancelled) {
+    const qint64 n = file.read(buffer.data(), chunk);
+    if (n < 0) {
+      emit readerFinished(current, file.errorString(), decoder.malformed());
+      return;
+    }
+
+    QString text(n + static_cast<qint64>(Utf8Decoder::kMaxPending) + 1, Qt::Uninitialized);
+    auto *out          = reinterpret_cast<char16_t *>(text.data());
+    std::size_t length = 0;
+    if (carriageReturn) out[length++] = u'\r';
+    length += n > 0 ? decoder.decode(buffer.constData(), static_cast<std::size_t>(n), out + length)
+                    : decoder.finish(out + length);
+    text.truncate(static_cast<qsizetype>(length));
+
+    carriageReturn = n > 0 && text.endsWith(u'\r');
+    if (carriageReturn) text.chop(1);
+    text.replace(QStringLiteral("\r\n"), QStringLiteral("\n"));
+
+    done += n;
+    if (!text.isEmpty()) emit readerChunk(current, text, done, total);
+    if (n == 0) {
+      emit readerFinished(current, QString(), decoder.malformed());
+      return;
+    }
+    chunk = kChunk;
+  }
+}
@@ -0,0 +1,43 @@
+#ifndef D4DC84AD_EF64_4748_A6E4_CBB96BF9D24C
+#define D4DC84AD_EF64_4748_A6E4_CBB96BF9D24C
+
+#include <QObject>
+#include <QString>
+#include <QThread>
+#include <atomic>
+
+// Reads and decodes a file on a background thread and hands it to the GUI thread in chunks,
+// the first one small enough to show a screenful right away. Line endings are normalized to
+// '\n'. Signals from a load that was cancelled or replaced by a newer one are dropped.
+class FileLoader : public QObject {
+  Q_OBJECT
+
+public:
+  explicit FileLoader(QObject *parent = nullptr);
+  ~FileLoader() override;
+
+  // Cancels the current load, if any, and starts loading `fileName`.
+  void start(const QString &fileName);
+  void cancel();
+  [[nodiscard]] bool isLoading() const { return loading; }
+
+signals:
+  void chunkLoaded(const QString &text, qint64 bytesRead, qint64 totalBytes);
+  // `error` is empty on success.
+  void finished(const QString &error, bool malformedUtf8);
+
+  // Emitted from the reader thread, tagged with the load they belong to.
+  void readerChunk(quint64 load, const QString &text, qint64 bytesRead, qint64 totalBytes);
+  void readerFinished(quint64 load, const QString &error, bool malformedUtf8);
+
+private:
+  QThread *reader = nullptr;
+  std::atomic<bool> cancelled{false};
+  quint64 load = 0; // only touched on the GUI thread
+  bool loading = false;
+
+  void read(const QString &fileName, quint64 load);
+  void stopReader();
+};
+
+#endif /* D4DC84AD_EF64_4748_A6E4_CBB96BF9D24C */
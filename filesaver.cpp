@@ -0,0 +1,360 @@
+#include "filesaver.hpp"
+
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStringEncoder>
+#include <QTextBlock>
+#include <QTextDocument>
+#include <QTimer>
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <limits>
+#include <mutex>
+#include <utility>
+
+#ifdef Q_OS_UNIX
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+constexpr qsizetype kBufferBytes = 1024 * 1024;
+constexpr qsizetype kSliceUnits  = 256 * 1024; // copied from the document per event loop turn
+
+// Makes the rename done by QSaveFile::commit() durable. Errors are ignored, as QSaveFile
+// does for its own sync: some file systems cannot sync directories.
+void syncParentDirectory(const QString &fileName) {
+#ifdef Q_OS_UNIX
+  const QByteArray directory = QFile::encodeName(QFileInfo(fileName).absolutePath());
+  const int fd               = ::open(directory.constData(), O_RDONLY | O_DIRECTORY);
+  if (fd < 0) return;
+  ::fsync(fd);
+  ::close(fd);
+#else
+  Q_UNUSED(fileName);
+#endif
+}
+
+// Encodes text to UTF-8 into a fixed buffer, which goes to `write` whenever it fills up
+class Utf8Output {
+public:
+  explicit Utf8Output(const FileSaver::Writer &write)
+      : write(write), buffer(kBufferBytes, Qt::Uninitialized), begin(buffer.data()),
+        end(begin + buffer.size()), out(begin) {}
+
+  // Writes `text` as QTextDocument::toPlainText() has it
+  bool append(QString text) {
+    for (QChar &c : text) {
+      if (c == QChar::Nbsp) {
+        c = u' ';
+      } else if (c == QChar::LineSeparator || c == QChar::ParagraphSeparator) {
+        c = u'\n';
+      }
+    }
+
+    for (QStringView rest = text; !rest.isEmpty();) {
+      // Encode as much as surely fits; a code unit takes at most 3 bytes
+      const qsizetype fits = (end - out - 4) / 3;
+      if (fits <= 0) {
+        if (!flush()) return false;
+        continue;
+      }
+      const QStringView part = rest.left(fits);
+      out                    = encoder.appendToBuffer(out, part);
+      rest                   = rest.mid(part.size());
+    }
+    return true;
+  }
+
+  bool flush() {
+    const bool written = out == begin || write(begin, out - begin);
+    flushed += out - begin;
+    out = begin;
+    return written;
+  }
+
+  // Cuts the output back to `bytes`, which must be where an appended text started
+  bool truncate(qint64 bytes) {
+    if (!flush()) return false;
+    flushed = bytes;
+    return write(nullptr, bytes);
+  }
+
+  // Bytes output so far
+  [[nodiscard]] qint64 size() const { return flushed + (out - begin); }
+  [[nodiscard]] bool hasError() const { return encoder.hasError(); }
+
+private:
+  const FileSaver::Writer &write;
+  QStringEncoder encoder{QStringEncoder::Utf8};
+  QByteArray buffer;
+  char *const begin;
+  char *const end;
+  char *out;
+  qint64 flushed = 0;
+};
+
+// Writes `text`, copied already
+FileSaver::Snapshot textSnapshot(QString text) {
+  return [text = std::move(text)](const FileSaver::Writer &write) {
+    Utf8Output output(write);
+    return output.append(text) && output.flush() && !output.hasError();
+  };
+}
+
+} // namespace
+
+struct FileSaver::Stream {
+  struct Slice {
+    qsizetype start; // position in the document
+    QString text;
+  };
+
+  std::mutex mutex;
+  std::condition_variable changed;
+  std::deque<Slice> slices; // copied and not written yet, in order
+  qsizetype queued = 0;     // code units in slices
+  qsizetype rewind = -1;    // the writer drops what it wrote of the slices from here on
+  bool complete    = false; // the last slice is in
+  bool taken       = false; // the writer took the last slice, so edits no longer matter
+  bool cancelled   = false; // the save is abandoned
+};
+
+FileSaver::FileSaver(QObject *parent) : QObject(parent), copier(new QTimer(this)) {
+  copier->setSingleShot(true);
+  connect(copier, &QTimer::timeout, this, [this] { copySlice(); });
+
+  // Queued to the GUI thread
+  connect(this, &FileSaver::writerFinished, this,
+          [this](const QString &fileName, const QString &error) {
+            waitForWriter();
+            emit finished(fileName, error);
+            startNext();
+          });
+  connect(this, &FileSaver::writerTookText, this, [this] {
+    if (!copier->isActive()) copySlice();
+  });
+}
+
+FileSaver::~FileSaver() {
+  // There is no event loop to go on with, so the saves still to come are written here
+  for (;;) {
+    if (copied) copySlice(true);
+    waitForWriter();
+    if (queue.isEmpty()) break;
+    startNext();
+  }
+}
+
+void FileSaver::save(const QString &fileName, Snapshot snapshot) {
+  enqueue({fileName, std::move(snapshot), nullptr});
+}
+
+void FileSaver::save(const QString &fileName, QTextDocument *document) {
+  enqueue({fileName, Snapshot(), document});
+}
+
+void FileSaver::detach(const QTextDocument *document) {
+  if (copied.data() == document) {
+    // What the document is given next is not an edit to the text being saved
+    copySlice(true);
+    disconnect(watch);
+    copied.clear();
+  }
+  for (Save &save : queue) {
+    if (save.document.data() != document) continue;
+    save.snapshot = textSnapshot(save.document->toPlainText());
+    save.document = nullptr;
+  }
+}
+
+void FileSaver::enqueue(Save save) {
+  const auto sameFile = [&save](const Save &queued) { return queued.fileName == save.fileName; };
+  queue.erase(std::remove_if(queue.begin(), queue.end(), sameFile), queue.end());
+  queue.append(std::move(save));
+  startNext();
+}
+
+void FileSaver::startNext() {
+  if (writer || queue.isEmpty()) return;
+  Save next = queue.takeFirst();
+
+  Snapshot snapshot = std::move(next.snapshot);
+  if (!snapshot) {
+    // Its document went away while the save waited
+    if (!next.document) {
+      emit finished(next.fileName, tr("The document was closed"));
+      startNext();
+      return;
+    }
+
+    stream         = std::make_shared<Stream>();
+    copied         = next.document;
+    copiedRevision = copied->revision();
+    rewinds        = 0;
+    watch          = connect(copied, &QTextDocument::contentsChange, this,
+                             [this](int position) { documentChanged(position); });
+    snapshot       = [this, stream = stream](const Writer &write) {
+      Utf8Output output(write);
+      // Where each slice written starts, in the document and in the file
+      std::vector<std::pair<qsizetype, qint64>> written;
+      for (;;) {
+        Stream::Slice slice;
+        qsizetype rewind = -1;
+        {
+          std::unique_lock<std::mutex> lock(stream->mutex);
+          stream->changed.wait(lock, [&stream] {
+            return stream->cancelled || stream->rewind >= 0 || stream->complete ||
+                   !stream->slices.empty();
+          });
+          if (stream->cancelled) return false;
+          rewind = std::exchange(stream->rewind, -1);
+          if (rewind < 0) {
+            if (stream->slices.empty()) {
+              stream->taken = true; // complete
+              break;
+            }
+            const bool full = stream->queued >= maxQueuedUnits;
+            slice           = std::move(stream->slices.front());
+            stream->slices.pop_front();
+            stream->queued -= slice.text.size();
+            if (full && stream->queued < maxQueuedUnits) emit writerTookText();
+          }
+        }
+
+        if (rewind >= 0) {
+          const auto from = std::lower_bound(written.begin(), written.end(),
+                                             std::make_pair(rewind, qint64{0}));
+          if (from == written.end()) continue; // not written yet
+          if (!output.truncate(from->second)) return false;
+          written.erase(from, written.end());
+          continue;
+        }
+        written.emplace_back(slice.start, output.size());
+        if (!output.append(std::move(slice.text))) return false;
+      }
+      return output.flush() && !output.hasError();
+    };
+    copySlice();
+  }
+
+  writer = QThread::create([this, fileName = next.fileName, snapshot = std::move(snapshot),
+                            sync = syncDirectory] { write(fileName, snapshot, sync); });
+  writer->start();
+}
+
+void FileSaver::copySlice(bool rest) {
+  if (!stream || stream->complete) return;
+  if (!rest) {
+    const std::lock_guard<std::mutex> lock(stream->mutex);
+    if (stream->queued >= maxQueuedUnits) return; // writerTookText() comes back here
+  }
+
+  if (!copied) {
+    const std::lock_guard<std::mutex> lock(stream->mutex);
+    stream->cancelled = true;
+    stream->changed.notify_all();
+    return;
+  }
+
+  // Whole blocks from copiedTo, which is where one starts, with the line break after each
+  const qsizetype start = copiedTo;
+  const qsizetype units = rest ? std::numeric_limits<qsizetype>::max() : kSliceUnits;
+  QString slice;
+  QTextBlock block = copied->findBlock(static_cast<int>(copiedTo));
+  for (; block.isValid() && slice.size() < units; block = block.next()) {
+    slice += QStringView(block.text()).mid(copiedTo - block.position());
+    if (block.next().isValid()) slice += u'\n';
+    copiedTo = block.position() + block.length();
+  }
+  sliceStarts.push_back(start);
+
+  const std::lock_guard<std::mutex> lock(stream->mutex);
+  stream->queued += slice.size();
+  stream->slices.push_back({start, std::move(slice)});
+  stream->complete = !block.isValid();
+  stream->changed.notify_all();
+  if (!stream->complete && stream->queued < maxQueuedUnits) copier->start();
+}
+
+// An edit to text that was copied already sends the copy back to the slice it is in. Without
+// a copy of the text before the edit, that is all a save can do and stay small. Past
+// maxRewinds, the rest is copied now and the edits that follow are left for the next save.
+void FileSaver::documentChanged(int position) {
+  // The highlighter reports its formatting as changes too
+  if (!stream || copied->revision() == copiedRevision) return;
+  copiedRevision = copied->revision();
+  if (position >= copiedTo) return;
+
+  {
+    const std::lock_guard<std::mutex> lock(stream->mutex);
+    if (stream->taken) return;
+    const auto slice = std::upper_bound(sliceStarts.begin(), sliceStarts.end(), position) - 1;
+    copiedTo         = *slice;
+    sliceStarts.erase(slice, sliceStarts.end());
+
+    while (!stream->slices.empty() && stream->slices.back().start >= copiedTo) {
+      stream->queued -= stream->slices.back().text.size();
+      stream->slices.pop_back();
+    }
+    stream->rewind   = stream->rewind < 0 ? copiedTo : std::min(stream->rewind, copiedTo);
+    stream->complete = false;
+    stream->changed.notify_all();
+  }
+
+  if (++rewinds < maxRewinds) {
+    if (!copier->isActive()) copier->start();
+    return;
+  }
+  disconnect(watch);
+  copySlice(true);
+}
+
+void FileSaver::waitForWriter() {
+  if (stream) {
+    // A writer still waiting for text would wait forever
+    const std::lock_guard<std::mutex> lock(stream->mutex);
+    if (!stream->complete) stream->cancelled = true;
+    stream->changed.notify_all();
+  }
+  copier->stop();
+  disconnect(watch);
+  stream.reset();
+  copied.clear();
+  copiedTo = 0;
+  sliceStarts.clear();
+
+  if (!writer) return;
+  writer->wait();
+  delete writer;
+  writer = nullptr;
+}
+
+void FileSaver::write(const QString &fileName, const Snapshot &snapshot, bool sync) {
+  QSaveFile file(fileName);
+  if (!file.open(QIODevice::WriteOnly)) {
+    emit writerFinished(fileName, file.errorString());
+    return;
+  }
+
+  const bool written = snapshot([&file](const char *data, qint64 length) {
+    if (!data) return file.resize(length) && file.seek(length);
+    return file.write(data, length) == length;
+  });
+  if (!written) {
+    const QString error =
+        file.error() == QFileDevice::NoError ? tr("Saving was cancelled") : file.errorString();
+    file.cancelWriting();
+    emit writerFinished(fileName, error);
+    return;
+  }
+  if (!file.commit()) {
+    emit writerFinished(fileName, file.errorString());
+    return;
+  }
+
+  if (sync) syncParentDirectory(fileName);
+  emit writerFinished(fileName, QString());
+}
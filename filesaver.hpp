@@ -0,0 +1,97 @@
+#ifndef ABDD2178_591F_43B6_AE25_C99CE3A6D642
+#define ABDD2178_591F_43B6_AE25_C99CE3A6D642
+
+#include <QList>
+#include <QObject>
+#include <QPointer>
+#include <QString>
+#include <QThread>
+#include <functional>
+#include <memory>
+#include <vector>
+
+class QTextDocument;
+class QTimer;
+
+// Saves files on a background thread, one after the other, so editing can go on while a file
+// is written. Output goes through a fixed-size buffer into a QSaveFile, which replaces the
+// target only once everything is written and synced.
+class FileSaver : public QObject {
+  Q_OBJECT
+
+public:
+  // Receives consecutive pieces of the text; returns false if writing failed. A null `data`
+  // cuts what was written back to `length` bytes, for a snapshot that has to go back.
+  using Writer = std::function<bool(const char *data, qint64 length)>;
+  // Feeds the whole text to `write`, stopping if it fails. Runs on the writer thread, so it
+  // must only use data it owns.
+  using Snapshot = std::function<bool(const Writer &write)>;
+
+  // Text of a document copied ahead of the writer; the copy waits while this much is queued
+  static constexpr qsizetype maxQueuedUnits = 4 * 1024 * 1024;
+  // Edits to text copied already that send a save back; after this many, the rest of the
+  // document is copied at once
+  static constexpr int maxRewinds = 8;
+
+  explicit FileSaver(QObject *parent = nullptr);
+  ~FileSaver() override; // finishes the running save, then writes the queued ones
+
+  // Writes `snapshot` to `fileName` once the saves before it are done. A save of the same file
+  // that is still waiting is replaced, since this one is newer.
+  void save(const QString &fileName, Snapshot snapshot);
+  // Writes the text of `document`. Its blocks are copied on the GUI thread a slice at a time,
+  // as the writer takes them, so only a few MiB of the text are ever held twice. The file gets
+  // the text as it is when the last slice is copied: an edit to text copied already sends the
+  // copy, and the writer, back to the slice it is in. After maxRewinds of those, the rest is
+  // copied in one go, so that steady typing cannot hold a save back, and later edits are left
+  // for the next save.
+  void save(const QString &fileName, QTextDocument *document);
+  // Copies what the saves of `document` still need of its text now. Call it before the
+  // document is given other text or destroyed, which would otherwise end up in the file or
+  // cancel the save.
+  void detach(const QTextDocument *document);
+  [[nodiscard]] bool isSaving() const { return writer != nullptr || !queue.isEmpty(); }
+
+  // QSaveFile syncs the file itself; this also syncs its directory, so that the rename that
+  // replaces the old file survives a power loss.
+  void setSyncDirectory(bool sync) { syncDirectory = sync; }
+
+signals:
+  // `error` is empty on success.
+  void finished(const QString &fileName, const QString &error);
+
+  // Emitted from the writer thread.
+  void writerFinished(const QString &fileName, const QString &error);
+  void writerTookText(); // the document copy has room again
+
+private:
+  struct Save {
+    QString fileName;
+    Snapshot snapshot;                // or null for a document
+    QPointer<QTextDocument> document; // whose text is copied once the save starts
+  };
+  struct Stream; // document text on its way from the copier to the writer
+
+  QList<Save> queue; // saves waiting for the writer
+  QThread *writer    = nullptr;
+  bool syncDirectory = true;
+
+  // The copy of the running save's document, if it is one
+  std::shared_ptr<Stream> stream;
+  QPointer<QTextDocument> copied;
+  QMetaObject::Connection watch;      // to copied's edits
+  qsizetype copiedTo = 0;             // where the next slice starts
+  std::vector<qsizetype> sliceStarts; // of the slices copied so far, in order
+  int copiedRevision = 0;
+  int rewinds        = 0;             // edits that sent the running save back
+  QTimer *copier;                     // copies the next slice
+
+  void enqueue(Save save);
+  void startNext();
+  void copySlice(bool rest = false); // or all of the rest, at once
+  void documentChanged(int position);
+  void write(const QString &fileName, const Snapshot &snapshot, bool sync);
+  void waitForWriter();
+};
+
+#endif /* ABDD2178_591F_43B6_AE25_C99CE3A6D642 */
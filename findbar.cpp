@@ -0,0 +1,191 @@
+#include "findbar.hpp"
+
+#include <QCheckBox>
+#include <QHBoxLayout>
+#include <QKeyEvent>
+#include <QLabel>
+#include <QLineEdit>
+#include <QTextCursor>
+#include <QToolButton>
+#include <utility>
+
+#include "buffersearch.hpp"
+#include "editor.hpp"
+
+FindBar::FindBar(AutoIndentTextEdit *editor, QWidget *parent)
+    : QWidget(parent), editor(editor), search(new BufferSearch(editor->document(), this)),
+      findEdit(new QLineEdit(this)), replaceEdit(new QLineEdit(this)),
+      matchCase(new QCheckBox(tr("Match case"), this)),
+      regex(new QCheckBox(tr("Regex"), this)), status(new QLabel(this)) {
+  auto *previous   = new QToolButton(this);
+  auto *next       = new QToolButton(this);
+  auto *replaceOne = new QToolButton(this);
+  auto *replaceAll = new QToolButton(this);
+  auto *closeBar   = new QToolButton(this);
+  previous->setText(tr("Previous"));
+  next->setText(tr("Next"));
+  replaceOne->setText(tr("Replace"));
+  replaceAll->setText(tr("Replace All"));
+  closeBar->setText(tr("Close"));
+
+  auto *layout = new QHBoxLayout(this);
+  layout->setContentsMargins(4, 2, 4, 2);
+  layout->addWidget(findEdit, 2);
+  layout->addWidget(matchCase);
+  layout->addWidget(regex);
+  layout->addWidget(previous);
+  layout->addWidget(next);
+  layout->addWidget(status);
+  layout->addWidget(replaceEdit, 1);
+  layout->addWidget(replaceOne);
+  layout->addWidget(replaceAll);
+  layout->addWidget(closeBar);
+  setSizePolicy(QSizePolicy::Preferred, QSizePolicy::Fixed);
+
+  findEdit->setPlaceholderText(tr("Find"));
+  findEdit->installEventFilter(this);
+  replaceEdit->setPlaceholderText(tr("Replace with"));
+  status->setMinimumWidth(fontMetrics().horizontalAdvance(tr("99999 of 99999")));
+  editor->setSearch(search);
+
+  connect(findEdit, &QLineEdit::textChanged, this, &FindBar::updateQuery);
+  connect(matchCase, &QCheckBox::toggled, this, &FindBar::updateQuery);
+  connect(regex, &QCheckBox::toggled, this, &FindBar::updateQuery);
+  connect(replaceEdit, &QLineEdit::returnPressed, this, &FindBar::replace);
+  connect(previous, &QToolButton::clicked, this, [this] { findNext(true); });
+  connect(next, &QToolButton::clicked, this, [this] { findNext(false); });
+  connect(replaceOne, &QToolButton::clicked, this, &FindBar::replace);
+  connect(replaceAll, &QToolButton::clicked, this, &FindBar::replaceAll);
+  connect(closeBar, &QToolButton::clicked, this, &FindBar::dismiss);
+  connect(search, &BufferSearch::matchesChanged, this, &FindBar::matchesChanged);
+  connect(search, &BufferSearch::aboutToReplaceAll, this, &FindBar::aboutToReplaceAll);
+  connect(search, &BufferSearch::replacedAll, this, &FindBar::replacedAll);
+  connect(editor, &QTextEdit::cursorPositionChanged, this, &FindBar::updateStatus);
+}
+
+void FindBar::activate() {
+  const QString selected = editor->textCursor().selectedText();
+  // selectedText() ends blocks with U+2029
+  if (!selected.isEmpty() && !selected.contains(QChar::ParagraphSeparator)) {
+    findEdit->setText(selected);
+  }
+  show();
+  if (!search->isActive()) updateQuery();
+  findEdit->setFocus();
+  findEdit->selectAll();
+}
+
+void FindBar::keyPressEvent(QKeyEvent *event) {
+  if (event->key() == Qt::Key_Escape) {
+    dismiss();
+    return;
+  }
+  QWidget::keyPressEvent(event);
+}
+
+bool FindBar::eventFilter(QObject *watched, QEvent *event) {
+  // Enter finds the next match, Shift+Enter the previous one
+  if (watched == findEdit && event->type() == QEvent::KeyPress) {
+    const auto *key = static_cast<QKeyEvent *>(event);
+    if (key->key() == Qt::Key_Return || key->key() == Qt::Key_Enter) {
+      findNext(key->modifiers() & Qt::ShiftModifier);
+      return true;
+    }
+  }
+  return QWidget::eventFilter(watched, event);
+}
+
+void FindBar::updateQuery() {
+  BufferSearch::Query query;
+  query.pattern   = findEdit->text();
+  query.regex     = regex->isChecked();
+  query.matchCase = matchCase->isChecked();
+
+  // The nearest match from where the typing started is selected once the search is done
+  const QTextCursor cursor = editor->textCursor();
+  jumpFrom                 = cursor.selectionStart();
+  error.clear();
+  if (!search->setQuery(query, &error)) jumpFrom = -1;
+  updateStatus();
+}
+
+void FindBar::matchesChanged() {
+  if (jumpFrom >= 0 && !search->isSearching()) {
+    selectMatch(search->nearest(std::exchange(jumpFrom, -1), false));
+  }
+  updateStatus();
+}
+
+void FindBar::updateStatus() {
+  const std::size_t count = search->matches().size();
+  if (!error.isEmpty()) {
+    status->setText(tr("Invalid"));
+    status->setToolTip(error);
+    return;
+  }
+  status->setToolTip(QString());
+  if (!search->isActive()) {
+    status->clear();
+  } else if (search->isSearching()) {
+    status->setText(tr("Searching..."));
+  } else if (count == 0) {
+    status->setText(tr("No matches"));
+  } else if (const int selected = selectedMatch(); selected >= 0) {
+    status->setText(tr("%1 of %2").arg(selected + 1).arg(count));
+  } else {
+    status->setText(tr("%n match(es)", nullptr, static_cast<int>(count)));
+  }
+}
+
+void FindBar::findNext(bool backward) {
+  const QTextCursor cursor = editor->textCursor();
+  selectMatch(search->nearest(backward ? cursor.selectionStart() : cursor.selectionEnd(),
+                              backward));
+}
+
+void FindBar::selectMatch(int index) {
+  if (index < 0) return;
+  const BufferSearch::Match &match = search->matches()[static_cast<std::size_t>(index)];
+  const int start                  = search->position(match);
+  QTextCursor cursor               = editor->textCursor();
+  cursor.setPosition(start);
+  cursor.setPosition(start + match.length, QTextCursor::KeepAnchor);
+  editor->setTextCursor(cursor);
+  editor->ensureCursorVisible();
+}
+
+int FindBar::selectedMatch() const {
+  const QTextCursor cursor = editor->textCursor();
+  if (!cursor.hasSelection() || search->matches().empty()) return -1;
+  const int index                  = search->nearest(cursor.selectionStart(), false);
+  const BufferSearch::Match &match = search->matches()[static_cast<std::size_t>(index)];
+  const bool selected              = search->position(match) == cursor.selectionStart() &&
+                        match.length == cursor.selectionEnd() - cursor.selectionStart();
+  return selected ? index : -1;
+}
+
+void FindBar::replace() {
+  if (search->isSearching()) return;
+  const int index = selectedMatch();
+  if (index >= 0) {
+    const BufferSearch::Match match = search->matches()[static_cast<std::size_t>(index)];
+    QTextCursor cursor              = editor->textCursor();
+    cursor.insertText(search->replacementFor(match, replaceEdit->text()));
+    editor->setTextCursor(cursor);
+  }
+  findNext(false);
+}
+
+void FindBar::replaceAll() {
+  const int replaced = search->replaceAll(replaceEdit->text());
+  if (replaced < 0) return;
+  status->setText(tr("Replaced %n", nullptr, replaced));
+}
+
+void FindBar::dismiss() {
+  jumpFrom = -1;
+  error.clear();
+  search->setQuery(BufferSearch::Query());
+  hide();
+  editor->setFocus();
+}
@@ -0,0 +1,59 @@
+#ifndef C9E4B7D2_5A13_4F86_9B0C_7E21D8A4F3B6
+#define C9E4B7D2_5A13_4F86_9B0C_7E21D8A4F3B6
+
+#include <QList>
+#include <QWidget>
+
+class AutoIndentTextEdit;
+class BufferSearch;
+class QCheckBox;
+class QLabel;
+class QLineEdit;
+
+// Find/replace bar for the text editor. Matches are found by a BufferSearch as the query is
+// typed and highlighted where they are on screen; Enter and Shift+Enter step through them.
+class FindBar : public QWidget {
+  Q_OBJECT
+
+public:
+  explicit FindBar(AutoIndentTextEdit *editor, QWidget *parent = nullptr);
+
+  // Shows the bar and focuses the query, starting from the editor's selection if it is on one
+  // line.
+  void activate();
+
+signals:
+  // Forwarded from the BufferSearch: Replace All edits the document in one step, and
+  // `blocks` are the lines it replaced matches on.
+  void aboutToReplaceAll();
+  void replacedAll(const QList<int> &blocks);
+
+protected:
+  void keyPressEvent(QKeyEvent *event) override;
+  bool eventFilter(QObject *watched, QEvent *event) override;
+
+private:
+  AutoIndentTextEdit *editor;
+  BufferSearch *search;
+  QLineEdit *findEdit;
+  QLineEdit *replaceEdit;
+  QCheckBox *matchCase;
+  QCheckBox *regex;
+  QLabel *status;
+  QString error;     // why the query cannot be searched for
+  int jumpFrom = -1; // position to select the nearest match from once they are found
+
+  void updateQuery();
+  void matchesChanged();
+  void updateStatus();
+  // Selects the next match after the editor's selection, or the previous one before it
+  void findNext(bool backward);
+  void selectMatch(int index);
+  // Index of the match the editor's selection is exactly on, or -1
+  [[nodiscard]] int selectedMatch() const;
+  void replace();
+  void replaceAll();
+  void dismiss(); // hides the bar and its highlights
+};
+
+#endif /* C9E4B7D2_5A13_4F86_9B0C_7E21D8A4F3B6 */
@@ -0,0 +1,165 @@
+#include "findinfiles.hpp"
+
+#include <QCheckBox>
+#include <QHBoxLayout>
+#include <QLabel>
+#include <QLineEdit>
+#include <QListView>
+#include <QTimer>
+#include <QToolButton>
+#include <QVBoxLayout>
+
+#include "pathindexer.hpp"
+#include "projectsearch.hpp"
+
+FindResultsModel::FindResultsModel(QObject *parent) : QAbstractListModel(parent) {}
+
+void FindResultsModel::clear() {
+  beginResetModel();
+  files.clear();
+  rows.clear();
+  endResetModel();
+}
+
+void FindResultsModel::append(const QString &file, const QList<int> &lines,
+                              const QStringList &texts, const QList<int> &columns,
+                              const QList<int> &lengths) {
+  if (lines.isEmpty()) return;
+  // A file's matches can come in several batches, one after another
+  if (files.isEmpty() || files.constLast() != file) files.append(file);
+  const int fileIndex = static_cast<int>(files.size()) - 1;
+
+  const int first = static_cast<int>(rows.size());
+  beginInsertRows(QModelIndex(), first, first + static_cast<int>(lines.size()) - 1);
+  for (qsizetype i = 0; i < lines.size(); ++i) {
+    rows.push_back(Row{fileIndex, lines[i], columns[i], lengths[i], texts[i]});
+  }
+  endInsertRows();
+}
+
+int FindResultsModel::rowCount(const QModelIndex &parent) const {
+  return parent.isValid() ? 0 : static_cast<int>(rows.size());
+}
+
+QVariant FindResultsModel::data(const QModelIndex &index, int role) const {
+  if (!index.isValid() || index.row() >= rowCount()) return QVariant();
+  const Row &match = row(index.row());
+  if (role == Qt::DisplayRole) {
+    return QStringLiteral("%1:%2: %3").arg(files[match.file]).arg(match.line + 1).arg(
+        match.text.trimmed());
+  }
+  if (role == Qt::ToolTipRole) return files[match.file];
+  return QVariant();
+}
+
+FindInFilesPanel::FindInFilesPanel(PathIndexer *indexer, QWidget *parent)
+    : QWidget(parent), indexer(indexer), search(new ProjectSearch(this)),
+      model(new FindResultsModel(this)), queryEdit(new QLineEdit(this)),
+      matchCase(new QCheckBox(tr("Match case"), this)),
+      regex(new QCheckBox(tr("Regex"), this)), stopButton(new QToolButton(this)),
+      status(new QLabel(this)), results(new QListView(this)), debounce(new QTimer(this)) {
+  auto *queryRow = new QHBoxLayout;
+  queryRow->addWidget(queryEdit);
+  queryRow->addWidget(matchCase);
+  queryRow->addWidget(regex);
+  queryRow->addWidget(stopButton);
+
+  auto *layout = new QVBoxLayout(this);
+  layout->setContentsMargins(0, 0, 0, 0);
+  layout->addLayout(queryRow);
+  layout->addWidget(status);
+  layout->addWidget(results);
+
+  queryEdit->setPlaceholderText(tr("Find in files"));
+  queryEdit->setClearButtonEnabled(true);
+  stopButton->setText(tr("Stop"));
+  stopButton->setEnabled(false);
+  results->setModel(model);
+  results->setUniformItemSizes(true);
+  results->setEditTriggers(QAbstractItemView::NoEditTriggers);
+
+  debounce->setSingleShot(true);
+  debounce->setInterval(debounceMs);
+  connect(debounce, &QTimer::timeout, this, &FindInFilesPanel::startSearch);
+  connect(queryEdit, &QLineEdit::textChanged, this, [this](const QString &text) {
+    if (text.size() >= minQueryLength) {
+      debounce->start();
+    } else {
+      debounce->stop();
+      stopSearch();
+    }
+  });
+  connect(queryEdit, &QLineEdit::returnPressed, this, &FindInFilesPanel::startSearch);
+  connect(matchCase, &QCheckBox::toggled, this, &FindInFilesPanel::startSearch);
+  connect(regex, &QCheckBox::toggled, this, &FindInFilesPanel::startSearch);
+  connect(stopButton, &QToolButton::clicked, this, &FindInFilesPanel::stopSearch);
+  connect(results, &QListView::activated, this, &FindInFilesPanel::openResult);
+
+  connect(search, &ProjectSearch::found, this,
+          [this](const QString &file, const QList<int> &lines, const QStringList &texts,
+                 const QList<int> &columns, const QList<int> &lengths) {
+            model->append(file, lines, texts, columns, lengths);
+            status->setText(tr("Searching... %n match(es)", nullptr, model->rowCount()));
+          });
+  connect(search, &ProjectSearch::finished, this, &FindInFilesPanel::searchFinished);
+  connect(indexer, &PathIndexer::indexChanged, this, [this] {
+    if (waitingForIndex) startSearch();
+  });
+}
+
+void FindInFilesPanel::activate(const QString &text) {
+  show();
+  if (!text.isEmpty() && !text.contains(u'\n')) queryEdit->setText(text);
+  queryEdit->setFocus();
+  queryEdit->selectAll();
+}
+
+void FindInFilesPanel::startSearch() {
+  debounce->stop();
+  stopSearch();
+  model->clear();
+  if (queryEdit->text().isEmpty()) return;
+
+  const std::shared_ptr<const PathIndex> index = indexer->index();
+  if (!index) {
+    waitingForIndex = true;
+    status->setText(tr("Indexing %1...").arg(indexer->rootPath()));
+    return;
+  }
+
+  ProjectSearch::Query query;
+  query.pattern   = queryEdit->text();
+  query.regex     = regex->isChecked();
+  query.matchCase = matchCase->isChecked();
+  QString error;
+  searchedRoot = indexer->rootPath();
+  if (!search->start(searchedRoot, index, query, &error)) {
+    status->setText(error);
+    return;
+  }
+  stopButton->setEnabled(true);
+  status->setText(tr("Searching..."));
+}
+
+void FindInFilesPanel::stopSearch() {
+  waitingForIndex = false;
+  if (!search->isSearching()) return;
+  search->cancel();
+  stopButton->setEnabled(false);
+  status->setText(tr("Stopped; %n match(es)", nullptr, model->rowCount()));
+}
+
+void FindInFilesPanel::searchFinished(int filesSearched, int matches, bool truncated) {
+  stopButton->setEnabled(false);
+  QString text = tr("%n match(es)", nullptr, matches) + ' ' +
+                 tr("in %n file(s) searched", nullptr, filesSearched);
+  if (truncated) text += ' ' + tr("(stopped at %1)").arg(ProjectSearch::maxMatches);
+  status->setText(text);
+}
+
+void FindInFilesPanel::openResult(const QModelIndex &index) {
+  if (!index.isValid()) return;
+  const FindResultsModel::Row &match = model->row(index.row());
+  emit locationActivated(searchedRoot + '/' + model->file(match.file), match.line,
+                         match.column, match.length);
+}
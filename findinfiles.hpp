@@ -0,0 +1,90 @@
+#ifndef B3177887_F76E_43DF_9777_953AB407BC65
+#define B3177887_F76E_43DF_9777_953AB407BC65
+
+#include <QAbstractListModel>
+#include <QStringList>
+#include <QWidget>
+#include <vector>
+
+class PathIndexer;
+class ProjectSearch;
+class QCheckBox;
+class QLabel;
+class QLineEdit;
+class QListView;
+class QTimer;
+class QToolButton;
+
+// Matches of a project search, one row per match. Rows are only formatted when the view asks
+// for them, so the view stays responsive with tens of thousands of matches.
+class FindResultsModel : public QAbstractListModel {
+  Q_OBJECT
+
+public:
+  struct Row {
+    int file; // index into files()
+    int line; // 0-based
+    int column;
+    int length;
+    QString text;
+  };
+
+  explicit FindResultsModel(QObject *parent = nullptr);
+
+  void clear();
+  void append(const QString &file, const QList<int> &lines, const QStringList &texts,
+              const QList<int> &columns, const QList<int> &lengths);
+
+  [[nodiscard]] const Row &row(int i) const { return rows[static_cast<std::size_t>(i)]; }
+  [[nodiscard]] const QString &file(int i) const { return files[i]; }
+
+  [[nodiscard]] int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+  [[nodiscard]] QVariant data(const QModelIndex &index, int role) const override;
+
+private:
+  QStringList files;
+  std::vector<Row> rows;
+};
+
+// Find in Files panel: a query line with case and regular expression toggles over a list of
+// matches that fills in as the search runs. Typing restarts the search after a pause; Enter
+// restarts it at once.
+class FindInFilesPanel : public QWidget {
+  Q_OBJECT
+
+public:
+  FindInFilesPanel(PathIndexer *indexer, QWidget *parent = nullptr);
+
+  // Shows the panel and focuses the query, starting from `text` if it is not empty.
+  void activate(const QString &text);
+
+signals:
+  // A match was chosen. `file` is absolute, `line` 0-based, `column` and `length` in UTF-16
+  // code units.
+  void locationActivated(const QString &file, int line, int column, int length);
+
+private:
+  // Typing searches this long after the last key, once the query has minQueryLength characters
+  static constexpr int debounceMs     = 300;
+  static constexpr int minQueryLength = 3;
+
+  PathIndexer *indexer;
+  ProjectSearch *search;
+  FindResultsModel *model;
+  QLineEdit *queryEdit;
+  QCheckBox *matchCase;
+  QCheckBox *regex;
+  QToolButton *stopButton;
+  QLabel *status;
+  QListView *results;
+  QTimer *debounce;
+  QString searchedRoot;         // root of the search the results belong to
+  bool waitingForIndex = false; // a search is due once the first index is there
+
+  void startSearch();
+  void stopSearch();
+  void searchFinished(int filesSearched, int matches, bool truncated);
+  void openResult(const QModelIndex &index);
+};
+
+#endif /* B3177887_F76E_43DF_9777_953AB407BC65 */
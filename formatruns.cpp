@@ -0,0 +1,59 @@
+#include "formatruns.hpp"
+
+#include <algorithm>
+
+namespace {
+
+// Appends [start, end) to `runs`, extending the last run instead when it has the same format
+// and nothing but blanks lies in between.
+void appendRun(const char16_t *text, int start, int end, std::uint8_t format,
+               std::vector<FormatRun> &runs) {
+  if (!runs.empty() && runs.back().format == format) {
+    FormatRun &last   = runs.back();
+    const int lastEnd = last.start + last.length;
+    const bool blank  = std::all_of(text + lastEnd, text + start,
+                                    [](char16_t c) { return c == u' ' || c == u'\t'; });
+    if (blank) {
+      last.length = end - last.start;
+      return;
+    }
+  }
+  runs.push_back({start, end - start, format});
+}
+
+} // namespace
+
+void coalesceTokens(const char16_t *text, const std::vector<Token> &tokens,
+                    const std::uint8_t *formatOfKind, std::vector<FormatRun> &runs) {
+  for (const Token &token : tokens) {
+    if (token.kind == TokenKind::Plain) continue;
+    appendRun(text, token.start, token.start + token.length,
+              formatOfKind[static_cast<int>(token.kind)], runs);
+  }
+}
+
+void FormatRunResolver::reset(int length) { cells.assign(length, 0); }
+
+void FormatRunResolver::add(int start, int length, std::uint8_t format, std::uint8_t priority) {
+  const int end             = std::min(start + length, static_cast<int>(cells.size()));
+  const std::uint16_t value = static_cast<std::uint16_t>((priority + 1) << 8 | format);
+  for (int i = std::max(start, 0); i < end; ++i) {
+    if ((value >> 8) >= (cells[i] >> 8)) cells[i] = value;
+  }
+}
+
+int FormatRunResolver::formatAt(int index) const {
+  return cells[index] == 0 ? -1 : cells[index] & 0xff;
+}
+
+void FormatRunResolver::resolve(const char16_t *text, std::vector<FormatRun> &runs) const {
+  const int length = static_cast<int>(cells.size());
+  int i            = 0;
+  while (i < length) {
+    const int format = formatAt(i);
+    int end          = i + 1;
+    while (end < length && formatAt(end) == format) ++end;
+    if (format >= 0) appendRun(text, i, end, static_cast<std::uint8_t>(format), runs);
+    i = end;
+  }
+}
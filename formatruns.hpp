@@ -0,0 +1,38 @@
+#ifndef D6DD2E76_B613_42EE_98EE_5246B750F1C6
+#define D6DD2E76_B613_42EE_98EE_5246B750F1C6
+
+#include <cstdint>
+#include <vector>
+
+#include "lexer.hpp"
+
+// One resolved stretch of a block that gets a single setFormat call. `format` indexes the
+// highlighter's table of distinct formats.
+struct FormatRun {
+  int start;
+  int length;
+  std::uint8_t format;
+};
+
+// Turns lexer tokens into runs. Tokens whose kinds share a format are merged when they touch
+// or when only spaces and tabs separate them, so `) {` or `*/ /*` become one run.
+void coalesceTokens(const char16_t *text, const std::vector<Token> &tokens,
+                    const std::uint8_t *formatOfKind, std::vector<FormatRun> &runs);
+
+// Resolves overlapping spans into non-overlapping runs. Each character keeps the span with
+// the highest priority; on equal priority the span added last wins, like repeated setFormat.
+class FormatRunResolver {
+public:
+  void reset(int length);
+  void add(int start, int length, std::uint8_t format, std::uint8_t priority);
+
+  // Format that won at `index`, or -1 if the character stays plain.
+  [[nodiscard]] int formatAt(int index) const;
+
+  void resolve(const char16_t *text, std::vector<FormatRun> &runs) const;
+
+private:
+  std::vector<std::uint16_t> cells; // (priority + 1) << 8 | format, 0 while plain
+};
+
+#endif /* D6DD2E76_B613_42EE_98EE_5246B750F1C6 */
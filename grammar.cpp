@@ -0,0 +1,265 @@
+#include "grammar.hpp"
+
+#include <QColor>
+#include <QCryptographicHash>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QFont>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QStringView>
+#include <algorithm>
+#include <iterator>
+
+#include "scan.hpp"
+
+namespace {
+
+// Bumped whenever the grammar language or the Dfa encoding changes, so stale caches miss.
+constexpr char kCacheSalt[] = "edit-grammar-dfa-1";
+
+constexpr const char *kKindNames[] = {
+    "Plain",  "Keyword",   "Operator",       "String",  "Number",           "Function",
+    "Type",   "Namespace", "TemplateParams", "Comment", "MultiLineComment",
+};
+static_assert(std::size(kKindNames) == static_cast<size_t>(TokenKind::Count));
+
+bool kindFromName(QStringView name, TokenKind &kind) {
+  for (size_t i = 0; i < std::size(kKindNames); ++i) {
+    if (name == QLatin1String(kKindNames[i])) {
+      kind = static_cast<TokenKind>(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+QString cachePath(const QByteArray &key) {
+  return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/grammars/" +
+         QString::fromLatin1(key.toHex()) + ".dfa";
+}
+
+bool readCache(const QString &path, Dfa &dfa, int ruleCount) {
+  QFile file(path);
+  if (!file.open(QIODevice::ReadOnly)) return false;
+  const QByteArray data = file.readAll();
+  return dfa.deserialize(reinterpret_cast<const std::uint8_t *>(data.constData()),
+                         static_cast<std::size_t>(data.size()), ruleCount);
+}
+
+void writeCache(const QString &path, const Dfa &dfa) {
+  QDir().mkpath(QFileInfo(path).absolutePath());
+  const std::vector<std::uint8_t> data = dfa.serialize();
+  QSaveFile file(path);
+  if (!file.open(QIODevice::WriteOnly)) return;
+  file.write(reinterpret_cast<const char *>(data.data()), static_cast<qint64>(data.size()));
+  file.commit();
+}
+
+QString userDataPath(const QString &name) {
+  return QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/" + name;
+}
+
+} // namespace
+
+std::shared_ptr<const Grammar> Grammar::load(const QString &path, QString *error) {
+  auto fail = [&](const QString &message) -> std::shared_ptr<const Grammar> {
+    if (error) *error = path + ": " + message;
+    return nullptr;
+  };
+
+  QFile file(path);
+  if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) return fail(file.errorString());
+  const QByteArray source = file.readAll();
+
+  auto grammar = std::make_shared<Grammar>();
+  std::vector<DfaRule> dfaRules;
+
+  const QStringList lines = QString::fromUtf8(source).split('\n');
+  for (int number = 0; number < lines.size(); ++number) {
+    const QString line = lines[number].trimmed();
+    if (line.isEmpty() || line.startsWith('#')) continue;
+
+    const QStringList fields = line.split(' ', Qt::SkipEmptyParts);
+    const QString &directive = fields[0];
+    const QString where      = QString("line %1: ").arg(number + 1);
+
+    if (directive == "name" && fields.size() == 2) {
+      grammar->grammarName = fields[1];
+      continue;
+    }
+    if (directive == "extensions") {
+      grammar->fileExtensions = fields.mid(1);
+      continue;
+    }
+
+    TokenKind kind = TokenKind::Plain;
+    if (fields.size() < 3 || !kindFromName(fields[1], kind)) {
+      return fail(where + "expected '" + directive + " <Kind> ...'");
+    }
+
+    if (directive == "token") {
+      // The pattern is the rest of the line, so it may contain spaces
+      const qsizetype kindAt = line.indexOf(fields[1], directive.size());
+      const QString pattern  = line.mid(kindAt + fields[1].size()).trimmed();
+      dfaRules.push_back({pattern.toStdString(), false});
+      grammar->rules.push_back({kind, -1});
+    } else if (directive == "keywords") {
+      for (qsizetype i = 2; i < fields.size(); ++i) {
+        dfaRules.push_back({fields[i].toStdString(), true});
+        grammar->rules.push_back({kind, -1});
+      }
+    } else if (directive == "region" && fields.size() == 4) {
+      dfaRules.push_back({fields[2].toStdString(), true});
+      grammar->rules.push_back({kind, static_cast<int>(grammar->regions.size())});
+      grammar->regions.push_back({kind, fields[3].toStdU16String()});
+    } else {
+      return fail(where + "unknown directive '" + directive + "'");
+    }
+  }
+  if (grammar->grammarName.isEmpty()) return fail("missing 'name'");
+
+  // Keyed by the grammar text itself, so editing the file invalidates its cache
+  QCryptographicHash hash(QCryptographicHash::Sha1);
+  hash.addData(QByteArrayView(kCacheSalt));
+  hash.addData(source);
+  const QString cache = cachePath(hash.result());
+
+  if (!readCache(cache, grammar->dfa, static_cast<int>(dfaRules.size()))) {
+    std::string message;
+    if (!grammar->dfa.compile(dfaRules, message)) return fail(QString::fromStdString(message));
+    writeCache(cache, grammar->dfa);
+  }
+  return grammar;
+}
+
+const std::vector<std::shared_ptr<const Grammar>> &Grammar::registry() {
+  static const std::vector<std::shared_ptr<const Grammar>> grammars = [] {
+    std::vector<std::shared_ptr<const Grammar>> loaded;
+    for (const QString &directory : {QString(":/grammars"), userDataPath("grammars")}) {
+      const QDir dir(directory);
+      for (const QString &entry : dir.entryList({"*.grammar"}, QDir::Files, QDir::Name)) {
+        QString error;
+        auto grammar = load(dir.filePath(entry), &error);
+        if (!grammar) {
+          qWarning().noquote() << "grammar:" << error;
+          continue;
+        }
+        // Later directories override earlier ones
+        loaded.erase(std::remove_if(loaded.begin(), loaded.end(),
+                                    [&](const auto &other) {
+                                      return other->name() == grammar->name();
+                                    }),
+                     loaded.end());
+        loaded.push_back(std::move(grammar));
+      }
+    }
+    return loaded;
+  }();
+  return grammars;
+}
+
+std::shared_ptr<const Grammar> Grammar::forFile(const QString &fileName) {
+  const QString suffix = QFileInfo(fileName).suffix();
+  for (const auto &grammar : registry()) {
+    if (grammar->extensions().contains(suffix)) return grammar;
+  }
+  return nullptr;
+}
+
+std::shared_ptr<const Grammar> Grammar::byName(const QString &name) {
+  for (const auto &grammar : registry()) {
+    if (grammar->name() == name) return grammar;
+  }
+  return nullptr;
+}
+
+// Index just past the region's closing delimiter, or -1 if it does not close in this block.
+int Grammar::regionEnd(const Region &region, const char16_t *text, int length, int from) const {
+  const int size = static_cast<int>(region.close.size());
+  for (int i = scan::find(text, length, from, region.close[0]); i + size <= length;
+       i     = scan::find(text, length, i + 1, region.close[0])) {
+    if (std::u16string_view(text + i, size) == region.close) return i + size;
+  }
+  return -1;
+}
+
+int Grammar::tokenize(const char16_t *text, int length, int state,
+                      std::vector<Token> &tokens) const {
+  auto emit = [&tokens](int start, int end, TokenKind kind) {
+    if (end > start && kind != TokenKind::Plain) tokens.push_back({start, end - start, kind});
+  };
+
+  int pos = 0;
+  if (state > 0 && state <= static_cast<int>(regions.size())) {
+    const Region &region = regions[state - 1];
+    const int end        = regionEnd(region, text, length, 0);
+    emit(0, end < 0 ? length : end, region.kind);
+    if (end < 0) return state;
+    pos = end;
+  }
+
+  while (pos < length) {
+    int end        = pos;
+    const int rule = dfa.match(text, pos, length, end);
+    if (rule < 0) {
+      ++pos;
+      continue;
+    }
+
+    const Rule &matched = rules[rule];
+    if (matched.region >= 0) {
+      const Region &region = regions[matched.region];
+      const int close      = regionEnd(region, text, length, end);
+      emit(pos, close < 0 ? length : close, region.kind);
+      if (close < 0) return matched.region + 1;
+      pos = close;
+      continue;
+    }
+
+    emit(pos, end, matched.kind);
+    pos = end;
+  }
+  return 0;
+}
+
+bool loadTheme(const QString &path, TokenFormats &formats, QString *error) {
+  QFile file(path);
+  if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+    if (error) *error = path + ": " + file.errorString();
+    return false;
+  }
+
+  TokenFormats themed = formats;
+  const QStringList lines = QString::fromUtf8(file.readAll()).split('\n');
+  for (int number = 0; number < lines.size(); ++number) {
+    const QString line = lines[number].trimmed();
+    if (line.isEmpty() || line.startsWith('#')) continue;
+
+    const QStringList fields = line.split(' ', Qt::SkipEmptyParts);
+    TokenKind kind           = TokenKind::Plain;
+    const QColor color       = fields.size() >= 2 ? QColor(fields[1]) : QColor();
+    if (!kindFromName(fields[0], kind) || !color.isValid()) {
+      if (error) {
+        *error = QString("%1: line %2: expected '<Kind> <color>'").arg(path).arg(number + 1);
+      }
+      return false;
+    }
+
+    QTextCharFormat format;
+    format.setForeground(color);
+    if (fields.contains("bold")) format.setFontWeight(QFont::Bold);
+    if (fields.contains("italic")) format.setFontItalic(true);
+    themed[static_cast<size_t>(kind)] = format;
+  }
+
+  formats = themed;
+  return true;
+}
+
+QString themePath() {
+  const QString user = userDataPath("theme");
+  return QFileInfo::exists(user) ? user : QString(":/themes/dracula.theme");
+}
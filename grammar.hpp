@@ -0,0 +1,75 @@
+#ifndef AB16056C_B173_4C8F_8682_AF76FEB0DFFF
+#define AB16056C_B173_4C8F_8682_AF76FEB0DFFF
+
+#include <QString>
+#include <QStringList>
+#include <QTextCharFormat>
+#include <array>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "dfa.hpp"
+#include "lexer.hpp"
+
+// One format per token class, indexed by TokenKind.
+using TokenFormats = std::array<QTextCharFormat, static_cast<size_t>(TokenKind::Count)>;
+
+// A language defined by a grammar file instead of C++. The file is a list of lines:
+//
+//   name <name>
+//   extensions <ext>...
+//   token <Kind> <pattern>        pattern in the Dfa dialect, up to the end of the line
+//   keywords <Kind> <word>...     literal tokens
+//   region <Kind> <open> <close>  literal delimiters of a span that may cross lines
+//
+// Kind is a TokenKind name; Plain tokens are matched but not colored. Lines starting with #
+// are comments. All tokens and region openers compile into one Dfa, so a block is colored in
+// a single pass whatever the number of rules.
+class Grammar {
+public:
+  // Loads a grammar file. The compiled Dfa is read from the on-disk cache when one exists for
+  // the same grammar text; otherwise it is compiled and cached for the next start.
+  static std::shared_ptr<const Grammar> load(const QString &path, QString *error = nullptr);
+
+  // Grammars shipped in the resources and in <app data>/grammars, loaded on first use. A user
+  // grammar replaces a built-in one with the same name. Returns null if none matches.
+  static std::shared_ptr<const Grammar> forFile(const QString &fileName);
+  static std::shared_ptr<const Grammar> byName(const QString &name);
+
+  [[nodiscard]] const QString &name() const { return grammarName; }
+  [[nodiscard]] const QStringList &extensions() const { return fileExtensions; }
+
+  // Same contract as CppLexer::tokenize. The state is 0, or the 1-based index of the region
+  // the block ends inside.
+  int tokenize(const char16_t *text, int length, int state, std::vector<Token> &tokens) const;
+
+private:
+  struct Rule {
+    TokenKind kind;
+    int region; // index into regions for region openers, -1 otherwise
+  };
+
+  struct Region {
+    TokenKind kind;
+    std::u16string close;
+  };
+
+  QString grammarName;
+  QStringList fileExtensions;
+  std::vector<Rule> rules;
+  std::vector<Region> regions;
+  Dfa dfa;
+
+  static const std::vector<std::shared_ptr<const Grammar>> &registry();
+  int regionEnd(const Region &region, const char16_t *text, int length, int from) const;
+};
+
+// Applies a theme file over `formats`. Each line is `<Kind> <color> [bold] [italic]`; kinds the
+// theme does not mention keep their format.
+bool loadTheme(const QString &path, TokenFormats &formats, QString *error = nullptr);
+
+// <app data>/theme if the user has one, otherwise the built-in Dracula theme.
+QString themePath();
+
+#endif /* AB16056C_B173_4C8F_8682_AF76FEB0DFFF */
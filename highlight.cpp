@@ -1,8 +1,38 @@
 #include "highlight.hpp"
 
+#include <QDebug>
+#include <QElapsedTimer>
 #include <QRegularExpression>
 #include <QSyntaxHighlighter>
+#include <QTextBlock>
 #include <QTextCharFormat>
+#include <QTextDocument>
+#include <algorithm>
+#include <iterator>
+
+#include "scan.hpp"
+
+namespace {
+
+// Moves a queued block number across an edit that changed the block count by `delta` at
+// block `first`. Blocks that were merged away become -1.
+void shiftBlockNumber(int &number, int first, int delta) {
+  if (number <= first) return;
+  if (delta < 0 && number <= first - delta) {
+    number = -1;
+  } else {
+    number += delta;
+  }
+}
+
+// Lexer state a block starts in, read from the previous block outside highlightBlock.
+int startState(const QTextBlock &block) {
+  const QTextBlock previous = block.previous();
+  return previous.isValid() && previous.userState() >= 0 ? previous.userState()
+                                                         : CppLexer::Normal;
+}
+
+} // namespace
 
 DraculaCppSyntaxHighlighter::DraculaCppSyntaxHighlighter(QTextDocument *parent)
     : QSyntaxHighlighter(parent) {
@@ -242,50 +272,531 @@ DraculaCppSyntaxHighlighter::DraculaCppSyntaxHighlighter(QTextDocument *parent)
   highlightingRules.append(singleLineCommentRule);
 
   // Formatting for multi-line comments as gray text
-  QTextCharFormat multiLineCommentFormat;
-  multiLineCommentFormat.setForeground(Qt::gray); // Comment Blue
-  commentStartExpression = QRegularExpression("/\\*");
-  commentEndExpression   = QRegularExpression("\\*/");
+  multiLineCommentFormat.setForeground(Qt::gray);
+
+  // Formats for the lexer's token classes, same colors as the rules above
+  TokenFormats tokenFormats;
+  auto tokenFormat = [&tokenFormats](TokenKind kind) -> QTextCharFormat & {
+    return tokenFormats[static_cast<size_t>(kind)];
+  };
+  tokenFormat(TokenKind::Keyword)          = keywordFormat;
+  tokenFormat(TokenKind::Operator)         = operatorFormat;
+  tokenFormat(TokenKind::String)           = stringFormat;
+  tokenFormat(TokenKind::Number)           = numberFormat;
+  tokenFormat(TokenKind::Function)         = functionFormat;
+  tokenFormat(TokenKind::Type)             = typeFormat;
+  tokenFormat(TokenKind::Namespace)        = namespaceFormat;
+  tokenFormat(TokenKind::TemplateParams)   = templateParameterFormat;
+  tokenFormat(TokenKind::Comment)          = singleLineCommentFormat;
+  tokenFormat(TokenKind::MultiLineComment) = multiLineCommentFormat;
+
+  // The theme file has the same colors; a user theme replaces them
+  QString themeError;
+  if (!loadTheme(themePath(), tokenFormats, &themeError)) qWarning().noquote() << themeError;
+
+  // Identical formats share an id so neighbouring runs of the same look can merge
+  for (size_t kind = 1; kind < tokenFormats.size(); ++kind) { // Plain is never applied
+    tokenFormatIds[kind] = formatId(tokenFormats[kind]);
+  }
+  for (HighlightingRule &rule : highlightingRules) {
+    rule.formatId = formatId(rule.format);
+  }
+  multiLineCommentFormatId = formatId(multiLineCommentFormat);
+
+  const QString engineName = qEnvironmentVariable("EDIT_HIGHLIGHT_ENGINE");
+  if (engineName == "regex") {
+    currentEngine = Engine::Regex;
+  } else if (engineName == "verify") {
+    currentEngine = Engine::Verify;
+  }
+
+  // One worker keeps jobs in document order
+  lexerPool.setMaxThreadCount(1);
+
+  dispatchTimer = new QTimer(this);
+  dispatchTimer->setSingleShot(true);
+  dispatchTimer->setInterval(0);
+  connect(dispatchTimer, &QTimer::timeout, this, &DraculaCppSyntaxHighlighter::startLexJob);
+
+  applyTimer = new QTimer(this);
+  applyTimer->setSingleShot(true);
+  applyTimer->setInterval(0);
+  connect(applyTimer, &QTimer::timeout, this, &DraculaCppSyntaxHighlighter::applyLexedBlocks);
+
+  fillTimer = new QTimer(this);
+  fillTimer->setSingleShot(true);
+  fillTimer->setInterval(0);
+  connect(fillTimer, &QTimer::timeout, this, &DraculaCppSyntaxHighlighter::fillOffscreen);
+
+  trackDocument();
+}
+
+DraculaCppSyntaxHighlighter::~DraculaCppSyntaxHighlighter() {
+  lexerPool.clear();
+  lexerPool.waitForDone();
+}
+
+void DraculaCppSyntaxHighlighter::setDocument(QTextDocument *document) {
+  if (this->document()) {
+    disconnect(this->document(), &QTextDocument::contentsChange, this,
+               &DraculaCppSyntaxHighlighter::onContentsChange);
+  }
+
+  // Queued and lexed blocks are numbered in the previous document
+  pendingBlocks.clear();
+  lexedBlocks.clear();
+  inFlightShifts.clear();
+  ++documentSerial;
+  fillBlock = 0;
+
+  QSyntaxHighlighter::setDocument(document);
+  trackDocument();
+}
+
+// Connected after QSyntaxHighlighter's own handler, so blocks queued while it reformats
+// already carry the new numbering when onContentsChange runs.
+void DraculaCppSyntaxHighlighter::trackDocument() {
+  if (!document()) return;
+  lastBlockCount = document()->blockCount();
+  connect(document(), &QTextDocument::contentsChange, this,
+          &DraculaCppSyntaxHighlighter::onContentsChange);
+}
+
+void DraculaCppSyntaxHighlighter::setBackgroundThreshold(int blocks) {
+  backgroundThreshold = blocks;
+}
+
+std::uint8_t DraculaCppSyntaxHighlighter::formatId(const QTextCharFormat &format) {
+  auto it = std::find(formats.begin(), formats.end(), format);
+  if (it != formats.end()) return static_cast<std::uint8_t>(it - formats.begin());
+  formats.push_back(format);
+  return static_cast<std::uint8_t>(formats.size() - 1);
+}
+
+// The only place formats reach the document: one setFormat per resolved run.
+void DraculaCppSyntaxHighlighter::applyRuns(const std::vector<FormatRun> &blockRuns) {
+  for (const FormatRun &run : blockRuns) {
+    setFormat(run.start, run.length, formats[run.format]);
+  }
 }
 
+void DraculaCppSyntaxHighlighter::setLazy(bool enabled) { lazy = enabled; }
+
+bool DraculaCppSyntaxHighlighter::isLazy() const { return lazy; }
+
+void DraculaCppSyntaxHighlighter::setVisibleBlocks(int first, int last) {
+  visibleFirst = first;
+  visibleLast  = last;
+  if (!document() || currentEngine != Engine::Lexer || languageGrammar) return;
+
+  const int from   = std::max(0, first - kVisibleMargin);
+  QTextBlock block = document()->findBlockByNumber(from);
+  for (int number = from; block.isValid() && number <= last + kVisibleMargin; ++number) {
+    if (!hasValidTokens(block)) queueBlock(block);
+    block = block.next();
+  }
+}
+
+void DraculaCppSyntaxHighlighter::setEngine(Engine engine) {
+  if (engine == currentEngine) return;
+  currentEngine    = engine;
+  verifyMismatches = 0;
+  rehighlight();
+}
+
+DraculaCppSyntaxHighlighter::Engine DraculaCppSyntaxHighlighter::engine() const {
+  return currentEngine;
+}
+
+void DraculaCppSyntaxHighlighter::setGrammar(std::shared_ptr<const Grammar> grammar) {
+  if (grammar == languageGrammar) return;
+  languageGrammar = std::move(grammar);
+  rehighlight();
+}
+
+const Grammar *DraculaCppSyntaxHighlighter::grammar() const { return languageGrammar.get(); }
+
 void DraculaCppSyntaxHighlighter::highlightBlock(const QString &text) {
+  if (languageGrammar) {
+    highlightWithGrammar(text);
+    return;
+  }
+
+  switch (currentEngine) {
+    case Engine::Lexer:
+      highlightFromCache(text);
+      break;
+    case Engine::Regex:
+      highlightWithRules(text);
+      break;
+    case Engine::Verify:
+      verifyBlock(text);
+      break;
+  }
+}
+
+// Tokenizes the block into `tokens` and returns the lexer state for the next block.
+int DraculaCppSyntaxHighlighter::lexBlock(const QString &text) {
+  const int previous = previousBlockState();
+  tokens.clear();
+  return CppLexer::tokenize(reinterpret_cast<const char16_t *>(text.utf16()),
+                            static_cast<int>(text.size()),
+                            previous < 0 ? CppLexer::Normal : previous, tokens);
+}
+
+// Applies the block's cached tokens. On a miss the block is lexed right away if it is cheap
+// enough to do so, otherwise it is queued for the worker and left uncolored for now.
+void DraculaCppSyntaxHighlighter::highlightFromCache(const QString &text) {
+  const int previous = previousBlockState();
+  const int start    = previous < 0 ? CppLexer::Normal : previous;
+  const int revision = currentBlock().revision();
+  auto *cached       = static_cast<BlockTokens *>(currentBlockUserData());
+
+  if (!cached || cached->revision != revision || cached->startState != start) {
+    const int blockNumber = currentBlock().blockNumber();
+    const bool offscreen  = lazy && !nearViewport(blockNumber);
+    if (offscreen || !lexInline()) {
+      if (offscreen) {
+        scheduleFill(blockNumber);
+      } else {
+        pendingBlocks.push_back({blockNumber, revision, start, changeSerial, text});
+        if (!jobRunning) dispatchTimer->start();
+      }
+
+      // Keep the old end state so a pending block does not cascade into the next ones
+      setCurrentBlockState(cached ? cached->endState : start);
+      return;
+    }
+
+    if (!cached) {
+      cached = new BlockTokens;
+      setCurrentBlockUserData(cached);
+    }
+    cached->revision   = revision;
+    cached->startState = start;
+    cached->endState   = lexBlock(text);
+    cached->runs.clear();
+    coalesceTokens(reinterpret_cast<const char16_t *>(text.utf16()), tokens,
+                   tokenFormatIds.data(), cached->runs);
+    cached->runs.shrink_to_fit();
+  }
+
+  setCurrentBlockState(cached->endState);
+  applyRuns(cached->runs);
+}
+
+// Small documents are always lexed on the GUI thread. Large ones get a few blocks per event
+// loop turn, which covers typing without waiting for the worker.
+bool DraculaCppSyntaxHighlighter::lexInline() {
+  if (document()->blockCount() < backgroundThreshold) return true;
+  if (inlineBudget == 0) return false;
+
+  if (inlineBudget == kInlineBlocksPerTurn) {
+    QTimer::singleShot(0, this, [this] { inlineBudget = kInlineBlocksPerTurn; });
+  }
+  --inlineBudget;
+  return true;
+}
+
+bool DraculaCppSyntaxHighlighter::nearViewport(int blockNumber) const {
+  return blockNumber >= visibleFirst - kVisibleMargin &&
+         blockNumber <= visibleLast + kVisibleMargin;
+}
+
+// The same stamp check highlightFromCache does, for a block outside highlightBlock.
+bool DraculaCppSyntaxHighlighter::hasValidTokens(const QTextBlock &block) const {
+  const auto *cached = static_cast<const BlockTokens *>(block.userData());
+  if (!cached || cached->revision != block.revision()) return false;
+
+  return cached->startState == startState(block);
+}
+
+void DraculaCppSyntaxHighlighter::queueBlock(const QTextBlock &block) {
+  pendingBlocks.push_back(
+      {block.blockNumber(), block.revision(), startState(block), changeSerial, block.text()});
+  if (!jobRunning) dispatchTimer->start();
+}
+
+void DraculaCppSyntaxHighlighter::scheduleFill(int fromBlock) {
+  fillBlock = std::min(fillBlock, fromBlock);
+  if (!jobRunning && lexedBlocks.empty()) fillTimer->start();
+}
+
+// One idle slice: walks forward from fillBlock and queues a chunk of stale blocks for the
+// worker. The next slice runs once that chunk has been applied, so work for newly visible
+// blocks never waits behind more than one chunk.
+void DraculaCppSyntaxHighlighter::fillOffscreen() {
+  if (jobRunning || !lexedBlocks.empty() || !pendingBlocks.empty()) return;
+
+  const int blockCount = document()->blockCount();
+  if (fillBlock >= blockCount) return;
+
+  QElapsedTimer timer;
+  timer.start();
+
+  QTextBlock block = document()->findBlockByNumber(fillBlock);
+  int queued       = 0;
+  while (block.isValid() && queued < kFillChunkBlocks && timer.elapsed() < kFillSliceMs) {
+    if (!hasValidTokens(block)) {
+      queueBlock(block);
+      ++queued;
+    }
+    block = block.next();
+    ++fillBlock;
+  }
+
+  if (block.isValid() && queued == 0) fillTimer->start();
+}
+
+void DraculaCppSyntaxHighlighter::onContentsChange(int position, int, int) {
+  const int blockCount = document()->blockCount();
+  const int delta      = blockCount - lastBlockCount;
+  lastBlockCount       = blockCount;
+
+  if (delta != 0) {
+    const int first = document()->findBlock(position).blockNumber();
+
+    for (PendingBlock &pending : pendingBlocks) {
+      if (pending.serial != changeSerial) shiftBlockNumber(pending.blockNumber, first, delta);
+    }
+    for (LexedBlock &lexed : lexedBlocks) {
+      shiftBlockNumber(lexed.blockNumber, first, delta);
+    }
+    if (jobRunning) inFlightShifts.emplace_back(first, delta);
+  }
+
+  ++changeSerial;
+}
+
+void DraculaCppSyntaxHighlighter::startLexJob() {
+  if (jobRunning || pendingBlocks.empty()) return;
+
+  // Blocks can be queued more than once per turn; the last entry is the current one.
+  std::vector<PendingBlock> job;
+  job.swap(pendingBlocks);
+  std::stable_sort(job.begin(), job.end(), [](const PendingBlock &a, const PendingBlock &b) {
+    return a.blockNumber < b.blockNumber;
+  });
+  auto last = job.begin();
+  for (auto it = job.begin(); it != job.end(); ++it) {
+    if (it->blockNumber < 0) continue;
+    if (last != job.begin() && std::prev(last)->blockNumber == it->blockNumber) {
+      *std::prev(last) = std::move(*it);
+    } else {
+      if (last != it) *last = std::move(*it);
+      ++last;
+    }
+  }
+  job.erase(last, job.end());
+
+  jobRunning = true;
+  inFlightShifts.clear();
+
+  lexerPool.start([this, job = std::move(job), formatIds = tokenFormatIds,
+                   forDocument = documentSerial] {
+    std::vector<LexedBlock> results;
+    results.reserve(job.size());
+
+    std::vector<Token> scratch;
+    int state    = CppLexer::Normal;
+    int previous = -2;
+    for (const PendingBlock &pending : job) {
+      const auto *text = reinterpret_cast<const char16_t *>(pending.text.constData());
+
+      LexedBlock lexed;
+      lexed.blockNumber = pending.blockNumber;
+      lexed.revision    = pending.revision;
+      lexed.length      = static_cast<int>(pending.text.size());
+      // Consecutive blocks chain the state computed here rather than the GUI's guess
+      lexed.startState = pending.blockNumber == previous + 1 ? state : pending.startState;
+
+      scratch.clear();
+      lexed.endState = CppLexer::tokenize(text, lexed.length, lexed.startState, scratch);
+      coalesceTokens(text, scratch, formatIds.data(), lexed.runs);
+
+      state    = lexed.endState;
+      previous = pending.blockNumber;
+      results.push_back(std::move(lexed));
+    }
+
+    QMetaObject::invokeMethod(
+        this,
+        [this, forDocument, results = std::move(results)]() mutable {
+          finishLexJob(forDocument, std::move(results));
+        },
+        Qt::QueuedConnection);
+  });
+}
+
+void DraculaCppSyntaxHighlighter::finishLexJob(int forDocument, std::vector<LexedBlock> results) {
+  jobRunning = false;
+  if (forDocument != documentSerial) results.clear();
+
+  for (LexedBlock &lexed : results) {
+    for (const auto &[first, delta] : inFlightShifts) {
+      shiftBlockNumber(lexed.blockNumber, first, delta);
+    }
+    lexedBlocks.push_back(std::move(lexed));
+  }
+  inFlightShifts.clear();
+
+  applyLexedBlocks();
+  if (!pendingBlocks.empty()) dispatchTimer->start();
+}
+
+// Stores worker results on their blocks and recolors them, a time slice at a time. A result
+// is dropped when its block was edited since; the edit queued a fresh entry already.
+void DraculaCppSyntaxHighlighter::applyLexedBlocks() {
+  QElapsedTimer timer;
+  timer.start();
+
+  while (!lexedBlocks.empty() && timer.elapsed() < kApplySliceMs) {
+    LexedBlock lexed = std::move(lexedBlocks.front());
+    lexedBlocks.pop_front();
+    if (lexed.blockNumber < 0) continue;
+
+    QTextBlock block = document()->findBlockByNumber(lexed.blockNumber);
+    if (!block.isValid() || block.revision() != lexed.revision ||
+        block.length() - 1 != lexed.length) {
+      continue;
+    }
+
+    auto *cached = static_cast<BlockTokens *>(block.userData());
+    if (!cached) {
+      cached = new BlockTokens;
+      block.setUserData(cached);
+    }
+    cached->revision   = lexed.revision;
+    cached->startState = lexed.startState;
+    cached->endState   = lexed.endState;
+    cached->runs       = std::move(lexed.runs);
+    rehighlightBlock(block);
+  }
+
+  if (!lexedBlocks.empty()) {
+    applyTimer->start();
+  } else if (!jobRunning && pendingBlocks.empty() && fillBlock < document()->blockCount()) {
+    fillTimer->start();
+  }
+}
+
+void DraculaCppSyntaxHighlighter::highlightWithLexer(const QString &text) {
+  setCurrentBlockState(lexBlock(text));
+  runs.clear();
+  coalesceTokens(reinterpret_cast<const char16_t *>(text.utf16()), tokens, tokenFormatIds.data(),
+                 runs);
+  applyRuns(runs);
+}
+
+// Grammar languages are lexed inline: one Dfa pass per block is cheap enough to need no
+// cache or worker.
+void DraculaCppSyntaxHighlighter::highlightWithGrammar(const QString &text) {
+  const auto *chars  = reinterpret_cast<const char16_t *>(text.utf16());
+  const int previous = previousBlockState();
+  tokens.clear();
+  setCurrentBlockState(languageGrammar->tokenize(chars, static_cast<int>(text.size()),
+                                                 previous < 0 ? 0 : previous, tokens));
+  runs.clear();
+  coalesceTokens(chars, tokens, tokenFormatIds.data(), runs);
+  applyRuns(runs);
+}
+
+void DraculaCppSyntaxHighlighter::highlightWithRules(const QString &text) {
+  setCurrentBlockState(resolveRules(text));
+  runs.clear();
+  ruleResolver.resolve(reinterpret_cast<const char16_t *>(text.utf16()), runs);
+  applyRuns(runs);
+}
+
+// Runs the original regex rules over the block into ruleResolver without touching the
+// document. Returns the multi-line comment state (Normal or InComment) for the next block.
+int DraculaCppSyntaxHighlighter::resolveRules(const QString &text) {
+  ruleResolver.reset(static_cast<int>(text.size()));
+
+  // A rule's priority is its position in the list, multi-line comments come last
+  std::uint8_t priority = 0;
   for (const HighlightingRule &rule : std::as_const(highlightingRules)) {
     QRegularExpressionMatchIterator matchIterator = rule.pattern.globalMatch(text);
     while (matchIterator.hasNext()) {
       QRegularExpressionMatch match = matchIterator.next();
-      setFormat(match.capturedStart(), match.capturedLength(), rule.format);
+      ruleResolver.add(match.capturedStart(), match.capturedLength(), rule.formatId, priority);
     }
+    ++priority;
   }
 
-  // Handle multi-line comments
-  setCurrentBlockState(0);
+  // Handle multi-line comments. The delimiters are plain pairs, found with the vector scans
+  const auto *chars = reinterpret_cast<const char16_t *>(text.utf16());
+  const int length  = static_cast<int>(text.size());
+  int state         = CppLexer::Normal;
 
   int startIndex = 0;
 
   // Check if the previous block ended with a multi-line comment
-  if (previousBlockState() != 1) {
-    startIndex = text.indexOf(commentStartExpression);
+  if (previousBlockState() != CppLexer::InComment) {
+    startIndex = scan::findPair(chars, length, 0, u'/', u'*');
   }
 
   // Iterate through the entire block of text to find multi-line comments
-  while (startIndex >= 0) {
+  while (startIndex < length) {
     // Find the end of the multi-line comment
-    QRegularExpressionMatch match = commentEndExpression.match(text, startIndex);
-    int endIndex                  = match.capturedStart();
-    int commentLength             = 0;
+    const int endIndex = scan::findPair(chars, length, startIndex, u'*', u'/');
+    int commentLength  = 0;
 
-    if (endIndex == -1) {
+    if (endIndex == length) {
       // No end expression found, comment continues to the next block
-      setCurrentBlockState(1);
-      commentLength = text.length() - startIndex; // Extend to the end of the block
+      state         = CppLexer::InComment;
+      commentLength = length - startIndex; // Extend to the end of the block
     } else {
       // End expression found
-      commentLength = endIndex - startIndex + match.capturedLength();
+      commentLength = endIndex - startIndex + 2;
     }
 
-    setFormat(startIndex, commentLength, multiLineCommentFormat);
+    ruleResolver.add(startIndex, commentLength, multiLineCommentFormatId, priority);
     // Find the next comment start expression in the text after the current
     // comment
-    startIndex = text.indexOf(commentStartExpression, startIndex + commentLength);
+    startIndex = scan::findPair(chars, length, startIndex + commentLength, u'/', u'*');
+  }
+
+  return state;
+}
+
+// Highlights with the lexer, then resolves the regex rules off-document and reports the first
+// character whose color or weight differs.
+void DraculaCppSyntaxHighlighter::verifyBlock(const QString &text) {
+  highlightWithLexer(text);
+
+  // The rules only track block comments, so blocks that continue a raw string, a spliced
+  // line or an `#if 0` region have nothing to be compared with.
+  const int previous = previousBlockState();
+  if (previous > CppLexer::InComment) return;
+  resolveRules(text);
+
+  std::vector<int> lexed(text.size(), -1);
+  for (const FormatRun &run : runs) {
+    std::fill_n(lexed.begin() + run.start, run.length, run.format);
+  }
+
+  auto color = [this](int format) {
+    return format >= 0 ? formats[format].foreground().color().name() : QString("plain");
+  };
+  auto weight = [this](int format) {
+    return format >= 0 ? formats[format].fontWeight() : static_cast<int>(QFont::Normal);
+  };
+
+  for (size_t i = 0; i < lexed.size(); ++i) {
+    const int expected = ruleResolver.formatAt(static_cast<int>(i));
+
+    // Runs also cover the blanks between merged tokens; those cannot differ visibly
+    if (text.at(i).isSpace()) continue;
+    if (color(lexed[i]) == color(expected) && weight(lexed[i]) == weight(expected)) continue;
+
+    ++verifyMismatches;
+    qWarning().noquote() << QString("highlight verify: line %1 column %2: lexer %3, regex %4 "
+                                    "(%5 mismatched blocks)")
+                                .arg(currentBlock().blockNumber() + 1)
+                                .arg(i + 1)
+                                .arg(color(lexed[i]), color(expected))
+                                .arg(verifyMismatches);
+    break;
   }
 }
@@ -3,29 +3,165 @@
 
 #include <QRegularExpression>
 #include <QSyntaxHighlighter>
+#include <QTextBlockUserData>
 #include <QTextCharFormat>
+#include <QThreadPool>
+#include <QTimer>
+#include <array>
+#include <deque>
+#include <memory>
+#include <utility>
+#include <vector>
 
+#include "formatruns.hpp"
+#include "grammar.hpp"
 #include "highlight.moc"
+#include "lexer.hpp"
+
+// Lexer output cached on a block as resolved format runs. It is only used while the stamp
+// still matches: the block revision it was computed for and the lexer state it started in.
+class BlockTokens : public QTextBlockUserData {
+public:
+  int revision   = -1;
+  int startState = CppLexer::Normal;
+  int endState   = CppLexer::Normal;
+  std::vector<FormatRun> runs;
+};
 
 class DraculaCppSyntaxHighlighter : public QSyntaxHighlighter {
   Q_OBJECT
 public:
+  // Lexer colors blocks with the single-pass CppLexer. Regex uses the original rule list.
+  // Verify colors with the lexer and reports every block where the regex rules disagree.
+  // The initial engine can be picked with EDIT_HIGHLIGHT_ENGINE=lexer|regex|verify.
+  enum class Engine { Lexer, Regex, Verify };
+
   DraculaCppSyntaxHighlighter(QTextDocument* parent = nullptr);
+  ~DraculaCppSyntaxHighlighter() override;
+
+  // Hides QSyntaxHighlighter::setDocument, which is not virtual, so that edits to the new
+  // document are tracked. Set the document through this class.
+  void setDocument(QTextDocument* document);
+
+  void setEngine(Engine engine);
+  [[nodiscard]] Engine engine() const;
+
+  // Colors the document with a data-driven grammar instead of the C/C++ engines. Null goes
+  // back to C/C++.
+  void setGrammar(std::shared_ptr<const Grammar> grammar);
+  [[nodiscard]] const Grammar* grammar() const;
+
+  // Documents with at least this many blocks are tokenized on a worker thread. Blocks whose
+  // tokens are not back yet stay uncolored instead of stalling the GUI thread.
+  void setBackgroundThreshold(int blocks);
+
+  // In lazy mode only blocks around the visible range are highlighted when they change; the
+  // rest of the document is filled in by idle time slices that run while the worker is free.
+  void setLazy(bool enabled);
+  [[nodiscard]] bool isLazy() const;
+
+  // Tells the highlighter which blocks are on screen. Stale blocks in that range jump ahead
+  // of the idle fill.
+  void setVisibleBlocks(int first, int last);
 
 protected:
   void highlightBlock(const QString& text) override;
 
 private:
+  // Rules are resolved by priority, which is their position in the list: later rules win
+  // where they overlap earlier ones, and multi-line comments win over everything. There are
+  // fewer than 255 rules, so the position fits the resolver's 8-bit priority.
   struct HighlightingRule {
     QRegularExpression pattern;
     QTextCharFormat format;
+    std::uint8_t formatId = 0;
   };
 
   QVector<HighlightingRule> highlightingRules;
 
-  QRegularExpression commentStartExpression;
-  QRegularExpression commentEndExpression;
   QTextCharFormat multiLineCommentFormat;
+
+  // Distinct formats; format runs refer to them by index
+  std::vector<QTextCharFormat> formats;
+  std::array<std::uint8_t, static_cast<size_t>(TokenKind::Count)> tokenFormatIds{};
+  std::uint8_t multiLineCommentFormatId = 0;
+
+  // Lexer state
+  Engine currentEngine = Engine::Lexer;
+  std::shared_ptr<const Grammar> languageGrammar;
+  std::vector<Token> tokens;   // reused between blocks to avoid reallocating
+  std::vector<FormatRun> runs; // same
+  FormatRunResolver ruleResolver;
+  int verifyMismatches = 0;
+
+  // Background tokenization. Blocks are queued by number together with the revision and
+  // start state they were seen with; the worker lexes them in order and the results are
+  // applied back in time slices once they are validated against the live block.
+  struct PendingBlock {
+    int blockNumber;
+    int revision;
+    int startState;
+    int serial; // contentsChange serial whose block numbering this entry uses
+    QString text;
+  };
+
+  struct LexedBlock {
+    int blockNumber;
+    int revision;
+    int length;
+    int startState;
+    int endState;
+    std::vector<FormatRun> runs;
+  };
+
+  static constexpr int kInlineBlocksPerTurn = 32;
+  static constexpr int kApplySliceMs        = 8;
+  static constexpr int kFillSliceMs         = 4;
+  static constexpr int kFillChunkBlocks     = 512;
+  static constexpr int kVisibleMargin       = 20;
+
+  QThreadPool lexerPool;
+  QTimer* dispatchTimer;
+  QTimer* applyTimer;
+  QTimer* fillTimer;
+  std::vector<PendingBlock> pendingBlocks;         // waiting for the worker
+  std::deque<LexedBlock> lexedBlocks;              // back from the worker, not applied
+  std::vector<std::pair<int, int>> inFlightShifts; // (first block, delta) during a job
+  bool jobRunning         = false;
+  int documentSerial      = 0; // set documents so far; a job for an earlier one is dropped
+  int changeSerial        = 0;
+  int lastBlockCount      = 0;
+  int inlineBudget        = kInlineBlocksPerTurn;
+  int backgroundThreshold = 2000;
+
+  // Lazy mode
+  bool lazy        = false;
+  int visibleFirst = 0;
+  int visibleLast  = 100;
+  int fillBlock    = 0; // first block the idle fill has not looked at yet
+
+  void trackDocument();
+  void onContentsChange(int position, int charsRemoved, int charsAdded);
+  bool lexInline();
+  bool nearViewport(int blockNumber) const;
+  bool hasValidTokens(const QTextBlock& block) const;
+  void queueBlock(const QTextBlock& block);
+  void scheduleFill(int fromBlock);
+  void fillOffscreen();
+  void startLexJob();
+  void finishLexJob(int forDocument, std::vector<LexedBlock> results);
+  void applyLexedBlocks();
+
+  std::uint8_t formatId(const QTextCharFormat& format);
+  void applyRuns(const std::vector<FormatRun>& blockRuns);
+
+  int lexBlock(const QString& text);
+  void highlightFromCache(const QString& text);
+  void highlightWithLexer(const QString& text);
+  void highlightWithGrammar(const QString& text);
+  void highlightWithRules(const QString& text);
+  void verifyBlock(const QString& text);
+  int resolveRules(const QString& text);
 };
 
 #endif /* C7005E20_38B5_4A1A_A4D4_D097DB950A3E */
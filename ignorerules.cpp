@@ -0,0 +1,148 @@
+#include "ignorerules.hpp"
+
+namespace {
+
+// Matches a bracket expression at `p` against `c`. Sets `end` past the closing ']', or
+// returns false with `end` unset if there is none, in which case '[' is a literal.
+bool matchClass(const char *p, const char *pend, char c, bool &matched, const char *&end) {
+  const char *q      = p + 1;
+  const bool negated = q < pend && (*q == '!' || *q == '^');
+  if (negated) ++q;
+
+  bool found        = false;
+  const char *first = q;
+  while (q < pend && (*q != ']' || q == first)) {
+    char low = *q;
+    if (low == '\\' && q + 1 < pend) low = *++q;
+    char high = low;
+    if (q + 2 < pend && q[1] == '-' && q[2] != ']') {
+      q += 2;
+      high = *q;
+      if (high == '\\' && q + 1 < pend) high = *++q;
+    }
+    if (low <= c && c <= high) found = true;
+    ++q;
+  }
+  if (q == pend) return false;
+
+  matched = found != negated;
+  end     = q + 1;
+  return true;
+}
+
+// Glob match where '*' and '?' stop at '/' and a '**' component spans directories.
+bool globMatch(const char *pbegin, const char *p, const char *pend, const char *s,
+               const char *send) {
+  while (p < pend) {
+    if (*p == '*') {
+      const bool twice = p + 1 < pend && p[1] == '*';
+      if (twice && (p == pbegin || p[-1] == '/') && (p + 2 == pend || p[2] == '/')) {
+        // "/**" at the end matches everything inside; "**/" matches zero or more directories
+        if (p + 2 == pend) return true;
+        const char *rest = p + 3;
+        if (globMatch(pbegin, rest, pend, s, send)) return true;
+        for (const char *t = s; t < send; ++t) {
+          if (*t == '/' && globMatch(pbegin, rest, pend, t + 1, send)) return true;
+        }
+        return false;
+      }
+
+      while (p < pend && *p == '*') ++p;
+      for (const char *t = s;; ++t) {
+        if (globMatch(pbegin, p, pend, t, send)) return true;
+        if (t == send || *t == '/') return false;
+      }
+    }
+
+    if (s == send) return false;
+
+    if (*p == '?') {
+      if (*s == '/') return false;
+      ++p;
+      ++s;
+      continue;
+    }
+
+    if (*p == '[') {
+      bool matched    = false;
+      const char *end = nullptr;
+      if (matchClass(p, pend, *s, matched, end)) {
+        if (!matched || *s == '/') return false;
+        p = end;
+        ++s;
+        continue;
+      }
+    }
+
+    char c = *p;
+    if (c == '\\' && p + 1 < pend) c = *++p;
+    if (c != *s) return false;
+    ++p;
+    ++s;
+  }
+  return s == send;
+}
+
+} // namespace
+
+IgnoreRules::IgnoreRules(std::string_view text) {
+  while (!text.empty()) {
+    const std::size_t newline = text.find('\n');
+    std::string_view line     = text.substr(0, newline);
+    text.remove_prefix(newline == std::string_view::npos ? text.size() : newline + 1);
+
+    if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+    // Trailing spaces are dropped unless escaped
+    while (!line.empty() && line.back() == ' ' &&
+           !(line.size() >= 2 && line[line.size() - 2] == '\\')) {
+      line.remove_suffix(1);
+    }
+    if (line.empty() || line.front() == '#') continue;
+
+    Rule rule{{}, false, false, false};
+    if (line.front() == '!') {
+      rule.negated = true;
+      line.remove_prefix(1);
+    }
+    if (!line.empty() && line.back() == '/') {
+      rule.dirOnly = true;
+      line.remove_suffix(1);
+    }
+    rule.anchored = line.find('/') != std::string_view::npos;
+    if (!line.empty() && line.front() == '/') line.remove_prefix(1);
+    if (line.empty()) continue;
+
+    rule.pattern = line;
+    rules.push_back(std::move(rule));
+  }
+}
+
+IgnoreRules::Match IgnoreRules::match(std::string_view path, bool isDir) const {
+  const std::size_t slash     = path.rfind('/');
+  const std::string_view name = slash == std::string_view::npos ? path : path.substr(slash + 1);
+
+  for (auto rule = rules.rbegin(); rule != rules.rend(); ++rule) {
+    if (rule->dirOnly && !isDir) continue;
+    const std::string_view subject = rule->anchored ? path : name;
+    const char *p                  = rule->pattern.data();
+    if (globMatch(p, p, p + rule->pattern.size(), subject.data(),
+                  subject.data() + subject.size())) {
+      return rule->negated ? Match::Included : Match::Ignored;
+    }
+  }
+  return Match::None;
+}
+
+bool isIgnored(const std::vector<IgnoreScope> &scopes, std::string_view path, bool isDir) {
+  const std::size_t slash = path.rfind('/');
+  if (isDir && path.substr(slash == std::string_view::npos ? 0 : slash + 1) == ".git") {
+    return true;
+  }
+
+  for (auto scope = scopes.rbegin(); scope != scopes.rend(); ++scope) {
+    if (!scope->rules || path.substr(0, scope->base.size()) != scope->base) continue;
+    const auto match = scope->rules->match(path.substr(scope->base.size()), isDir);
+    if (match != IgnoreRules::Match::None) return match == IgnoreRules::Match::Ignored;
+  }
+  return false;
+}
@@ -0,0 +1,45 @@
+#ifndef DE66ED06_ED24_4D94_8970_70164602F755
+#define DE66ED06_ED24_4D94_8970_70164602F755
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// The patterns of one .gitignore file. Supports what git documents: comments, negation with
+// '!', a trailing '/' for directories only, anchoring by a '/' anywhere but at the end, the
+// wildcards '*', '?' and '[...]', '**' between slashes, and '\' escapes.
+class IgnoreRules {
+public:
+  enum class Match { None, Ignored, Included };
+
+  IgnoreRules() = default;
+  explicit IgnoreRules(std::string_view text);
+
+  // Matches `path`, relative to the directory of the .gitignore and separated by '/'. The last
+  // matching pattern decides; None if no pattern matches.
+  [[nodiscard]] Match match(std::string_view path, bool isDir) const;
+  [[nodiscard]] bool empty() const { return rules.empty(); }
+
+private:
+  struct Rule {
+    std::string pattern;
+    bool negated;
+    bool dirOnly;
+    bool anchored; // matched against the whole path instead of the last component
+  };
+  std::vector<Rule> rules;
+};
+
+// The .gitignore files that apply to one directory of a project, outermost first. `base` is
+// where each one lives, relative to the project root, with a trailing '/' unless empty.
+struct IgnoreScope {
+  std::shared_ptr<const IgnoreRules> rules;
+  std::string base;
+};
+
+// True if `path`, relative to the project root, is ignored. Files nearer to the path take
+// precedence, as in git. The .git directory is always ignored.
+bool isIgnored(const std::vector<IgnoreScope> &scopes, std::string_view path, bool isDir);
+
+#endif /* DE66ED06_ED24_4D94_8970_70164602F755 */
@@ -0,0 +1,114 @@
+#include "jobrunner.hpp"
+
+#include <QTimer>
+#include <utility>
+
+JobRunner::JobRunner(QObject *parent)
+    : QObject(parent), killTimer(new QTimer(this)), flushTimer(new QTimer(this)) {
+  killTimer->setSingleShot(true);
+  killTimer->setInterval(killDelayMs);
+  connect(killTimer, &QTimer::timeout, this, [this] {
+    if (process) process->kill();
+  });
+  flushTimer->setSingleShot(true);
+  flushTimer->setInterval(flushDelayMs);
+  connect(flushTimer, &QTimer::timeout, this, &JobRunner::flush);
+}
+
+JobRunner::~JobRunner() {
+  if (!process) return;
+  process->disconnect(this);
+  process->kill();
+  process->waitForFinished(killDelayMs);
+}
+
+void JobRunner::start(const QList<Job> &jobs) {
+  const bool running = isRunning();
+  // The stopped job's finished() goes on with the new queue
+  if (running) stop();
+  queue = jobs;
+  if (running || queue.isEmpty()) return;
+  emit runningChanged(true);
+  next();
+}
+
+void JobRunner::stop() {
+  queue.clear();
+  if (!process || stopping) return;
+  stopping = true;
+  process->terminate();
+  killTimer->start();
+}
+
+void JobRunner::next() {
+  if (queue.isEmpty()) {
+    emit runningChanged(false);
+    return;
+  }
+
+  current       = queue.takeFirst();
+  stopping      = false;
+  stdoutDecoder = QStringDecoder(QStringDecoder::System);
+  stderrDecoder = QStringDecoder(QStringDecoder::System);
+
+  // A process per job, so that no signal is ever connected twice
+  process = new QProcess(this);
+  process->setWorkingDirectory(current.workingDirectory);
+  process->setProgram(current.program);
+  process->setArguments(current.arguments);
+  connect(process, &QProcess::readyReadStandardOutput, this,
+          [this] { read(QProcess::StandardOutput); });
+  connect(process, &QProcess::readyReadStandardError, this,
+          [this] { read(QProcess::StandardError); });
+  connect(process, &QProcess::errorOccurred, this, [this](QProcess::ProcessError error) {
+    // No finished() follows this one
+    if (error == QProcess::FailedToStart) {
+      finish(Outcome::FailedToStart, -1, process->errorString());
+    }
+  });
+  connect(process, &QProcess::finished, this, [this](int exitCode, QProcess::ExitStatus status) {
+    if (stopping) {
+      finish(Outcome::Stopped, exitCode, {});
+    } else {
+      finish(status == QProcess::CrashExit ? Outcome::Crashed : Outcome::Exited, exitCode, {});
+    }
+  });
+
+  emit jobStarted(current);
+  process->start();
+}
+
+void JobRunner::read(QProcess::ProcessChannel channel) {
+  if (channel == QProcess::StandardOutput) {
+    pending += QString(stdoutDecoder.decode(process->readAllStandardOutput()));
+  } else {
+    pending += QString(stderrDecoder.decode(process->readAllStandardError()));
+  }
+  if (!pending.isEmpty() && !flushTimer->isActive()) flushTimer->start();
+}
+
+void JobRunner::flush() {
+  flushTimer->stop();
+  if (!pending.isEmpty()) emit output(current.channel, std::exchange(pending, {}));
+}
+
+void JobRunner::finish(Outcome outcome, int exitCode, const QString &error) {
+  killTimer->stop();
+  // What the pipes still hold comes before the job's end
+  read(QProcess::StandardOutput);
+  read(QProcess::StandardError);
+  flush();
+
+  process->disconnect(this);
+  process->deleteLater();
+  process = nullptr;
+
+  // The jobs after a failed one depend on it. A stopped job's queue was dropped by stop(), so
+  // anything queued now was started since.
+  if (!stopping && (outcome != Outcome::Exited || exitCode != 0)) queue.clear();
+  stopping = false;
+
+  emit jobFinished(current, outcome, exitCode, error);
+  // Unless a slot started a new pipeline already
+  if (!process) next();
+}
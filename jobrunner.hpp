@@ -0,0 +1,76 @@
+#ifndef EC5A7F13_2B8D_4E61_9C07_5D1A3F6B28E4
+#define EC5A7F13_2B8D_4E61_9C07_5D1A3F6B28E4
+
+#include <QList>
+#include <QObject>
+#include <QProcess>
+#include <QString>
+#include <QStringDecoder>
+#include <QStringList>
+
+class QTimer;
+
+// Runs external programs, such as the compiler, the compiled program and objdump, without
+// blocking the GUI thread. A pipeline is a list of jobs run one after the other, each started
+// from the previous one's finished() once it exited with code 0. Output is passed on as it
+// arrives, a few times a second at most. A job can be stopped: it is asked to terminate, and
+// killed if it has not exited shortly after.
+class JobRunner : public QObject {
+  Q_OBJECT
+
+public:
+  struct Job {
+    QString name; // for messages, e.g. "Build"
+    QString program;
+    QStringList arguments;
+    QString workingDirectory;
+    int channel = 0; // passed back with the job's output, to tell where it goes
+  };
+
+  enum class Outcome {
+    Exited,        // with an exit code, which may not be 0
+    Crashed,       // or was killed by a signal from elsewhere
+    Stopped,       // by stop()
+    FailedToStart, // the program was not found or could not be executed
+  };
+
+  static constexpr int killDelayMs  = 3000; // after terminating, before killing
+  static constexpr int flushDelayMs = 50;   // output is collected this long before it is passed on
+
+  explicit JobRunner(QObject *parent = nullptr);
+  ~JobRunner() override; // kills the running job
+
+  // Runs `jobs` in order. A pipeline that is still running is stopped first.
+  void start(const QList<Job> &jobs);
+  // Stops the running job; the jobs queued after it are dropped.
+  void stop();
+  [[nodiscard]] bool isRunning() const { return process != nullptr; }
+
+signals:
+  void jobStarted(const JobRunner::Job &job);
+  // Standard output and error, in the order they arrived as far as the pipes tell.
+  void output(int channel, const QString &text);
+  // `exitCode` is only meaningful for Outcome::Exited; `error` only for FailedToStart.
+  void jobFinished(const JobRunner::Job &job, JobRunner::Outcome outcome, int exitCode,
+                   const QString &error);
+  // A pipeline started or ran out of jobs, because all of them ran or one failed.
+  void runningChanged(bool running);
+
+private:
+  QList<Job> queue; // jobs after the running one
+  Job current;
+  QProcess *process = nullptr;
+  bool stopping     = false; // stop() was called for `process`
+  QTimer *killTimer;
+  QTimer *flushTimer;
+  QString pending; // output not passed on yet
+  QStringDecoder stdoutDecoder;
+  QStringDecoder stderrDecoder;
+
+  void next();
+  void read(QProcess::ProcessChannel channel);
+  void flush();
+  void finish(Outcome outcome, int exitCode, const QString &error);
+};
+
+#endif /* EC5A7F13_2B8D_4E61_9C07_5D1A3F6B28E4 */
@@ -0,0 +1,323 @@
+#ifndef D889031E_9F80_4C7A_B6CC_B701C9655BA1
+#define D889031E_9F80_4C7A_B6CC_B701C9655BA1
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <string_view>
+
+// Keyword and builtin type table shared by the lexer and the completer. The table is turned
+// into a perfect hash at compile time (hash and displace), so classifying an identifier costs
+// one FNV-1a pass, two table reads and a compare, and never allocates.
+namespace keywords {
+
+enum class Kind : std::uint8_t { None, Keyword, Type };
+
+struct Entry {
+  std::string_view word;
+  Kind kind;
+};
+
+inline constexpr Entry kTable[] = {
+    // C
+    {"auto", Kind::Keyword},
+    {"break", Kind::Keyword},
+    {"case", Kind::Keyword},
+    {"const", Kind::Keyword},
+    {"continue", Kind::Keyword},
+    {"default", Kind::Keyword},
+    {"do", Kind::Keyword},
+    {"else", Kind::Keyword},
+    {"enum", Kind::Keyword},
+    {"extern", Kind::Keyword},
+    {"for", Kind::Keyword},
+    {"goto", Kind::Keyword},
+    {"if", Kind::Keyword},
+    {"inline", Kind::Keyword},
+    {"register", Kind::Keyword},
+    {"restrict", Kind::Keyword},
+    {"return", Kind::Keyword},
+    {"sizeof", Kind::Keyword},
+    {"static", Kind::Keyword},
+    {"struct", Kind::Keyword},
+    {"switch", Kind::Keyword},
+    {"typedef", Kind::Keyword},
+    {"union", Kind::Keyword},
+    {"volatile", Kind::Keyword},
+    {"while", Kind::Keyword},
+    {"_Alignas", Kind::Keyword},
+    {"_Alignof", Kind::Keyword},
+    {"_Atomic", Kind::Keyword},
+    {"_Generic", Kind::Keyword},
+    {"_Noreturn", Kind::Keyword},
+    {"_Static_assert", Kind::Keyword},
+    {"_Thread_local", Kind::Keyword},
+
+    // C++
+    {"alignas", Kind::Keyword},
+    {"alignof", Kind::Keyword},
+    {"and", Kind::Keyword},
+    {"and_eq", Kind::Keyword},
+    {"asm", Kind::Keyword},
+    {"bitand", Kind::Keyword},
+    {"bitor", Kind::Keyword},
+    {"catch", Kind::Keyword},
+    {"class", Kind::Keyword},
+    {"co_await", Kind::Keyword},
+    {"co_return", Kind::Keyword},
+    {"co_yield", Kind::Keyword},
+    {"compl", Kind::Keyword},
+    {"concept", Kind::Keyword},
+    {"const_cast", Kind::Keyword},
+    {"consteval", Kind::Keyword},
+    {"constexpr", Kind::Keyword},
+    {"constinit", Kind::Keyword},
+    {"decltype", Kind::Keyword},
+    {"delete", Kind::Keyword},
+    {"dynamic_cast", Kind::Keyword},
+    {"explicit", Kind::Keyword},
+    {"export", Kind::Keyword},
+    {"false", Kind::Keyword},
+    {"final", Kind::Keyword},
+    {"friend", Kind::Keyword},
+    {"mutable", Kind::Keyword},
+    {"namespace", Kind::Keyword},
+    {"new", Kind::Keyword},
+    {"noexcept", Kind::Keyword},
+    {"not", Kind::Keyword},
+    {"not_eq", Kind::Keyword},
+    {"nullptr", Kind::Keyword},
+    {"operator", Kind::Keyword},
+    {"or", Kind::Keyword},
+    {"or_eq", Kind::Keyword},
+    {"override", Kind::Keyword},
+    {"private", Kind::Keyword},
+    {"protected", Kind::Keyword},
+    {"public", Kind::Keyword},
+    {"reinterpret_cast", Kind::Keyword},
+    {"requires", Kind::Keyword},
+    {"static_assert", Kind::Keyword},
+    {"static_cast", Kind::Keyword},
+    {"template", Kind::Keyword},
+    {"this", Kind::Keyword},
+    {"thread_local", Kind::Keyword},
+    {"throw", Kind::Keyword},
+    {"true", Kind::Keyword},
+    {"try", Kind::Keyword},
+    {"typeid", Kind::Keyword},
+    {"typename", Kind::Keyword},
+    {"using", Kind::Keyword},
+    {"virtual", Kind::Keyword},
+    {"xor", Kind::Keyword},
+    {"xor_eq", Kind::Keyword},
+
+    // Builtin types
+    {"void", Kind::Type},
+    {"bool", Kind::Type},
+    {"char", Kind::Type},
+    {"char8_t", Kind::Type},
+    {"char16_t", Kind::Type},
+    {"char32_t", Kind::Type},
+    {"wchar_t", Kind::Type},
+    {"short", Kind::Type},
+    {"int", Kind::Type},
+    {"long", Kind::Type},
+    {"signed", Kind::Type},
+    {"unsigned", Kind::Type},
+    {"float", Kind::Type},
+    {"double", Kind::Type},
+    {"_Bool", Kind::Type},
+    {"_Complex", Kind::Type},
+
+    // stdint.h
+    {"int8_t", Kind::Type},
+    {"int16_t", Kind::Type},
+    {"int32_t", Kind::Type},
+    {"int64_t", Kind::Type},
+    {"uint8_t", Kind::Type},
+    {"uint16_t", Kind::Type},
+    {"uint32_t", Kind::Type},
+    {"uint64_t", Kind::Type},
+    {"int_fast8_t", Kind::Type},
+    {"int_fast16_t", Kind::Type},
+    {"int_fast32_t", Kind::Type},
+    {"int_fast64_t", Kind::Type},
+    {"uint_fast8_t", Kind::Type},
+    {"uint_fast16_t", Kind::Type},
+    {"uint_fast32_t", Kind::Type},
+    {"uint_fast64_t", Kind::Type},
+    {"int_least8_t", Kind::Type},
+    {"int_least16_t", Kind::Type},
+    {"int_least32_t", Kind::Type},
+    {"int_least64_t", Kind::Type},
+    {"uint_least8_t", Kind::Type},
+    {"uint_least16_t", Kind::Type},
+    {"uint_least32_t", Kind::Type},
+    {"uint_least64_t", Kind::Type},
+    {"intmax_t", Kind::Type},
+    {"uintmax_t", Kind::Type},
+    {"intptr_t", Kind::Type},
+    {"uintptr_t", Kind::Type},
+
+    // stddef.h
+    {"size_t", Kind::Type},
+    {"ptrdiff_t", Kind::Type},
+    {"max_align_t", Kind::Type},
+    {"nullptr_t", Kind::Type},
+
+    // Qt
+    {"signals", Kind::Keyword},
+    {"slots", Kind::Keyword},
+    {"emit", Kind::Keyword},
+    {"foreach", Kind::Keyword},
+    {"forever", Kind::Keyword},
+    {"Q_OBJECT", Kind::Keyword},
+    {"Q_GADGET", Kind::Keyword},
+    {"Q_SIGNALS", Kind::Keyword},
+    {"Q_SLOTS", Kind::Keyword},
+    {"Q_EMIT", Kind::Keyword},
+    {"Q_PROPERTY", Kind::Keyword},
+    {"Q_INVOKABLE", Kind::Keyword},
+    {"Q_ENUM", Kind::Keyword},
+    {"qint8", Kind::Type},
+    {"qint16", Kind::Type},
+    {"qint32", Kind::Type},
+    {"qint64", Kind::Type},
+    {"quint8", Kind::Type},
+    {"quint16", Kind::Type},
+    {"quint32", Kind::Type},
+    {"quint64", Kind::Type},
+    {"qintptr", Kind::Type},
+    {"quintptr", Kind::Type},
+    {"qreal", Kind::Type},
+    {"qsizetype", Kind::Type},
+};
+
+inline constexpr std::size_t kCount = std::size(kTable);
+
+namespace detail {
+
+inline constexpr std::size_t kBuckets   = 64;  // first level, power of two
+inline constexpr std::size_t kSlots     = 512; // second level, power of two
+inline constexpr std::size_t kMaxBucket = 16;
+
+// FNV-1a over code units so char and char16_t spellings hash the same. lookup() inlines the
+// same loop to reject non-ASCII input in the same pass.
+template <typename CharT>
+constexpr std::uint64_t hash(const CharT *s, std::size_t n) {
+  std::uint64_t h = 0xcbf29ce484222325ull;
+  for (std::size_t i = 0; i < n; ++i) {
+    h ^= static_cast<std::uint64_t>(s[i]);
+    h *= 0x100000001b3ull;
+  }
+  return h;
+}
+
+// Second level slot for a key hash under the bucket's displacement.
+constexpr std::size_t slot(std::uint64_t h, std::uint16_t displacement) {
+  std::uint64_t x = (h >> 32) ^ (h << 7) ^ (displacement * 0x9e3779b97f4a7c15ull);
+  x ^= x >> 29;
+  x *= 0xbf58476d1ce4e5b9ull;
+  x ^= x >> 32;
+  return static_cast<std::size_t>(x & (kSlots - 1));
+}
+
+struct PerfectHash {
+  std::uint16_t displacement[kBuckets] = {};
+  std::int16_t slots[kSlots]           = {};
+  bool ok                              = false;
+};
+
+constexpr PerfectHash build() {
+  PerfectHash table;
+  for (auto &entry : table.slots) entry = -1;
+
+  std::uint64_t hashes[kCount]              = {};
+  std::size_t members[kBuckets][kMaxBucket] = {};
+  std::size_t sizes[kBuckets]               = {};
+  for (std::size_t i = 0; i < kCount; ++i) {
+    hashes[i]                = hash(kTable[i].word.data(), kTable[i].word.size());
+    const std::size_t bucket = hashes[i] & (kBuckets - 1);
+    if (sizes[bucket] == kMaxBucket) return table;
+    members[bucket][sizes[bucket]++] = i;
+  }
+
+  // Place the largest buckets first; they are the hardest to fit.
+  std::size_t order[kBuckets] = {};
+  for (std::size_t i = 0; i < kBuckets; ++i) order[i] = i;
+  for (std::size_t i = 1; i < kBuckets; ++i) {
+    for (std::size_t j = i; j > 0 && sizes[order[j]] > sizes[order[j - 1]]; --j) {
+      const std::size_t tmp = order[j];
+      order[j]              = order[j - 1];
+      order[j - 1]          = tmp;
+    }
+  }
+
+  for (std::size_t b : order) {
+    if (sizes[b] == 0) break;
+
+    bool placed = false;
+    for (std::uint32_t d = 0; d < 0x10000 && !placed; ++d) {
+      std::size_t taken[kMaxBucket] = {};
+      placed                        = true;
+      for (std::size_t m = 0; m < sizes[b] && placed; ++m) {
+        taken[m] = slot(hashes[members[b][m]], static_cast<std::uint16_t>(d));
+        if (table.slots[taken[m]] != -1) placed = false;
+        for (std::size_t k = 0; k < m && placed; ++k) {
+          if (taken[k] == taken[m]) placed = false;
+        }
+      }
+      if (!placed) continue;
+
+      table.displacement[b] = static_cast<std::uint16_t>(d);
+      for (std::size_t m = 0; m < sizes[b]; ++m) {
+        table.slots[taken[m]] = static_cast<std::int16_t>(members[b][m]);
+      }
+    }
+    if (!placed) return table;
+  }
+
+  table.ok = true;
+  return table;
+}
+
+inline constexpr PerfectHash kPerfectHash = build();
+static_assert(kPerfectHash.ok, "keyword table does not fit a perfect hash, grow kSlots");
+
+} // namespace detail
+
+// Looks up an identifier given as char or char16_t code units.
+template <typename CharT>
+constexpr Kind lookup(const CharT *s, std::size_t n) {
+  std::uint64_t h = 0xcbf29ce484222325ull;
+  for (std::size_t i = 0; i < n; ++i) {
+    const auto unit = static_cast<std::uint64_t>(s[i]);
+    if (unit > 0x7f) return Kind::None; // every keyword is ASCII
+    h ^= unit;
+    h *= 0x100000001b3ull;
+  }
+
+  const std::int16_t index =
+      detail::kPerfectHash
+          .slots[detail::slot(h, detail::kPerfectHash.displacement[h & (detail::kBuckets - 1)])];
+  if (index < 0) return Kind::None;
+
+  const Entry &entry = kTable[index];
+  if (entry.word.size() != n) return Kind::None;
+  for (std::size_t i = 0; i < n; ++i) {
+    if (static_cast<std::uint32_t>(s[i]) != static_cast<unsigned char>(entry.word[i])) {
+      return Kind::None;
+    }
+  }
+  return entry.kind;
+}
+
+inline constexpr Kind lookup(std::string_view word) { return lookup(word.data(), word.size()); }
+
+inline constexpr Kind lookup(std::u16string_view word) {
+  return lookup(word.data(), word.size());
+}
+
+} // namespace keywords
+
+#endif /* D889031E_9F80_4C7A_B6CC_B701C9655BA1 */
@@ -0,0 +1,638 @@
+#include "largetextview.hpp"
+
+#include <QClipboard>
+#include <QGuiApplication>
+#include <QKeyEvent>
+#include <QMouseEvent>
+#include <QPainter>
+#include <QScrollBar>
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+#include "lexer.hpp"
+#include "utf8.hpp"
+
+namespace {
+
+constexpr int kMargin   = 4;
+constexpr int kTabWidth = 2; // same tab stop as the editor
+
+// Only this much of a line is decoded and shown, so a file without newlines stays usable.
+// Longer lines are read-only: what is past this is never looked at, so an edit could not tell
+// the end of the shown part from the end of the line.
+constexpr std::size_t kMaxLineBytes = 64 * 1024;
+
+// Bytes of a read-only file indexed per event loop pass; a few milliseconds of scanning. The
+// indexer of a file to edit checks for cancellation as often.
+constexpr std::size_t kIndexChunk = 8 * 1024 * 1024;
+
+const QColor kBackground("#282a36");
+const QColor kForeground("#f8f8f2");
+const QColor kCurrentLine("#44475a");
+const QColor kSelection("#6272a4");
+
+// Tabs are drawn as spaces so advances can be measured on the drawn string
+QString expandTabs(QString text) { return text.replace('\t', QString(kTabWidth, ' ')); }
+
+// Column of the code point before or after `column`, stepping over surrogate pairs
+qsizetype previousColumn(const QString &text, qsizetype column) {
+  --column;
+  if (column > 0 && text[column].isLowSurrogate()) --column;
+  return column;
+}
+
+qsizetype nextColumn(const QString &text, qsizetype column) {
+  ++column;
+  if (column < text.size() && text[column].isLowSurrogate()) ++column;
+  return column;
+}
+
+} // namespace
+
+LargeTextView::LargeTextView(QWidget *parent)
+    : QAbstractScrollArea(parent), table(std::make_unique<PieceTable>()) {
+  setFocusPolicy(Qt::StrongFocus);
+  viewport()->setCursor(Qt::IBeamCursor);
+
+  QFont font = this->font();
+  font.setFixedPitch(true);
+  setFont(font);
+
+  // Same colors as the C/C++ highlighter
+  loadTheme(themePath(), formats);
+}
+
+LargeTextView::~LargeTextView() { stopIndexer(); }
+
+bool LargeTextView::openFile(const QString &fileName, QString *error, bool readOnly) {
+  closeFile();
+
+  auto opened = std::make_shared<QFile>(fileName);
+  if (!opened->open(QIODevice::ReadOnly)) {
+    if (error) *error = opened->errorString();
+    return false;
+  }
+
+  if (opened->size() > 0) {
+    const uchar *data = opened->map(0, opened->size());
+    if (!data) {
+      if (error) *error = opened->errorString();
+      return false;
+    }
+    mapped = std::string_view(reinterpret_cast<const char *>(data),
+                              static_cast<std::size_t>(opened->size()));
+  }
+  file = std::move(opened);
+
+  table.reset();
+  openedReadOnly = readOnly;
+  index          = std::make_unique<LineIndex>(mapped);
+  // Enough for the first screens and a line count estimate; the indexer does the rest
+  index->indexMore(kIndexChunk);
+  startIndexer();
+  cursorLine   = 0;
+  cursorColumn = 0;
+  anchorLine   = 0;
+  anchorColumn = 0;
+  widestLine   = 0;
+  verticalScrollBar()->setValue(0);
+  horizontalScrollBar()->setValue(0);
+  updateScrollBars();
+  viewport()->update();
+  return true;
+}
+
+// The snapshot shares the mapping, which stays readable after a save has replaced the file
+// or another file has been opened. Only the piece list and the typed text are copied.
+FileSaver::Snapshot LargeTextView::snapshot() const {
+  if (!table) {
+    return [file = file, text = mapped](const FileSaver::Writer &write) {
+      return text.empty() || write(text.data(), static_cast<qint64>(text.size()));
+    };
+  }
+  return [file = file, table = table->copyText()](const FileSaver::Writer &write) {
+    return table.forEachChunk([&write](std::string_view chunk) {
+      return write(chunk.data(), static_cast<qint64>(chunk.size()));
+    });
+  };
+}
+
+void LargeTextView::setModified(bool modified) {
+  if (this->modified == modified) return;
+  this->modified = modified;
+  emit modificationChanged(modified);
+}
+
+void LargeTextView::closeFile() {
+  stopIndexer();
+  pendingEnd = PendingEnd::None;
+  index.reset();
+  table    = std::make_unique<PieceTable>();
+  mapped   = {};
+  file     = std::make_shared<QFile>(); // unmaps, unless a snapshot still uses the mapping
+  modified = false;
+  viewport()->update();
+}
+
+QString LargeTextView::fileName() const { return file->fileName(); }
+
+bool LargeTextView::isModified() const { return modified; }
+
+qsizetype LargeTextView::lineCount() const {
+  return static_cast<qsizetype>(table ? table->lineCount() : index->estimatedLineCount());
+}
+
+void LargeTextView::goToLine(qsizetype line) {
+  moveCursor(line, 0);
+  verticalScrollBar()->setValue(static_cast<int>(cursorLine));
+}
+
+void LargeTextView::startIndexer() {
+  indexerCancelled = false;
+  indexer          = QThread::create([this, text = mapped] {
+    auto lines = std::make_unique<LineIndex>(text);
+    while (!indexerCancelled && !lines->indexMore(kIndexChunk)) {
+    }
+    if (!indexerCancelled) indexed = std::move(lines);
+  });
+  connect(indexer, &QThread::finished, this, [this, started = ++generation] {
+    if (started == generation) indexerFinished();
+  });
+  indexer->start();
+}
+
+// The file becomes editable, or a read-only file gets the complete index
+void LargeTextView::indexerFinished() {
+  indexer->wait();
+  delete indexer;
+  indexer = nullptr;
+
+  if (openedReadOnly) {
+    index = std::move(indexed);
+  } else {
+    table = std::make_unique<PieceTable>(mapped, std::move(*indexed));
+    indexed.reset();
+    index.reset();
+  }
+  updateScrollBars();
+  viewport()->update();
+
+  if (pendingEnd != PendingEnd::None) moveToEnd(pendingEnd == PendingEnd::Select);
+}
+
+void LargeTextView::stopIndexer() {
+  if (!indexer) return;
+  indexerCancelled = true;
+  ++generation; // its finished() may be queued already
+  indexer->wait();
+  delete indexer;
+  indexer = nullptr;
+  indexed.reset();
+}
+
+void LargeTextView::setSyntaxHighlighting(bool enabled) {
+  highlighting = enabled;
+  viewport()->update();
+}
+
+int LargeTextView::lineHeight() const { return fontMetrics().lineSpacing(); }
+
+int LargeTextView::visibleLines() const {
+  return std::max(1, viewport()->height() / lineHeight());
+}
+
+LargeTextView::Line LargeTextView::line(qsizetype number) const {
+  const auto n = static_cast<std::size_t>(number);
+  Line line;
+  std::string copied;
+  std::string_view bytes;
+  // One byte past the limit tells a line that was cut from one that just fits
+  if (table) {
+    line.start = table->lineStart(n);
+    copied     = table->text(line.start, table->lineLength(n, kMaxLineBytes + 1));
+    bytes      = copied;
+  } else {
+    line.start = index->lineStart(n);
+    bytes      = mapped.substr(line.start, index->lineLength(n, kMaxLineBytes + 1));
+  }
+  line.truncated = bytes.size() > kMaxLineBytes;
+  bytes          = bytes.substr(0, kMaxLineBytes);
+
+  line.text.reserve(static_cast<qsizetype>(bytes.size()));
+  line.offsets.reserve(bytes.size() + 1);
+  for (std::size_t i = 0; i < bytes.size();) {
+    char32_t codePoint;
+    const std::size_t length = utf8Sequence(bytes.data() + i, bytes.size() - i, codePoint);
+    if (QChar::requiresSurrogates(codePoint)) {
+      line.text += QChar(QChar::highSurrogate(codePoint));
+      line.text += QChar(QChar::lowSurrogate(codePoint));
+      line.offsets.push_back(i);
+    } else {
+      line.text += QChar(static_cast<char16_t>(codePoint));
+    }
+    line.offsets.push_back(i);
+    i += length;
+  }
+  line.offsets.push_back(bytes.size());
+  return line;
+}
+
+int LargeTextView::columnX(const QString &text, qsizetype column) const {
+  return fontMetrics().horizontalAdvance(expandTabs(text.left(column)));
+}
+
+std::size_t LargeTextView::offsetOf(qsizetype line, qsizetype column) const {
+  const Line at = this->line(line);
+  return at.start + at.offsets[static_cast<std::size_t>(column)];
+}
+
+std::size_t LargeTextView::cursorOffset() const { return offsetOf(cursorLine, cursorColumn); }
+
+bool LargeTextView::editable(qsizetype line) const { return table && !this->line(line).truncated; }
+
+// Line and nearest code point boundary to a point in the viewport
+std::pair<qsizetype, qsizetype> LargeTextView::positionAt(QPointF point) const {
+  const qsizetype line = std::clamp<qsizetype>(
+      verticalScrollBar()->value() + static_cast<qsizetype>(point.y()) / lineHeight(), 0,
+      lineCount() - 1);
+  const QString text = this->line(line).text;
+  const int x        = static_cast<int>(point.x()) + horizontalScrollBar()->value() - kMargin;
+
+  // One pass over the line, adding up the advance of each code point
+  const QFontMetrics metrics = fontMetrics();
+  const int tab              = metrics.horizontalAdvance(QString(kTabWidth, ' '));
+  qsizetype column           = 0;
+  int left                   = 0;
+  while (column < text.size()) {
+    const qsizetype next = nextColumn(text, column);
+    const int width      = text[column] == '\t' ? tab
+                           : next - column == 1  ? metrics.horizontalAdvance(text[column])
+                                                 : metrics.horizontalAdvance(text.mid(column, 2));
+    if (2 * left + width >= 2 * x) break;
+    left += width;
+    column = next;
+  }
+  return {line, column};
+}
+
+bool LargeTextView::hasSelection() const {
+  return anchorLine != cursorLine || anchorColumn != cursorColumn;
+}
+
+std::pair<std::size_t, std::size_t> LargeTextView::selection() const {
+  const std::size_t anchor = offsetOf(anchorLine, anchorColumn);
+  const std::size_t cursor = cursorOffset();
+  return {std::min(anchor, cursor), std::max(anchor, cursor)};
+}
+
+void LargeTextView::copySelection() const {
+  if (!hasSelection()) return;
+  const auto [from, to] = selection();
+  const std::string text =
+      table ? table->text(from, to - from) : std::string(mapped.substr(from, to - from));
+  QGuiApplication::clipboard()->setText(
+      QString::fromUtf8(text.data(), static_cast<qsizetype>(text.size())));
+}
+
+void LargeTextView::selectAll() {
+  anchorLine   = 0;
+  anchorColumn = 0;
+  moveToEnd(true);
+}
+
+// The last line is known once the indexer has counted the lines, so until then the move waits
+// for it rather than scanning the rest of the file here
+void LargeTextView::moveToEnd(bool select) {
+  if (indexer) {
+    pendingEnd = select ? PendingEnd::Select : PendingEnd::Move;
+    viewport()->update();
+    return;
+  }
+  const qsizetype last = lineCount() - 1;
+  moveCursor(last, line(last).text.size(), select);
+}
+
+void LargeTextView::updateScrollBars() {
+  const auto last = std::clamp<qsizetype>(lineCount() - visibleLines(), 0,
+                                          std::numeric_limits<int>::max());
+  verticalScrollBar()->setRange(0, static_cast<int>(last));
+  verticalScrollBar()->setPageStep(visibleLines());
+  horizontalScrollBar()->setRange(0, std::max(0, widestLine + 2 * kMargin - viewport()->width()));
+  horizontalScrollBar()->setPageStep(viewport()->width());
+}
+
+void LargeTextView::ensureCursorVisible() {
+  QScrollBar *vertical = verticalScrollBar();
+  if (cursorLine < vertical->value()) {
+    vertical->setValue(static_cast<int>(cursorLine));
+  } else if (cursorLine >= vertical->value() + visibleLines()) {
+    vertical->setValue(static_cast<int>(cursorLine - visibleLines() + 1));
+  }
+
+  QScrollBar *horizontal = horizontalScrollBar();
+  const int x            = columnX(line(cursorLine).text, cursorColumn);
+  widestLine             = std::max(widestLine, x);
+  updateScrollBars();
+  if (x < horizontal->value()) {
+    horizontal->setValue(x);
+  } else if (x > horizontal->value() + viewport()->width() - 2 * kMargin) {
+    horizontal->setValue(x - viewport()->width() + 2 * kMargin);
+  }
+}
+
+void LargeTextView::moveCursor(qsizetype line, qsizetype column, bool select) {
+  lastEdit           = EditKind::None;
+  pendingEnd         = PendingEnd::None;
+  cursorLine         = std::clamp<qsizetype>(line, 0, lineCount() - 1);
+  const QString text = this->line(cursorLine).text;
+  cursorColumn       = std::clamp<qsizetype>(column, 0, text.size());
+  if (cursorColumn < text.size() && text[cursorColumn].isLowSurrogate()) --cursorColumn;
+  if (!select) {
+    anchorLine   = cursorLine;
+    anchorColumn = cursorColumn;
+  }
+  ensureCursorVisible();
+  viewport()->update();
+}
+
+// Moves the cursor to byte `offset` of the table
+void LargeTextView::placeCursor(std::size_t offset) {
+  cursorLine       = static_cast<qsizetype>(table->lineAt(offset));
+  const Line moved = line(cursorLine);
+  const auto found =
+      std::lower_bound(moved.offsets.begin(), moved.offsets.end(), offset - moved.start);
+  cursorColumn = std::min<qsizetype>(found - moved.offsets.begin(), moved.text.size());
+  anchorLine   = cursorLine;
+  anchorColumn = cursorColumn;
+}
+
+void LargeTextView::beginEdit(EditKind kind) {
+  if (kind != lastEdit || kind == EditKind::Other) table->endUndoStep();
+  lastEdit = kind;
+}
+
+void LargeTextView::insertText(const QString &text) {
+  if (hasSelection()) {
+    const auto [from, to] = selection();
+    table->remove(from, to - from);
+    placeCursor(from);
+  }
+
+  const QByteArray bytes = text.toUtf8();
+  const std::size_t here = cursorOffset();
+  table->insert(here, std::string_view(bytes.constData(), bytes.size()));
+  placeCursor(here + static_cast<std::size_t>(bytes.size()));
+  edited();
+}
+
+void LargeTextView::removeText(std::size_t from, std::size_t to) {
+  table->remove(from, to - from);
+  placeCursor(from);
+  edited();
+}
+
+void LargeTextView::edited() {
+  setModified(true);
+  updateScrollBars();
+  ensureCursorVisible();
+  viewport()->update();
+}
+
+void LargeTextView::resizeEvent(QResizeEvent *event) {
+  QAbstractScrollArea::resizeEvent(event);
+  updateScrollBars();
+}
+
+void LargeTextView::paintEvent(QPaintEvent *event) {
+  QPainter painter(viewport());
+  painter.fillRect(event->rect(), kBackground);
+
+  const int height      = lineHeight();
+  const int ascent      = fontMetrics().ascent();
+  const int left        = kMargin - horizontalScrollBar()->value();
+  const qsizetype first = verticalScrollBar()->value();
+  const qsizetype last  = std::min<qsizetype>(lineCount() - 1, first + visibleLines());
+
+  // Selection as (line, column) pairs, start first
+  auto selectionStart = std::pair(anchorLine, anchorColumn);
+  auto selectionEnd   = std::pair(cursorLine, cursorColumn);
+  if (selectionEnd < selectionStart) std::swap(selectionStart, selectionEnd);
+
+  const int widest = widestLine;
+  std::vector<Token> tokens;
+  for (qsizetype line = first; line <= last; ++line) {
+    const int y = static_cast<int>(line - first) * height;
+    if (line == cursorLine) painter.fillRect(0, y, viewport()->width(), height, kCurrentLine);
+
+    const QString text = this->line(line).text;
+    if (hasSelection() && line >= selectionStart.first && line <= selectionEnd.first) {
+      const qsizetype from = line == selectionStart.first ? selectionStart.second : 0;
+      const qsizetype to   = line == selectionEnd.first ? selectionEnd.second : text.size();
+      // A selected newline shows as a space past the end of the line
+      const int newline = line == selectionEnd.first ? 0 : fontMetrics().horizontalAdvance(' ');
+      const int x       = left + columnX(text, from);
+      painter.fillRect(x, y, left + columnX(text, to) + newline - x, height, kSelection);
+    }
+    tokens.clear();
+    if (highlighting) {
+      CppLexer::tokenize(reinterpret_cast<const char16_t *>(text.utf16()),
+                         static_cast<int>(text.size()), CppLexer::Normal, tokens);
+    }
+
+    int x = left;
+    auto draw = [&](qsizetype from, qsizetype to, const QTextCharFormat *format) {
+      if (to <= from) return;
+      QFont segmentFont = font();
+      if (format) {
+        segmentFont.setBold(format->fontWeight() >= QFont::Bold);
+        segmentFont.setItalic(format->fontItalic());
+      }
+      const QString segment = expandTabs(text.mid(from, to - from));
+      painter.setFont(segmentFont);
+      painter.setPen(format ? format->foreground().color() : kForeground);
+      painter.drawText(x, y + ascent, segment);
+      x += QFontMetrics(segmentFont).horizontalAdvance(segment);
+    };
+
+    qsizetype pos = 0;
+    for (const Token &token : tokens) {
+      draw(pos, token.start, nullptr);
+      draw(token.start, token.start + token.length, &formats[static_cast<size_t>(token.kind)]);
+      pos = token.start + token.length;
+    }
+    draw(pos, text.size(), nullptr);
+    widestLine = std::max(widestLine, x - left);
+
+    if (line == cursorLine && hasFocus()) {
+      painter.fillRect(left + columnX(text, cursorColumn), y, 2, height, kForeground);
+    }
+  }
+
+  if (widestLine != widest) updateScrollBars();
+}
+
+void LargeTextView::mousePressEvent(QMouseEvent *event) {
+  if (event->button() != Qt::LeftButton) {
+    QAbstractScrollArea::mousePressEvent(event);
+    return;
+  }
+
+  const auto [line, column] = positionAt(event->position());
+  moveCursor(line, column, event->modifiers() & Qt::ShiftModifier);
+}
+
+void LargeTextView::mouseMoveEvent(QMouseEvent *event) {
+  if (!(event->buttons() & Qt::LeftButton)) {
+    QAbstractScrollArea::mouseMoveEvent(event);
+    return;
+  }
+
+  const auto [line, column] = positionAt(event->position());
+  moveCursor(line, column, true);
+}
+
+void LargeTextView::keyPressEvent(QKeyEvent *event) {
+  const Line current  = line(cursorLine);
+  const QString &text = current.text;
+  const bool control  = event->modifiers() & Qt::ControlModifier;
+  const bool select   = event->modifiers() & Qt::ShiftModifier;
+  const auto offsetAt = [&current](qsizetype column) {
+    return current.start + current.offsets[static_cast<std::size_t>(column)];
+  };
+
+  switch (event->key()) {
+    case Qt::Key_Left:
+      if (cursorColumn > 0) {
+        moveCursor(cursorLine, previousColumn(text, cursorColumn), select);
+      } else if (cursorLine > 0) {
+        moveCursor(cursorLine - 1, line(cursorLine - 1).text.size(), select);
+      }
+      return;
+    case Qt::Key_Right:
+      if (cursorColumn < text.size()) {
+        moveCursor(cursorLine, nextColumn(text, cursorColumn), select);
+      } else if (cursorLine + 1 < lineCount()) {
+        moveCursor(cursorLine + 1, 0, select);
+      }
+      return;
+    case Qt::Key_Up:
+      moveCursor(cursorLine - 1, cursorColumn, select);
+      return;
+    case Qt::Key_Down:
+      moveCursor(cursorLine + 1, cursorColumn, select);
+      return;
+    case Qt::Key_PageUp:
+      moveCursor(cursorLine - visibleLines(), cursorColumn, select);
+      return;
+    case Qt::Key_PageDown:
+      moveCursor(cursorLine + visibleLines(), cursorColumn, select);
+      return;
+    case Qt::Key_Home:
+      control ? moveCursor(0, 0, select) : moveCursor(cursorLine, 0, select);
+      return;
+    case Qt::Key_End:
+      if (control) {
+        moveToEnd(select);
+      } else {
+        moveCursor(cursorLine, text.size(), select);
+      }
+      return;
+    default:
+      break;
+  }
+
+  if (event->matches(QKeySequence::SelectAll)) {
+    selectAll();
+    return;
+  }
+  if (event->matches(QKeySequence::Copy)) {
+    copySelection();
+    return;
+  }
+  if (isReadOnly()) {
+    QAbstractScrollArea::keyPressEvent(event);
+    return;
+  }
+
+  if (event->matches(QKeySequence::Undo) || event->matches(QKeySequence::Redo)) {
+    std::size_t offset = 0;
+    if (event->matches(QKeySequence::Undo) ? table->undo(offset) : table->redo(offset)) {
+      lastEdit = EditKind::None;
+      placeCursor(offset);
+      edited();
+    }
+    return;
+  }
+  // Lines too long to show whole are left as they are
+  if (current.truncated || !editable(anchorLine)) {
+    if (event->text().isEmpty() || control) QAbstractScrollArea::keyPressEvent(event);
+    return;
+  }
+  if (event->matches(QKeySequence::Cut)) {
+    if (hasSelection()) {
+      copySelection();
+      beginEdit(EditKind::Other);
+      insertText(QString());
+    }
+    return;
+  }
+  if (event->matches(QKeySequence::Paste)) {
+    QString pasted = QGuiApplication::clipboard()->text();
+    pasted.replace(QStringLiteral("\r\n"), QStringLiteral("\n")).replace(u'\r', u'\n');
+    beginEdit(EditKind::Other);
+    insertText(pasted);
+    return;
+  }
+
+  if (hasSelection() &&
+      (event->key() == Qt::Key_Backspace || event->key() == Qt::Key_Delete)) {
+    beginEdit(EditKind::Other);
+    insertText(QString());
+    return;
+  }
+
+  // Deletes the whole UTF-8 sequence next to the cursor, or the newline when joining lines
+  switch (event->key()) {
+    case Qt::Key_Backspace:
+      if (cursorColumn > 0) {
+        beginEdit(EditKind::Deleting);
+        removeText(offsetAt(previousColumn(text, cursorColumn)), offsetAt(cursorColumn));
+      } else if (cursorLine > 0 && editable(cursorLine - 1)) {
+        beginEdit(EditKind::Deleting);
+        removeText(current.start - 1, current.start);
+      }
+      return;
+    case Qt::Key_Delete:
+      if (cursorColumn < text.size()) {
+        beginEdit(EditKind::Deleting);
+        removeText(offsetAt(cursorColumn), offsetAt(nextColumn(text, cursorColumn)));
+      } else if (cursorLine + 1 < lineCount() && editable(cursorLine + 1)) {
+        beginEdit(EditKind::Deleting);
+        removeText(offsetAt(cursorColumn), offsetAt(cursorColumn) + 1);
+      }
+      return;
+    case Qt::Key_Return:
+    case Qt::Key_Enter: {
+      // Keep the current line's indentation, like the editor
+      qsizetype indent = 0;
+      while (indent < text.size() && (text[indent] == ' ' || text[indent] == '\t')) ++indent;
+      beginEdit(EditKind::Other);
+      insertText("\n" + text.left(std::min(indent, cursorColumn)));
+      return;
+    }
+    case Qt::Key_Tab:
+      beginEdit(EditKind::Other);
+      insertText("  ");
+      return;
+    default:
+      break;
+  }
+
+  if (!control && !event->text().isEmpty() && event->text().at(0).isPrint()) {
+    beginEdit(hasSelection() ? EditKind::Other : EditKind::Typing);
+    insertText(event->text());
+    return;
+  }
+  QAbstractScrollArea::keyPressEvent(event);
+}
@@ -0,0 +1,140 @@
+#ifndef BFF45854_D11B_4977_8599_78A286888B20
+#define BFF45854_D11B_4977_8599_78A286888B20
+
+#include <QAbstractScrollArea>
+#include <QFile>
+#include <QThread>
+#include <atomic>
+#include <memory>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "filesaver.hpp"
+#include "grammar.hpp"
+#include "lineindex.hpp"
+#include "piecetable.hpp"
+
+// Plain-text editor for files too large for QTextDocument. The file is memory-mapped and
+// edited through a PieceTable; only the lines on screen are ever decoded, colored and laid
+// out. Lines are colored independently, each starting outside any comment. Edits can be
+// undone, and text can be selected with the keyboard or the mouse, copied, cut and pasted. Only
+// the first 64 KiB of a line is shown, and a line longer than that cannot be edited.
+//
+// The table needs every line of the file counted. That is done on a background thread, and
+// until it is done the file is shown as if opened read-only. Ctrl+End and Select All need the
+// last line, so they wait for the count and happen once it is done.
+//
+// Opened read-only, the view works straight off the mapping and a LineIndex, so memory is
+// bounded by the sparse index and the visible lines. The lines on screen are found by an
+// index that scans only as far as they are, while a complete one is built in the background,
+// so the file can be scrolled before it has been scanned to the end.
+class LargeTextView : public QAbstractScrollArea {
+  Q_OBJECT
+
+public:
+  explicit LargeTextView(QWidget *parent = nullptr);
+  ~LargeTextView() override;
+
+  bool openFile(const QString &fileName, QString *error = nullptr, bool readOnly = false);
+  // Text to hand to FileSaver; it stays valid while editing goes on.
+  [[nodiscard]] FileSaver::Snapshot snapshot() const;
+  void closeFile();
+
+  [[nodiscard]] QString fileName() const;
+  [[nodiscard]] bool isModified() const;
+  void setModified(bool modified);
+  [[nodiscard]] bool isReadOnly() const { return !table; }
+
+  // Number of lines; while a read-only file is still being indexed, an estimate.
+  [[nodiscard]] qsizetype lineCount() const;
+  // Moves the cursor to the start of `line`, counting from 0, and scrolls it to the top.
+  void goToLine(qsizetype line);
+
+  // Colors visible lines with the C/C++ lexer.
+  void setSyntaxHighlighting(bool enabled);
+
+signals:
+  void modificationChanged(bool modified);
+
+protected:
+  void paintEvent(QPaintEvent *event) override;
+  void resizeEvent(QResizeEvent *event) override;
+  void keyPressEvent(QKeyEvent *event) override;
+  void mousePressEvent(QMouseEvent *event) override;
+  void mouseMoveEvent(QMouseEvent *event) override;
+
+private:
+  std::shared_ptr<QFile> file = std::make_shared<QFile>();
+  std::string_view mapped;
+  std::unique_ptr<PieceTable> table; // when editable
+  std::unique_ptr<LineIndex> index;  // when read-only
+  bool openedReadOnly = false;
+
+  // Counts the lines of the file: for the table, or for an index of a read-only file that is
+  // complete
+  QThread *indexer = nullptr;
+  std::atomic<bool> indexerCancelled{false};
+  std::unique_ptr<LineIndex> indexed; // the indexer's result
+  quint64 generation = 0;             // tells the current indexer from stopped ones
+  // A move to the last line waiting for the indexer, and whether it selects
+  enum class PendingEnd { None, Move, Select };
+  PendingEnd pendingEnd = PendingEnd::None;
+  TokenFormats formats;
+  bool highlighting = true;
+  bool modified     = false;
+  int widestLine    = 0; // widest line painted so far, for the horizontal scroll range
+
+  // Consecutive typing, or consecutive deleting, is undone as one step
+  enum class EditKind { None, Typing, Deleting, Other };
+  EditKind lastEdit = EditKind::None;
+
+  // The cursor is a line and a UTF-16 column into that line's decoded text. The column is
+  // always at a code point boundary, never between the halves of a surrogate pair.
+  qsizetype cursorLine   = 0;
+  qsizetype cursorColumn = 0;
+  // Where the selection started; the same as the cursor when nothing is selected
+  qsizetype anchorLine   = 0;
+  qsizetype anchorColumn = 0;
+
+  // A line as shown. Its bytes are decoded here rather than by QString::fromUtf8 so that every
+  // column maps back to the exact byte it came from, malformed sequences included.
+  struct Line {
+    QString text;
+    std::size_t start = 0;            // byte offset of the line in the file
+    std::vector<std::size_t> offsets; // byte offset in the line of every column, and the end
+    bool truncated = false;           // longer than what is shown, so it cannot be edited
+  };
+
+  [[nodiscard]] int lineHeight() const;
+  [[nodiscard]] int visibleLines() const;
+  [[nodiscard]] Line line(qsizetype number) const;
+  [[nodiscard]] int columnX(const QString &text, qsizetype column) const;
+  [[nodiscard]] std::size_t offsetOf(qsizetype line, qsizetype column) const;
+  [[nodiscard]] std::size_t cursorOffset() const;
+  [[nodiscard]] bool editable(qsizetype line) const;
+  [[nodiscard]] std::pair<qsizetype, qsizetype> positionAt(QPointF point) const;
+
+  [[nodiscard]] bool hasSelection() const;
+  // Byte range of the selection, start first
+  [[nodiscard]] std::pair<std::size_t, std::size_t> selection() const;
+  void copySelection() const;
+  void selectAll();
+
+  void updateScrollBars();
+  void ensureCursorVisible();
+  // Leaves the anchor where it is when `select`, so the selection grows or shrinks
+  void moveCursor(qsizetype line, qsizetype column, bool select = false);
+  void moveToEnd(bool select);
+  void placeCursor(std::size_t offset);
+  void beginEdit(EditKind kind);
+  // Replaces the selection, if there is one
+  void insertText(const QString &text);
+  void removeText(std::size_t from, std::size_t to);
+  void edited();
+  void startIndexer();
+  void indexerFinished();
+  void stopIndexer();
+};
+
+#endif /* BFF45854_D11B_4977_8599_78A286888B20 */
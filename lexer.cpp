@@ -0,0 +1,418 @@
+#include "lexer.hpp"
+
+#include <algorithm>
+#include <string_view>
+
+#include "keywords.hpp"
+#include "scan.hpp"
+
+namespace {
+
+inline bool isIdentStart(char16_t c) {
+  return (c >= u'a' && c <= u'z') || (c >= u'A' && c <= u'Z') || c == u'_';
+}
+
+inline bool isDigit(char16_t c) { return c >= u'0' && c <= u'9'; }
+
+inline bool isIdentChar(char16_t c) { return isIdentStart(c) || isDigit(c); }
+
+inline bool isSpace(char16_t c) {
+  return c == u' ' || c == u'\t' || c == u'\r' || c == u'\f' || c == u'\v';
+}
+
+inline bool isOperator(char16_t c) {
+  switch (c) {
+    case u'+':
+    case u'-':
+    case u'*':
+    case u'/':
+    case u'%':
+    case u'=':
+    case u'!':
+    case u'<':
+    case u'>':
+    case u'&':
+    case u'|':
+    case u'^':
+    case u'~':
+    case u'?':
+    case u':':
+    case u',':
+    case u';':
+    case u'[':
+    case u']':
+    case u'(':
+    case u')':
+    case u'{':
+    case u'}':
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Folds a raw string delimiter into the 16 bits the block state has room for.
+int delimiterHash(const char16_t *text, int length) {
+  std::uint32_t h = 2166136261u;
+  for (int i = 0; i < length; ++i) {
+    h = (h ^ text[i]) * 16777619u;
+  }
+  return static_cast<int>((h ^ (h >> 16)) & 0xffff);
+}
+
+// Anything but spaces, parentheses and backslashes may appear in a raw string delimiter.
+inline bool isDelimiterChar(char16_t c) {
+  return !isSpace(c) && c != u'(' && c != u')' && c != u'\\' && c != u'"';
+}
+
+// Single left-to-right scan over one block. Every helper advances `pos` and never looks
+// further ahead than the next identifier, so the whole block is visited a constant number
+// of times. A helper that runs off the end of the block records what continues in `carry`.
+class Scanner {
+public:
+  Scanner(const char16_t *text, int length, std::vector<Token> &tokens)
+      : s(text), n(length), out(tokens) {}
+
+  int run(int state) {
+    bool lineStart = true;
+
+    // A line that continues the `#if 0` line itself, in a comment, raw string or spliced
+    // directive started there, is lexed as live code; the region starts on the line after
+    int depth             = CppLexer::disabledDepth(state);
+    const bool continuing = depth > 0 && CppLexer::context(state) != CppLexer::Normal;
+    if (depth > 0 && !continuing) {
+      if (!disabledLine(depth)) return CppLexer::makeState(CppLexer::Normal, depth);
+      lineStart = false;
+    }
+
+    switch (CppLexer::context(state)) {
+      case CppLexer::Normal:
+        break;
+      case CppLexer::InComment:
+        blockComment(0, 0);
+        break;
+      case CppLexer::InRawString:
+        rawStringBody(0, 0, CppLexer::delimiterLength(state), CppLexer::delimiterHash(state));
+        break;
+      case CppLexer::InString:
+        stringBody(0, 0, u'"');
+        break;
+      case CppLexer::InLineComment:
+        lineComment(0);
+        break;
+      case CppLexer::InDirective:
+        inDirective = true;
+        lineStart   = false;
+        break;
+    }
+
+    while (pos < n) {
+      const char16_t c = s[pos];
+
+      if (isSpace(c)) {
+        ++pos;
+        continue;
+      }
+
+      if (c == u'/' && pos + 1 < n && s[pos + 1] == u'/') {
+        lineComment(pos);
+        break;
+      }
+
+      if (c == u'/' && pos + 1 < n && s[pos + 1] == u'*') {
+        blockComment(pos, pos + 2);
+        continue;
+      }
+
+      if (c == u'#' && lineStart) {
+        directive();
+        lineStart = false;
+        continue;
+      }
+      lineStart = false;
+
+      if (c == u'"' || c == u'\'') {
+        quoted(pos);
+      } else if (isDigit(c) || (c == u'.' && pos + 1 < n && isDigit(s[pos + 1]))) {
+        number();
+      } else if (isIdentStart(c)) {
+        word();
+      } else if (isOperator(c)) {
+        operators();
+      } else {
+        ++pos;
+      }
+    }
+
+    int next = carry;
+    if (carry == CppLexer::Normal && inDirective && endsWithBackslash()) {
+      next = CppLexer::InDirective;
+    }
+    if (disables) return CppLexer::withDisabledDepth(next, 1);
+    if (continuing) return CppLexer::withDisabledDepth(next, depth);
+    return next;
+  }
+
+private:
+  const char16_t *s;
+  const int n;
+  std::vector<Token> &out;
+  int pos          = 0;
+  int carry        = CppLexer::Normal; // state for the next block
+  bool inDirective = false;            // this line is (a continuation of) a directive
+  bool disables    = false;            // this line is `#if 0`
+
+  void emit(int start, int end, TokenKind kind) {
+    if (end > start) out.push_back({start, end - start, kind});
+  }
+
+  int skipSpaces(int i) const {
+    while (i < n && isSpace(s[i])) ++i;
+    return i;
+  }
+
+  int identifierEnd(int i) const {
+    while (i < n && isIdentChar(s[i])) ++i;
+    return i;
+  }
+
+  // A backslash at the very end splices the next line onto this one.
+  bool endsWithBackslash() const {
+    int i = n;
+    if (i > 0 && s[i - 1] == u'\r') --i;
+    return i > 0 && s[i - 1] == u'\\';
+  }
+
+  void lineComment(int start) {
+    emit(start, n, TokenKind::Comment);
+    pos = n;
+    if (endsWithBackslash()) carry = CppLexer::InLineComment;
+  }
+
+  // Emits a /* */ comment starting at `start`, looking for the terminator from `from`.
+  void blockComment(int start, int from) {
+    const int close = scan::findPair(s, n, from, u'*', u'/');
+    if (close < n) {
+      emit(start, close + 2, TokenKind::MultiLineComment);
+      pos = close + 2;
+      return;
+    }
+    emit(start, n, TokenKind::MultiLineComment);
+    pos   = n;
+    carry = CppLexer::InComment;
+  }
+
+  // Lines inside `#if 0` are shown as comments. Only conditional directives are looked at, to
+  // track nesting and find where live code resumes. Returns true if this line resumes it, in
+  // which case the rest of the line after the directive name is left to the caller.
+  bool disabledLine(int &depth) {
+    const int hash = skipSpaces(0);
+    if (hash < n && s[hash] == u'#') {
+      const int name = skipSpaces(hash + 1);
+      const int end  = identifierEnd(name);
+      const std::u16string_view word(s + name, end - name);
+      if (word == u"if" || word == u"ifdef" || word == u"ifndef") {
+        depth = std::min(depth + 1, CppLexer::kMaxDisabledDepth);
+      } else if (word == u"endif") {
+        --depth;
+      } else if (depth == 1 && (word == u"else" || word == u"elif")) {
+        depth = 0;
+      }
+
+      if (depth == 0) {
+        emit(hash, end, TokenKind::Keyword);
+        pos         = end;
+        inDirective = true;
+        return true;
+      }
+    }
+    emit(0, n, TokenKind::Comment);
+    return false;
+  }
+
+  // `#include`, `#define`, ...: the hash and the directive name are keywords.
+  void directive() {
+    const int start = pos;
+    const int name  = skipSpaces(pos + 1);
+    const int end   = identifierEnd(name);
+    const std::u16string_view word(s + name, end - name);
+    emit(start, end, TokenKind::Keyword);
+    pos         = end;
+    inDirective = true;
+    if (word == u"include") {
+      pos = skipSpaces(pos);
+      if (pos < n && s[pos] == u'<') headerName();
+    } else if (word == u"if") {
+      const int condition = skipSpaces(pos);
+      disables            = condition < n && s[condition] == u'0' &&
+                 identifierEnd(condition + 1) == condition + 1;
+    }
+  }
+
+  void headerName() {
+    int i = pos + 1;
+    while (i < n && s[i] != u'>') ++i;
+    if (i < n) {
+      emit(pos, i + 1, TokenKind::String);
+      pos = i + 1;
+    } else {
+      operators();
+    }
+  }
+
+  // String or character literal starting at `start`; the opening quote is at `pos`.
+  void quoted(int start) { stringBody(start, pos + 1, s[pos]); }
+
+  // Rest of a literal from `from` up to the closing quote. Unterminated literals end with the
+  // block; a string whose last character is a backslash continues on the next one.
+  void stringBody(int start, int from, char16_t quote) {
+    const std::u16string_view stops = quote == u'"' ? u"\"\\" : u"'\\";
+    int i                           = scan::findAny(s, n, from, stops);
+    while (i + 1 < n && s[i] == u'\\') {
+      i = scan::findAny(s, n, i + 2, stops);
+    }
+    const bool closed = i < n && s[i] == quote;
+    const int end     = closed ? i + 1 : n;
+    emit(start, end, TokenKind::String);
+    pos = end;
+    if (!closed && i == n - 1 && quote == u'"') carry = CppLexer::InString;
+  }
+
+  // R"delim( ... )delim" starting at `start`, with the opening quote at `quote`. Returns false
+  // if this is not a well-formed raw string opener.
+  bool rawString(int start, int quote) {
+    int open = quote + 1;
+    while (open < n && open - quote - 1 < CppLexer::kMaxDelimiterLength &&
+           isDelimiterChar(s[open])) {
+      ++open;
+    }
+    if (open >= n || s[open] != u'(') return false;
+
+    const int length = open - quote - 1;
+    rawStringBody(start, open + 1, length, delimiterHash(s + quote + 1, length));
+    return true;
+  }
+
+  // Rest of a raw string from `from` up to `)delim"`. The delimiter is only known by its
+  // length and hash when the string started in an earlier block.
+  void rawStringBody(int start, int from, int length, int hash) {
+    for (int i = scan::find(s, n, from, u')'); i + length + 1 < n;
+         i     = scan::find(s, n, i + 1, u')')) {
+      if (s[i + length + 1] == u'"' && delimiterHash(s + i + 1, length) == hash) {
+        emit(start, i + length + 2, TokenKind::String);
+        pos = i + length + 2;
+        return;
+      }
+    }
+    emit(start, n, TokenKind::String);
+    pos   = n;
+    carry = CppLexer::makeState(CppLexer::InRawString, 0, length, hash);
+  }
+
+  void number() {
+    int i = pos + 1;
+    while (i < n) {
+      const char16_t c = s[i];
+      if (isIdentChar(c) || c == u'.' || c == u'\'') {
+        ++i;
+      } else if ((c == u'+' || c == u'-') &&
+                 (s[i - 1] == u'e' || s[i - 1] == u'E' || s[i - 1] == u'p' || s[i - 1] == u'P')) {
+        ++i;
+      } else {
+        break;
+      }
+    }
+    emit(pos, i, TokenKind::Number);
+    pos = i;
+  }
+
+  void operators() {
+    int i = pos + 1;
+    while (i < n && isOperator(s[i])) {
+      // Stop before a comment opener so the comment keeps its own format.
+      if (s[i] == u'/' && i + 1 < n && (s[i + 1] == u'/' || s[i + 1] == u'*')) break;
+      ++i;
+    }
+    emit(pos, i, TokenKind::Operator);
+    pos = i;
+  }
+
+  void word() {
+    const int start = pos;
+    const int end   = identifierEnd(pos);
+    const std::u16string_view text(s + start, end - start);
+    pos = end;
+
+    // Encoding prefixes glue onto the literal that follows: L"", u8"", U'', R"()", u8R"()".
+    if (end < n && (s[end] == u'"' || s[end] == u'\'') &&
+        (text == u"L" || text == u"u" || text == u"U" || text == u"u8")) {
+      quoted(start);
+      return;
+    }
+    if (end < n && s[end] == u'"' &&
+        (text == u"R" || text == u"LR" || text == u"uR" || text == u"UR" || text == u"u8R") &&
+        rawString(start, end)) {
+      return;
+    }
+
+    const keywords::Kind wordClass = keywords::lookup(text);
+    const int next                 = skipSpaces(end);
+
+    if (wordClass == keywords::Kind::Keyword) {
+      if (text == u"template" && next < n && s[next] == u'<') {
+        templateParams(start, next);
+      } else if ((text == u"namespace" || text == u"class") && next < n &&
+                 isIdentStart(s[next])) {
+        const int nameEnd = identifierEnd(next);
+        emit(start, nameEnd,
+             text == u"namespace" ? TokenKind::Namespace : TokenKind::Keyword);
+        pos = nameEnd;
+      } else {
+        emit(start, end, TokenKind::Keyword);
+      }
+      return;
+    }
+
+    if (next < n && s[next] == u'(' && wordClass == keywords::Kind::None) {
+      emit(start, end, TokenKind::Function);
+      return;
+    }
+
+    // `T name =`, `T name;`, `T name(` and `T name,` declare something of type T.
+    if (next < n && isIdentStart(s[next])) {
+      const int after = skipSpaces(identifierEnd(next));
+      if (after < n && (s[after] == u'=' || s[after] == u';' || s[after] == u'(' ||
+                        s[after] == u',')) {
+        const keywords::Kind declared = keywords::lookup(s + next, identifierEnd(next) - next);
+        if (declared != keywords::Kind::Keyword) {
+          emit(start, end, TokenKind::Type);
+          return;
+        }
+      }
+    }
+
+    if (wordClass == keywords::Kind::Type) emit(start, end, TokenKind::Keyword);
+  }
+
+  // `template <...>` is one span; nested angle brackets are balanced.
+  void templateParams(int start, int open) {
+    int depth = 0;
+    int i     = open;
+    for (; i < n; ++i) {
+      if (s[i] == u'<') {
+        ++depth;
+      } else if (s[i] == u'>' && --depth == 0) {
+        ++i;
+        break;
+      }
+    }
+    emit(start, i, TokenKind::TemplateParams);
+    pos = i;
+  }
+};
+
+} // namespace
+
+int CppLexer::tokenize(const char16_t *text, int length, int state, std::vector<Token> &tokens) {
+  return Scanner(text, length, tokens).run(state);
+}
@@ -0,0 +1,76 @@
+#ifndef DDD369BE_2C3E_4DE8_A9C9_DBBE7E94F46C
+#define DDD369BE_2C3E_4DE8_A9C9_DBBE7E94F46C
+
+#include <cstdint>
+#include <vector>
+
+// Token classes produced by CppLexer. Each one maps to a single Dracula format in the
+// highlighter, so the lexer never has to know about colors.
+enum class TokenKind : std::uint8_t {
+  Plain,
+  Keyword,
+  Operator,
+  String,
+  Number,
+  Function,
+  Type,
+  Namespace,
+  TemplateParams,
+  Comment,
+  MultiLineComment,
+  Count,
+};
+
+struct Token {
+  int start;
+  int length;
+  TokenKind kind;
+};
+
+// Hand-written C/C++ tokenizer. It walks a block once from left to right and produces every
+// token class the old per-keyword regex rules did. Tokens are emitted in order and never
+// overlap; plain text is not emitted at all.
+class CppLexer {
+public:
+  // What the next block continues. A comment, raw string, string or directive that runs off
+  // the end of a line carries over; so does a `//` comment or string ending in a backslash.
+  enum Context : int {
+    Normal        = 0,
+    InComment     = 1,
+    InRawString   = 2,
+    InString      = 3,
+    InLineComment = 4,
+    InDirective   = 5,
+  };
+
+  // A block state packs everything the next block needs to resume, so QSyntaxHighlighter can
+  // stop as soon as a block ends in the state it had before. It is never negative, since -1
+  // marks blocks that were not highlighted yet:
+  //   bits 0-2    context
+  //   bits 3-8    #if nesting depth inside an `#if 0` region, 0 while code is live; with a
+  //               context, the `#if 0` line itself still goes on in it
+  //   bits 9-13   raw string delimiter length
+  //   bits 14-29  raw string delimiter hash
+  static constexpr int kMaxDisabledDepth   = 63;
+  static constexpr int kMaxDelimiterLength = 16;
+
+  static constexpr int makeState(Context context, int disabledDepth = 0,
+                                 int delimiterLength = 0, int delimiterHash = 0) {
+    return static_cast<int>(context) | disabledDepth << 3 | delimiterLength << 9 |
+           (delimiterHash & 0xffff) << 14;
+  }
+  static constexpr Context context(int state) { return static_cast<Context>(state & 7); }
+  static constexpr int disabledDepth(int state) { return (state >> 3) & 0x3f; }
+  static constexpr int delimiterLength(int state) { return (state >> 9) & 0x1f; }
+  static constexpr int delimiterHash(int state) { return (state >> 14) & 0xffff; }
+  // `state` with its disabled depth replaced, keeping what it carries
+  static constexpr int withDisabledDepth(int state, int disabledDepth) {
+    return (state & ~(0x3f << 3)) | disabledDepth << 3;
+  }
+
+  // Tokenizes one block of UTF-16 text that starts in `state`, appending to `tokens`.
+  // Returns the state the next block starts in.
+  static int tokenize(const char16_t *text, int length, int state, std::vector<Token> &tokens);
+};
+
+#endif /* DDD369BE_2C3E_4DE8_A9C9_DBBE7E94F46C */
@@ -0,0 +1,94 @@
+#include "lineindex.hpp"
+
+#include <algorithm>
+
+#include "scan.hpp"
+
+namespace {
+
+// Newlines are counted a block at a time; a block without a checkpoint is skipped whole
+constexpr std::size_t kBlock = 64 * 1024;
+
+// How much indexLine() and indexOffset() scan between checks
+constexpr std::size_t kStep = 16 * kBlock;
+
+} // namespace
+
+LineIndex::LineIndex(std::string_view text) : text(text) { checkpoints.push_back(0); }
+
+bool LineIndex::indexMore(std::size_t bytes) const {
+  const char *data      = text.data();
+  const std::size_t end = scannedTo + std::min(bytes, text.size() - scannedTo);
+
+  while (scannedTo < end) {
+    const std::size_t block = std::min(kBlock, end - scannedTo);
+    const std::size_t want  = checkpoints.size() * kStride; // newlines before the next checkpoint
+    const std::size_t count = scan::countByte(data + scannedTo, block, '\n');
+    if (scannedLines + count < want) {
+      scannedLines += count;
+      scannedTo += block;
+      continue;
+    }
+
+    // The next checkpoint is in this block: step to the newline that ends the line before it
+    std::size_t i = scannedTo;
+    for (;; ++i) {
+      i = scan::findByte(data, scannedTo + block, i, '\n');
+      if (++scannedLines == want) break;
+    }
+    checkpoints.push_back(i + 1);
+    scannedTo = i + 1;
+  }
+  return complete();
+}
+
+void LineIndex::indexLine(std::size_t line) const {
+  while (line / kStride >= checkpoints.size() && !indexMore(kStep)) {
+  }
+}
+
+void LineIndex::indexOffset(std::size_t offset) const {
+  while (scannedTo < offset && !indexMore(kStep)) {
+  }
+}
+
+std::size_t LineIndex::lineStart(std::size_t line) const {
+  indexLine(line);
+  const std::size_t checkpoint = line / kStride;
+  if (checkpoint >= checkpoints.size()) return text.size();
+
+  std::size_t offset = checkpoints[checkpoint];
+  for (std::size_t n = line % kStride; n > 0; --n) {
+    const std::size_t newline = scan::findByte(text.data(), text.size(), offset, '\n');
+    if (newline == text.size()) return text.size();
+    offset = newline + 1;
+  }
+  return offset;
+}
+
+std::size_t LineIndex::lineLength(std::size_t line, std::size_t limit) const {
+  const std::size_t start = lineStart(line);
+  const std::size_t end   = start + std::min(limit, text.size() - start);
+  return scan::findByte(text.data(), end, start, '\n') - start;
+}
+
+std::size_t LineIndex::lineAt(std::size_t offset) const {
+  offset = std::min(offset, text.size());
+  indexOffset(offset);
+
+  const auto after        = std::upper_bound(checkpoints.begin(), checkpoints.end(), offset);
+  const auto checkpoint   = static_cast<std::size_t>(after - checkpoints.begin()) - 1;
+  const std::size_t start = checkpoints[checkpoint];
+  return checkpoint * kStride + scan::countByte(text.data() + start, offset - start, '\n');
+}
+
+std::size_t LineIndex::lineCount() const {
+  indexMore(text.size());
+  return scannedLines + 1;
+}
+
+std::size_t LineIndex::estimatedLineCount() const {
+  if (complete() || scannedTo == 0) return scannedLines + 1;
+  const double perByte = static_cast<double>(scannedLines) / static_cast<double>(scannedTo);
+  return std::max(scannedLines, static_cast<std::size_t>(perByte * text.size())) + 1;
+}
@@ -0,0 +1,51 @@
+#ifndef FD7D6217_80C7_46F1_803C_0A43EA576AA7
+#define FD7D6217_80C7_46F1_803C_0A43EA576AA7
+
+#include <cstddef>
+#include <limits>
+#include <string_view>
+#include <vector>
+
+// Line starts of a large, immutable text, found on demand. Only the start of every kStride-th
+// line is stored, so the index of a multi-GB file takes a few MB; other lines are found by
+// scanning forward from the nearest checkpoint, which is bounded by kStride lines. The text
+// is scanned only as far as a query needs, a block at a time with the SIMD newline counter,
+// and indexMore() lets the caller finish the rest in the background.
+//
+// Queries are const but advance the index, so a LineIndex must not be shared between threads.
+class LineIndex {
+public:
+  static constexpr std::size_t kStride = 256;
+
+  // `text` must outlive the index.
+  explicit LineIndex(std::string_view text = {});
+
+  // Byte offset where `line` starts, or size() if the text has fewer lines.
+  [[nodiscard]] std::size_t lineStart(std::size_t line) const;
+  // Length of `line` without the '\n', or `limit` if it is longer; no more than that is scanned.
+  [[nodiscard]] std::size_t
+  lineLength(std::size_t line, std::size_t limit = std::numeric_limits<std::size_t>::max()) const;
+  // Line that contains byte `offset`; offsets past the end map to the last line.
+  [[nodiscard]] std::size_t lineAt(std::size_t offset) const;
+
+  // Number of lines, counting the text after the last '\n'. Scans the rest of the text.
+  [[nodiscard]] std::size_t lineCount() const;
+  // Line count extrapolated from the part scanned so far; exact once complete().
+  [[nodiscard]] std::size_t estimatedLineCount() const;
+
+  // Scans up to `bytes` more of the text. Returns true once the whole text is indexed.
+  bool indexMore(std::size_t bytes) const;
+  [[nodiscard]] bool complete() const { return scannedTo == text.size(); }
+  [[nodiscard]] std::size_t size() const { return text.size(); }
+
+private:
+  std::string_view text;
+  mutable std::vector<std::size_t> checkpoints; // start of line k * kStride
+  mutable std::size_t scannedTo    = 0;         // newlines before this offset are counted
+  mutable std::size_t scannedLines = 0;         // number of newlines before scannedTo
+
+  void indexLine(std::size_t line) const;
+  void indexOffset(std::size_t offset) const;
+};
+
+#endif /* FD7D6217_80C7_46F1_803C_0A43EA576AA7 */
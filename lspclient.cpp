@@ -0,0 +1,496 @@
+#include "lspclient.hpp"
+
+#include <QCoreApplication>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QProcess>
+#include <QSet>
+#include <QStandardPaths>
+#include <QTextBlock>
+#include <QTextCursor>
+#include <QTextDocument>
+#include <QTimer>
+#include <QUrl>
+#include <algorithm>
+#include <utility>
+
+namespace {
+
+constexpr int kShutdownMs = 500;
+constexpr int kMaxItems   = 200; // clangd's own default is 100
+// Items clangd ranks this high count as often used words, which lifts them in the fuzzy match
+constexpr int kTopItems = 8;
+
+constexpr const char *kSeverities[] = {"error", "warning", "note", "hint"};
+
+// The language clangd should take `fileName` for, or an empty string for other files
+QString languageOf(const QString &fileName) {
+  const QString suffix = QFileInfo(fileName).suffix().toLower();
+  if (suffix == "c") return "c";
+  static const QStringList cpp{"h",  "cc",  "cp",  "cpp", "cxx", "c++", "hh",
+                               "hp", "hpp", "hxx", "h++", "inl", "ipp", "tcc"};
+  return cpp.contains(suffix) ? "cpp" : QString();
+}
+
+// A selection's text as toPlainText() has it, character for character
+QString plainText(QString text) {
+  for (QChar &c : text) {
+    if (c == QChar::ParagraphSeparator || c == QChar::LineSeparator) {
+      c = u'\n';
+    } else if (c == QChar::Nbsp) {
+      c = u' ';
+    }
+  }
+  return text;
+}
+
+bool isIdentifierPart(QChar c) { return c.isLetterOrNumber() || c == u'_'; }
+
+QJsonObject lspPosition(int line, int character) {
+  return {{"line", line}, {"character", character}};
+}
+
+QJsonObject lspPosition(const QTextDocument *document, int position) {
+  const QTextBlock block = document->findBlock(position);
+  return lspPosition(block.blockNumber(), position - block.position());
+}
+
+} // namespace
+
+LspClient::LspClient(QTextDocument *document, QObject *parent)
+    : QObject(parent), document(document), changeTimer(new QTimer(this)),
+      completionTimer(new QTimer(this)) {
+  parser.setMaxThreadCount(1);
+
+  changeTimer->setSingleShot(true);
+  changeTimer->setInterval(changeDelayMs);
+  connect(changeTimer, &QTimer::timeout, this, &LspClient::sendChanges);
+  completionTimer->setSingleShot(true);
+  completionTimer->setInterval(completionDelayMs);
+  connect(completionTimer, &QTimer::timeout, this, &LspClient::sendCompletion);
+  connect(document, &QTextDocument::contentsChange, this, &LspClient::contentsChange);
+
+  // Queued to the GUI thread
+  connect(this, &LspClient::workerInitialized, this, [this](bool incrementalSync) {
+    if (!process) return;
+    initialized = true;
+    incremental = incrementalSync;
+    notify("initialized", {});
+    for (const QByteArray &message : std::exchange(queued, {})) process->write(message);
+  });
+  connect(this, &LspClient::workerCompleted, this, [this](quint64 request, bool incomplete) {
+    if (!isLatest(request)) return;
+    inFlight             = 0;
+    completionIncomplete = incomplete;
+    emit completionsChanged();
+  });
+  connect(this, &LspClient::workerRequest, this, [this](const QJsonValue &id) {
+    // This client registers for nothing, so nothing clangd asks needs more than an answer
+    if (process) write({{"jsonrpc", "2.0"}, {"id", id}, {"result", QJsonValue()}});
+  });
+  connect(this, &LspClient::workerDiagnostics, this, &LspClient::diagnosticsChanged);
+  connect(this, &LspClient::workerMessage, this, &LspClient::message);
+}
+
+LspClient::~LspClient() {
+  stop();
+  parser.waitForDone();
+}
+
+void LspClient::openDocument(const QString &fileName) {
+  const QString language = languageOf(fileName);
+  const QString next     = language.isEmpty()
+                               ? QString()
+                               : QString::fromUtf8(QUrl::fromLocalFile(fileName).toEncoded());
+  if (!uri.isEmpty() && next == uri) return;
+  closeDocument();
+  if (next.isEmpty() || !start()) return;
+
+  uri      = next;
+  version  = 1;
+  synced   = document->toPlainText();
+  revision = document->revision();
+  notify("textDocument/didOpen",
+         {{"textDocument", QJsonObject{{"uri", uri},
+                                       {"languageId", language},
+                                       {"version", version},
+                                       {"text", synced}}}});
+}
+
+void LspClient::closeDocument() {
+  if (uri.isEmpty()) return;
+  changes.clear();
+  changeTimer->stop();
+  completionTimer->stop();
+  notify("textDocument/didClose", {{"textDocument", QJsonObject{{"uri", uri}}}});
+  uri.clear();
+  synced.clear();
+  completionStart = -1;
+  dropItems();
+}
+
+void LspClient::complete(int position) {
+  if (uri.isEmpty()) return;
+  const QTextBlock block = document->findBlock(position);
+  const QString text     = block.text();
+  int start              = position - block.position();
+  while (start > 0 && isIdentifierPart(text[start - 1])) --start;
+  start += block.position();
+
+  // The items for the word so far are all there is for a longer one; the fuzzy match narrows
+  // them
+  if (start == completionStart && !completionIncomplete && position >= completionPosition) {
+    return;
+  }
+  if (start != completionStart) {
+    completionStart = start;
+    dropItems();
+  }
+  completionPosition = position;
+  completionTimer->start();
+}
+
+std::shared_ptr<const SymbolArena> LspClient::symbols() const {
+  const std::lock_guard<std::mutex> lock(mutex);
+  return items;
+}
+
+bool LspClient::start() {
+  if (process) return true;
+  if (failed) return false;
+  const QString path = QStandardPaths::findExecutable(clangd);
+  if (path.isEmpty()) {
+    failed = true;
+    emit message(tr("%1 was not found; semantic completion is off").arg(clangd));
+    return false;
+  }
+
+  process = new QProcess(this);
+  if (!root.isEmpty()) process->setWorkingDirectory(root);
+  connect(process, &QProcess::readyReadStandardOutput, this, [this] {
+    parser.start([this, data = process->readAllStandardOutput()] { parse(data); });
+  });
+  connect(process, &QProcess::readyReadStandardError, this, [this] {
+    const QStringList lines =
+        QString::fromUtf8(process->readAllStandardError()).split('\n', Qt::SkipEmptyParts);
+    for (const QString &line : lines) emit message("clangd: " + line.trimmed());
+  });
+  connect(process, &QProcess::errorOccurred, this, [this](QProcess::ProcessError error) {
+    if (error != QProcess::FailedToStart) return;
+    failed = true;
+    emit message(tr("%1 could not be started: %2").arg(clangd, process->errorString()));
+    reset();
+  });
+  connect(process, &QProcess::finished, this, [this](int exitCode) {
+    emit message(tr("clangd exited with code %1; it is started again with the next file")
+                     .arg(exitCode));
+    reset();
+  });
+  process->start(path, {"--log=error", "--header-insertion=never",
+                        QString("--limit-results=%1").arg(kMaxItems)});
+
+  const QJsonObject initializationOptions{
+      {"fallbackFlags", QJsonArray::fromStringList(fallbackFlags)}};
+
+  const QJsonValue rootUri =
+      root.isEmpty() ? QJsonValue() : QJsonValue(QUrl::fromLocalFile(root).toString());
+  // Positions are in UTF-16 code units, like QString's, which is the protocol's default
+  const QJsonObject capabilities{
+      {"textDocument",
+       QJsonObject{{"synchronization", QJsonObject{{"didSave", false}}},
+                   {"completion",
+                    QJsonObject{{"completionItem", QJsonObject{{"snippetSupport", false}}}}},
+                   {"publishDiagnostics", QJsonObject()}}}};
+  write({{"jsonrpc", "2.0"},
+         {"id", "initialize"},
+         {"method", "initialize"},
+         {"params",
+          QJsonObject{{"processId", QCoreApplication::applicationPid()},
+                      {"rootUri", rootUri},
+                      {"capabilities", capabilities},
+                      {"initializationOptions", initializationOptions}}}});
+  return true;
+}
+
+void LspClient::stop() {
+  if (!process) return;
+  process->disconnect(this);
+  if (initialized) {
+    write({{"jsonrpc", "2.0"}, {"id", "shutdown"}, {"method", "shutdown"}});
+    write({{"jsonrpc", "2.0"}, {"method", "exit"}});
+    process->closeWriteChannel();
+    if (!process->waitForFinished(kShutdownMs)) process->kill();
+  } else {
+    process->kill();
+  }
+  process->waitForFinished(kShutdownMs);
+  reset();
+}
+
+void LspClient::reset() {
+  if (process) {
+    process->disconnect(this);
+    process->deleteLater();
+    process = nullptr;
+  }
+  initialized = false;
+  queued.clear();
+  uri.clear();
+  synced.clear();
+  changes.clear();
+  changeTimer->stop();
+  completionTimer->stop();
+  completionStart = -1;
+  inFlight        = 0;
+  dropItems();
+  // A message cut short by the old process would run into the next one's
+  parser.start([this] { incoming.clear(); });
+}
+
+QByteArray LspClient::frame(const QJsonObject &message) {
+  const QByteArray body = QJsonDocument(message).toJson(QJsonDocument::Compact);
+  return "Content-Length: " + QByteArray::number(body.size()) + "\r\n\r\n" + body;
+}
+
+void LspClient::write(const QJsonObject &message) { process->write(frame(message)); }
+
+void LspClient::send(const QJsonObject &message) {
+  if (initialized) {
+    write(message);
+  } else {
+    queued.append(frame(message));
+  }
+}
+
+void LspClient::notify(const QString &method, const QJsonObject &params) {
+  send({{"jsonrpc", "2.0"}, {"method", method}, {"params", params}});
+}
+
+void LspClient::contentsChange(int position, int charsRemoved, int charsAdded) {
+  if (uri.isEmpty()) return;
+  // The highlighter reports its formatting as changes too
+  if (document->revision() == revision) return;
+  revision = document->revision();
+
+  // Replacing all of the text reports a character more than there is
+  const int length = document->characterCount() - 1; // without the last block's separator
+  if (position + charsRemoved > synced.size() || position + charsAdded > length) {
+    resync();
+    return;
+  }
+
+  // Text before `position` is as it was, so the start is found in the document. The end is
+  // counted on through the removed text, which only `synced` still has.
+  const QTextBlock block = document->findBlock(position);
+  Change change{block.blockNumber(), position - block.position(), 0, 0, position, {}, false};
+  change.endLine   = change.startLine;
+  change.endColumn = change.startColumn;
+  for (int i = position; i < position + charsRemoved; ++i) {
+    if (synced[i] == u'\n') {
+      ++change.endLine;
+      change.endColumn = 0;
+    } else {
+      ++change.endColumn;
+    }
+  }
+  QTextCursor cursor(document);
+  cursor.setPosition(position);
+  cursor.setPosition(position + charsAdded, QTextCursor::KeepAnchor);
+  change.text = plainText(cursor.selectedText());
+  synced.replace(position, charsRemoved, change.text);
+  if (synced.size() != length) {
+    resync();
+    return;
+  }
+  changeTimer->start();
+
+  // Typing on from the last change, or taking back what it typed, amends it
+  if (!changes.empty()) {
+    Change &last      = changes.back();
+    const int lastEnd = last.position + static_cast<int>(last.text.size());
+    if (charsRemoved == 0 && position == lastEnd) {
+      last.text += change.text;
+      return;
+    }
+    if (charsAdded == 0 && position >= last.position && position + charsRemoved == lastEnd) {
+      last.text.chop(charsRemoved);
+      return;
+    }
+  }
+  changes.push_back(std::move(change));
+}
+
+void LspClient::resync() {
+  synced = document->toPlainText();
+  changes.clear();
+  changes.push_back({0, 0, 0, 0, 0, synced, true});
+  changeTimer->start();
+}
+
+void LspClient::sendChanges() {
+  changeTimer->stop();
+  if (uri.isEmpty() || changes.empty()) return;
+
+  QJsonArray contentChanges;
+  if (!incremental) {
+    contentChanges.append(QJsonObject{{"text", synced}});
+  } else {
+    for (const Change &change : changes) {
+      if (change.full) {
+        contentChanges.append(QJsonObject{{"text", change.text}});
+        continue;
+      }
+      const QJsonObject range{{"start", lspPosition(change.startLine, change.startColumn)},
+                              {"end", lspPosition(change.endLine, change.endColumn)}};
+      contentChanges.append(QJsonObject{{"range", range}, {"text", change.text}});
+    }
+  }
+  changes.clear();
+  notify("textDocument/didChange",
+         {{"textDocument", QJsonObject{{"uri", uri}, {"version", ++version}}},
+          {"contentChanges", contentChanges}});
+}
+
+void LspClient::sendCompletion() {
+  if (uri.isEmpty()) return;
+  // clangd has to have the text being completed
+  sendChanges();
+  if (inFlight != 0) {
+    notify("$/cancelRequest", {{"id", QString("complete:%1").arg(inFlight)}});
+  }
+
+  const quint64 request = ++nextRequest;
+  {
+    const std::lock_guard<std::mutex> lock(mutex);
+    latestCompletion = request;
+  }
+  inFlight = request;
+  send({{"jsonrpc", "2.0"},
+         {"id", QString("complete:%1").arg(request)},
+         {"method", "textDocument/completion"},
+         {"params", QJsonObject{{"textDocument", QJsonObject{{"uri", uri}}},
+                                {"position", lspPosition(document, completionPosition)}}}});
+}
+
+void LspClient::dropItems() {
+  // Responses to requests made before are dropped too
+  const std::lock_guard<std::mutex> lock(mutex);
+  latestCompletion = ++nextRequest;
+  items.reset();
+}
+
+bool LspClient::isLatest(quint64 request) const {
+  const std::lock_guard<std::mutex> lock(mutex);
+  return request == latestCompletion;
+}
+
+void LspClient::parse(const QByteArray &data) {
+  incoming += data;
+  for (;;) {
+    // Content-Length: <n>\r\n, maybe other fields, \r\n, then n bytes of JSON
+    const qsizetype headerEnd = incoming.indexOf("\r\n\r\n");
+    if (headerEnd < 0) return;
+    qsizetype length                = -1;
+    const QList<QByteArray> fields = incoming.left(headerEnd).split('\n');
+    for (const QByteArray &field : fields) {
+      if (field.toLower().startsWith("content-length:")) {
+        length = field.mid(15).trimmed().toLongLong();
+      }
+    }
+    const qsizetype bodyStart = headerEnd + 4;
+    if (length < 0) {
+      incoming.remove(0, bodyStart);
+      continue;
+    }
+    if (incoming.size() - bodyStart < length) return;
+
+    const QJsonDocument json = QJsonDocument::fromJson(incoming.mid(bodyStart, length));
+    incoming.remove(0, bodyStart + length);
+    if (json.isObject()) dispatch(json.object());
+  }
+}
+
+void LspClient::dispatch(const QJsonObject &message) {
+  const QString method = message.value("method").toString();
+  const QJsonValue id  = message.value("id");
+  if (!method.isEmpty() && !id.isUndefined()) {
+    emit workerRequest(id);
+    return;
+  }
+
+  const QJsonObject params = message.value("params").toObject();
+  if (method == "textDocument/publishDiagnostics") {
+    QStringList diagnostics;
+    for (const QJsonValue &value : params.value("diagnostics").toArray()) {
+      const QJsonObject diagnostic = value.toObject();
+      const QJsonObject start =
+          diagnostic.value("range").toObject().value("start").toObject();
+      const int severity = std::clamp(diagnostic.value("severity").toInt(1), 1, 4);
+      diagnostics.append(QString("%1:%2: %3: %4")
+                             .arg(start.value("line").toInt() + 1)
+                             .arg(start.value("character").toInt() + 1)
+                             .arg(QString::fromLatin1(kSeverities[severity - 1]),
+                                  diagnostic.value("message").toString()));
+    }
+    emit workerDiagnostics(QUrl(params.value("uri").toString()).toLocalFile(), diagnostics);
+    return;
+  }
+  if (method == "window/showMessage") {
+    // Errors and warnings; logMessage is left to clangd's own log
+    if (params.value("type").toInt() <= 2) {
+      emit workerMessage("clangd: " + params.value("message").toString());
+    }
+    return;
+  }
+
+  const QString request = id.toString();
+  if (request == "initialize") {
+    // TextDocumentSyncKind Incremental is 2, given alone or as an option's `change`
+    const QJsonValue sync =
+        message.value("result").toObject().value("capabilities").toObject().value(
+            "textDocumentSync");
+    const int kind = sync.isObject() ? sync.toObject().value("change").toInt() : sync.toInt();
+    emit workerInitialized(kind == 2);
+  } else if (request.startsWith("complete:")) {
+    completed(request.mid(9).toULongLong(), message.value("result"));
+  }
+}
+
+void LspClient::completed(quint64 request, const QJsonValue &result) {
+  if (!isLatest(request)) return;
+
+  // A CompletionList, or just its items
+  const QJsonArray list =
+      result.isArray() ? result.toArray() : result.toObject().value("items").toArray();
+  const bool incomplete = result.toObject().value("isIncomplete").toBool();
+
+  // The word each item inserts, in clangd's order; overloads insert the same one
+  std::vector<std::pair<QString, QString>> ranked; // sortText, word
+  ranked.reserve(static_cast<std::size_t>(list.size()));
+  for (const QJsonValue &value : list) {
+    const QJsonObject item = value.toObject();
+    QString word           = item.value("filterText").toString();
+    if (word.isEmpty()) word = item.value("insertText").toString();
+    if (word.isEmpty()) word = item.value("label").toString().trimmed();
+    if (word.isEmpty()) continue;
+    ranked.emplace_back(item.value("sortText").toString(word), word);
+  }
+  std::stable_sort(ranked.begin(), ranked.end(),
+                   [](const auto &a, const auto &b) { return a.first < b.first; });
+
+  auto arena = std::make_shared<SymbolArena>();
+  QSet<QString> seen;
+  for (const auto &[sortText, word] : ranked) {
+    if (seen.contains(word)) continue;
+    seen.insert(word);
+    arena->add(word.toStdU16String(), seen.size() <= kTopItems ? kTopItems : 1);
+  }
+
+  {
+    const std::lock_guard<std::mutex> lock(mutex);
+    if (request != latestCompletion) return;
+    items = std::move(arena);
+  }
+  emit workerCompleted(request, incomplete);
+}
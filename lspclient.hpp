@@ -0,0 +1,135 @@
+#ifndef FDE5A3A5_A4F6_4A05_8F11_D82A3D78677C
+#define FDE5A3A5_A4F6_4A05_8F11_D82A3D78677C
+
+#include <QJsonObject>
+#include <QJsonValue>
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QThreadPool>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "completionengine.hpp"
+
+class QProcess;
+class QTextDocument;
+class QTimer;
+
+// Talks to clangd, over JSON-RPC on its standard input and output, about the file open in a
+// QTextDocument. Edits are sent as the ranges QTextDocument::contentsChange reports, collected
+// for a moment and merged where one continues the last, so typing in a long file sends a few
+// characters rather than the file. Messages from clangd are split and parsed on a worker
+// thread. Completions are a CompletionSource: the items of the latest request, which clangd
+// has already narrowed to the word being typed, are fuzzy matched with the other sources'
+// words. A request is only sent again once the word starts somewhere else or clangd said the
+// items were incomplete; a newer request cancels the one in flight.
+class LspClient : public QObject, public CompletionSource {
+  Q_OBJECT
+
+public:
+  static constexpr int changeDelayMs     = 150; // edits are collected this long before sending
+  static constexpr int completionDelayMs = 30;  // keystrokes this close share one request
+
+  explicit LspClient(QTextDocument *document, QObject *parent = nullptr);
+  ~LspClient() override; // shuts clangd down
+
+  // clangd is started on the first openDocument(); these apply from then on.
+  void setProgram(const QString &program) {
+    clangd = program;
+    failed = false;
+  }
+  [[nodiscard]] QString program() const { return clangd; }
+  void setRootPath(const QString &path) { root = path; }
+  // Compiler flags for files that no compile_commands.json covers.
+  void setFallbackFlags(const QStringList &flags) { fallbackFlags = flags; }
+
+  // Tells clangd that the document now holds `fileName`. Files that are not C or C++ are not
+  // sent; the document's edits are followed until closeDocument() or the next file.
+  void openDocument(const QString &fileName);
+  void closeDocument();
+
+  // Asks for the completions of the word that ends at `position` of the document.
+  void complete(int position);
+
+  [[nodiscard]] std::shared_ptr<const SymbolArena> symbols() const override;
+
+signals:
+  // New completion items came in; the word being completed should be matched again.
+  void completionsChanged();
+  // clangd's diagnostics for `fileName`, as "line:column: severity: message", all of them.
+  void diagnosticsChanged(const QString &fileName, const QStringList &diagnostics);
+  // Something to tell the user, such as clangd not being installed.
+  void message(const QString &text);
+
+  // Emitted from the parser.
+  void workerInitialized(bool incrementalSync);
+  void workerCompleted(quint64 request, bool incomplete);
+  void workerDiagnostics(const QString &fileName, const QStringList &diagnostics);
+  void workerRequest(const QJsonValue &id);
+  void workerMessage(const QString &text);
+
+private:
+  // A contentChanges entry: `text` replaces a range of the text as clangd has it so far
+  struct Change {
+    int startLine;
+    int startColumn;
+    int endLine;
+    int endColumn;
+    int position; // of `text` in the document, to tell whether the next edit continues it
+    QString text;
+    bool full; // `text` is the whole document
+  };
+
+  QTextDocument *document;
+  QProcess *process = nullptr;
+  QString clangd    = "clangd";
+  QString root;
+  QStringList fallbackFlags;
+  bool failed      = false; // clangd could not be started; it is not tried again
+  bool initialized = false; // clangd answered initialize
+  bool incremental = true;  // clangd takes ranges; otherwise changes send the whole text
+  QList<QByteArray> queued; // messages held back until initialized
+
+  QString uri;                 // of the open file, or empty
+  int version  = 0;            // of the text clangd has
+  int revision = -1;           // QTextDocument::revision() that `synced` is of
+  QString synced;              // the text with `changes` applied
+  std::vector<Change> changes; // not sent yet
+  QTimer *changeTimer;         // sends `changes`
+
+  QTimer *completionTimer;          // sends the request for completionPosition
+  int completionPosition    = 0;    // of the latest request
+  int completionStart       = -1;   // where the word the items are for starts
+  bool completionIncomplete = true; // clangd has more for a longer word
+  quint64 nextRequest       = 0;
+  quint64 inFlight          = 0; // completion request not answered yet, to cancel
+
+  QThreadPool parser;  // one thread, so that messages are handled in order
+  QByteArray incoming; // read but not parsed yet; used by the parser only
+  // Guards the two below; symbols() reads items on the completion thread, and the parser
+  // checks latestCompletion
+  mutable std::mutex mutex;
+  quint64 latestCompletion = 0; // only its response is used
+  std::shared_ptr<const SymbolArena> items;
+
+  bool start();
+  void stop();
+  void reset();
+  static QByteArray frame(const QJsonObject &message);
+  void write(const QJsonObject &message);
+  void send(const QJsonObject &message); // held back until initialized
+  void notify(const QString &method, const QJsonObject &params);
+  void contentsChange(int position, int charsRemoved, int charsAdded);
+  void resync();
+  void sendChanges();
+  void sendCompletion();
+  void dropItems();
+  [[nodiscard]] bool isLatest(quint64 request) const;
+  void parse(const QByteArray &data);
+  void dispatch(const QJsonObject &message);
+  void completed(quint64 request, const QJsonValue &result);
+};
+
+#endif /* FDE5A3A5_A4F6_4A05_8F11_D82A3D78677C */
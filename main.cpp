@@ -1,11 +1,12 @@
 #include <QAction>
 #include <QApplication>
 #include <QComboBox>
+#include <QElapsedTimer>
 #include <QFileDialog>
-#include <QFileSystemModel>
 #include <QFont>
 #include <QFontDialog>
 #include <QIcon>
+#include <QInputDialog>
 #include <QLineEdit>
 #include <QMainWindow>
 #include <QMenu>
@@ -13,6 +14,7 @@
 #include <QMessageBox>
 #include <QPainter>
 #include <QProcess>
+#include <QProgressBar>
 #include <QScrollBar>
 #include <QSettings>
 #include <QSplitter>
@@ -21,10 +23,65 @@
 #include <QTextEdit>
 #include <QTimer>
 #include <QToolBar>
+#include <QToolButton>
 #include <QTreeView>
 #include <QVBoxLayout>
-
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <utility>
+
+#include "clangformat.hpp"
+#include "completionengine.hpp"
+#include "editedlines.hpp"
 #include "editor.hpp"
+#include "fileloader.hpp"
+#include "filesaver.hpp"
+#include "findbar.hpp"
+#include "findinfiles.hpp"
+#include "jobrunner.hpp"
+#include "largetextview.hpp"
+#include "lspclient.hpp"
+#include "pathindexer.hpp"
+#include "projectsymbols.hpp"
+#include "projecttree.hpp"
+#include "quickopen.hpp"
+
+// Per-phase startup timings, printed when run with --trace-startup
+class StartupTrace {
+public:
+  // Time to the first painted frame that startup should stay under
+  static constexpr qint64 firstFrameBudgetMs = 250;
+
+  static void start(bool enabled) {
+    tracing = enabled;
+    timer.start();
+  }
+
+  static void mark(const char *phase) {
+    if (!tracing) return;
+    const qint64 now = timer.elapsed();
+    qDebug().noquote() << QString("startup: %1 ms (+%2 ms) %3").arg(now).arg(now - last).arg(phase);
+    last = now;
+  }
+
+  static void firstFrame() {
+    mark("first frame");
+    if (tracing && timer.elapsed() > firstFrameBudgetMs) {
+      qWarning("startup: first frame took longer than the %lld ms budget", firstFrameBudgetMs);
+    }
+  }
+
+  static void finish() {
+    mark("file loaded");
+    tracing = false;
+  }
+
+private:
+  static inline QElapsedTimer timer;
+  static inline qint64 last   = 0;
+  static inline bool tracing = false;
+};
 
 class EditorApp : public QMainWindow {
   Q_OBJECT
@@ -35,58 +92,96 @@ signals:
 public:
   EditorApp(QWidget *parent = nullptr) : QMainWindow(parent) {
     setupUi();
-    // Disable the signal to avoid emitting textChanged signal
     configureEditor();
+    StartupTrace::mark("setupUi");
     setupActions();
     setupMenus();
     setupToolBar();
-    loadSettings();
     setupShortcuts();
+    StartupTrace::mark("actions and menus");
+    loadSettings();
+    StartupTrace::mark("settings");
 
     // Set the focus to the text editor
-    fontDialog->setCurrentFont(textEditor->font());
     textEditor->setFocus();
-    textEditor->moveCursor(QTextCursor::End);
 
-    isDirty = false;
+    // Loading a file blocks the editor's signals, so only user edits get here
+    connect(textEditor, &QTextEdit::textChanged, [this] { isDirty = true; });
 
-    // connect textChanged after 500ms to avoid emitting the signal when loading
-    // a file
-    QTimer::singleShot(
-        500, [this] { connect(textEditor, &QTextEdit::textChanged, [this] { isDirty = true; }); });
+    // The startup file is opened once the window has been painted
+    textEditor->viewport()->installEventFilter(this);
   }
 
   ~EditorApp() override { saveSettings(); }
 
-  // Sets and opens the current file if passed from the command line
-  void setCurrentFile(const QString &fileName) {
-    currentFile = fileName;
+  // Sets the file to open after the first paint, instead of the most recent one. The file is
+  // created if it does not exist.
+  void setStartupFile(const QString &fileName) { startupFile = fileName; }
 
-    // If the file exists, open it
-    if (QFile::exists(fileName)) {
-      openFile(fileName);
-    } else {
-      QFile file(fileName);
-      if (file.open(QFile::WriteOnly | QFile::Text)) {
-        file.write("");
-        file.close();
-        openFile(fileName);
-      }
+protected:
+  bool eventFilter(QObject *watched, QEvent *event) override {
+    if (watched == textEditor->viewport() && event->type() == QEvent::Paint) {
+      textEditor->viewport()->removeEventFilter(this);
+      StartupTrace::firstFrame();
+      // Leave the event loop free to finish this frame first
+      QTimer::singleShot(0, this, &EditorApp::openStartupFile);
+      QTimer::singleShot(0, this, [this] { pathIndexer->setRootPath(fileModel->rootPath()); });
     }
+    return QMainWindow::eventFilter(watched, event);
   }
 
 private:
+  // Where a job's output goes
+  enum OutputChannel { BuildOutput, DisassemblyOutput };
+
   QSplitter *mainSplitter;        // main splitter for the file tree and text editor
+  QSplitter *rightSplitter;       // the editors over the output view and find in files
   QTreeView *fileTree;            // file tree view
   AutoIndentTextEdit *textEditor; // text editor for code editing
   QTextEdit *outputView;          // output view for the compiler and run process
+  LargeTextView *largeView;       // replaces textEditor for files of largeFileBytes or more
+  FileLoader *fileLoader;         // reads files into textEditor in the background
+  QProgressBar *loadProgress;     // status bar progress of fileLoader
+  QToolButton *cancelLoadButton;  // status bar button that cancels fileLoader
+  FileSaver *fileSaver;           // writes files in the background
   QTextEdit *disAssemblyView;     // disassembly view for the compiled program
-  QFileSystemModel *fileModel;    // model for the file tree
-  QProcess *compileProcess;       // process to compile the program
-  QProcess *runProcess;           // process to run the compiled program
+  ProjectTreeModel *fileModel;    // model for the file tree
+  PathIndexer *pathIndexer;       // paths of the project's files, for quickOpen
+  ProjectSymbols *projectSymbols; // declarations in them, for completion and Go to Definition
+  LspClient *lspClient;           // clangd, for completions and diagnostics of the open file
+  QString diagnosedFile;          // the file lspClient last reported diagnostics of
+  QStringList diagnostics;        // and those diagnostics, so unchanged ones are not repeated
+  QuickOpenDialog *quickOpen;     // Ctrl+P palette, created on first use
+  FindInFilesPanel *findInFiles;  // Ctrl+Shift+F panel, created on first use
+  FindBar *findBar;               // Ctrl+F find/replace bar under textEditor, created on first use
+  JobRunner *jobs;                // compiles, runs and disassembles the program in the background
   QProcess *clangFormat;          // process to format the code
-  QProcess *disAssembleProcess;   // process to format the code
+  QByteArray formatInput;         // text clangFormat is formatting
+  EditedLines editedLines;        // lines not formatted since they were edited
+  int editRevision      = 0;      // incremented by every edit; see markEditedLines()
+  int markedRevision    = -1;     // document revision that markEditedLines() last saw
+  int markedBlockCount  = 1;      // and the document's block count then
+  int formatSnapshot    = 0;      // editRevision when clangFormat was started
+  bool applyingFormat   = false;  // formatFinished() is editing the document
+  QString formatAfterSave;        // file whose save formats its edited lines once written
+  bool replacingAll     = false;  // findBar's Replace All is, and marks its lines itself
   QString currentFile;            // current file being edited
+  QString startupFile;            // file from the command line, opened after the first paint
+  int pendingLine   = -1;         // match to show once loading currentFile gets to its line
+  int pendingColumn = 0;
+  int pendingLength = 0;
+  // currentFile can be edited while it loads. Loaded text has to stay out of the undo stack,
+  // and the only way to keep it out, turning undo off, also clears the stack. So once there is
+  // something to undo, chunks are held back, and when the load ends the edits are undone, the
+  // held text is appended and the edits are made again as undoable steps.
+  struct LoadEdit {
+    int position;
+    int removed;
+    QString inserted;
+  };
+  QList<LoadEdit> loadEdits;      // edits made to currentFile while it loads
+  QString heldText;               // loaded text not yet appended
+  bool appendingLoad = false;     // loaded text is going into the document
   QStringList extraFiles;         // extra files to be compiled
   QStringList recentFiles;        // recently opened files
   QString compiler;               // compiler to use
@@ -103,17 +198,34 @@ private:
   QAction *actionCut;
   QAction *actionCopy;
   QAction *actionPaste;
+  QAction *actionGoToLine;
+  QAction *actionFind;
+
+  // jumps to where the name under the cursor is declared
+  QAction *actionGoToDefinition;
+
+  // opens a project file by fuzzy matching its path
+  QAction *actionQuickOpen;
+
+  // searches the project's files
+  QAction *actionFindInFiles;
 
   // Actions for the toolbar
   QAction *actionCompileAndRun;
   QAction *actionNew;
   QAction *actionRecentFiles;
   QAction *actionFormatCode;
-  QAction *actionBuild, *actionRun, *actionDisassemble;
+  QAction *actionBuild, *actionRun, *actionDisassemble, *actionStop;
 
   // formatOnSave toggle
   QAction *actionFormatOnSave;
 
+  // syncs the file's directory after saving, so the save survives a power loss
+  QAction *actionSyncOnSave;
+
+  // lists dotfiles in the file tree
+  QAction *actionShowHidden;
+
   // select widget for the compiler
   QComboBox *compilerSelect;
 
@@ -135,37 +247,72 @@ private:
   // Track if the editor is dirty
   bool isDirty = false;
 
+  // Files at least this large are highlighted lazily, visible range first
+  static constexpr qint64 lazyHighlightBytes = 1024 * 1024;
+
+  // Files at least this large are opened in the piece-table view instead of the text editor
+  static constexpr qint64 largeFileBytes = 64 * 1024 * 1024;
+
+  // Files at least this large, such as multi-GB build logs, are opened read-only
+  static constexpr qint64 viewerFileBytes = 512 * 1024 * 1024;
+
+  // Most -lines ranges passed to clang-format
+  static constexpr int maxFormatRanges = 64;
+
   void setupUi() {
     mainSplitter = new QSplitter(Qt::Horizontal, this);
 
+    // The tree shows the project containing the working directory, listed as it is expanded
     fileTree  = new QTreeView(mainSplitter);
-    fileModel = new QFileSystemModel(this);
-    fileModel->setRootPath(QDir::rootPath());
+    fileModel = new ProjectTreeModel(this);
+    fileModel->setRootPath(ProjectTreeModel::findProjectRoot(QDir::currentPath()));
     fileTree->setModel(fileModel);
-    fileTree->setRootIndex(fileModel->index(QDir::currentPath()));
+    fileTree->setUniformRowHeights(true);
 
-    // show hidden files
-    fileModel->setFilter(QDir::AllEntries | QDir::NoDotAndDotDot | QDir::Hidden);
+    // Indexed in the background once the window is up
+    pathIndexer = new PathIndexer(this);
+    quickOpen   = nullptr;
+    findInFiles = nullptr;
+    findBar     = nullptr;
 
     // set icons
     fileTree->setAnimated(false);
     fileTree->setIndentation(20);
-    fileTree->setSortingEnabled(true);
-    fileTree->setColumnWidth(0, 250);
 
+    connect(fileTree, &QTreeView::expanded, fileModel,
+            [this](const QModelIndex &index) { fileModel->setExpanded(index, true); });
+    connect(fileTree, &QTreeView::collapsed, fileModel,
+            [this](const QModelIndex &index) { fileModel->setExpanded(index, false); });
     connect(fileTree, &QTreeView::doubleClicked, this, &EditorApp::onFileSelected);
     // On Enter key press, open the file
     connect(fileTree, &QTreeView::activated, this, &EditorApp::onFileSelected);
 
-    auto *rightSplitter = new QSplitter(Qt::Vertical, mainSplitter);
+    rightSplitter = new QSplitter(Qt::Vertical, mainSplitter);
 
     // Set the syntax highlighter
     textEditor       = new AutoIndentTextEdit(rightSplitter);
     auto highlighter = new DraculaCppSyntaxHighlighter(textEditor->document());
     textEditor->setHighlighter(highlighter);
 
+    // Made after the editor, so its completion engine is gone before the source it reads
+    projectSymbols = new ProjectSymbols(pathIndexer, this);
+    textEditor->completionEngine()->addSource(projectSymbols);
+    lspClient = new LspClient(textEditor->document(), this);
+    lspClient->setRootPath(fileModel->rootPath());
+    textEditor->completionEngine()->addSource(lspClient);
+    connect(textEditor, &AutoIndentTextEdit::completionRequested, lspClient, &LspClient::complete);
+    connect(lspClient, &LspClient::completionsChanged, textEditor,
+            &AutoIndentTextEdit::refreshCompletions);
+
+    largeView = new LargeTextView(rightSplitter);
+    largeView->hide();
+    connect(largeView, &LargeTextView::modificationChanged, this,
+            [this](bool modified) { isDirty = modified; });
+
     outputView = new QTextEdit(rightSplitter);
     outputView->setReadOnly(true);
+    connect(lspClient, &LspClient::message, outputView, &QTextEdit::append);
+    connect(lspClient, &LspClient::diagnosticsChanged, this, &EditorApp::showDiagnostics);
 
     mainSplitter->addWidget(fileTree);
     mainSplitter->addWidget(rightSplitter);
@@ -173,26 +320,20 @@ private:
     // Set the text editor to take 70% of the available space
     mainSplitter->setStretchFactor(0, 1);
     mainSplitter->setStretchFactor(1, 6);
-    mainSplitter->setStretchFactor(2, 3);
 
     // let the output view take 20% of the available space vertically
     rightSplitter->setStretchFactor(0, 8);
     rightSplitter->setStretchFactor(1, 2);
 
-    // Create a disassembly view
-    disAssemblyView = new QTextEdit(mainSplitter);
-    disAssemblyView->setReadOnly(true);
-    disAssemblyView->setLineWrapMode(QTextEdit::NoWrap);
-    disAssemblyView->setStyleSheet(
-        "QTextEdit {"
-        "  background-color: #282a36;"
-        "  color: #faede3;"
-        "  selection-background-color: #6272a4;"
-        "  selection-color: #f8f8f2;"
-        "}");
+    // The disassembly view, clang-format and the font dialog are created on first use
+    disAssemblyView = nullptr;
+    clangFormat     = nullptr;
+    fontDialog      = nullptr;
 
-    // disable the disassembly view by default
-    mainSplitter->setStretchFactor(2, 0);
+    jobs = new JobRunner(this);
+    connect(jobs, &JobRunner::jobStarted, this, &EditorApp::jobStarted);
+    connect(jobs, &JobRunner::output, this, &EditorApp::jobOutput);
+    connect(jobs, &JobRunner::jobFinished, this, &EditorApp::jobFinished);
 
     // set the central widget
     setCentralWidget(mainSplitter);
@@ -200,11 +341,27 @@ private:
     setWindowTitle("Edit");
     resize(800, 600);
 
-    // Initialize the processes
-    compileProcess     = new QProcess(this);
-    runProcess         = new QProcess(this);
-    clangFormat        = new QProcess(this);
-    disAssembleProcess = new QProcess(this);
+    // Files are loaded in the background, with progress and a cancel button in the status bar
+    fileLoader   = new FileLoader(this);
+    loadProgress = new QProgressBar(this);
+    loadProgress->setMaximumWidth(160);
+    loadProgress->setTextVisible(false);
+    loadProgress->hide();
+    cancelLoadButton = new QToolButton(this);
+    cancelLoadButton->setIcon(QIcon::fromTheme("process-stop"));
+    cancelLoadButton->setToolTip(tr("Cancel loading"));
+    cancelLoadButton->hide();
+    statusBar()->addPermanentWidget(loadProgress);
+    statusBar()->addPermanentWidget(cancelLoadButton);
+
+    connect(fileLoader, &FileLoader::chunkLoaded, this, &EditorApp::appendLoadedText);
+    connect(fileLoader, &FileLoader::finished, this, &EditorApp::loadFinished);
+    connect(cancelLoadButton, &QToolButton::clicked, this, &EditorApp::cancelLoad);
+    connect(textEditor->document(), &QTextDocument::contentsChange, this,
+            &EditorApp::markEditedLines);
+
+    fileSaver = new FileSaver(this);
+    connect(fileSaver, &FileSaver::finished, this, &EditorApp::saveFinished);
 
     // edits for compiler and flags
     compilerSelect = new QComboBox(this);
@@ -217,18 +374,21 @@ private:
     ldFlagsEdit = new QLineEdit(this);
     ldFlagsEdit->setPlaceholderText("Linker flags");
 
-    fontDialog = new QFontDialog(this);
-
-    connect(fontDialog, &QFontDialog::fontSelected, [this](const QFont &font) {
-      if (font != currentFont) {
-        textEditor->setFont(font);
-        currentFont = font;
+    fontSelect = new QAction(QIcon::fromTheme("format-text-bold"), tr("Font"), this);
+    connect(fontSelect, &QAction::triggered, [this] {
+      if (!fontDialog) {
+        fontDialog = new QFontDialog(this);
+        connect(fontDialog, &QFontDialog::fontSelected, [this](const QFont &font) {
+          if (font != currentFont) {
+            textEditor->setFont(font);
+            currentFont = font;
+          }
+        });
       }
+      fontDialog->setCurrentFont(currentFont);
+      fontDialog->open();
     });
 
-    fontSelect = new QAction(QIcon::fromTheme("format-text-bold"), tr("Font"), this);
-    connect(fontSelect, &QAction::triggered, [this] { fontDialog->open(); });
-
     // Add the compiler and flags to the status bar
     statusBar()->addPermanentWidget(compilerSelect);
     statusBar()->addPermanentWidget(cFlagsEdit);
@@ -236,11 +396,14 @@ private:
 
     connect(compilerSelect, &QComboBox::currentTextChanged, [this](const QString &text) {
       compiler = text;
+      projectSymbols->setCompiler(text);
       statusBar()->showMessage(tr("Compiler changed to %1").arg(text), 2000);
     });
 
-    connect(cFlagsEdit, &QLineEdit::textChanged,
-            [this](const QString &text) { cFlags = text.split(" ", Qt::SkipEmptyParts); });
+    connect(cFlagsEdit, &QLineEdit::textChanged, [this](const QString &text) {
+      cFlags = text.split(" ", Qt::SkipEmptyParts);
+      lspClient->setFallbackFlags(cFlags);
+    });
 
     connect(ldFlagsEdit, &QLineEdit::textChanged,
             [this](const QString &text) { ldFlags = text.split(" ", Qt::SkipEmptyParts); });
@@ -256,15 +419,9 @@ private:
     font.setWeight(QFont::Normal);
 
     // configure fileTree
-    fileTree->setRootIndex(fileModel->index(QDir::currentPath()));
     fileTree->setAnimated(false);
     fileTree->setIndentation(20);
-    fileTree->setSortingEnabled(true);
-    fileTree->setColumnWidth(0, 250);
     fileTree->setHeaderHidden(true);
-    fileTree->hideColumn(1);
-    fileTree->hideColumn(2);
-    fileTree->hideColumn(3);
 
     // configure outputView
     outputView->setReadOnly(true);
@@ -311,6 +468,10 @@ private:
     actionOpen->setShortcut(QKeySequence::Open);
     connect(actionOpen, &QAction::triggered, this, &EditorApp::openFileDialog);
 
+    actionQuickOpen = new QAction(tr("&Quick Open..."), this);
+    actionQuickOpen->setShortcut(QKeySequence(Qt::CTRL | Qt::Key_P));
+    connect(actionQuickOpen, &QAction::triggered, this, &EditorApp::showQuickOpen);
+
     actionSave = new QAction(QIcon::fromTheme("document-save"), tr("&Save"), this);
     actionSave->setShortcut(QKeySequence::Save);
     connect(actionSave, &QAction::triggered, this, &EditorApp::saveFile);
@@ -341,6 +502,22 @@ private:
     connect(actionCopy, &QAction::triggered, textEditor, &QTextEdit::copy);
     connect(actionPaste, &QAction::triggered, textEditor, &QTextEdit::paste);
 
+    actionGoToLine = new QAction(tr("&Go to Line..."), this);
+    actionGoToLine->setShortcut(QKeySequence(Qt::CTRL | Qt::Key_G));
+    connect(actionGoToLine, &QAction::triggered, this, &EditorApp::goToLine);
+
+    actionFind = new QAction(QIcon::fromTheme("edit-find"), tr("&Find/Replace..."), this);
+    actionFind->setShortcut(QKeySequence::Find);
+    connect(actionFind, &QAction::triggered, this, &EditorApp::showFindBar);
+
+    actionGoToDefinition = new QAction(tr("Go to &Definition"), this);
+    actionGoToDefinition->setShortcut(QKeySequence(Qt::Key_F12));
+    connect(actionGoToDefinition, &QAction::triggered, this, &EditorApp::goToDefinition);
+
+    actionFindInFiles = new QAction(tr("Find in &Files..."), this);
+    actionFindInFiles->setShortcut(QKeySequence(Qt::CTRL | Qt::SHIFT | Qt::Key_F));
+    connect(actionFindInFiles, &QAction::triggered, this, &EditorApp::showFindInFiles);
+
     // Build actions
     actionCompileAndRun = new QAction(QIcon::fromTheme("system-run"), tr("&Compile and Run"), this);
     actionCompileAndRun->setShortcut(QKeySequence(Qt::CTRL | Qt::Key_B));
@@ -363,10 +540,20 @@ private:
     actionDisassemble->setShortcut(QKeySequence(Qt::CTRL | Qt::SHIFT | Qt::Key_D));
     connect(actionDisassemble, &QAction::triggered, this, &EditorApp::disassemble);
 
+    actionStop = new QAction(QIcon::fromTheme("process-stop"), tr("Stop"), this);
+    actionStop->setShortcut(QKeySequence(Qt::CTRL | Qt::Key_Period));
+    actionStop->setEnabled(false);
+    connect(actionStop, &QAction::triggered, this, [this] { jobs->stop(); });
+    connect(jobs, &JobRunner::runningChanged, actionStop, &QAction::setEnabled);
+
     actionNew = new QAction(QIcon::fromTheme("document-new"), tr("&New"), this);
     actionNew->setShortcut(QKeySequence::New);
 
     connect(actionNew, &QAction::triggered, [this] {
+      stopLoading();
+      showLargeView(false);
+      lspClient->closeDocument();
+      fileSaver->detach(textEditor->document());
       textEditor->clear();
       currentFile.clear();
 
@@ -391,12 +578,22 @@ private:
     actionFormatOnSave = new QAction(tr("Format on Save"), this);
     actionFormatOnSave->setCheckable(true);
     actionFormatOnSave->setChecked(true);
+
+    actionSyncOnSave = new QAction(tr("Sync to Disk on Save"), this);
+    actionSyncOnSave->setCheckable(true);
+    actionSyncOnSave->setChecked(true);
+    connect(actionSyncOnSave, &QAction::toggled, fileSaver, &FileSaver::setSyncDirectory);
+
+    actionShowHidden = new QAction(tr("Show Hidden Files"), this);
+    actionShowHidden->setCheckable(true);
+    connect(actionShowHidden, &QAction::toggled, fileModel, &ProjectTreeModel::setShowHidden);
   }
 
   void setupMenus() {
     QMenu *fileMenu = menuBar()->addMenu(tr("&File"));
     fileMenu->addAction(actionNew);
     fileMenu->addAction(actionOpen);
+    fileMenu->addAction(actionQuickOpen);
     fileMenu->addSeparator();
     fileMenu->addAction(actionSave);
     fileMenu->addAction(actionSaveAs);
@@ -412,15 +609,25 @@ private:
     editMenu->addAction(actionCopy);
     editMenu->addAction(actionPaste);
     editMenu->addSeparator();
+    editMenu->addAction(actionGoToLine);
+    editMenu->addAction(actionGoToDefinition);
+    editMenu->addAction(actionFind);
+    editMenu->addAction(actionFindInFiles);
+    editMenu->addSeparator();
     editMenu->addAction(actionFormatOnSave);
+    editMenu->addAction(actionSyncOnSave);
 
     QMenu *buildMenu = menuBar()->addMenu(tr("&Build"));
     buildMenu->addAction(actionCompileAndRun);
     buildMenu->addAction(actionBuild);
     buildMenu->addAction(actionRun);
     buildMenu->addAction(actionDisassemble);
+    buildMenu->addAction(actionStop);
     buildMenu->addSeparator();
     buildMenu->addAction(actionFormatCode);
+
+    QMenu *viewMenu = menuBar()->addMenu(tr("&View"));
+    viewMenu->addAction(actionShowHidden);
   }
 
   void setupToolBar() {
@@ -439,6 +646,7 @@ private:
     toolBar->addAction(actionBuild);
     toolBar->addAction(actionRun);
     toolBar->addAction(actionDisassemble);
+    toolBar->addAction(actionStop);
     toolBar->addSeparator();
     toolBar->addAction(actionFormatCode);
     toolBar->addSeparator();
@@ -454,10 +662,6 @@ private:
     recentFiles = settings.value("recentFiles").toStringList();
     recentFiles.removeDuplicates();
 
-    if (!recentFiles.isEmpty()) {
-      openFile(recentFiles.first());
-    }
-
     actionRecentFiles->setEnabled(!recentFiles.isEmpty());
     if (!recentFiles.isEmpty()) {
       // Populate the recent files menu
@@ -476,18 +680,43 @@ private:
     ldFlags = settings.value("ldFlags", QStringList({"-lm", "-lpthread"})).toStringList();
 
     compilerSelect->setCurrentText(compiler);
+    projectSymbols->setCompiler(compiler);
     cFlagsEdit->setText(cFlags.join(" "));
+    lspClient->setFallbackFlags(cFlags);
+    lspClient->setProgram(settings.value("clangdPath", "clangd").toString());
     ldFlagsEdit->setText(ldFlags.join(" "));
 
     actionFormatOnSave->setChecked(settings.value("formatOnSave", true).toBool());
+    actionSyncOnSave->setChecked(settings.value("syncOnSave", true).toBool());
+    actionShowHidden->setChecked(settings.value("showHiddenFiles", false).toBool());
+
+    // Completions arriving later than this after the keystroke are not shown
+    textEditor->completionEngine()->setLatencyBudget(
+        settings.value("completionBudgetMs", CompletionEngine::defaultBudgetMs).toInt());
 
     // font settings
     currentFont =
         settings.value("font", QFont("JetBrainsMonoNL Nerd Font Mono", 18)).value<QFont>();
     textEditor->setFont(currentFont);
-    fontDialog->setCurrentFont(currentFont);
+  }
+
+  void openStartupFile() {
+    if (!startupFile.isEmpty()) {
+      if (!QFile::exists(startupFile)) {
+        QFile file(startupFile);
+        if (!file.open(QFile::WriteOnly | QFile::Text)) {
+          QMessageBox::warning(this, tr("Error"), tr("Could not create file"));
+          StartupTrace::finish();
+          return;
+        }
+      }
+      openFile(startupFile);
+    } else if (!recentFiles.isEmpty()) {
+      openFile(recentFiles.first());
+    }
 
-    qDebug() << "Loaded Font: " << currentFont;
+    // Files the background loader reads are finished in loadFinished()
+    if (!fileLoader->isLoading()) StartupTrace::finish();
   }
 
   void saveSettings() {
@@ -510,6 +739,10 @@ private:
     settings.setValue("cFlags", cFlags);
     settings.setValue("ldFlags", ldFlags);
     settings.setValue("formatOnSave", actionFormatOnSave->isChecked());
+    settings.setValue("syncOnSave", actionSyncOnSave->isChecked());
+    settings.setValue("showHiddenFiles", actionShowHidden->isChecked());
+    settings.setValue("completionBudgetMs", textEditor->completionEngine()->latencyBudget());
+    settings.setValue("clangdPath", lspClient->program());
 
     // Font settings
     settings.setValue("font", currentFont);
@@ -528,6 +761,55 @@ private slots:
     }
   }
 
+  void showQuickOpen() {
+    if (!quickOpen) {
+      quickOpen = new QuickOpenDialog(pathIndexer, this);
+      connect(quickOpen, &QuickOpenDialog::fileSelected, this, &EditorApp::openFile);
+    }
+    quickOpen->popup();
+  }
+
+  void showFindBar() {
+    if (largeFileOpen()) {
+      statusBar()->showMessage(tr("Find is not available for large files; use Ctrl+G"), 2000);
+      return;
+    }
+    if (!findBar) {
+      findBar = new FindBar(textEditor, rightSplitter);
+      rightSplitter->insertWidget(rightSplitter->indexOf(largeView) + 1, findBar);
+      connect(findBar, &FindBar::aboutToReplaceAll, this, [this] { replacingAll = true; });
+      connect(findBar, &FindBar::replacedAll, this, &EditorApp::markReplacedLines);
+    }
+    findBar->activate();
+  }
+
+  void showFindInFiles() {
+    if (!findInFiles) {
+      findInFiles = new FindInFilesPanel(pathIndexer, rightSplitter);
+      rightSplitter->addWidget(findInFiles);
+      rightSplitter->setStretchFactor(rightSplitter->indexOf(findInFiles), 2);
+      connect(findInFiles, &FindInFilesPanel::locationActivated, this, &EditorApp::openLocation);
+    }
+    findInFiles->activate(largeFileOpen() ? QString() : textEditor->textCursor().selectedText());
+  }
+
+  // Opens `fileName` with the match at `line`, `column` and `length` selected. A small file is
+  // still loading after openFile(), so the match is shown once the loader gets to its line.
+  void openLocation(const QString &fileName, int line, int column, int length) {
+    if (QDir::cleanPath(fileName) != QDir::cleanPath(currentFile)) {
+      openFile(fileName);
+      if (QDir::cleanPath(fileName) != QDir::cleanPath(currentFile)) return;
+    }
+    if (!largeFileOpen() && fileLoader->isLoading() &&
+        textEditor->document()->blockCount() <= line + 1) {
+      pendingLine   = line;
+      pendingColumn = column;
+      pendingLength = length;
+      return;
+    }
+    showLocation(line, column, length);
+  }
+
   void openFileDialog() {
     QString fileName = QFileDialog::getOpenFileName(this, tr("Open File"), QDir::currentPath());
     if (!fileName.isEmpty()) {
@@ -536,126 +818,384 @@ private slots:
   }
 
   void openFile(const QString &fileName) {
+    pendingLine       = -1;
+    const qint64 size = QFileInfo(fileName).size();
+    if (size >= largeFileBytes) {
+      openLargeFile(fileName, size >= viewerFileBytes);
+      return;
+    }
+
+    // Fail early, keeping the current document, if the file cannot be read at all
     QFile file(fileName);
-    if (file.open(QFile::ReadOnly | QFile::Text)) {
-      // block signals to avoid emitting textChanged signal
-      // otherwise the editor will be marked as dirty when loading a file
-      textEditor->blockSignals(true);
-      textEditor->setPlainText(file.readAll());
-      textEditor->blockSignals(false);
-      isDirty = false;
+    if (!file.open(QFile::ReadOnly)) {
+      QMessageBox::warning(this, tr("Error"), tr("Could not open file"));
+      return;
+    }
+    file.close();
 
-      currentFile = fileName;
-      statusBar()->showMessage(tr("File loaded"), 2000);
-      file.close();
+    stopLoading();
+    showLargeView(false);
+    // clangd is told of the file once all of it is loaded
+    lspClient->closeDocument();
+    fileSaver->detach(textEditor->document());
 
-      // Add the file to the recent files list
-      if (recentFiles.contains(currentFile)) {
-        recentFiles.removeAll(currentFile);
-      }
-      recentFiles.prepend(currentFile);
+    // block signals to avoid emitting textChanged signal
+    // otherwise the editor will be marked as dirty when loading a file
+    textEditor->blockSignals(true);
+    textEditor->getHighlighter()->setLazy(size >= lazyHighlightBytes);
+    textEditor->getHighlighter()->setGrammar(Grammar::forFile(fileName));
+    textEditor->clear();
+    textEditor->blockSignals(false);
 
-      // update the window title
-      setWindowTitle(QString("%1 - Edit").arg(currentFile));
+    // The file can be edited, with undo, as soon as its first chunk is in
+    textEditor->setReadOnly(true);
+    textEditor->document()->setUndoRedoEnabled(false);
+    fileOpened(fileName);
 
-      // emit the fileSaved signal to format the code if formatOnSave is enabled
-      if (actionFormatOnSave->isChecked()) {
-        formatCode();
-      }
-    } else {
-      QMessageBox::warning(this, tr("Error"), tr("Could not open file"));
+    loadProgress->setRange(0, 1000);
+    loadProgress->setValue(0);
+    loadProgress->show();
+    cancelLoadButton->show();
+    fileLoader->start(fileName);
+  }
+
+  void appendLoadedText(const QString &text, qint64 bytesRead, qint64 totalBytes) {
+    if (totalBytes > 0) loadProgress->setValue(static_cast<int>(bytesRead * 1000 / totalBytes));
+
+    QTextDocument *document = textEditor->document();
+    if (!heldText.isEmpty() || document->isUndoAvailable() || document->isRedoAvailable()) {
+      heldText += text;
+      return;
+    }
+
+    // Nothing to undo yet, so turning undo off for the append loses nothing
+    const bool first = textEditor->isReadOnly();
+    document->setUndoRedoEnabled(false);
+    QTextCursor end(document);
+    end.movePosition(QTextCursor::End);
+    appendingLoad = true;
+    textEditor->blockSignals(true);
+    end.insertText(text);
+    textEditor->blockSignals(false);
+    appendingLoad = false;
+    document->setUndoRedoEnabled(true);
+
+    if (first) {
+      // The editor's cursor sat at the insertion point and moved with the text
+      textEditor->moveCursor(QTextCursor::Start);
+      textEditor->setReadOnly(false);
+    }
+
+    // The last block may still be cut short by the chunk boundary
+    if (pendingLine >= 0 && textEditor->document()->blockCount() > pendingLine + 1) {
+      showPendingLocation();
     }
   }
 
-  void saveFile() {
-    if (currentFile.isEmpty()) {
-      saveFileAs();
-    } else {
-      saveToFile(currentFile);
+  void showPendingLocation() {
+    const int line = std::exchange(pendingLine, -1);
+    showLocation(line, pendingColumn, pendingLength);
+  }
+
+  void loadFinished(const QString &error, bool malformedUtf8) {
+    if (error.isEmpty()) appendHeldText();
+    endLoading();
+    StartupTrace::finish();
+    if (!error.isEmpty()) {
+      pendingLine = -1;
+      QMessageBox::warning(this, tr("Error"), tr("Could not read file: %1").arg(error));
+      detachFromFile();
+      return;
     }
+    if (pendingLine >= 0) showPendingLocation();
 
-    isDirty = false;
+    statusBar()->showMessage(malformedUtf8 ? tr("File loaded; invalid UTF-8 was replaced")
+                                           : tr("File loaded"),
+                             2000);
+    lspClient->openDocument(currentFile);
+
+    // format the code if formatOnSave is enabled, now that all of it is there
     if (actionFormatOnSave->isChecked()) {
       formatCode();
     }
   }
 
-  void saveFileAs() {
-    QString fileName = QFileDialog::getSaveFileName(this, tr("Save File As"), QDir::currentPath());
-    if (!fileName.isEmpty()) {
-      saveToFile(fileName);
+  // Stops loading at the user's request. The text loaded so far stays, but no longer belongs
+  // to the file, so that saving cannot truncate it.
+  void cancelLoad() {
+    if (!fileLoader->isLoading()) return;
+    stopLoading();
+    detachFromFile();
+    statusBar()->showMessage(tr("Loading cancelled"), 2000);
+  }
+
+  void stopLoading() {
+    if (fileLoader->isLoading()) {
+      fileLoader->cancel();
+      endLoading();
     }
   }
 
-  void saveToFile(const QString &fileName) {
-    QFile file(fileName);
-    if (file.open(QFile::WriteOnly | QFile::Text)) {
-      file.write(textEditor->toPlainText().toUtf8());
-      currentFile = fileName;
-      statusBar()->showMessage(tr("File saved"), 2000);
-    } else {
-      QMessageBox::warning(this, tr("Error"), tr("Could not save file"));
+  // Appends the text held back since the first edit under the edits, which stay undoable
+  void appendHeldText() {
+    if (heldText.isEmpty()) return;
+
+    QTextDocument *document   = textEditor->document();
+    const QTextCursor editing = textEditor->textCursor();
+    const int anchor          = editing.anchor();
+    const int position        = editing.position();
+
+    appendingLoad = true;
+    textEditor->blockSignals(true);
+    while (document->isUndoAvailable()) document->undo();
+    document->setUndoRedoEnabled(false);
+    QTextCursor cursor(document);
+    cursor.movePosition(QTextCursor::End);
+    cursor.insertText(std::exchange(heldText, QString()));
+    document->setUndoRedoEnabled(true);
+
+    // The edits were all before the held text, so their positions still hold
+    for (const LoadEdit &edit : std::as_const(loadEdits)) {
+      const int last = document->characterCount() - 1;
+      cursor.setPosition(std::min(edit.position, last));
+      cursor.setPosition(std::min(edit.position + edit.removed, last), QTextCursor::KeepAnchor);
+      cursor.insertText(edit.inserted);
     }
+    textEditor->blockSignals(false);
+    appendingLoad = false;
+
+    QTextCursor restored(document);
+    restored.setPosition(anchor);
+    restored.setPosition(position, QTextCursor::KeepAnchor);
+    textEditor->setTextCursor(restored);
   }
 
-  void compileAndRun() {
-    if (currentFile.isEmpty()) {
-      QMessageBox::warning(this, tr("Error"), tr("No file to compile"));
+  void endLoading() {
+    heldText.clear();
+    loadEdits.clear();
+    textEditor->setReadOnly(false);
+    textEditor->document()->setUndoRedoEnabled(true);
+    loadProgress->hide();
+    cancelLoadButton->hide();
+  }
+
+  void detachFromFile() {
+    lspClient->closeDocument();
+    currentFile.clear();
+    setWindowTitle("untitled - Edit");
+  }
+
+  // Opens a large file in the piece-table view. Nothing is read up front: the file is mapped
+  // and only the visible lines are decoded.
+  void openLargeFile(const QString &fileName, bool readOnly) {
+    stopLoading();
+
+    QString error;
+    if (!largeView->openFile(fileName, &error, readOnly)) {
+      QMessageBox::warning(this, tr("Error"), tr("Could not open file: %1").arg(error));
       return;
     }
 
-    if (compile()) {
-      run();
+    const QString suffix = QFileInfo(fileName).suffix().toLower();
+    largeView->setFont(textEditor->font());
+    largeView->setSyntaxHighlighting(
+        QStringList{"c", "cc", "cpp", "cxx", "h", "hh", "hpp", "hxx"}.contains(suffix));
+    showLargeView(true);
+
+    // Free the previous document; the text editor is not used until a small file is opened
+    lspClient->closeDocument();
+    fileSaver->detach(textEditor->document());
+    textEditor->blockSignals(true);
+    textEditor->clear();
+    textEditor->blockSignals(false);
+    fileOpened(fileName);
+    statusBar()->showMessage(readOnly ? tr("File opened read-only") : tr("File loaded"), 2000);
+  }
+
+  void showLargeView(bool large) {
+    largeView->setVisible(large);
+    textEditor->setVisible(!large);
+    if (large) {
+      if (findBar) findBar->hide();
+      largeView->setFocus();
+    } else {
+      largeView->closeFile();
+    }
+  }
+
+  [[nodiscard]] bool largeFileOpen() const { return !largeView->isHidden(); }
+
+  void fileOpened(const QString &fileName) {
+    isDirty     = false;
+    currentFile = fileName;
+    editedLines.clear();
+
+    // Add the file to the recent files list
+    if (recentFiles.contains(currentFile)) {
+      recentFiles.removeAll(currentFile);
     }
+    recentFiles.prepend(currentFile);
+
+    // update the window title
+    setWindowTitle(QString("%1 - Edit").arg(currentFile));
   }
 
-  void updateOutput() {
-    outputView->append(compileProcess->readAllStandardOutput());
-    outputView->append(compileProcess->readAllStandardError());
+  void goToLine() {
+    const bool large = largeFileOpen();
+    const qsizetype lines = large ? largeView->lineCount() : textEditor->document()->blockCount();
 
-    // scroll to the bottom
-    outputView->verticalScrollBar()->setValue(outputView->verticalScrollBar()->maximum());
+    bool ok        = false;
+    const int line = QInputDialog::getInt(
+        this, tr("Go to Line"), tr("Line:"), 1, 1,
+        static_cast<int>(std::min<qsizetype>(lines, std::numeric_limits<int>::max())), 1, &ok);
+    if (!ok) return;
+    showLocation(line - 1, 0, 0);
   }
 
-  bool compile() {
-    if (currentFile.isEmpty()) {
-      QMessageBox::warning(this, tr("Error"), tr("No file to compile"));
-      return false;
+  // Opens where the name under the cursor is declared, its definition first. When the cursor
+  // is already on one of the places, the next one is opened, so that F12 again goes from a
+  // definition to the declarations.
+  void goToDefinition() {
+    if (largeFileOpen()) return;
+    QTextCursor cursor = textEditor->textCursor();
+    if (!cursor.hasSelection()) cursor.select(QTextCursor::WordUnderCursor);
+    const QString name = cursor.selectedText().trimmed();
+    if (name.isEmpty()) return;
+
+    const QList<ProjectSymbols::Location> found = projectSymbols->locate(name);
+    if (found.isEmpty()) {
+      statusBar()->showMessage(projectSymbols->isIndexing()
+                                   ? tr("No declaration of %1 yet; still indexing").arg(name)
+                                   : tr("No declaration of %1 found").arg(name),
+                               2000);
+      return;
     }
 
-    // clear the output view
-    outputView->clear();
+    qsizetype next = 0;
+    const int line = textEditor->textCursor().blockNumber();
+    for (qsizetype i = 0; i < found.size(); ++i) {
+      if (found[i].line == line &&
+          QDir::cleanPath(found[i].fileName) == QDir::cleanPath(currentFile)) {
+        next = (i + 1) % found.size();
+        break;
+      }
+    }
+    const ProjectSymbols::Location &location = found[next];
+    openLocation(location.fileName, location.line, location.column, location.length);
+  }
 
-    // if file ends with .cpp, use g++
-    if (currentFile.endsWith(".cpp")) {
-      compiler = "g++";
+  // Moves the cursor to the 0-based `line` and selects `length` code units from `column`. The
+  // large file view only moves to the line.
+  void showLocation(int line, int column, int length) {
+    if (largeFileOpen()) {
+      largeView->goToLine(line);
+      largeView->setFocus();
+      return;
     }
+    const QTextBlock block = textEditor->document()->findBlockByNumber(line);
+    if (!block.isValid()) return;
+    QTextCursor cursor(block);
+    cursor.setPosition(block.position() + std::min(column, block.length() - 1));
+    cursor.setPosition(block.position() + std::min(column + length, block.length() - 1),
+                       QTextCursor::KeepAnchor);
+    textEditor->setTextCursor(cursor);
+    textEditor->ensureCursorVisible();
+    textEditor->setFocus();
+  }
 
-    const QString output        = getBaseName(currentFile);
-    const QStringList otherArgs = {"-o", output};
+  void saveFile() {
+    const bool saving = currentFile.isEmpty() ? saveFileAs() : saveToFile(currentFile);
+    if (!saving) return;
 
-    // compose final args
-    QStringList args;
-    args << cFlags << ldFlags << otherArgs << currentFile;
+    isDirty = false;
+    // Formatting edits the document, so it waits until the save has taken the text
+    if (actionFormatOnSave->isChecked()) formatAfterSave = currentFile;
+  }
 
-    compileProcess->setWorkingDirectory(QFileInfo(currentFile).path());
-    compileProcess->setProgram(compiler);
-    compileProcess->setArguments(args);
+  bool saveFileAs() {
+    QString fileName = QFileDialog::getSaveFileName(this, tr("Save File As"), QDir::currentPath());
+    return !fileName.isEmpty() && saveToFile(fileName);
+  }
 
-    // log the command and arguments to the output view
-    outputView->append(QString("Running: %1 %2\n").arg(compiler).arg(args.join(" ")));
+  // Returns whether a save was started
+  bool saveToFile(const QString &fileName) {
+    // Saving a partly loaded document would truncate the file
+    if (fileLoader->isLoading()) {
+      statusBar()->showMessage(tr("The file is still loading"), 2000);
+      return false;
+    }
 
-    compileProcess->start();
+    // Written on a background thread, so editing can go on. A large file's pieces are
+    // snapshotted here; a document's text is copied a slice at a time as the writer takes it.
+    if (largeFileOpen()) {
+      // A read-only file has nothing to write back
+      if (largeView->isReadOnly() && fileName == currentFile) return false;
 
-    connect(compileProcess, &QProcess::readyReadStandardOutput, this, &EditorApp::updateOutput);
-    connect(compileProcess, &QProcess::readyReadStandardError, this, &EditorApp::updateOutput);
+      fileSaver->save(fileName, largeView->snapshot());
+      largeView->setModified(false);
+    } else {
+      fileSaver->save(fileName, textEditor->document());
+      // clangd reads the text from here, so it need not wait for the save
+      lspClient->openDocument(fileName);
+    }
+    currentFile = fileName;
+    statusBar()->showMessage(tr("Saving..."));
+    return true;
+  }
 
-    // Wait for the compilation process to finish
-    compileProcess->waitForFinished();
+  void saveFinished(const QString &fileName, const QString &error) {
+    const bool format = fileName == formatAfterSave;
+    if (format) formatAfterSave.clear();
+    if (error.isEmpty()) {
+      statusBar()->showMessage(tr("File saved"), 2000);
+      projectSymbols->refresh();
+      if (format && fileName == currentFile) formatEditedLines();
+      return;
+    }
 
-    statusBar()->showMessage(tr("Compilation finished"), 2000);
+    // The text was not written, so it is unsaved again
+    isDirty = true;
+    if (largeFileOpen()) largeView->setModified(true);
+    statusBar()->clearMessage();
+    QMessageBox::warning(this, tr("Error"), tr("Could not save %1: %2").arg(fileName, error));
+  }
 
-    return compileProcess->exitCode() == 0;
+  // Lists clangd's diagnostics for the open file in the output view when they change
+  void showDiagnostics(const QString &fileName, const QStringList &found) {
+    if (fileName != currentFile) return;
+    if (fileName == diagnosedFile && found == diagnostics) return;
+    const bool hadProblems = fileName == diagnosedFile && !diagnostics.isEmpty();
+    diagnosedFile          = fileName;
+    diagnostics            = found;
+
+    const QString name = QFileInfo(fileName).fileName();
+    if (found.isEmpty()) {
+      if (hadProblems) outputView->append(tr("%1: no problems").arg(name));
+      return;
+    }
+    for (const QString &diagnostic : found) outputView->append(name + ":" + diagnostic);
+  }
+
+  void compileAndRun() {
+    if (currentFile.isEmpty()) {
+      QMessageBox::warning(this, tr("Error"), tr("No file to compile"));
+      return;
+    }
+
+    // The run starts once the build has succeeded
+    outputView->clear();
+    jobs->start({buildJob(), runJob()});
+  }
+
+  void compile() {
+    if (currentFile.isEmpty()) {
+      QMessageBox::warning(this, tr("Error"), tr("No file to compile"));
+      return;
+    }
+
+    // clear the output view
+    outputView->clear();
+    jobs->start({buildJob()});
   }
 
   void run() {
@@ -672,31 +1212,46 @@ private slots:
 
     // clear the output view
     outputView->clear();
+    jobs->start({runJob()});
+  }
 
-    // Run the compiled program
-    runProcess->setWorkingDirectory(QFileInfo(currentFile).path());
-    runProcess->setProcessChannelMode(QProcess::SeparateChannels);
-    runProcess->setProgram("./" + getBaseName(currentFile));
+  JobRunner::Job buildJob() {
+    // if file ends with .cpp, use g++
+    if (currentFile.endsWith(".cpp")) {
+      compiler = "g++";
+    }
 
-    connect(runProcess, &QProcess::readyReadStandardOutput, this, &EditorApp::updateRunOutput);
-    connect(runProcess, &QProcess::readyReadStandardError, this, &EditorApp::updateRunOutput);
+    const QString output        = getBaseName(currentFile);
+    const QStringList otherArgs = {"-o", output};
 
-    // Start the process
-    runProcess->start();
+    // compose final args
+    QStringList args;
+    args << cFlags << ldFlags << otherArgs << currentFile;
+    return {tr("Build"), compiler, args, QFileInfo(currentFile).path(), BuildOutput};
+  }
 
-    // Check if the process started successfully
-    if (!runProcess->waitForStarted()) {
-      qDebug() << "Failed to start the process:" << runProcess->errorString();
-      return;
-    }
+  JobRunner::Job runJob() {
+    return {tr("Run"), "./" + getBaseName(currentFile), {}, QFileInfo(currentFile).path(),
+            BuildOutput};
+  }
 
-    // Wait for the process to finish
-    runProcess->waitForFinished();
-    statusBar()->showMessage(tr("Process finished with exit code: %1").arg(runProcess->exitCode()),
-                             2000);
+  void createDisassemblyView() {
+    disAssemblyView = new QTextEdit(mainSplitter);
+    disAssemblyView->setReadOnly(true);
+    disAssemblyView->setLineWrapMode(QTextEdit::NoWrap);
+    disAssemblyView->setStyleSheet(
+        "QTextEdit {"
+        "  background-color: #282a36;"
+        "  color: #faede3;"
+        "  selection-background-color: #6272a4;"
+        "  selection-color: #f8f8f2;"
+        "}");
+    auto asmHighlighter = new DraculaCppSyntaxHighlighter(disAssemblyView->document());
+    asmHighlighter->setGrammar(Grammar::byName("asm"));
   }
 
   void disassemble() {
+    if (!disAssemblyView) createDisassemblyView();
     disAssemblyView->setFont(textEditor->font());
     disAssemblyView->clear();
 
@@ -711,11 +1266,6 @@ private slots:
       return;
     }
 
-    // Disassemble the compiled program
-    disAssembleProcess->setWorkingDirectory(QFileInfo(currentFile).path());
-    disAssembleProcess->setProcessChannelMode(QProcess::SeparateChannels);
-    disAssembleProcess->setProgram("objdump");
-
     QStringList args = {"-d", getBaseName(currentFile), "-M", "intel", "--no-show-raw-insn"};
     // If in C++ mode, use c++filt to demangle the symbols
     if (currentFile.endsWith(".cpp")) {
@@ -727,27 +1277,9 @@ private slots:
       args.append("--source");
     }
 
-    disAssembleProcess->setArguments(args);
-
-    // log the command and arguments to the output view
-    disAssemblyView->append(
-        QString("Running: %1 %2\n").arg(disAssembleProcess->program()).arg(args.join(" ")));
-
-    connect(disAssembleProcess, &QProcess::readyReadStandardOutput, this,
-            &EditorApp::updateDisassembly);
-    connect(disAssembleProcess, &QProcess::readyReadStandardError, this,
-            &EditorApp::updateDisassembly);
-    // Start the process
-    disAssembleProcess->start();
-
-    // Check if the process started successfully
-    if (!disAssembleProcess->waitForStarted()) {
-      qDebug() << "Failed to start the process:" << disAssembleProcess->errorString();
-      return;
-    }
-
-    // Wait for the process to finish
-    disAssembleProcess->waitForFinished();
+    // Disassemble the compiled program
+    jobs->start(
+        {{tr("Disassembly"), "objdump", args, QFileInfo(currentFile).path(), DisassemblyOutput}});
 
     mainSplitter->setStretchFactor(0, 1); // First widget (side panel) - less priority for expansion
     mainSplitter->setStretchFactor(1, 1); // Second widget
@@ -755,65 +1287,200 @@ private slots:
         2, 3); // Third widget (disassembly view) - more priority for expansion
   }
 
-  void updateDisassembly() {
-    disAssemblyView->append(disAssembleProcess->readAllStandardOutput());
-    disAssemblyView->append(disAssembleProcess->readAllStandardError());
+  [[nodiscard]] QTextEdit *outputFor(int channel) const {
+    return channel == DisassemblyOutput ? disAssemblyView : outputView;
   }
 
-  void updateRunOutput() {
-    outputView->append(runProcess->readAllStandardOutput());
-    outputView->append(runProcess->readAllStandardError());
+  void jobStarted(const JobRunner::Job &job) {
+    // log the command and arguments to the output view
+    outputFor(job.channel)
+        ->append(QString("Running: %1 %2\n").arg(job.program, job.arguments.join(" ")));
   }
 
-  void formatCode() {
-    // Format the code in the text editor without losing undo history
-    clangFormat->setProgram("clang-format");
+  // Output comes in pieces that need not end at a line, so it is inserted as it is rather than
+  // appended as paragraphs. The view follows it unless it was scrolled up.
+  void jobOutput(int channel, const QString &text) {
+    QTextEdit *view      = outputFor(channel);
+    QScrollBar *scroll   = view->verticalScrollBar();
+    const bool following = scroll->value() == scroll->maximum();
+    QTextCursor end(view->document());
+    end.movePosition(QTextCursor::End);
+    end.insertText(text);
+    if (following) scroll->setValue(scroll->maximum());
+  }
 
-    QStringList args = {"-style=Google"};
+  void jobFinished(const JobRunner::Job &job, JobRunner::Outcome outcome, int exitCode,
+                   const QString &error) {
+    QString status;
+    switch (outcome) {
+      case JobRunner::Outcome::Exited:
+        status = tr("%1 finished with exit code %2").arg(job.name).arg(exitCode);
+        break;
+      case JobRunner::Outcome::Crashed:
+        status = tr("%1 crashed").arg(job.name);
+        break;
+      case JobRunner::Outcome::Stopped:
+        status = tr("%1 was stopped").arg(job.name);
+        break;
+      case JobRunner::Outcome::FailedToStart:
+        status = tr("%1 could not be started: %2").arg(job.name, error);
+        break;
+    }
+    statusBar()->showMessage(status, 5000);
 
-    // if there is a .clang-format file in the current directory, use it
-    if (QFile::exists(".clang-format")) {
-      args.append("--assume-filename=.clang-format");
+    // The disassembly is left as objdump wrote it, unless something went wrong
+    const bool succeeded = outcome == JobRunner::Outcome::Exited && exitCode == 0;
+    if (job.channel != DisassemblyOutput || !succeeded) outputFor(job.channel)->append(status);
+  }
+
+  // Formats the whole file
+  void formatCode() { startFormat(false); }
+
+  // Formats only the lines edited since the last format, as on save
+  void formatEditedLines() { startFormat(true); }
+
+  // Runs clang-format in the background on a copy of the text. It reports replacements,
+  // which formatFinished() applies as small edits, so that only the touched blocks are laid
+  // out and highlighted again and the undo step stays small.
+  void startFormat(bool editedOnly) {
+    // Large files are not reformatted, since clang-format would need the whole file in
+    // memory, and neither are files still loading
+    if (largeFileOpen() || fileLoader->isLoading()) return;
+
+    QList<QPair<int, int>> lines;
+    if (editedOnly) {
+      lines = editedLineRanges();
+      if (lines.isEmpty()) return;
     }
 
-    clangFormat->setArguments(args);
+    if (!clangFormat) {
+      clangFormat = new QProcess(this);
+      connect(clangFormat, &QProcess::finished, this, &EditorApp::formatFinished);
+      connect(clangFormat, &QProcess::errorOccurred, this, [this](QProcess::ProcessError error) {
+        if (error == QProcess::FailedToStart) {
+          QMessageBox::warning(this, tr("Error"), tr("Failed to start clang-format"));
+        }
+      });
+    }
 
-    // Start clang-format process
+    // A run still going is formatting outdated text
+    if (clangFormat->state() != QProcess::NotRunning) {
+      clangFormat->kill();
+      clangFormat->waitForFinished();
+    }
+
+    formatInput    = textEditor->toPlainText().toUtf8();
+    formatSnapshot = editRevision;
+    clangFormat->setProgram("clang-format");
+    clangFormat->setArguments(clangFormatArguments(lines));
     clangFormat->start();
 
     // Send the current content to clang-format via standard input
-    clangFormat->write(textEditor->toPlainText().toUtf8());
+    clangFormat->write(formatInput);
     clangFormat->closeWriteChannel();
+  }
 
-    if (!clangFormat->waitForStarted()) {
-      QMessageBox::warning(this, tr("Error"), tr("Failed to start clang-format"));
+  void formatFinished(int exitCode, QProcess::ExitStatus exitStatus) {
+    // A run killed by startFormat()
+    if (exitStatus != QProcess::NormalExit) return;
+
+    const QByteArray input = std::exchange(formatInput, QByteArray());
+    if (exitCode != 0) {
+      QMessageBox::warning(this, tr("Error"),
+                           tr("Failed to format the code:\n%1")
+                               .arg(QString::fromUtf8(clangFormat->readAllStandardError())));
       return;
     }
 
-    if (!clangFormat->waitForFinished()) {
-      QMessageBox::warning(this, tr("Error"), tr("Failed to format the code"));
+    // Replacements are offsets into the text that was sent, so they only fit that text
+    if (editRevision != formatSnapshot) {
+      statusBar()->showMessage(tr("Not formatted: the code changed while formatting"), 2000);
       return;
     }
 
-    // Get the formatted output from clang-format's standard output
-    QString formattedCode = clangFormat->readAllStandardOutput();
-
-    // Block signals to avoid triggering textChanged during formatting
-    textEditor->blockSignals(true);
+    QList<FormatEdit> edits;
+    QString error;
+    if (!parseFormatEdits(clangFormat->readAllStandardOutput(), input, edits, &error)) {
+      QMessageBox::warning(this, tr("Error"), tr("Failed to format the code: %1").arg(error));
+      return;
+    }
 
-    // Replace the content of the editor with the formatted code
-    QTextCursor cursor = textEditor->textCursor();
-    cursor.beginEditBlock();
-    cursor.select(QTextCursor::Document);
-    cursor.insertText(formattedCode);
-    cursor.endEditBlock();
+    if (!edits.isEmpty()) {
+      // Block signals to avoid triggering textChanged during formatting
+      textEditor->blockSignals(true);
+      applyingFormat = true;
+
+      // Back to front, so that earlier positions stay valid; one undo step for all of them
+      QTextCursor cursor(textEditor->document());
+      cursor.beginEditBlock();
+      for (auto edit = edits.crbegin(); edit != edits.crend(); ++edit) {
+        cursor.setPosition(static_cast<int>(edit->position));
+        cursor.setPosition(static_cast<int>(edit->position + edit->length),
+                           QTextCursor::KeepAnchor);
+        cursor.insertText(edit->text);
+      }
+      cursor.endEditBlock();
 
-    // Re-enable signals
-    textEditor->blockSignals(false);
+      applyingFormat = false;
+      textEditor->blockSignals(false);
+    }
 
+    editedLines.clear();
     statusBar()->showMessage(tr("Code formatted"), 2000);
   }
 
+  // Records the lines an edit touched, for formatEditedLines(). Block revisions are left
+  // alone: the highlighter's cache relies on them.
+  void markEditedLines(int position, int charsRemoved, int charsAdded) {
+    // The highlighter reports its formatting as changes too
+    QTextDocument *document = textEditor->document();
+    if (document->revision() == markedRevision) return;
+    markedRevision = document->revision();
+
+    // The line breaks removed are the ones added, less the growth of the block count
+    const int blockCount = std::exchange(markedBlockCount, document->blockCount());
+    // clang-format's own edits, whose lines are all formatted once they are applied, and the
+    // text of a file being loaded, which nobody edited
+    if (applyingFormat || appendingLoad) return;
+    if (fileLoader->isLoading()) recordLoadEdit(position, charsRemoved, charsAdded);
+
+    ++editRevision;
+    // One change that spans every line Replace All edited; markReplacedLines() marks those
+    if (replacingAll) return;
+    QTextBlock last = document->findBlock(position + charsAdded);
+    if (!last.isValid()) last = document->lastBlock(); // replacing all of the text
+    const int first   = document->findBlock(position).blockNumber();
+    const int added   = last.blockNumber() - first;
+    const int removed = std::max(0, added - (markedBlockCount - blockCount));
+    editedLines.edit(first, removed, added);
+  }
+
+  // Marks the lines Replace All edited, rather than the span between the first and last
+  void markReplacedLines(const QList<int> &blocks) {
+    replacingAll = false;
+    for (const int block : blocks) editedLines.edit(block, 0, 0);
+  }
+
+  // Keeps an edit to a loading file, to be made again by appendHeldText()
+  void recordLoadEdit(int position, int charsRemoved, int charsAdded) {
+    QTextDocument *document = textEditor->document();
+    QTextCursor added(document);
+    added.setPosition(position);
+    added.setPosition(std::min(position + charsAdded, document->characterCount() - 1),
+                      QTextCursor::KeepAnchor);
+    loadEdits.append({position, charsRemoved, added.selection().toPlainText()});
+  }
+
+  // 1-based line ranges of the blocks edited since the last format
+  [[nodiscard]] QList<QPair<int, int>> editedLineRanges() const {
+    QList<QPair<int, int>> ranges;
+    for (const auto &[first, last] : editedLines.ranges()) ranges.append({first + 1, last + 1});
+
+    // Past this many ranges, one range over the whole file is a shorter command line
+    if (ranges.size() > maxFormatRanges) return {{1, textEditor->document()->blockCount()}};
+    return ranges;
+  }
+
 protected:
   void closeEvent(QCloseEvent *event) override {
     if (isDirty) {
@@ -829,6 +1496,8 @@ protected:
       }
     }
 
+    // The editor goes before the saver, which writes what it still has to on the way out
+    fileSaver->detach(textEditor->document());
     event->accept();
   }
 };
@@ -853,22 +1522,31 @@ void enableDarkMode(QApplication &app) {
 }
 
 int main(int argc, char *argv[]) {
+  StartupTrace::start(std::any_of(argv + 1, argv + argc, [](const char *arg) {
+    return std::strcmp(arg, "--trace-startup") == 0;
+  }));
+
   QApplication app(argc, argv);
   app.setApplicationName("Edit");
   app.setOrganizationName("Yo Medical Files (U) LTD");
   app.setOrganizationDomain("yomedicalfiles.com");
   app.setApplicationVersion("1.0");
   app.setStyle("Fusion");
+  StartupTrace::mark("QApplication");
+
+  EditorApp editor;
 
   // check for file from the command line
-  if (app.arguments().size() > 1) {
-    EditorApp editor;
-    editor.setCurrentFile(app.arguments().at(1));
+  const QStringList arguments = app.arguments();
+  for (qsizetype i = 1; i < arguments.size(); ++i) {
+    if (!arguments[i].startsWith("--")) {
+      editor.setStartupFile(arguments[i]);
+      break;
+    }
   }
 
-  EditorApp editor;
-
   editor.show();
+  StartupTrace::mark("show");
   return app.exec();
 }
 
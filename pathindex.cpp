@@ -0,0 +1,233 @@
+#include "pathindex.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <set>
+#include <utility>
+
+#include "dirlist.hpp"
+#include "topmatches.hpp"
+
+namespace {
+
+char lower(char c) { return c >= 'A' && c <= 'Z' ? static_cast<char>(c | 0x20) : c; }
+bool isUpper(char c) { return c >= 'A' && c <= 'Z'; }
+bool isLower(char c) { return c >= 'a' && c <= 'z'; }
+
+int maskBit(char c) {
+  c = lower(c);
+  if (isLower(c)) return c - 'a';
+  if (c >= '0' && c <= '9') return 26 + (c - '0');
+  if (static_cast<unsigned char>(c) >= 0x80) return 63;
+  switch (c) {
+    case '_':
+      return 36;
+    case '-':
+      return 37;
+    case '.':
+      return 38;
+    case '/':
+      return 39;
+    default:
+      return 40 + (c & 15);
+  }
+}
+
+// Bonus for a match at text[i], which starts a path component or a word
+int boundaryBonus(std::string_view text, std::size_t i) {
+  if (i == 0) return 10;
+  const char previous = text[i - 1];
+  if (previous == '/') return 10;
+  if (previous == '_' || previous == '-' || previous == '.' || previous == ' ') return 8;
+  if (isLower(previous) && isUpper(text[i])) return 7;
+  return 0;
+}
+
+std::shared_ptr<const IgnoreRules> readIgnoreFile(const std::string &path) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) return nullptr;
+  const std::string text((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+  if (text.empty()) return nullptr;
+  return std::make_shared<const IgnoreRules>(text);
+}
+
+// `dir` is empty or ends in '/', and so does the result
+std::string absolute(const std::string &root, const std::string &dir) { return root + '/' + dir; }
+
+// Lists `dir`, splitting what is not hidden or ignored into files and subdirectories, both
+// relative to the root. The directory's .gitignore is added to `scopes`.
+bool listEntries(const std::string &root, const std::string &dir,
+                 std::vector<IgnoreScope> &scopes, std::vector<std::string> &files,
+                 std::vector<std::string> &subdirs) {
+  std::vector<DirEntry> entries;
+  if (!listDirectory(absolute(root, dir), entries)) return false;
+  std::sort(entries.begin(), entries.end(),
+            [](const DirEntry &a, const DirEntry &b) { return a.name < b.name; });
+
+  const bool hasIgnoreFile = std::any_of(entries.begin(), entries.end(), [](const DirEntry &e) {
+    return !e.isDir && e.name == ".gitignore";
+  });
+  if (hasIgnoreFile) {
+    if (auto rules = readIgnoreFile(absolute(root, dir) + ".gitignore")) {
+      scopes.push_back({std::move(rules), dir});
+    }
+  }
+
+  std::string path = dir;
+  for (const DirEntry &entry : entries) {
+    if (entry.name.front() == '.') continue;
+    path.resize(dir.size());
+    path += entry.name;
+    if (isIgnored(scopes, path, entry.isDir)) continue;
+    if (!entry.isDir) {
+      files.push_back(path);
+    } else if (!entry.isLink) {
+      subdirs.push_back(path + '/');
+    }
+  }
+  return true;
+}
+
+} // namespace
+
+std::uint64_t characterMask(std::string_view text) {
+  std::uint64_t mask = 0;
+  for (const char c : text) mask |= std::uint64_t(1) << maskBit(c);
+  return mask;
+}
+
+int fuzzyScore(std::string_view query, std::string_view text) {
+  if (query.empty()) return 0;
+
+  // The latest place the query can start, found from the back, favors the file name. The
+  // start of the file name is noted on the way.
+  std::size_t remaining = query.size();
+  std::size_t start     = text.size();
+  std::size_t fileName  = 0;
+  while (remaining > 0 && start > 0) {
+    const char c = text[--start];
+    if (c == '/' && fileName == 0) fileName = start + 1;
+    if (lower(c) == query[remaining - 1]) --remaining;
+  }
+  if (remaining > 0) return -1;
+
+  int score       = 0;
+  int run         = 0;
+  std::size_t got = 0;
+  for (std::size_t i = start; got < query.size(); ++i) {
+    if (lower(text[i]) != query[got]) {
+      score -= run > 0 ? 3 : 1;
+      run = 0;
+      continue;
+    }
+    const int bonus = boundaryBonus(text, i);
+    score += 16 + bonus + 4 * run;
+    if (got == 0) score += bonus;
+    if (i >= fileName) score += 4;
+    ++run;
+    ++got;
+  }
+  return std::max(score, 0);
+}
+
+void PathIndex::add(std::string_view path) {
+  arena.append(path);
+  offsets.push_back(static_cast<std::uint32_t>(arena.size()));
+  masks.push_back(characterMask(path));
+}
+
+void PathIndex::scan(const std::string &root, const std::string &dir,
+                     std::vector<IgnoreScope> scopes, std::vector<std::string> &dirs,
+                     const std::atomic<bool> &cancelled) {
+  if (cancelled) return;
+  std::vector<std::string> files;
+  std::vector<std::string> subdirs;
+  if (!listEntries(root, dir, scopes, files, subdirs)) return;
+
+  dirs.push_back(dir);
+  for (const std::string &file : files) add(file);
+  for (const std::string &subdir : subdirs) scan(root, subdir, scopes, dirs, cancelled);
+}
+
+PathIndex PathIndex::rescanDirectory(const PathIndex &old, const std::string &root,
+                                     const std::string &dir, std::vector<std::string> &dirs,
+                                     const std::atomic<bool> &cancelled) {
+  // The .gitignore files above `dir`; listEntries() adds its own
+  std::vector<IgnoreScope> scopes;
+  for (std::size_t slash = 0; slash < dir.size(); slash = dir.find('/', slash) + 1) {
+    const std::string parent = dir.substr(0, slash);
+    if (auto rules = readIgnoreFile(absolute(root, parent) + ".gitignore")) {
+      scopes.push_back({std::move(rules), parent});
+    }
+  }
+
+  std::vector<std::string> files;
+  std::vector<std::string> subdirs;
+  listEntries(root, dir, scopes, files, subdirs);
+  const std::set<std::string_view> present(subdirs.begin(), subdirs.end());
+  std::set<std::string_view> known;
+
+  PathIndex index;
+  index.arena.reserve(old.arena.size());
+  index.offsets.reserve(old.offsets.size());
+  index.masks.reserve(old.masks.size());
+  for (std::size_t i = 0; i < old.size(); ++i) {
+    const std::string_view path = old.path(i);
+    if (path.substr(0, dir.size()) == dir) {
+      // Files directly in `dir` are listed again below
+      const std::size_t slash = path.find('/', dir.size());
+      if (slash == std::string_view::npos) continue;
+      const std::string_view subdir = path.substr(0, slash + 1);
+      if (!present.count(subdir)) continue;
+      known.insert(subdir);
+    }
+    index.arena.append(path);
+    index.offsets.push_back(static_cast<std::uint32_t>(index.arena.size()));
+    index.masks.push_back(old.masks[i]);
+  }
+
+  for (const std::string &file : files) index.add(file);
+  for (const std::string &subdir : subdirs) {
+    if (!known.count(subdir)) index.scan(root, subdir, scopes, dirs, cancelled);
+  }
+  return index;
+}
+
+// Paths whose masks lack a character of the query are rejected before they are scored
+auto PathIndex::scorer(std::string_view query) const {
+  return [this, query, required = characterMask(query)](std::uint32_t i) {
+    if ((masks[i] & required) != required) return -1;
+    return fuzzyScore(query, path(i));
+  };
+}
+
+bool PathIndex::better(const Match &a, const Match &b) const {
+  if (a.score != b.score) return a.score > b.score;
+  const std::size_t aLength = offsets[a.path + 1] - offsets[a.path];
+  const std::size_t bLength = offsets[b.path + 1] - offsets[b.path];
+  if (aLength != bLength) return aLength < bLength;
+  return a.path < b.path;
+}
+
+std::vector<PathIndex::Match> PathIndex::search(std::string_view query, std::size_t limit,
+                                                std::size_t first, std::size_t last,
+                                                std::vector<std::uint32_t> *matched) const {
+  return topMatches<Match>(
+      limit,
+      [first, last](const auto &visit) {
+        for (std::size_t i = first; i < last; ++i) visit(static_cast<std::uint32_t>(i));
+      },
+      scorer(query), ranks(), matched);
+}
+
+std::vector<PathIndex::Match> PathIndex::search(std::string_view query, std::size_t limit,
+                                                const std::vector<std::uint32_t> &within,
+                                                std::vector<std::uint32_t> *matched) const {
+  return topMatches<Match>(limit, eachOf(within), scorer(query), ranks(), matched);
+}
+
+std::vector<PathIndex::Match> PathIndex::merge(std::vector<std::vector<Match>> parts,
+                                               std::size_t limit) const {
+  return mergeMatches(std::move(parts), limit, ranks());
+}
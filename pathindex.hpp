@@ -0,0 +1,75 @@
+#ifndef E859E19A_38F3_4954_9766_12D28350A22C
+#define E859E19A_38F3_4954_9766_12D28350A22C
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "ignorerules.hpp"
+
+// Relative paths of the files in a project, for fuzzy search. The paths are packed end to end
+// in one arena with an offset per path, plus a 64-bit mask of the characters in each, so that
+// most paths can be rejected with one AND before they are scored.
+class PathIndex {
+public:
+  struct Match {
+    std::uint32_t path;
+    int score;
+  };
+
+  [[nodiscard]] std::size_t size() const { return offsets.size() - 1; }
+  [[nodiscard]] std::string_view path(std::size_t i) const {
+    return std::string_view(arena).substr(offsets[i], offsets[i + 1] - offsets[i]);
+  }
+  void add(std::string_view path);
+
+  // Adds the files under `dir`, relative to `root` and ending in '/' unless empty, that the
+  // .gitignore files in `scopes` and below do not exclude. Hidden entries are skipped and
+  // links to directories are not followed. Each directory visited is appended to `dirs`.
+  // Stops early once `cancelled` is set.
+  void scan(const std::string &root, const std::string &dir, std::vector<IgnoreScope> scopes,
+            std::vector<std::string> &dirs, const std::atomic<bool> &cancelled);
+
+  // A copy of `old` in which the files directly in `dir` are listed again. Subdirectories
+  // that are gone lose their files; new ones are scanned and appended to `dirs`.
+  static PathIndex rescanDirectory(const PathIndex &old, const std::string &root,
+                                   const std::string &dir, std::vector<std::string> &dirs,
+                                   const std::atomic<bool> &cancelled);
+
+  // The best `limit` matches of `query` among paths [first, last), best first. `query` must
+  // be lowercase. Every path that matches is appended to `matched`, if given: a query that
+  // extends this one can only match those, and can search just them with the overload below.
+  [[nodiscard]] std::vector<Match> search(std::string_view query, std::size_t limit,
+                                          std::size_t first, std::size_t last,
+                                          std::vector<std::uint32_t> *matched = nullptr) const;
+  [[nodiscard]] std::vector<Match> search(std::string_view query, std::size_t limit,
+                                          const std::vector<std::uint32_t> &within,
+                                          std::vector<std::uint32_t> *matched = nullptr) const;
+  // Merges results of search() over disjoint ranges into the best `limit`, best first.
+  [[nodiscard]] std::vector<Match> merge(std::vector<std::vector<Match>> parts,
+                                         std::size_t limit) const;
+
+private:
+  std::string arena;
+  std::vector<std::uint32_t> offsets{0};
+  std::vector<std::uint64_t> masks;
+
+  [[nodiscard]] bool better(const Match &a, const Match &b) const;
+  [[nodiscard]] auto ranks() const {
+    return [this](const Match &a, const Match &b) { return better(a, b); };
+  }
+  // fuzzyScore() of path i for `query`, or -1, as topMatches() takes it
+  [[nodiscard]] auto scorer(std::string_view query) const;
+};
+
+// Bit of each character class that search() requires; letters ignore case.
+std::uint64_t characterMask(std::string_view text);
+
+// Scores `text` for the lowercase `query`, whose characters must appear in it in order, or
+// returns -1. Matches at the start of a path component or word, runs of consecutive
+// characters and matches in the file name score higher; gaps cost a little.
+int fuzzyScore(std::string_view query, std::string_view text);
+
+#endif /* E859E19A_38F3_4954_9766_12D28350A22C */
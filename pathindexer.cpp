@@ -0,0 +1,122 @@
+#include "pathindexer.hpp"
+
+#include <QDir>
+#include <QFile>
+#include <QFileSystemWatcher>
+#include <QTimer>
+
+namespace {
+
+constexpr int kChangeDelayMs = 200;
+constexpr qint64 kStaleMs    = 60 * 1000;
+
+} // namespace
+
+PathIndexer::PathIndexer(QObject *parent)
+    : QObject(parent), watcher(new QFileSystemWatcher(this)), changeTimer(new QTimer(this)) {
+  changeTimer->setSingleShot(true);
+  changeTimer->setInterval(kChangeDelayMs);
+  connect(changeTimer, &QTimer::timeout, this, [this] {
+    if (!worker) startWorker();
+  });
+
+  connect(watcher, &QFileSystemWatcher::directoryChanged, this, [this](const QString &path) {
+    QString dir = QDir(root).relativeFilePath(path);
+    dir         = dir == "." ? QString() : dir + '/';
+    if (!changed.contains(dir)) changed.append(dir);
+    changeTimer->start();
+  });
+}
+
+PathIndexer::~PathIndexer() { stopWorker(); }
+
+void PathIndexer::setRootPath(const QString &path) {
+  stopWorker();
+  root = QDir::cleanPath(path);
+  current.reset();
+  changed.clear();
+  scanAll = true;
+  startWorker();
+}
+
+void PathIndexer::refreshIfStale() {
+  if (complete || root.isEmpty() || worker || lastScan.elapsed() < kStaleMs) return;
+  scanAll = true;
+  startWorker();
+}
+
+void PathIndexer::startWorker() {
+  workerFull = scanAll || !current;
+  scanAll    = false;
+
+  std::vector<std::string> dirs;
+  if (!workerFull) {
+    for (const QString &dir : changed) dirs.push_back(QFile::encodeName(dir).toStdString());
+  }
+  changed.clear();
+
+  cancelled = false;
+  worker    = QThread::create([this, full = workerFull, base = current, dirs = std::move(dirs),
+                            rootName = QFile::encodeName(root).toStdString()] {
+    std::vector<std::string> found;
+    PathIndex index;
+    if (full) {
+      index.scan(rootName, std::string(), {}, found, cancelled);
+    } else {
+      index = *base;
+      for (const std::string &dir : dirs) {
+        index = PathIndex::rescanDirectory(index, rootName, dir, found, cancelled);
+      }
+    }
+    result     = std::move(index);
+    resultDirs = std::move(found);
+  });
+  connect(worker, &QThread::finished, this, [this, started = ++generation] {
+    if (started == generation) workerFinished();
+  });
+  worker->start();
+}
+
+void PathIndexer::workerFinished() {
+  worker->wait();
+  delete worker;
+  worker = nullptr;
+
+  current = std::make_shared<const PathIndex>(std::move(result));
+  result  = PathIndex();
+  watch(resultDirs, workerFull);
+  resultDirs.clear();
+  if (workerFull) lastScan.start();
+  emit indexChanged();
+
+  // Changes that came in during the scan
+  if (scanAll || !changed.isEmpty()) changeTimer->start();
+}
+
+void PathIndexer::stopWorker() {
+  if (!worker) return;
+  cancelled = true;
+  worker->wait();
+  delete worker;
+  worker = nullptr;
+  ++generation;
+}
+
+void PathIndexer::watch(const std::vector<std::string> &dirs, bool replace) {
+  if (replace) {
+    const QStringList watched = watcher->directories();
+    if (!watched.isEmpty()) watcher->removePaths(watched);
+    complete = true;
+  }
+
+  QStringList paths;
+  const int room = maxWatchedDirectories - static_cast<int>(watcher->directories().size());
+  for (const std::string &dir : dirs) {
+    if (paths.size() == room) {
+      complete = false;
+      break;
+    }
+    paths.append(QDir::cleanPath(root + '/' + QFile::decodeName(dir.c_str())));
+  }
+  if (!paths.isEmpty()) watcher->addPaths(paths);
+}
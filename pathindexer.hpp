@@ -0,0 +1,70 @@
+#ifndef EF257CFA_D271_4C3C_B2F2_EBBE07A4C8F0
+#define EF257CFA_D271_4C3C_B2F2_EBBE07A4C8F0
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QThread>
+#include <atomic>
+#include <memory>
+
+#include "pathindex.hpp"
+
+class QFileSystemWatcher;
+class QTimer;
+
+// Keeps a PathIndex of a project up to date. The first scan runs on a background thread;
+// after it, directory change events are collected for a moment and only the directories that
+// changed are listed again. Each update produces a new immutable index, so searches can keep
+// using the previous one from any thread.
+//
+// inotify watches are limited, so only the first maxWatchedDirectories directories, in scan
+// order, are watched. When some are not, refreshIfStale() scans everything again.
+class PathIndexer : public QObject {
+  Q_OBJECT
+
+public:
+  static constexpr int maxWatchedDirectories = 4096;
+
+  explicit PathIndexer(QObject *parent = nullptr);
+  ~PathIndexer() override; // stops a running scan
+
+  void setRootPath(const QString &path);
+  [[nodiscard]] QString rootPath() const { return root; }
+
+  // The latest index, or null until the first scan finishes.
+  [[nodiscard]] std::shared_ptr<const PathIndex> index() const { return current; }
+  [[nodiscard]] bool isIndexing() const { return worker != nullptr; }
+
+  // Scans again if some directories are not watched and the last scan is over a minute old.
+  void refreshIfStale();
+
+signals:
+  void indexChanged();
+
+private:
+  QString root;
+  std::shared_ptr<const PathIndex> current;
+  QFileSystemWatcher *watcher;
+  QTimer *changeTimer;    // collects directory changes before rescanning them
+  QStringList changed;    // directories to rescan, relative to root, ending in '/' unless empty
+  bool scanAll  = false;  // rescan everything instead
+  bool complete = true;   // every directory is watched
+  QElapsedTimer lastScan; // since the last full scan
+
+  QThread *worker = nullptr;
+  std::atomic<bool> cancelled{false};
+  quint64 generation = 0; // tells a stopped worker's finished() from the current one's
+  bool workerFull    = false;
+  // Written by the worker, read once it has finished
+  PathIndex result;
+  std::vector<std::string> resultDirs;
+
+  void startWorker();
+  void workerFinished();
+  void stopWorker();
+  void watch(const std::vector<std::string> &dirs, bool replace);
+};
+
+#endif /* EF257CFA_D271_4C3C_B2F2_EBBE07A4C8F0 */
@@ -0,0 +1,237 @@
+#include "piecetable.hpp"
+
+#include <algorithm>
+
+#include "scan.hpp"
+
+PieceTable::PieceTable(std::string_view original) : PieceTable(original, LineIndex(original)) {}
+
+PieceTable::PieceTable(std::string_view original, LineIndex originalLines)
+    : original(original), originalLines(std::move(originalLines)) {
+  totalSize     = original.size();
+  totalNewlines = this->originalLines.lineCount() - 1;
+  if (totalSize > 0) pieces.push_back({Source::Original, 0, totalSize, totalNewlines});
+}
+
+PieceTable PieceTable::copyText() const {
+  PieceTable copy;
+  copy.original      = original;
+  copy.added         = added;
+  copy.pieces        = pieces;
+  copy.originalLines = originalLines;
+  copy.totalSize     = totalSize;
+  copy.totalNewlines = totalNewlines;
+  return copy;
+}
+
+std::string_view PieceTable::bytes(const Piece &piece) const {
+  const std::string_view source = piece.source == Source::Original ? original : added;
+  return source.substr(piece.start, piece.length);
+}
+
+std::size_t PieceTable::countNewlines(Source source, std::size_t start, std::size_t length) const {
+  if (source == Source::Added) return scan::countByte(added.data() + start, length, '\n');
+
+  return originalLines.lineAt(start + length) - originalLines.lineAt(start);
+}
+
+// Offset within the piece's source of the piece's `n`th newline, counting from 0.
+std::size_t PieceTable::nthNewline(const Piece &piece, std::size_t n) const {
+  if (piece.source == Source::Original) {
+    return originalLines.lineStart(originalLines.lineAt(piece.start) + n + 1) - 1;
+  }
+
+  std::size_t i = scan::findByte(added.data(), piece.start + piece.length, piece.start, '\n');
+  for (; n > 0; --n) {
+    i = scan::findByte(added.data(), piece.start + piece.length, i + 1, '\n');
+  }
+  return i;
+}
+
+// Piece index and offset inside it for a document offset. An offset at a piece boundary
+// belongs to the later piece; the end of the document maps to (pieces.size(), 0).
+std::pair<std::size_t, std::size_t> PieceTable::locate(std::size_t offset) const {
+  std::size_t index = 0;
+  for (; index < pieces.size() && offset >= pieces[index].length; ++index) {
+    offset -= pieces[index].length;
+  }
+  return {index, offset};
+}
+
+PieceTable::Piece PieceTable::slice(const Piece &piece, std::size_t from, std::size_t to) const {
+  Piece part{piece.source, piece.start + from, to - from, 0};
+  part.newlines = countNewlines(part.source, part.start, part.length);
+  return part;
+}
+
+void PieceTable::insert(std::size_t offset, std::string_view text) {
+  if (text.empty()) return;
+  offset = std::min(offset, totalSize);
+
+  const std::size_t newlines = scan::countByte(text.data(), text.size(), '\n');
+  const std::size_t after    = offset + text.size();
+  const auto [index, inside] = locate(offset);
+
+  // Typing extends the piece that the previous keystroke added
+  if (inside == 0 && index > 0) {
+    Piece previous = pieces[index - 1];
+    if (previous.source == Source::Added && previous.start + previous.length == added.size()) {
+      added.append(text);
+      previous.length += text.size();
+      previous.newlines += newlines;
+      replace(index - 1, index, {previous}, offset, after);
+      return;
+    }
+  }
+
+  const Piece piece{Source::Added, added.size(), text.size(), newlines};
+  added.append(text);
+
+  if (inside == 0) {
+    replace(index, index, {piece}, offset, after);
+  } else {
+    const Piece &whole = pieces[index];
+    replace(index, index + 1,
+            {slice(whole, 0, inside), piece, slice(whole, inside, whole.length)}, offset, after);
+  }
+}
+
+void PieceTable::remove(std::size_t offset, std::size_t length) {
+  if (offset >= totalSize) return;
+  length = std::min(length, totalSize - offset);
+  if (length == 0) return;
+
+  const auto [first, firstInside] = locate(offset);
+  const auto [last, lastInside]   = locate(offset + length);
+
+  // Keep the head of the first piece and the tail of the last one
+  std::vector<Piece> kept;
+  if (firstInside > 0) kept.push_back(slice(pieces[first], 0, firstInside));
+  if (last < pieces.size() && lastInside > 0) {
+    kept.push_back(slice(pieces[last], lastInside, pieces[last].length));
+  }
+
+  const std::size_t end = std::min(pieces.size(), last + (lastInside > 0 ? 1 : 0));
+  replace(first, end, std::move(kept), offset, offset);
+}
+
+// Replaces pieces[first, end) and records it for undo
+void PieceTable::replace(std::size_t first, std::size_t end, std::vector<Piece> with,
+                         std::size_t before, std::size_t after) {
+  const auto from = pieces.begin() + static_cast<std::ptrdiff_t>(first);
+  Change change{first, std::vector<Piece>(from, from + static_cast<std::ptrdiff_t>(end - first)),
+                std::move(with), before, after};
+  splice(change.index, change.removed.size(), change.inserted);
+
+  redoSteps.clear();
+  if (!stepOpen || undoSteps.empty()) {
+    undoSteps.emplace_back();
+    stepOpen = true;
+  }
+
+  // Typing into the piece the step last changed updates that change instead of adding one
+  Step &step = undoSteps.back();
+  if (!step.empty() && step.back().index == change.index &&
+      step.back().inserted == change.removed) {
+    step.back().inserted = std::move(change.inserted);
+    step.back().after    = change.after;
+    return;
+  }
+  step.push_back(std::move(change));
+}
+
+void PieceTable::splice(std::size_t index, std::size_t count, const std::vector<Piece> &with) {
+  const auto first = pieces.begin() + static_cast<std::ptrdiff_t>(index);
+  const auto last  = first + static_cast<std::ptrdiff_t>(count);
+  for (auto it = first; it != last; ++it) {
+    totalSize -= it->length;
+    totalNewlines -= it->newlines;
+  }
+  for (const Piece &piece : with) {
+    totalSize += piece.length;
+    totalNewlines += piece.newlines;
+  }
+  pieces.insert(pieces.erase(first, last), with.begin(), with.end());
+}
+
+bool PieceTable::undo(std::size_t &offset) {
+  stepOpen = false;
+  if (undoSteps.empty()) return false;
+  const Step &step = redoSteps.emplace_back(std::move(undoSteps.back()));
+  undoSteps.pop_back();
+  for (auto change = step.rbegin(); change != step.rend(); ++change) {
+    splice(change->index, change->inserted.size(), change->removed);
+  }
+  offset = step.front().before;
+  return true;
+}
+
+bool PieceTable::redo(std::size_t &offset) {
+  stepOpen = false;
+  if (redoSteps.empty()) return false;
+  const Step &step = undoSteps.emplace_back(std::move(redoSteps.back()));
+  redoSteps.pop_back();
+  for (const Change &change : step) splice(change.index, change.removed.size(), change.inserted);
+  offset = step.back().after;
+  return true;
+}
+
+std::size_t PieceTable::lineStart(std::size_t line) const {
+  if (line == 0) return 0;
+  if (line > totalNewlines) return totalSize;
+
+  // The line starts after the document's `line`th newline
+  std::size_t offset = 0;
+  std::size_t seen   = 0;
+  for (const Piece &piece : pieces) {
+    if (seen + piece.newlines >= line) {
+      return offset + nthNewline(piece, line - seen - 1) - piece.start + 1;
+    }
+    seen += piece.newlines;
+    offset += piece.length;
+  }
+  return totalSize;
+}
+
+std::size_t PieceTable::lineAt(std::size_t offset) const {
+  std::size_t line = 0;
+  for (const Piece &piece : pieces) {
+    if (offset < piece.length) return line + countNewlines(piece.source, piece.start, offset);
+    line += piece.newlines;
+    offset -= piece.length;
+  }
+  return line;
+}
+
+std::size_t PieceTable::lineLength(std::size_t line, std::size_t limit) const {
+  std::size_t length   = 0;
+  auto [index, inside] = locate(lineStart(line));
+  for (; index < pieces.size() && length < limit; ++index, inside = 0) {
+    const std::string_view chunk = bytes(pieces[index]).substr(inside);
+    const std::size_t scanned    = std::min(chunk.size(), limit - length);
+    const std::size_t newline    = scan::findByte(chunk.data(), scanned, 0, '\n');
+    length += newline;
+    if (newline < scanned) break;
+  }
+  return length;
+}
+
+std::string PieceTable::line(std::size_t line) const {
+  const std::size_t start = lineStart(line);
+  const std::size_t end   = line + 1 < lineCount() ? lineStart(line + 1) - 1 : totalSize;
+  return text(start, end - start);
+}
+
+std::string PieceTable::text(std::size_t offset, std::size_t length) const {
+  std::string out;
+  if (offset >= totalSize) return out;
+  length = std::min(length, totalSize - offset);
+  out.reserve(length);
+
+  auto [index, inside] = locate(offset);
+  for (; index < pieces.size() && out.size() < length; ++index, inside = 0) {
+    const std::string_view chunk = bytes(pieces[index]).substr(inside);
+    out.append(chunk.substr(0, length - out.size()));
+  }
+  return out;
+}
@@ -0,0 +1,114 @@
+#ifndef F13446A6_22C2_47A7_9866_D2D289023A85
+#define F13446A6_22C2_47A7_9866_D2D289023A85
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "lineindex.hpp"
+
+// UTF-8 text stored as pieces of two buffers: the original file, which is never copied or
+// modified (it is usually a memory mapping), and an append-only buffer that holds everything
+// typed since. Edits only split and add pieces, so their cost does not depend on file size.
+// Offsets are in bytes; lines are split at '\n'.
+//
+// Edits are recorded as the pieces they replaced, so undoing one is as cheap as making it; the
+// added buffer keeps everything ever typed, which is what those pieces refer to.
+class PieceTable {
+public:
+  // `original` must outlive the table. Its lines are counted here, all of them.
+  explicit PieceTable(std::string_view original = {});
+  // Takes `originalLines`, an index of `original` that may have been built on another thread.
+  // Whatever it has not indexed yet is indexed here.
+  PieceTable(std::string_view original, LineIndex originalLines);
+
+  [[nodiscard]] std::size_t size() const { return totalSize; }
+  [[nodiscard]] std::size_t lineCount() const { return totalNewlines + 1; }
+
+  void insert(std::size_t offset, std::string_view text);
+  void remove(std::size_t offset, std::size_t length);
+
+  // Edits since the last call, or since the last undo or redo, are undone as one step.
+  void endUndoStep() { stepOpen = false; }
+  // Reverts the last undo step, or repeats the last undone one, and sets `offset` to where the
+  // cursor goes: the start of the step's first edit, or the end of its last one. Returns false
+  // if there is nothing to undo or redo. An edit drops the steps that could be redone.
+  bool undo(std::size_t &offset);
+  bool redo(std::size_t &offset);
+
+  // A copy without the undo history, e.g. for a save to write.
+  [[nodiscard]] PieceTable copyText() const;
+
+  // Byte offset where `line` starts, and its length without the '\n'. A line longer than `limit`
+  // has length `limit`, and no more than that is scanned.
+  [[nodiscard]] std::size_t lineStart(std::size_t line) const;
+  [[nodiscard]] std::size_t
+  lineLength(std::size_t line, std::size_t limit = std::numeric_limits<std::size_t>::max()) const;
+  // Line that contains byte `offset`; offsets past the end map to the last line.
+  [[nodiscard]] std::size_t lineAt(std::size_t offset) const;
+  [[nodiscard]] std::string line(std::size_t line) const;
+
+  [[nodiscard]] std::string text(std::size_t offset, std::size_t length) const;
+
+  // Calls `visit(std::string_view)` for every piece in order, e.g. to stream the text to disk.
+  // Stops early if `visit` returns false; returns false in that case.
+  template <typename Visitor>
+  bool forEachChunk(Visitor &&visit) const {
+    for (const Piece &piece : pieces) {
+      if (!visit(bytes(piece))) return false;
+    }
+    return true;
+  }
+
+private:
+  enum class Source : std::uint8_t { Original, Added };
+
+  struct Piece {
+    Source source;
+    std::size_t start;
+    std::size_t length;
+    std::size_t newlines;
+
+    bool operator==(const Piece &other) const {
+      return source == other.source && start == other.start && length == other.length &&
+             newlines == other.newlines;
+    }
+  };
+
+  // pieces[index, index + removed.size()) were replaced by `inserted`
+  struct Change {
+    std::size_t index;
+    std::vector<Piece> removed;
+    std::vector<Piece> inserted;
+    std::size_t before; // cursor offset before the edit
+    std::size_t after;  // and after it
+  };
+  using Step = std::vector<Change>;
+
+  std::string_view original;
+  std::string added;
+  std::vector<Piece> pieces;
+  LineIndex originalLines;
+  std::size_t totalSize     = 0;
+  std::size_t totalNewlines = 0;
+
+  std::vector<Step> undoSteps;
+  std::vector<Step> redoSteps;
+  bool stepOpen = false; // edits go on into undoSteps.back()
+
+  [[nodiscard]] std::string_view bytes(const Piece &piece) const;
+  [[nodiscard]] std::size_t countNewlines(Source source, std::size_t start,
+                                          std::size_t length) const;
+  [[nodiscard]] std::size_t nthNewline(const Piece &piece, std::size_t n) const;
+  [[nodiscard]] std::pair<std::size_t, std::size_t> locate(std::size_t offset) const;
+  Piece slice(const Piece &piece, std::size_t from, std::size_t to) const;
+  void replace(std::size_t first, std::size_t end, std::vector<Piece> with, std::size_t before,
+               std::size_t after);
+  void splice(std::size_t index, std::size_t count, const std::vector<Piece> &with);
+};
+
+#endif /* F13446A6_22C2_47A7_9866_D2D289023A85 */
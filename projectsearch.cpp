@@ -0,0 +1,261 @@
+#include "projectsearch.hpp"
+
+#include <QFile>
+#include <QRegularExpression>
+#include <algorithm>
+#include <atomic>
+
+#include "pathindex.hpp"
+#include "scan.hpp"
+#include "sourcefile.hpp"
+#include "utf8.hpp"
+
+namespace {
+
+constexpr qsizetype kMaxLineChars = 240; // of a line's text kept for display
+constexpr qsizetype kBatch        = 256; // matches sent at once
+
+bool isAscii(const QString &text) {
+  return std::all_of(text.begin(), text.end(), [](QChar c) { return c.unicode() < 0x80; });
+}
+
+} // namespace
+
+struct ProjectSearch::Run {
+  quint64 id = 0;
+  QString root;
+  std::shared_ptr<const PathIndex> index;
+  QRegularExpression regex;
+  bool useRegex = false;
+  QByteArray literal; // UTF-8; every match contains it, unless empty
+  bool ignoreCase = false;
+
+  std::atomic<bool> cancelled{false};
+  std::atomic<bool> truncated{false};
+  std::atomic<std::size_t> next{0};
+  std::atomic<int> files{0};
+  std::atomic<int> matches{0};
+  std::atomic<int> workers{0};
+};
+
+ProjectSearch::ProjectSearch(QObject *parent) : QObject(parent) {
+  // Queued to the GUI thread, where `search` tells current results from stale ones
+  connect(this, &ProjectSearch::workerFound, this,
+          [this](quint64 from, const QString &file, const QList<int> &lines,
+                 const QStringList &texts, const QList<int> &columns, const QList<int> &lengths) {
+            if (from == search) emit found(file, lines, texts, columns, lengths);
+          });
+  connect(this, &ProjectSearch::workerFinished, this,
+          [this](quint64 from, int filesSearched, int matches, bool truncated) {
+            if (from != search) return;
+            searching = false;
+            current.reset();
+            emit finished(filesSearched, std::min(matches, maxMatches), truncated);
+          });
+}
+
+ProjectSearch::~ProjectSearch() {
+  cancel();
+  pool.waitForDone();
+}
+
+bool ProjectSearch::start(const QString &root, std::shared_ptr<const PathIndex> index,
+                          const Query &query, QString *error) {
+  cancel();
+  if (query.pattern.isEmpty() || !index) {
+    if (error) *error = tr("Nothing to search");
+    return false;
+  }
+
+  auto next        = std::make_shared<Run>();
+  next->root       = root;
+  next->index      = std::move(index);
+  next->ignoreCase = !query.matchCase;
+
+  QString literal = query.pattern;
+  if (query.regex) {
+    next->regex = QRegularExpression(query.pattern, next->ignoreCase
+                                                        ? QRegularExpression::CaseInsensitiveOption
+                                                        : QRegularExpression::NoPatternOption);
+    if (!next->regex.isValid()) {
+      if (error) *error = next->regex.errorString();
+      return false;
+    }
+    next->useRegex = true;
+    literal        = requiredLiteral(query.pattern);
+  } else if (next->ignoreCase && !isAscii(literal)) {
+    // findLiteral folds ASCII only
+    next->regex    = QRegularExpression(QRegularExpression::escape(query.pattern),
+                                        QRegularExpression::CaseInsensitiveOption);
+    next->useRegex = true;
+  }
+  if (next->ignoreCase && !isAscii(literal)) literal.clear();
+  next->literal = literal.toUtf8();
+  if (next->useRegex) next->regex.optimize();
+
+  next->id      = ++search;
+  next->workers = pool.maxThreadCount();
+  current       = next;
+  searching     = true;
+  for (int i = 0; i < pool.maxThreadCount(); ++i) {
+    pool.start([this, next] { work(next); });
+  }
+  return true;
+}
+
+void ProjectSearch::cancel() {
+  if (current) current->cancelled = true;
+  current.reset();
+  searching = false;
+  ++search;
+}
+
+QString ProjectSearch::requiredLiteral(const QString &pattern) {
+  // Alternatives and inline options could make any literal optional
+  if (pattern.contains(u'|') || pattern.contains(QStringLiteral("(?"))) return QString();
+
+  QString best;
+  QString current;
+  const auto endRun = [&] {
+    if (current.size() > best.size()) best = current;
+    current.clear();
+  };
+  const auto skipClass = [&pattern](qsizetype i) {
+    // `i` is at '['; a ']' right after it, or after '^', is part of the class
+    ++i;
+    if (i < pattern.size() && pattern[i] == u'^') ++i;
+    if (i < pattern.size() && pattern[i] == u']') ++i;
+    for (; i < pattern.size() && pattern[i] != u']'; ++i) {
+      if (pattern[i] == u'\\') ++i;
+    }
+    return i;
+  };
+
+  int depth = 0; // of groups, whose contents may be optional
+  for (qsizetype i = 0; i < pattern.size(); ++i) {
+    const QChar c = pattern[i];
+    if (c == u'\\') {
+      endRun();
+      ++i;
+    } else if (c == u'[') {
+      endRun();
+      i = skipClass(i);
+    } else if (c == u'(') {
+      endRun();
+      ++depth;
+    } else if (c == u')') {
+      --depth;
+    } else if (depth > 0) {
+      continue;
+    } else if (c == u'*' || c == u'?' || c == u'{') {
+      // The character before is optional
+      current.chop(1);
+      endRun();
+      if (c == u'{') i = pattern.indexOf(u'}', i);
+      if (i < 0) break;
+    } else if (c == u'+' || c == u'.' || c == u'^' || c == u'$') {
+      endRun();
+    } else {
+      current += c;
+    }
+  }
+  endRun();
+  return best;
+}
+
+void ProjectSearch::work(const std::shared_ptr<Run> &run) {
+  const std::size_t count = run->index->size();
+  while (!run->cancelled) {
+    const std::size_t i = run->next++;
+    if (i >= count) break;
+    const std::string_view path = run->index->path(i);
+    searchFile(*run,
+               QFile::decodeName(QByteArray(path.data(), static_cast<qsizetype>(path.size()))));
+  }
+  if (--run->workers == 0) {
+    emit workerFinished(run->id, run->files, run->matches, run->truncated);
+  }
+}
+
+void ProjectSearch::searchFile(Run &run, const QString &file) {
+  SourceFile source;
+  if (!source.open(run.root + '/' + file)) return;
+  ++run.files;
+  if (source.text().empty()) return;
+  const char *data       = source.text().data();
+  const std::size_t size = source.text().size();
+
+  const std::string_view literal(run.literal.constData(),
+                                 static_cast<std::size_t>(run.literal.size()));
+  const int literalUnits = static_cast<int>(utf16Length(literal.data(), literal.size()));
+
+  QList<int> lines;
+  QList<int> columns;
+  QList<int> lengths;
+  QStringList texts;
+  const auto flush = [&] {
+    if (lines.isEmpty()) return;
+    emit workerFound(run.id, file, lines, texts, columns, lengths);
+    lines.clear();
+    columns.clear();
+    lengths.clear();
+    texts.clear();
+  };
+  // Counts a match; false once the search has found enough
+  const auto add = [&](int line, const QString &text, qsizetype column, qsizetype length) {
+    if (run.matches++ >= maxMatches) {
+      run.truncated = true;
+      run.cancelled = true;
+      return false;
+    }
+    lines.append(line);
+    texts.append(text);
+    columns.append(static_cast<int>(column));
+    lengths.append(static_cast<int>(length));
+    if (lines.size() >= kBatch) flush();
+    return true;
+  };
+
+  int line            = 0;
+  std::size_t counted = 0; // lines before `counted` are in `line`
+  for (std::size_t pos = 0; pos < size && !run.cancelled;) {
+    // Skip straight to the next line with the literal
+    std::size_t start = pos;
+    if (!literal.empty()) {
+      const std::size_t hit = scan::findLiteral(data, size, pos, literal, run.ignoreCase);
+      if (hit == size) break;
+      for (start = hit; start > pos && data[start - 1] != '\n';) --start;
+    }
+    const std::size_t end = scan::findByte(data, size, start, '\n');
+    pos                   = end + 1;
+
+    line += static_cast<int>(scan::countByte(data + counted, start - counted, '\n'));
+    counted = start;
+
+    const char *begin  = data + start;
+    std::size_t length = end - start;
+    if (length > 0 && begin[length - 1] == '\r') --length;
+    const QString text  = QString::fromUtf8(begin, static_cast<qsizetype>(length));
+    const QString shown = text.left(kMaxLineChars);
+
+    bool more = true;
+    if (!run.useRegex) {
+      for (std::size_t at = scan::findLiteral(begin, length, 0, literal, run.ignoreCase);
+           more && at < length;
+           at = scan::findLiteral(begin, length, at + literal.size(), literal, run.ignoreCase)) {
+        more = add(line, shown, static_cast<qsizetype>(utf16Length(begin, at)), literalUnits);
+      }
+    } else {
+      bool matched = false;
+      for (auto it = run.regex.globalMatch(text); more && it.hasNext();) {
+        const QRegularExpressionMatch match = it.next();
+        // An empty match only marks the line
+        if (match.capturedLength() == 0 && matched) continue;
+        matched = true;
+        more    = add(line, shown, match.capturedStart(), match.capturedLength());
+      }
+    }
+    if (!more) break;
+  }
+  flush();
+}
@@ -0,0 +1,70 @@
+#ifndef A49222AF_6270_4268_BA30_BED5443A875C
+#define A49222AF_6270_4268_BA30_BED5443A875C
+
+#include <QList>
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QThreadPool>
+#include <memory>
+
+class PathIndex;
+
+// Searches the files of a PathIndex, which leaves out ignored files, on a thread pool. Each
+// file is memory-mapped; files with a NUL byte near the start are taken as binary and skipped.
+// A literal that every match must contain is looked for with scan::findLiteral first, and
+// only the lines that have it are decoded and run through the regular expression, if any.
+// Matches stream back per file while the search goes on; a newer search or cancel() makes
+// the workers stop at their next file and drops whatever they still send.
+class ProjectSearch : public QObject {
+  Q_OBJECT
+
+public:
+  struct Query {
+    QString pattern;
+    bool regex     = false;
+    bool matchCase = false;
+  };
+
+  // The search stops once it has found this many matches
+  static constexpr int maxMatches = 100000;
+
+  explicit ProjectSearch(QObject *parent = nullptr);
+  ~ProjectSearch() override; // cancels and waits for the workers
+
+  // Cancels the current search and starts searching the files of `index`, relative to `root`.
+  // Returns false, with `error` set, if the pattern is not a valid regular expression.
+  bool start(const QString &root, std::shared_ptr<const PathIndex> index, const Query &query,
+             QString *error = nullptr);
+  void cancel();
+  [[nodiscard]] bool isSearching() const { return searching; }
+
+  // Longest run of characters every match of the regular expression `pattern` contains, or
+  // an empty string if there is none that is easy to tell.
+  static QString requiredLiteral(const QString &pattern);
+
+signals:
+  // Matches in `file`, relative to the root. `lines` are 0-based; `columns` and `lengths` are
+  // in UTF-16 code units of the line's text.
+  void found(const QString &file, const QList<int> &lines, const QStringList &texts,
+             const QList<int> &columns, const QList<int> &lengths);
+  void finished(int filesSearched, int matches, bool truncated);
+
+  // Emitted from the workers, tagged with the search they belong to.
+  void workerFound(quint64 search, const QString &file, const QList<int> &lines,
+                   const QStringList &texts, const QList<int> &columns, const QList<int> &lengths);
+  void workerFinished(quint64 search, int filesSearched, int matches, bool truncated);
+
+private:
+  struct Run;
+
+  QThreadPool pool;
+  std::shared_ptr<Run> current;
+  quint64 search = 0;
+  bool searching = false;
+
+  void work(const std::shared_ptr<Run> &run);
+  void searchFile(Run &run, const QString &file);
+};
+
+#endif /* A49222AF_6270_4268_BA30_BED5443A875C */
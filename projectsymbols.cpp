@@ -0,0 +1,334 @@
+#include "projectsymbols.hpp"
+
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QProcess>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "buffersymbols.hpp"
+#include "declscanner.hpp"
+#include "dirlist.hpp"
+#include "pathindexer.hpp"
+#include "sourcefile.hpp"
+#include "symbolindex.hpp"
+
+namespace {
+
+constexpr int kCompilerTimeoutMs = 5000;
+
+constexpr std::string_view kExtensions[] = {"c",   "h",   "cc",  "cp",  "cpp", "cxx", "c++",
+                                            "hh",  "hp",  "hpp", "hxx", "h++", "inl", "ipp",
+                                            "tcc", "txx", "ixx", "cppm"};
+
+// A C or C++ file by its name. Standard library headers like <vector> have no extension, so
+// `bare` takes those too.
+bool isSourceFile(std::string_view name, bool bare) {
+  const std::size_t slash = name.rfind('/');
+  const std::size_t dot   = name.rfind('.');
+  if (dot == std::string_view::npos || (slash != std::string_view::npos && dot < slash)) {
+    return bare;
+  }
+  const std::string_view extension = name.substr(dot + 1);
+  return std::find(std::begin(kExtensions), std::end(kExtensions), extension) !=
+         std::end(kExtensions);
+}
+
+QString cachePath(const QString &root, const QString &compiler) {
+  const QByteArray key =
+      QCryptographicHash::hash((root + '\n' + compiler).toUtf8(), QCryptographicHash::Sha1);
+  return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/symbols/" +
+         QString::fromLatin1(key.toHex()) + ".idx";
+}
+
+bool writeCache(const QString &path, const std::vector<std::uint8_t> &data) {
+  QDir().mkpath(QFileInfo(path).absolutePath());
+  QSaveFile file(path);
+  if (!file.open(QIODevice::WriteOnly)) return false;
+  file.write(reinterpret_cast<const char *>(data.data()), static_cast<qint64>(data.size()));
+  return file.commit();
+}
+
+// The directories `compiler` searches for #include <...>, which it lists on stderr with -v
+QStringList systemIncludeDirs(const QString &compiler) {
+  QProcess process;
+  process.setProcessChannelMode(QProcess::MergedChannels);
+  process.start(compiler, {"-xc++", "-E", "-v", "-"});
+  if (!process.waitForStarted(kCompilerTimeoutMs)) return {};
+  process.closeWriteChannel();
+  if (!process.waitForFinished(kCompilerTimeoutMs)) {
+    process.kill();
+    process.waitForFinished();
+    return {};
+  }
+
+  QStringList dirs;
+  bool listing            = false;
+  const QStringList lines = QString::fromLocal8Bit(process.readAll()).split('\n');
+  for (const QString &line : lines) {
+    if (line.startsWith("#include <...> search starts here:")) {
+      listing = true;
+    } else if (line.startsWith("End of search list.")) {
+      break;
+    } else if (listing) {
+      QString dir = line.trimmed();
+      dir.remove(" (framework directory)");
+      dirs.append(QDir::cleanPath(dir));
+    }
+  }
+  return dirs;
+}
+
+// Appends the headers under `dir` to `files` until it holds `limit`. Links to directories
+// are not followed, so a loop of them cannot keep the walk going.
+void collectHeaders(const std::string &dir, std::vector<std::string> &files, std::size_t limit,
+                    const std::atomic<bool> &cancelled) {
+  std::vector<DirEntry> entries;
+  if (!listDirectory(dir, entries)) return;
+  for (const DirEntry &entry : entries) {
+    if (files.size() >= limit || cancelled) return;
+    if (entry.name[0] == '.') continue;
+    std::string path = dir + '/' + entry.name;
+    if (entry.isDir) {
+      if (!entry.isLink) collectHeaders(path, files, limit, cancelled);
+    } else if (isSourceFile(entry.name, true)) {
+      files.push_back(std::move(path));
+    }
+  }
+}
+
+// Scans the declarations of `symbols.path`, unless it is a binary file
+void scanFile(FileSymbols &symbols) {
+  SourceFile source;
+  if (!source.open(QFile::decodeName(symbols.path.c_str())) || source.text().empty()) return;
+
+  std::vector<Declaration> declarations;
+  scanDeclarations(source.text(), declarations);
+  symbols.symbols.reserve(declarations.size());
+  for (const Declaration &declaration : declarations) symbols.add(declaration);
+}
+
+} // namespace
+
+// An index as the worker left it: mapped from the cache file, or held in memory if it could
+// not be written there
+struct ProjectSymbols::Snapshot {
+  QString cacheFile;
+  QFile file;
+  std::vector<std::uint8_t> bytes;
+  SymbolIndex index;
+  std::shared_ptr<const SymbolArena> arena; // each name once, with how often it is declared
+
+  bool load(const QString &path) {
+    cacheFile = path;
+    file.setFileName(path);
+    if (!file.open(QIODevice::ReadOnly) || file.size() <= 0) return false;
+    const uchar *data = file.map(0, file.size());
+    if (!data || !index.open(data, static_cast<std::size_t>(file.size()))) return false;
+    buildArena();
+    return true;
+  }
+
+  void adopt(const QString &path, std::vector<std::uint8_t> serialized) {
+    cacheFile = path;
+    bytes     = std::move(serialized);
+    index.open(bytes.data(), bytes.size());
+    buildArena();
+  }
+
+  void buildArena() {
+    auto built          = std::make_shared<SymbolArena>();
+    const std::size_t n = index.symbolCount();
+    for (std::size_t i = 0; i < n;) {
+      const std::string_view name = index.symbol(index.symbolByName(i)).name;
+      std::size_t next            = i + 1;
+      while (next < n && index.symbol(index.symbolByName(next)).name == name) ++next;
+      if (name.size() >= BufferSymbols::minWordLength) {
+        const QString word =
+            QString::fromUtf8(name.data(), static_cast<qsizetype>(name.size()));
+        built->add(word.toStdU16String(), static_cast<std::uint32_t>(next - i));
+      }
+      i = next;
+    }
+    arena = std::move(built);
+  }
+};
+
+ProjectSymbols::ProjectSymbols(PathIndexer *paths, QObject *parent)
+    : QObject(parent), paths(paths) {
+  connect(paths, &PathIndexer::indexChanged, this, &ProjectSymbols::refresh);
+}
+
+ProjectSymbols::~ProjectSymbols() { stopWorker(); }
+
+void ProjectSymbols::setCompiler(const QString &name) {
+  if (name == compiler) return;
+  stopWorker();
+  compiler = name;
+  includeDirs.clear();
+  includeDirsKnown = false;
+  startWorker();
+}
+
+void ProjectSymbols::refresh() {
+  if (worker) {
+    refreshPending = true;
+    return;
+  }
+  startWorker();
+}
+
+QList<ProjectSymbols::Location> ProjectSymbols::locate(const QString &name) const {
+  // `current` only changes on this thread
+  QList<Location> found;
+  if (!current || name.isEmpty()) return found;
+
+  const QByteArray key     = name.toUtf8();
+  const SymbolIndex &index = current->index;
+  for (const std::uint32_t i :
+       index.find(std::string_view(key.constData(), static_cast<std::size_t>(key.size())))) {
+    const SymbolIndex::Symbol symbol = index.symbol(i);
+    const std::string_view path      = index.file(symbol.file).path;
+    const QString fileName =
+        QFile::decodeName(QByteArray(path.data(), static_cast<qsizetype>(path.size())));
+    found.append(Location{fileName, static_cast<int>(symbol.line),
+                          static_cast<int>(symbol.column), static_cast<int>(name.size()),
+                          symbol.definition});
+  }
+  std::stable_partition(found.begin(), found.end(),
+                        [](const Location &location) { return location.definition; });
+  return found;
+}
+
+std::shared_ptr<const SymbolArena> ProjectSymbols::symbols() const {
+  const std::lock_guard<std::mutex> lock(mutex);
+  return current ? current->arena : nullptr;
+}
+
+void ProjectSymbols::startWorker() {
+  const std::shared_ptr<const PathIndex> files = paths->index();
+  if (!files) return;
+  refreshPending = false;
+
+  const QString root = paths->rootPath();
+
+  cancelled = false;
+  worker    = QThread::create([this, files, root, cacheFile = cachePath(root, compiler),
+                            compilerName = compiler, dirsKnown = includeDirsKnown,
+                            dirs = includeDirs, old = current] {
+    resultIncludeDirs =
+        dirsKnown || compilerName.isEmpty() ? dirs : systemIncludeDirs(compilerName);
+
+    // The index of the last scan, from this session or an earlier one
+    std::shared_ptr<const Snapshot> previous = old && old->cacheFile == cacheFile ? old : nullptr;
+    if (!previous) {
+      auto loaded = std::make_shared<Snapshot>();
+      if (loaded->load(cacheFile)) previous = std::move(loaded);
+    }
+    std::unordered_map<std::string_view, std::uint32_t> previousFiles;
+    if (previous) {
+      for (std::size_t i = 0; i < previous->index.fileCount(); ++i) {
+        previousFiles.emplace(previous->index.file(i).path, static_cast<std::uint32_t>(i));
+      }
+    }
+
+    // The project's sources, then the system headers
+    std::vector<std::string> names;
+    const std::string rootName = QFile::encodeName(root).toStdString();
+    for (std::size_t i = 0; i < files->size(); ++i) {
+      const std::string_view path = files->path(i);
+      if (isSourceFile(path, false)) names.push_back(rootName + '/' + std::string(path));
+    }
+    const std::size_t limit = names.size() + maxSystemFiles;
+    for (const QString &dir : resultIncludeDirs) {
+      collectHeaders(QFile::encodeName(dir).toStdString(), names, limit, cancelled);
+    }
+    std::sort(names.begin(), names.end());
+    names.erase(std::unique(names.begin(), names.end()), names.end());
+
+    // Files that are as they were scanned last time are copied from that index
+    std::vector<FileSymbols> scanned(names.size());
+    std::atomic<std::size_t> next{0};
+    std::atomic<bool> changed{!previous || previous->index.fileCount() != names.size()};
+    const auto work = [&] {
+      while (!cancelled) {
+        const std::size_t i = next++;
+        if (i >= names.size()) break;
+        const QFileInfo info(QFile::decodeName(names[i].c_str()));
+        FileSymbols &symbols = scanned[i];
+        symbols.path         = names[i];
+        symbols.modified     = info.lastModified().toMSecsSinceEpoch();
+        symbols.size         = info.size();
+
+        const auto seen = previousFiles.find(names[i]);
+        if (seen != previousFiles.end()) {
+          const SymbolIndex::File file = previous->index.file(seen->second);
+          if (file.modified == symbols.modified && file.size == symbols.size) {
+            symbols = previous->index.fileSymbols(seen->second);
+            continue;
+          }
+        }
+        changed = true;
+        // Files not scanned are still listed, so they are not tried again until they change
+        if (info.isFile() && symbols.size <= maxFileBytes) scanFile(symbols);
+      }
+    };
+    for (int i = 0; i < scanners.maxThreadCount(); ++i) scanners.start(work);
+    scanners.waitForDone();
+    if (cancelled) return;
+    if (!changed) {
+      result = previous;
+      return;
+    }
+
+    std::vector<std::uint8_t> bytes = SymbolIndex::serialize(scanned);
+    scanned                         = std::vector<FileSymbols>();
+
+    auto snapshot = std::make_shared<Snapshot>();
+    if (!writeCache(cacheFile, bytes) || !snapshot->load(cacheFile)) {
+      snapshot = std::make_shared<Snapshot>();
+      snapshot->adopt(cacheFile, std::move(bytes));
+    }
+    result = std::move(snapshot);
+  });
+  connect(worker, &QThread::finished, this, [this, started = ++generation] {
+    if (started == generation) workerFinished();
+  });
+  worker->start(QThread::LowPriority);
+}
+
+void ProjectSymbols::workerFinished() {
+  worker->wait();
+  delete worker;
+  worker = nullptr;
+
+  includeDirs      = resultIncludeDirs;
+  includeDirsKnown = true;
+  if (result && result != current) {
+    {
+      const std::lock_guard<std::mutex> lock(mutex);
+      current = std::move(result);
+    }
+    emit indexChanged();
+  }
+  result.reset();
+
+  // Files saved or changed during the scan
+  if (refreshPending) startWorker();
+}
+
+void ProjectSymbols::stopWorker() {
+  if (!worker) return;
+  cancelled = true;
+  worker->wait();
+  delete worker;
+  worker = nullptr;
+  result.reset();
+  ++generation;
+}
@@ -0,0 +1,82 @@
+#ifndef FEF5B2B6_B21A_488D_ACF5_2AF6506D0AF2
+#define FEF5B2B6_B21A_488D_ACF5_2AF6506D0AF2
+
+#include <QList>
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QThread>
+#include <QThreadPool>
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+#include "completionengine.hpp"
+
+class PathIndexer;
+
+// The functions, types and macros declared in a project's C and C++ files and in the system
+// headers of a compiler, for completion and Go to Definition. Files are scanned with
+// scanDeclarations on a background thread, several at a time, each time the project's file
+// index changes. The result is written to an index file in the cache directory and mapped
+// back into memory, so lookups read it in place. A file whose modification time and size are
+// the same as when it was last scanned, in this session or an earlier one, is not read again.
+class ProjectSymbols : public QObject, public CompletionSource {
+  Q_OBJECT
+
+public:
+  struct Location {
+    QString fileName;
+    int line; // 0-based
+    int column;
+    int length;
+    bool definition;
+  };
+
+  // Larger files, generated tables and the like, are not scanned
+  static constexpr qint64 maxFileBytes = 4 * 1024 * 1024;
+  // Beyond this many files under the include directories the rest are left out
+  static constexpr int maxSystemFiles = 50000;
+
+  explicit ProjectSymbols(PathIndexer *paths, QObject *parent = nullptr);
+  ~ProjectSymbols() override; // stops a running scan
+
+  // Indexes the system headers of `compiler` too, as `compiler -E -v` lists them.
+  void setCompiler(const QString &compiler);
+  // Scans the files that changed since the last scan, e.g. after one was saved.
+  void refresh();
+  [[nodiscard]] bool isIndexing() const { return worker != nullptr; }
+
+  // Where `name` is declared, definitions first.
+  [[nodiscard]] QList<Location> locate(const QString &name) const;
+
+  [[nodiscard]] std::shared_ptr<const SymbolArena> symbols() const override;
+
+signals:
+  void indexChanged();
+
+private:
+  struct Snapshot;
+
+  PathIndexer *paths;
+  QString compiler;
+  QStringList includeDirs;       // of `compiler`
+  bool includeDirsKnown = false; // the worker has asked `compiler` for includeDirs
+  mutable std::mutex mutex; // guards current, which symbols() reads on the completion thread
+  std::shared_ptr<const Snapshot> current;
+  QThreadPool scanners;
+
+  QThread *worker = nullptr;
+  std::atomic<bool> cancelled{false};
+  quint64 generation  = 0;     // tells a stopped worker's finished() from the current one's
+  bool refreshPending = false; // refresh() was called while the worker ran
+  // Written by the worker, read once it has finished
+  std::shared_ptr<const Snapshot> result;
+  QStringList resultIncludeDirs;
+
+  void startWorker();
+  void workerFinished();
+  void stopWorker();
+};
+
+#endif /* FEF5B2B6_B21A_488D_ACF5_2AF6506D0AF2 */
@@ -0,0 +1,353 @@
+#include "projecttree.hpp"
+
+#include <QAbstractFileIconProvider>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QFileSystemWatcher>
+#include <algorithm>
+
+#include "dirlist.hpp"
+
+namespace {
+
+bool nameLess(const QString &a, const QString &b) {
+  const int order = QString::compare(a, b, Qt::CaseInsensitive);
+  return order != 0 ? order < 0 : a < b;
+}
+
+// Order of the model's rows: directories first, then by name
+int compareEntries(bool aDir, const QString &a, bool bDir, const QString &b) {
+  if (aDir != bDir) return aDir ? -1 : 1;
+  if (nameLess(a, b)) return -1;
+  return nameLess(b, a) ? 1 : 0;
+}
+
+// Runs on a lister thread
+void listDirectoryInto(const QString &path, const std::string &relative,
+                       std::vector<IgnoreScope> scopes, bool hidden, bool &ok, QStringList &dirs,
+                       QStringList &files, QByteArray &ignoreFile) {
+  std::vector<DirEntry> entries;
+  ok = listDirectory(QFile::encodeName(path).toStdString(), entries);
+  if (!ok) return;
+
+  const bool hasIgnoreFile = std::any_of(entries.begin(), entries.end(), [](const DirEntry &e) {
+    return !e.isDir && e.name == ".gitignore";
+  });
+  if (hasIgnoreFile) {
+    QFile file(path + "/.gitignore");
+    if (file.open(QIODevice::ReadOnly)) ignoreFile = file.readAll();
+  }
+  if (!ignoreFile.isEmpty()) {
+    scopes.push_back({std::make_shared<const IgnoreRules>(
+                          std::string_view(ignoreFile.constData(), ignoreFile.size())),
+                      relative});
+  }
+
+  std::string entryPath = relative;
+  for (const DirEntry &entry : entries) {
+    if (!hidden && entry.name.front() == '.') continue;
+    entryPath.resize(relative.size());
+    entryPath += entry.name;
+    if (isIgnored(scopes, entryPath, entry.isDir)) continue;
+    (entry.isDir ? dirs : files).append(QFile::decodeName(entry.name.c_str()));
+  }
+  std::sort(dirs.begin(), dirs.end(), nameLess);
+  std::sort(files.begin(), files.end(), nameLess);
+}
+
+} // namespace
+
+ProjectTreeModel::ProjectTreeModel(QObject *parent)
+    : QAbstractItemModel(parent), watcher(new QFileSystemWatcher(this)) {
+  pool.setMaxThreadCount(2);
+
+  QAbstractFileIconProvider icons;
+  folderIcon = icons.icon(QAbstractFileIconProvider::Folder);
+  fileIcon   = icons.icon(QAbstractFileIconProvider::File);
+
+  // Queued to the GUI thread
+  connect(this, &ProjectTreeModel::listerFinished, this, &ProjectTreeModel::applyListing);
+  connect(watcher, &QFileSystemWatcher::directoryChanged, this, [this](const QString &path) {
+    if (Node *node = watched.value(path)) startListing(node);
+  });
+}
+
+ProjectTreeModel::~ProjectTreeModel() {
+  pool.clear();
+  pool.waitForDone();
+}
+
+QString ProjectTreeModel::findProjectRoot(const QString &path) {
+  for (QDir dir(QFileInfo(path).absoluteFilePath());;) {
+    if (dir.exists(".git")) return dir.absolutePath();
+    if (!dir.cdUp()) return QFileInfo(path).absoluteFilePath();
+  }
+}
+
+void ProjectTreeModel::setRootPath(const QString &path) {
+  reset(QDir::cleanPath(QFileInfo(path).absoluteFilePath()));
+}
+
+QString ProjectTreeModel::rootPath() const { return root ? root->name : QString(); }
+
+void ProjectTreeModel::setShowHidden(bool show) {
+  if (show == showHidden) return;
+  showHidden = show;
+  if (root) reset(root->name);
+}
+
+// The root is listed when the view first asks for it, which is after the window is shown
+void ProjectTreeModel::reset(const QString &path) {
+  beginResetModel();
+  if (!watched.isEmpty()) watcher->removePaths(watched.keys());
+  watched.clear();
+  listings.clear();
+
+  root        = std::make_unique<Node>();
+  root->name  = path;
+  root->isDir = true;
+  endResetModel();
+
+  watched.insert(path, root.get());
+  watcher->addPath(path);
+}
+
+QString ProjectTreeModel::filePath(const QModelIndex &index) const {
+  return pathOf(nodeFor(index));
+}
+
+bool ProjectTreeModel::isDir(const QModelIndex &index) const { return nodeFor(index)->isDir; }
+
+void ProjectTreeModel::setExpanded(const QModelIndex &index, bool expanded) {
+  Node *node = nodeFor(index);
+  if (node == root.get() || !node->isDir || node->expanded == expanded) return;
+  node->expanded = expanded;
+
+  const QString path = pathOf(node);
+  if (expanded) {
+    watched.insert(path, node);
+    watcher->addPath(path);
+    if (!node->listed && !node->listing) startListing(node);
+  } else {
+    watched.remove(path);
+    watcher->removePath(path);
+    dropChildren(node);
+  }
+}
+
+QModelIndex ProjectTreeModel::index(int row, int column, const QModelIndex &parent) const {
+  const Node *node = nodeFor(parent);
+  if (!node || column != 0 || row < 0 || row >= static_cast<int>(node->children.size())) {
+    return QModelIndex();
+  }
+  return createIndex(row, column, node->children[row].get());
+}
+
+QModelIndex ProjectTreeModel::parent(const QModelIndex &child) const {
+  if (!child.isValid()) return QModelIndex();
+  return indexFor(static_cast<const Node *>(child.internalPointer())->parent);
+}
+
+int ProjectTreeModel::rowCount(const QModelIndex &parent) const {
+  const Node *node = nodeFor(parent);
+  return node ? static_cast<int>(node->children.size()) : 0;
+}
+
+int ProjectTreeModel::columnCount(const QModelIndex &) const { return 1; }
+
+QVariant ProjectTreeModel::data(const QModelIndex &index, int role) const {
+  if (!index.isValid()) return QVariant();
+  const Node *node = nodeFor(index);
+  switch (role) {
+    case Qt::DisplayRole:
+      return node->name;
+    case Qt::DecorationRole:
+      return node->isDir ? folderIcon : fileIcon;
+    case Qt::ToolTipRole:
+      return pathOf(node);
+    default:
+      return QVariant();
+  }
+}
+
+bool ProjectTreeModel::hasChildren(const QModelIndex &parent) const {
+  const Node *node = nodeFor(parent);
+  return node && node->isDir && (!node->listed || !node->children.empty());
+}
+
+bool ProjectTreeModel::canFetchMore(const QModelIndex &parent) const {
+  const Node *node = nodeFor(parent);
+  return node && node->isDir && !node->listed && !node->listing;
+}
+
+void ProjectTreeModel::fetchMore(const QModelIndex &parent) {
+  if (canFetchMore(parent)) startListing(nodeFor(parent));
+}
+
+ProjectTreeModel::Node *ProjectTreeModel::nodeFor(const QModelIndex &index) const {
+  return index.isValid() ? static_cast<Node *>(index.internalPointer()) : root.get();
+}
+
+QModelIndex ProjectTreeModel::indexFor(const Node *node) const {
+  if (!node || node == root.get()) return QModelIndex();
+  return createIndex(node->row, 0, const_cast<Node *>(node));
+}
+
+QString ProjectTreeModel::pathOf(const Node *node) const {
+  QStringList parts;
+  for (; node != root.get(); node = node->parent) parts.prepend(node->name);
+
+  QString path = root->name;
+  for (const QString &part : parts) {
+    if (!path.endsWith(u'/')) path += u'/';
+    path += part;
+  }
+  return path;
+}
+
+// A newer listing of the same directory replaces one still in flight
+void ProjectTreeModel::startListing(Node *node) {
+  if (node->listing) listings.remove(node->listing);
+  node->listing = ++lastListing;
+  listings.insert(node->listing, node);
+
+  // The .gitignore files of the parents, with their paths from the root. The lister reads the
+  // directory's own, which may have changed.
+  std::vector<IgnoreScope> scopes;
+  std::string relative;
+  std::vector<const Node *> chain;
+  for (const Node *n = node; n; n = n->parent) chain.push_back(n);
+  for (auto n = chain.rbegin(); n != chain.rend(); ++n) {
+    if (*n != root.get()) relative += QFile::encodeName((*n)->name).toStdString() + '/';
+    if ((*n)->rules && *n != node) scopes.push_back({(*n)->rules, relative});
+  }
+
+  pool.start([this, id = node->listing, path = pathOf(node), relative = std::move(relative),
+              scopes = std::move(scopes), hidden = showHidden]() mutable {
+    bool ok = false;
+    QStringList dirs;
+    QStringList files;
+    QByteArray ignoreFile;
+    listDirectoryInto(path, relative, std::move(scopes), hidden, ok, dirs, files, ignoreFile);
+    emit listerFinished(id, ok, dirs, files, ignoreFile);
+  });
+}
+
+void ProjectTreeModel::applyListing(quint64 listing, bool ok, const QStringList &dirs,
+                                    const QStringList &files, const QByteArray &ignoreFile) {
+  Node *node = listings.take(listing);
+  if (!node) return;
+  node->listing = 0;
+  if (!ok) {
+    // Unreadable, or removed; the parent's watcher reports removals
+    node->listed = true;
+    return;
+  }
+
+  // Parsed again here; the lister's copy stayed on its thread
+  node->rules = ignoreFile.isEmpty() ? nullptr
+                                     : std::make_shared<const IgnoreRules>(std::string_view(
+                                           ignoreFile.constData(), ignoreFile.size()));
+  node->listed = true;
+  merge(node, dirs, files);
+}
+
+// Removes the rows that are gone and inserts the new ones, keeping the nodes, and with them
+// the expanded subtrees, of entries that are still there.
+void ProjectTreeModel::merge(Node *node, const QStringList &dirs, const QStringList &files) {
+  auto &children           = node->children;
+  const QModelIndex parent = indexFor(node);
+
+  const auto dirCount   = static_cast<std::size_t>(dirs.size());
+  const auto freshCount = dirCount + static_cast<std::size_t>(files.size());
+  const auto freshDir   = [dirCount](std::size_t i) { return i < dirCount; };
+  const auto freshName  = [&, dirCount](std::size_t i) -> const QString & {
+    return i < dirCount ? dirs[static_cast<qsizetype>(i)]
+                        : files[static_cast<qsizetype>(i - dirCount)];
+  };
+  const auto compare = [&](const Node *child, std::size_t i) {
+    return compareEntries(child->isDir, child->name, freshDir(i), freshName(i));
+  };
+  const auto renumber = [&children](std::size_t from) {
+    for (std::size_t i = from; i < children.size(); ++i) children[i]->row = static_cast<int>(i);
+  };
+
+  std::vector<bool> keep(children.size(), false);
+  for (std::size_t i = 0, j = 0; i < children.size() && j < freshCount;) {
+    const int order = compare(children[i].get(), j);
+    if (order == 0) keep[i] = true;
+    if (order <= 0) ++i;
+    if (order >= 0) ++j;
+  }
+
+  for (int last = static_cast<int>(children.size()) - 1; last >= 0;) {
+    if (keep[last]) {
+      --last;
+      continue;
+    }
+    int first = last;
+    while (first > 0 && !keep[first - 1]) --first;
+
+    beginRemoveRows(parent, first, last);
+    for (int i = first; i <= last; ++i) release(children[i].get());
+    children.erase(children.begin() + first, children.begin() + last + 1);
+    renumber(first);
+    endRemoveRows();
+    last = first - 1;
+  }
+
+  // Every child left is in the fresh list, so runs of new entries go before children[i]
+  for (std::size_t i = 0, j = 0; j < freshCount;) {
+    if (i < children.size() && compare(children[i].get(), j) == 0) {
+      ++i;
+      ++j;
+      continue;
+    }
+    std::size_t end = j;
+    while (end < freshCount && (i == children.size() || compare(children[i].get(), end) != 0)) {
+      ++end;
+    }
+
+    beginInsertRows(parent, static_cast<int>(i), static_cast<int>(i + end - j - 1));
+    std::vector<std::unique_ptr<Node>> added;
+    added.reserve(end - j);
+    for (std::size_t k = j; k < end; ++k) {
+      auto child    = std::make_unique<Node>();
+      child->name   = freshName(k);
+      child->parent = node;
+      child->isDir  = freshDir(k);
+      added.push_back(std::move(child));
+    }
+    children.insert(children.begin() + static_cast<std::ptrdiff_t>(i),
+                    std::make_move_iterator(added.begin()), std::make_move_iterator(added.end()));
+    renumber(i);
+    endInsertRows();
+
+    i += end - j;
+    j = end;
+  }
+}
+
+void ProjectTreeModel::dropChildren(Node *node) {
+  if (node->listing) listings.remove(node->listing);
+  node->listing = 0;
+  node->listed  = false;
+  if (node->children.empty()) return;
+
+  beginRemoveRows(indexFor(node), 0, static_cast<int>(node->children.size()) - 1);
+  for (const auto &child : node->children) release(child.get());
+  node->children.clear();
+  endRemoveRows();
+}
+
+// Forgets the listings and watches of a subtree that is about to be deleted
+void ProjectTreeModel::release(Node *node) {
+  if (node->listing) listings.remove(node->listing);
+  if (node->expanded) {
+    const QString path = pathOf(node);
+    watched.remove(path);
+    watcher->removePath(path);
+  }
+  for (const auto &child : node->children) release(child.get());
+}
@@ -0,0 +1,91 @@
+#ifndef D0E4A1B2_5C3F_4E8A_9B61_7F2C84D3A916
+#define D0E4A1B2_5C3F_4E8A_9B61_7F2C84D3A916
+
+#include <QAbstractItemModel>
+#include <QHash>
+#include <QIcon>
+#include <QThreadPool>
+#include <memory>
+#include <vector>
+
+#include "ignorerules.hpp"
+
+class QFileSystemWatcher;
+
+// File tree of one project directory, for trees too large for QFileSystemModel. Directories
+// are listed on a thread pool when first expanded, skipping what .gitignore files exclude,
+// and are watched only while expanded. Collapsing a directory drops its children, so only
+// what the view can show stays in memory. Entries are sorted directories first, then by name.
+class ProjectTreeModel : public QAbstractItemModel {
+  Q_OBJECT
+
+public:
+  explicit ProjectTreeModel(QObject *parent = nullptr);
+  ~ProjectTreeModel() override; // waits for running listings
+
+  // Nearest directory at or above `path` that contains .git, or `path` if there is none.
+  static QString findProjectRoot(const QString &path);
+
+  void setRootPath(const QString &path);
+  [[nodiscard]] QString rootPath() const;
+  // Whether to list names starting with '.'; the .git directory is never listed.
+  void setShowHidden(bool show);
+
+  [[nodiscard]] QString filePath(const QModelIndex &index) const;
+  [[nodiscard]] bool isDir(const QModelIndex &index) const;
+
+  // Connect to the view's expanded() and collapsed() signals.
+  void setExpanded(const QModelIndex &index, bool expanded);
+
+  [[nodiscard]] QModelIndex index(int row, int column,
+                                  const QModelIndex &parent = QModelIndex()) const override;
+  [[nodiscard]] QModelIndex parent(const QModelIndex &child) const override;
+  [[nodiscard]] int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+  [[nodiscard]] int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+  [[nodiscard]] QVariant data(const QModelIndex &index, int role) const override;
+  [[nodiscard]] bool hasChildren(const QModelIndex &parent = QModelIndex()) const override;
+  [[nodiscard]] bool canFetchMore(const QModelIndex &parent) const override;
+  void fetchMore(const QModelIndex &parent) override;
+
+signals:
+  // Emitted from a lister thread. `ignoreFile` is the directory's .gitignore, if any.
+  void listerFinished(quint64 listing, bool ok, const QStringList &dirs, const QStringList &files,
+                      const QByteArray &ignoreFile);
+
+private:
+  struct Node {
+    QString name; // the absolute path for the root
+    Node *parent = nullptr;
+    std::vector<std::unique_ptr<Node>> children;
+    std::shared_ptr<const IgnoreRules> rules; // of this directory's .gitignore
+    int row         = 0;
+    bool isDir      = false;
+    bool listed     = false; // children are known
+    bool expanded   = false;
+    quint64 listing = 0; // listing in flight, or 0
+  };
+
+  std::unique_ptr<Node> root;
+  QHash<quint64, Node *> listings; // listings in flight; dropped nodes are removed
+  QHash<QString, Node *> watched;  // expanded directories by path
+  QFileSystemWatcher *watcher;
+  QThreadPool pool;
+  quint64 lastListing = 0;
+  bool showHidden     = false;
+  QIcon folderIcon;
+  QIcon fileIcon;
+
+  [[nodiscard]] Node *nodeFor(const QModelIndex &index) const;
+  [[nodiscard]] QModelIndex indexFor(const Node *node) const;
+  [[nodiscard]] QString pathOf(const Node *node) const;
+
+  void reset(const QString &path);
+  void startListing(Node *node);
+  void applyListing(quint64 listing, bool ok, const QStringList &dirs, const QStringList &files,
+                    const QByteArray &ignoreFile);
+  void merge(Node *node, const QStringList &dirs, const QStringList &files);
+  void dropChildren(Node *node);
+  void release(Node *node);
+};
+
+#endif /* D0E4A1B2_5C3F_4E8A_9B61_7F2C84D3A916 */
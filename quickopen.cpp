@@ -0,0 +1,115 @@
+#include "quickopen.hpp"
+
+#include <QFile>
+#include <QKeyEvent>
+#include <QLineEdit>
+#include <QListWidget>
+#include <QVBoxLayout>
+
+#include "pathindexer.hpp"
+
+QuickOpenDialog::QuickOpenDialog(PathIndexer *indexer, QWidget *parent)
+    : QDialog(parent), indexer(indexer), queryEdit(new QLineEdit(this)),
+      results(new QListWidget(this)) {
+  setWindowTitle(tr("Quick Open"));
+
+  auto *layout = new QVBoxLayout(this);
+  layout->setContentsMargins(4, 4, 4, 4);
+  layout->addWidget(queryEdit);
+  layout->addWidget(results);
+
+  queryEdit->setPlaceholderText(tr("File name"));
+  queryEdit->installEventFilter(this);
+  results->setUniformItemSizes(true);
+
+  connect(queryEdit, &QLineEdit::textChanged, this, &QuickOpenDialog::updateResults);
+  connect(queryEdit, &QLineEdit::returnPressed, this, &QuickOpenDialog::openSelected);
+  connect(results, &QListWidget::itemActivated, this, &QuickOpenDialog::openSelected);
+  connect(indexer, &PathIndexer::indexChanged, this, [this] {
+    if (isVisible()) updateResults();
+  });
+}
+
+QuickOpenDialog::~QuickOpenDialog() { pool.waitForDone(); }
+
+void QuickOpenDialog::popup() {
+  if (QWidget *window = parentWidget()) {
+    resize(window->width() / 2, window->height() / 2);
+    move(window->mapToGlobal(QPoint((window->width() - width()) / 2, window->height() / 8)));
+  }
+  indexer->refreshIfStale();
+
+  queryEdit->clear();
+  updateResults();
+  show();
+  raise();
+  activateWindow();
+  queryEdit->setFocus();
+}
+
+bool QuickOpenDialog::eventFilter(QObject *watched, QEvent *event) {
+  // Up and Down move through the results while typing
+  if (watched == queryEdit && event->type() == QEvent::KeyPress) {
+    const int key = static_cast<QKeyEvent *>(event)->key();
+    if ((key == Qt::Key_Down || key == Qt::Key_Up) && results->count() > 0) {
+      const int row = results->currentRow() + (key == Qt::Key_Down ? 1 : -1);
+      results->setCurrentRow(qBound(0, row, results->count() - 1));
+      return true;
+    }
+  }
+  return QDialog::eventFilter(watched, event);
+}
+
+void QuickOpenDialog::updateResults() {
+  results->clear();
+  const std::shared_ptr<const PathIndex> index = indexer->index();
+  if (!index) {
+    results->addItem(tr("Indexing %1...").arg(indexer->rootPath()));
+    results->item(0)->setFlags(Qt::NoItemFlags);
+    return;
+  }
+
+  // Letters are matched ignoring case, spaces not at all
+  QByteArray query = queryEdit->text().toUtf8().toLower();
+  query.replace(" ", "");
+  const std::string_view text(query.constData(), static_cast<std::size_t>(query.size()));
+
+  const std::size_t size = index->size();
+  const std::size_t parts =
+      size < parallelPaths ? 1 : static_cast<std::size_t>(qMax(1, pool.maxThreadCount()));
+  // The paths that matched a query are the only ones that can match a longer one
+  const bool narrow = index == searched && !searchedQuery.isEmpty() &&
+                      query.startsWith(searchedQuery) && matched.size() == parts;
+
+  std::vector<std::vector<PathIndex::Match>> found(parts);
+  std::vector<std::vector<std::uint32_t>> nowMatched(parts);
+  const auto searchPart = [&](std::size_t part) {
+    std::vector<std::uint32_t> *keep = query.isEmpty() ? nullptr : &nowMatched[part];
+    found[part] = narrow ? index->search(text, maxResults, matched[part], keep)
+                         : index->search(text, maxResults, size * part / parts,
+                                         size * (part + 1) / parts, keep);
+  };
+  for (std::size_t part = 1; part < parts; ++part) {
+    pool.start([&searchPart, part] { searchPart(part); });
+  }
+  searchPart(0);
+  pool.waitForDone();
+
+  searched      = index;
+  searchedQuery = query;
+  matched       = std::move(nowMatched);
+
+  for (const PathIndex::Match &match : index->merge(std::move(found), maxResults)) {
+    const std::string_view path = index->path(match.path);
+    results->addItem(
+        QFile::decodeName(QByteArray(path.data(), static_cast<qsizetype>(path.size()))));
+  }
+  if (results->count() > 0) results->setCurrentRow(0);
+}
+
+void QuickOpenDialog::openSelected() {
+  const QListWidgetItem *item = results->currentItem();
+  if (!item || !(item->flags() & Qt::ItemIsEnabled)) return;
+  emit fileSelected(indexer->rootPath() + '/' + item->text());
+  hide();
+}
@@ -0,0 +1,55 @@
+#ifndef AF51CD4C_ADF0_44CF_9BBF_6176DA26E16A
+#define AF51CD4C_ADF0_44CF_9BBF_6176DA26E16A
+
+#include <QByteArray>
+#include <QDialog>
+#include <QThreadPool>
+#include <memory>
+#include <vector>
+
+#include "pathindex.hpp"
+
+class PathIndexer;
+class QLineEdit;
+class QListWidget;
+
+// Ctrl+P palette that opens a project file by fuzzy matching its path. Each keystroke scores
+// the index on a thread pool, each thread keeping its own top results. When the query grows,
+// only the paths that matched the previous query are scored again.
+class QuickOpenDialog : public QDialog {
+  Q_OBJECT
+
+public:
+  static constexpr int maxResults = 50;
+
+  QuickOpenDialog(PathIndexer *indexer, QWidget *parent = nullptr);
+  ~QuickOpenDialog() override;
+
+  // Clears the query and shows the dialog over the top of its parent.
+  void popup();
+
+signals:
+  void fileSelected(const QString &fileName);
+
+protected:
+  bool eventFilter(QObject *watched, QEvent *event) override;
+
+private:
+  // Indexes smaller than this are searched on the calling thread alone
+  static constexpr std::size_t parallelPaths = 32 * 1024;
+
+  PathIndexer *indexer;
+  QLineEdit *queryEdit;
+  QListWidget *results;
+  QThreadPool pool;
+
+  // What the last search matched, per part of the index, to narrow the next one
+  std::shared_ptr<const PathIndex> searched;
+  QByteArray searchedQuery;
+  std::vector<std::vector<std::uint32_t>> matched;
+
+  void updateResults();
+  void openSelected();
+};
+
+#endif /* AF51CD4C_ADF0_44CF_9BBF_6176DA26E16A */
@@ -0,0 +1,420 @@
+#include "scan.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define EDIT_SCAN_X86 1
+#endif
+
+namespace scan {
+namespace {
+
+struct Kernels {
+  int (*findAny)(const char16_t *, int, int, const char16_t *, int);
+  std::size_t (*findByte)(const char *, std::size_t, std::size_t, char);
+  std::size_t (*countByte)(const char *, std::size_t, char);
+  std::size_t (*widenAscii)(const char *, std::size_t, char16_t *);
+  std::size_t (*findLiteral)(const char *, std::size_t, std::size_t, const char *, std::size_t,
+                             bool);
+  std::size_t (*filterMasks)(const std::uint64_t *, std::size_t, std::size_t, std::uint64_t,
+                             std::uint32_t *);
+  const char *name;
+};
+
+int findAnyScalar(const char16_t *s, int n, int from, const char16_t *set, int count) {
+  for (int i = from; i < n; ++i) {
+    for (int k = 0; k < count; ++k) {
+      if (s[i] == set[k]) return i;
+    }
+  }
+  return n;
+}
+
+std::size_t findByteScalar(const char *s, std::size_t n, std::size_t from, char c) {
+  if (from >= n) return n;
+  const void *hit = std::memchr(s + from, c, n - from);
+  return hit ? static_cast<std::size_t>(static_cast<const char *>(hit) - s) : n;
+}
+
+std::size_t countByteScalar(const char *s, std::size_t n, char c) {
+  std::size_t total = 0;
+  for (std::size_t i = 0; i < n; ++i) total += s[i] == c;
+  return total;
+}
+
+std::size_t widenAsciiScalar(const char *s, std::size_t n, char16_t *out) {
+  std::size_t i = 0;
+  for (; i < n && static_cast<unsigned char>(s[i]) < 0x80; ++i) {
+    out[i] = static_cast<char16_t>(s[i]);
+  }
+  return i;
+}
+
+std::size_t filterMasksScalar(const std::uint64_t *masks, std::size_t first, std::size_t last,
+                              std::uint64_t required, std::uint32_t *out) {
+  std::size_t found = 0;
+  for (std::size_t i = first; i < last; ++i) {
+    out[found] = static_cast<std::uint32_t>(i);
+    found += (masks[i] & required) == required;
+  }
+  return found;
+}
+
+bool isAsciiLetter(char c) { return (c | 0x20) >= 'a' && (c | 0x20) <= 'z'; }
+
+// Bits to OR into a byte before comparing it with `c`, which folds case if `c` is a letter
+char foldBits(char c, bool ignoreCase) { return ignoreCase && isAsciiLetter(c) ? 0x20 : 0; }
+
+bool isAsciiLetter(char16_t c) { return c < 0x80 && isAsciiLetter(static_cast<char>(c)); }
+
+// `c` in lower case if it is an ASCII letter
+char16_t foldAscii(char16_t c) { return isAsciiLetter(c) ? c | 0x20 : c; }
+
+bool textEqual(const char16_t *s, const char16_t *needle, int m, bool ignoreCase) {
+  for (int k = 0; k < m; ++k) {
+    if (s[k] != needle[k] && (!ignoreCase || foldAscii(s[k]) != foldAscii(needle[k]))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool literalEqual(const char *s, const char *needle, std::size_t m, bool ignoreCase) {
+  if (!ignoreCase) return std::memcmp(s, needle, m) == 0;
+  for (std::size_t k = 0; k < m; ++k) {
+    const char fold = foldBits(needle[k], true);
+    if ((s[k] | fold) != (needle[k] | fold)) return false;
+  }
+  return true;
+}
+
+// Callers ensure 0 < m <= n - from
+std::size_t findLiteralScalar(const char *s, std::size_t n, std::size_t from, const char *needle,
+                              std::size_t m, bool ignoreCase) {
+  const char fold  = foldBits(needle[0], ignoreCase);
+  const char first = needle[0] | fold;
+  for (std::size_t i = from; i + m <= n; ++i) {
+    if (!fold) {
+      const void *hit = std::memchr(s + i, first, n - m + 1 - i);
+      if (!hit) break;
+      i = static_cast<std::size_t>(static_cast<const char *>(hit) - s);
+    } else if ((s[i] | fold) != first) {
+      continue;
+    }
+    if (literalEqual(s + i + 1, needle + 1, m - 1, ignoreCase)) return i;
+  }
+  return n;
+}
+
+#ifdef EDIT_SCAN_X86
+
+// 16 code units (two registers) per iteration.
+int findAnySse2(const char16_t *s, int n, int from, const char16_t *set, int count) {
+  __m128i needles[kMaxSet];
+  for (int k = 0; k < count; ++k) needles[k] = _mm_set1_epi16(static_cast<short>(set[k]));
+
+  int i = from;
+  for (; i + 16 <= n; i += 16) {
+    const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s + i));
+    const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s + i + 8));
+    __m128i hitA    = _mm_cmpeq_epi16(a, needles[0]);
+    __m128i hitB    = _mm_cmpeq_epi16(b, needles[0]);
+    for (int k = 1; k < count; ++k) {
+      hitA = _mm_or_si128(hitA, _mm_cmpeq_epi16(a, needles[k]));
+      hitB = _mm_or_si128(hitB, _mm_cmpeq_epi16(b, needles[k]));
+    }
+    const unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(hitA)) |
+                          static_cast<unsigned>(_mm_movemask_epi8(hitB)) << 16;
+    if (mask) return i + __builtin_ctz(mask) / 2;
+  }
+  return findAnyScalar(s, n, i, set, count);
+}
+
+std::size_t findByteSse2(const char *s, std::size_t n, std::size_t from, char c) {
+  const __m128i needle = _mm_set1_epi8(c);
+  std::size_t i        = from;
+  for (; i + 16 <= n; i += 16) {
+    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s + i));
+    const int mask  = _mm_movemask_epi8(_mm_cmpeq_epi8(v, needle));
+    if (mask) return i + __builtin_ctz(static_cast<unsigned>(mask));
+  }
+  return findByteScalar(s, n, i, c);
+}
+
+std::size_t countByteSse2(const char *s, std::size_t n, char c) {
+  const __m128i needle = _mm_set1_epi8(c);
+  std::size_t total    = 0;
+  std::size_t i        = 0;
+  for (; i + 16 <= n; i += 16) {
+    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s + i));
+    total += __builtin_popcount(
+        static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, needle))));
+  }
+  return total + countByteScalar(s + i, n - i, c);
+}
+
+std::size_t widenAsciiSse2(const char *s, std::size_t n, char16_t *out) {
+  const __m128i zero = _mm_setzero_si128();
+  std::size_t i      = 0;
+  for (; i + 16 <= n; i += 16) {
+    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s + i));
+    if (_mm_movemask_epi8(v)) break; // a byte with the high bit set
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), _mm_unpacklo_epi8(v, zero));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i + 8), _mm_unpackhi_epi8(v, zero));
+  }
+  return i + widenAsciiScalar(s + i, n - i, out + i);
+}
+
+// 16 candidate positions per iteration.
+std::size_t findLiteralSse2(const char *s, std::size_t n, std::size_t from, const char *needle,
+                            std::size_t m, bool ignoreCase) {
+  const __m128i firstFold = _mm_set1_epi8(foldBits(needle[0], ignoreCase));
+  const __m128i lastFold  = _mm_set1_epi8(foldBits(needle[m - 1], ignoreCase));
+  const __m128i first     = _mm_or_si128(_mm_set1_epi8(needle[0]), firstFold);
+  const __m128i last      = _mm_or_si128(_mm_set1_epi8(needle[m - 1]), lastFold);
+
+  std::size_t i = from;
+  for (; i + m - 1 + 16 <= n; i += 16) {
+    const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s + i));
+    const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s + i + m - 1));
+    auto mask       = static_cast<unsigned>(
+        _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(_mm_or_si128(a, firstFold), first),
+                                              _mm_cmpeq_epi8(_mm_or_si128(b, lastFold), last))));
+    for (; mask; mask &= mask - 1) {
+      const std::size_t at = i + __builtin_ctz(mask);
+      if (literalEqual(s + at + 1, needle + 1, m - 1, ignoreCase)) return at;
+    }
+  }
+  return findLiteralScalar(s, n, i, needle, m, ignoreCase);
+}
+
+// Two masks per iteration. SSE2 has no 64-bit compare, so a mask passes when both of its
+// 32-bit halves lack no required bit.
+std::size_t filterMasksSse2(const std::uint64_t *masks, std::size_t first, std::size_t last,
+                            std::uint64_t required, std::uint32_t *out) {
+  const __m128i want = _mm_set1_epi64x(static_cast<long long>(required));
+  std::size_t found  = 0;
+  std::size_t i      = first;
+  for (; i + 2 <= last; i += 2) {
+    const __m128i v      = _mm_loadu_si128(reinterpret_cast<const __m128i *>(masks + i));
+    const __m128i halves = _mm_cmpeq_epi32(_mm_andnot_si128(v, want), _mm_setzero_si128());
+    const __m128i both   = _mm_and_si128(halves, _mm_shuffle_epi32(halves, 0xb1));
+    const auto bits      = static_cast<unsigned>(_mm_movemask_pd(_mm_castsi128_pd(both)));
+    out[found] = static_cast<std::uint32_t>(i);
+    found += bits & 1;
+    out[found] = static_cast<std::uint32_t>(i + 1);
+    found += bits >> 1;
+  }
+  return found + filterMasksScalar(masks, i, last, required, out + found);
+}
+
+// 32 code units (two registers) per iteration.
+__attribute__((target("avx2"))) int findAnyAvx2(const char16_t *s, int n, int from,
+                                                const char16_t *set, int count) {
+  __m256i needles[kMaxSet];
+  for (int k = 0; k < count; ++k) needles[k] = _mm256_set1_epi16(static_cast<short>(set[k]));
+
+  int i = from;
+  for (; i + 32 <= n; i += 32) {
+    const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s + i));
+    const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s + i + 16));
+    __m256i hitA    = _mm256_cmpeq_epi16(a, needles[0]);
+    __m256i hitB    = _mm256_cmpeq_epi16(b, needles[0]);
+    for (int k = 1; k < count; ++k) {
+      hitA = _mm256_or_si256(hitA, _mm256_cmpeq_epi16(a, needles[k]));
+      hitB = _mm256_or_si256(hitB, _mm256_cmpeq_epi16(b, needles[k]));
+    }
+    const unsigned long long mask =
+        static_cast<unsigned>(_mm256_movemask_epi8(hitA)) |
+        static_cast<unsigned long long>(static_cast<unsigned>(_mm256_movemask_epi8(hitB))) << 32;
+    if (mask) return i + __builtin_ctzll(mask) / 2;
+  }
+  _mm256_zeroupper(); // the SSE2 tail would otherwise pay for the dirty upper halves
+  return findAnySse2(s, n, i, set, count);
+}
+
+__attribute__((target("avx2"))) std::size_t findByteAvx2(const char *s, std::size_t n,
+                                                         std::size_t from, char c) {
+  const __m256i needle = _mm256_set1_epi8(c);
+  std::size_t i        = from;
+  for (; i + 32 <= n; i += 32) {
+    const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s + i));
+    const auto mask = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, needle)));
+    if (mask) return i + __builtin_ctz(mask);
+  }
+  _mm256_zeroupper();
+  return findByteSse2(s, n, i, c);
+}
+
+__attribute__((target("avx2"))) std::size_t countByteAvx2(const char *s, std::size_t n, char c) {
+  const __m256i needle = _mm256_set1_epi8(c);
+  std::size_t total    = 0;
+  std::size_t i        = 0;
+  for (; i + 32 <= n; i += 32) {
+    const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s + i));
+    total += __builtin_popcount(
+        static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, needle))));
+  }
+  _mm256_zeroupper();
+  return total + countByteSse2(s + i, n - i, c);
+}
+
+__attribute__((target("avx2"))) std::size_t widenAsciiAvx2(const char *s, std::size_t n,
+                                                           char16_t *out) {
+  std::size_t i = 0;
+  for (; i + 32 <= n; i += 32) {
+    const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s + i));
+    if (_mm256_movemask_epi8(v)) break;
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i),
+                        _mm256_cvtepu8_epi16(_mm256_castsi256_si128(v)));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i + 16),
+                        _mm256_cvtepu8_epi16(_mm256_extracti128_si256(v, 1)));
+  }
+  _mm256_zeroupper();
+  return i + widenAsciiSse2(s + i, n - i, out + i);
+}
+
+// 32 candidate positions per iteration.
+__attribute__((target("avx2"))) std::size_t findLiteralAvx2(const char *s, std::size_t n,
+                                                            std::size_t from, const char *needle,
+                                                            std::size_t m, bool ignoreCase) {
+  const __m256i firstFold = _mm256_set1_epi8(foldBits(needle[0], ignoreCase));
+  const __m256i lastFold  = _mm256_set1_epi8(foldBits(needle[m - 1], ignoreCase));
+  const __m256i first     = _mm256_or_si256(_mm256_set1_epi8(needle[0]), firstFold);
+  const __m256i last      = _mm256_or_si256(_mm256_set1_epi8(needle[m - 1]), lastFold);
+
+  std::size_t i = from;
+  for (; i + m - 1 + 32 <= n; i += 32) {
+    const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s + i));
+    const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s + i + m - 1));
+    auto mask       = static_cast<unsigned>(_mm256_movemask_epi8(
+        _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_or_si256(a, firstFold), first),
+                               _mm256_cmpeq_epi8(_mm256_or_si256(b, lastFold), last))));
+    for (; mask; mask &= mask - 1) {
+      const std::size_t at = i + __builtin_ctz(mask);
+      if (literalEqual(s + at + 1, needle + 1, m - 1, ignoreCase)) return at;
+    }
+  }
+  _mm256_zeroupper();
+  return findLiteralSse2(s, n, i, needle, m, ignoreCase);
+}
+
+// Eight masks (two registers) per iteration.
+__attribute__((target("avx2"))) std::size_t filterMasksAvx2(const std::uint64_t *masks,
+                                                            std::size_t first, std::size_t last,
+                                                            std::uint64_t required,
+                                                            std::uint32_t *out) {
+  const __m256i want = _mm256_set1_epi64x(static_cast<long long>(required));
+  const __m256i zero = _mm256_setzero_si256();
+  std::size_t found  = 0;
+  std::size_t i      = first;
+  for (; i + 8 <= last; i += 8) {
+    const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(masks + i));
+    const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(masks + i + 4));
+    const auto hitA = static_cast<unsigned>(_mm256_movemask_pd(
+        _mm256_castsi256_pd(_mm256_cmpeq_epi64(_mm256_andnot_si256(a, want), zero))));
+    const auto hitB = static_cast<unsigned>(_mm256_movemask_pd(
+        _mm256_castsi256_pd(_mm256_cmpeq_epi64(_mm256_andnot_si256(b, want), zero))));
+    for (unsigned bits = hitA | hitB << 4; bits; bits &= bits - 1) {
+      out[found++] = static_cast<std::uint32_t>(i + __builtin_ctz(bits));
+    }
+  }
+  _mm256_zeroupper();
+  return found + filterMasksSse2(masks, i, last, required, out + found);
+}
+
+#endif // EDIT_SCAN_X86
+
+Kernels select() {
+  const Kernels scalar{findAnyScalar,     findByteScalar,    countByteScalar, widenAsciiScalar,
+                       findLiteralScalar, filterMasksScalar, "scalar"};
+
+  const char *requested = std::getenv("EDIT_SCAN");
+  if (requested && std::strcmp(requested, "scalar") == 0) return scalar;
+
+#ifdef EDIT_SCAN_X86
+  // SSE2 is part of the x86-64 baseline
+  const Kernels sse2{findAnySse2,     findByteSse2,    countByteSse2, widenAsciiSse2,
+                     findLiteralSse2, filterMasksSse2, "sse2"};
+  if (requested && std::strcmp(requested, "sse2") == 0) return sse2;
+
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return {findAnyAvx2,     findByteAvx2,    countByteAvx2, widenAsciiAvx2,
+            findLiteralAvx2, filterMasksAvx2, "avx2"};
+  }
+  return sse2;
+#else
+  return scalar;
+#endif
+}
+
+const Kernels &kernels() {
+  static const Kernels selected = select();
+  return selected;
+}
+
+} // namespace
+
+int findAny(const char16_t *text, int length, int from, std::u16string_view set) {
+  if (from >= length) return length;
+  return kernels().findAny(text, length, from, set.data(), static_cast<int>(set.size()));
+}
+
+int findPair(const char16_t *text, int length, int from, char16_t first, char16_t second) {
+  for (int i = find(text, length, from, first); i + 1 < length;
+       i     = find(text, length, i + 1, first)) {
+    if (text[i + 1] == second) return i;
+  }
+  return length;
+}
+
+int findText(const char16_t *text, int length, int from, std::u16string_view needle,
+             bool ignoreCase) {
+  const int m = static_cast<int>(needle.size());
+  if (m == 0) return std::min(from, length);
+
+  const bool fold         = ignoreCase && isAsciiLetter(needle[0]);
+  const char16_t first[2] = {static_cast<char16_t>(fold ? needle[0] | 0x20 : needle[0]),
+                             static_cast<char16_t>(needle[0] & ~0x20)};
+  const std::u16string_view set(first, fold ? 2 : 1);
+
+  for (int i = findAny(text, length, from, set); i + m <= length;
+       i     = findAny(text, length, i + 1, set)) {
+    if (textEqual(text + i + 1, needle.data() + 1, m - 1, ignoreCase)) return i;
+  }
+  return length;
+}
+
+std::size_t findByte(const char *data, std::size_t length, std::size_t from, char c) {
+  if (from >= length) return length;
+  return kernels().findByte(data, length, from, c);
+}
+
+std::size_t countByte(const char *data, std::size_t length, char c) {
+  return kernels().countByte(data, length, c);
+}
+
+std::size_t findLiteral(const char *data, std::size_t length, std::size_t from,
+                        std::string_view needle, bool ignoreCase) {
+  if (needle.empty()) return std::min(from, length);
+  if (from >= length || needle.size() > length - from) return length;
+  return kernels().findLiteral(data, length, from, needle.data(), needle.size(), ignoreCase);
+}
+
+std::size_t widenAscii(const char *data, std::size_t length, char16_t *out) {
+  return kernels().widenAscii(data, length, out);
+}
+
+std::size_t filterMasks(const std::uint64_t *masks, std::size_t first, std::size_t last,
+                        std::uint64_t required, std::uint32_t *out) {
+  if (first >= last) return 0;
+  return kernels().filterMasks(masks, first, last, required, out);
+}
+
+const char *isa() { return kernels().name; }
+
+} // namespace scan
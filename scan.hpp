@@ -0,0 +1,57 @@
+#ifndef CA226CC8_D0C2_473F_87AD_0994A82A34DE
+#define CA226CC8_D0C2_473F_87AD_0994A82A34DE
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// Vectorized character scans. Each function has a scalar, an SSE2 and an AVX2 kernel; the
+// widest one the CPU supports is picked the first time any of them is called. The choice can
+// be lowered with EDIT_SCAN=scalar|sse2 to compare kernels.
+namespace scan {
+
+// Most code units findAny searches for at once.
+inline constexpr std::size_t kMaxSet = 8;
+
+// Index of the first code unit at or after `from` that is one of `set`, or `length` if there
+// is none. `set` holds between 1 and kMaxSet code units.
+int findAny(const char16_t *text, int length, int from, std::u16string_view set);
+
+inline int find(const char16_t *text, int length, int from, char16_t c) {
+  return findAny(text, length, from, std::u16string_view(&c, 1));
+}
+
+// Index of the first `/*` or `*/` style pair `first second` at or after `from`, or `length`.
+int findPair(const char16_t *text, int length, int from, char16_t first, char16_t second);
+
+// Index of the first occurrence of `needle` in `text` at or after `from`, or `length`. With
+// `ignoreCase`, ASCII letters match either case. Candidates are the positions of the needle's
+// first code unit, in either case, found with findAny.
+int findText(const char16_t *text, int length, int from, std::u16string_view needle,
+             bool ignoreCase);
+
+// Byte scans over UTF-8 file data, used to index lines.
+std::size_t findByte(const char *data, std::size_t length, std::size_t from, char c);
+std::size_t countByte(const char *data, std::size_t length, char c);
+
+// Index of the first occurrence of `needle` in `data` at or after `from`, or `length`. With
+// `ignoreCase`, ASCII letters match either case. Candidates are found by comparing the
+// needle's first and last bytes at every position of a register at once.
+std::size_t findLiteral(const char *data, std::size_t length, std::size_t from,
+                        std::string_view needle, bool ignoreCase);
+
+// Copies the leading ASCII bytes of `data` to `out` as UTF-16 and returns how many there were,
+// i.e. the index of the first byte with the high bit set, or `length`.
+std::size_t widenAscii(const char *data, std::size_t length, char16_t *out);
+
+// Writes to `out` the index of each of masks [first, last) that has all the bits of `required`,
+// in order, and returns how many there were. `out` needs room for last - first indexes.
+std::size_t filterMasks(const std::uint64_t *masks, std::size_t first, std::size_t last,
+                        std::uint64_t required, std::uint32_t *out);
+
+// Name of the kernel set in use: "avx2", "sse2" or "scalar".
+const char *isa();
+
+} // namespace scan
+
+#endif /* CA226CC8_D0C2_473F_87AD_0994A82A34DE */
@@ -0,0 +1,27 @@
+#include "sourcefile.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+constexpr std::size_t kBinaryProbeBytes = 8 * 1024; // as much as git looks at
+
+} // namespace
+
+bool SourceFile::open(const QString &fileName) {
+  file.setFileName(fileName);
+  if (!file.open(QIODevice::ReadOnly)) return false;
+  if (file.size() <= 0) return true;
+
+  // Files that cannot be mapped, like those in /proc, are read instead
+  const char *data = reinterpret_cast<const char *>(file.map(0, file.size()));
+  std::size_t size = static_cast<std::size_t>(file.size());
+  if (!data) {
+    buffer = file.readAll();
+    data   = buffer.constData();
+    size   = static_cast<std::size_t>(buffer.size());
+  }
+  if (!std::memchr(data, 0, std::min(size, kBinaryProbeBytes))) contents = {data, size};
+  return true;
+}
@@ -0,0 +1,25 @@
+#ifndef A3FB7A3B_4E3C_4A35_89F8_84F8BDB84883
+#define A3FB7A3B_4E3C_4A35_89F8_84F8BDB84883
+
+#include <QByteArray>
+#include <QFile>
+#include <QString>
+#include <string_view>
+
+// The text of a file that is searched or scanned in place: mapped when it can be, read
+// otherwise. Files that look binary, with a NUL byte near the start as git judges them, have
+// no text.
+class SourceFile {
+public:
+  // Returns false if `fileName` cannot be opened.
+  bool open(const QString &fileName);
+  // Valid while this is; empty for an empty or binary file.
+  [[nodiscard]] std::string_view text() const { return contents; }
+
+private:
+  QFile file;
+  QByteArray buffer; // the contents of a file that cannot be mapped
+  std::string_view contents;
+};
+
+#endif /* A3FB7A3B_4E3C_4A35_89F8_84F8BDB84883 */
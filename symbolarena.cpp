@@ -0,0 +1,163 @@
+#include "symbolarena.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <utility>
+
+#include "scan.hpp"
+#include "topmatches.hpp"
+
+namespace {
+
+// Words longer than this are scored by their leading units only
+constexpr std::size_t kMaxScored = 128;
+
+// Worse than any real score, yet safe to add to
+constexpr int kNone = INT_MIN / 2;
+
+bool isUpper(char16_t c) { return c >= u'A' && c <= u'Z'; }
+bool isLower(char16_t c) { return c >= u'a' && c <= u'z'; }
+bool isDigit(char16_t c) { return c >= u'0' && c <= u'9'; }
+char16_t fold(char16_t c) { return isUpper(c) ? c | 0x20 : c; }
+
+int maskBit(char16_t c) {
+  c = fold(c);
+  if (isLower(c)) return c - u'a';
+  if (isDigit(c)) return 26 + (c - u'0');
+  if (c >= 0x80) return 63;
+  if (c == u'_') return 36;
+  return 40 + (c & 15);
+}
+
+// Bonus for a match at word[i], which starts the word or a part of it
+int boundaryBonus(std::u16string_view word, std::size_t i) {
+  if (i == 0) return 10;
+  const char16_t previous = word[i - 1];
+  if (previous < 0x80 && !isLower(fold(previous)) && !isDigit(previous)) return 8; // '_', "::"
+  if (isLower(previous) && isUpper(word[i])) return 7;
+  if (!isDigit(previous) && isDigit(word[i])) return 4;
+  return 0;
+}
+
+} // namespace
+
+std::uint64_t symbolMask(std::u16string_view text) {
+  std::uint64_t mask = 0;
+  for (const char16_t c : text) mask |= std::uint64_t(1) << maskBit(c);
+  return mask;
+}
+
+int symbolScore(std::u16string_view query, std::u16string_view word) {
+  const std::size_t m = query.size();
+  if (m == 0) return 0;
+
+  // Most words that pass the mask test fail here, before any scoring. The earliest place each
+  // character can match is noted on the way: the scoring below starts there. The check runs
+  // to the end of the word; only the scoring is limited to kMaxScored units.
+  std::size_t earliest[kMaxScored];
+  std::size_t got  = 0;
+  std::size_t last = 0;
+  for (std::size_t i = 0; i < word.size() && got < m; ++i) {
+    if (fold(word[i]) != fold(query[got])) continue;
+    if (i < kMaxScored) earliest[got] = i;
+    last = i;
+    ++got;
+  }
+  if (got < m) return -1;
+  // It matches, but only past the units that are scored: as a run of plain matches
+  if (last >= kMaxScored) return 16 * static_cast<int>(m);
+
+  // previous[i] is the best score with the query's last character so far matched at word[i].
+  // `gapped` carries the best of previous[j] for j < i - 1, less a point per unit skipped.
+  const std::size_t n = std::min(word.size(), kMaxScored);
+  int rows[2][kMaxScored];
+  int *previous = rows[0];
+  int *current  = rows[1];
+  for (std::size_t k = 0; k < m; ++k) {
+    const char16_t wanted = fold(query[k]);
+    int gapped            = kNone;
+    for (std::size_t i = k == 0 ? earliest[0] : earliest[k - 1] + 1; i < n; ++i) {
+      int best = kNone;
+      if (fold(word[i]) == wanted) {
+        const int bonus = boundaryBonus(word, i);
+        const int gain  = 16 + bonus + (word[i] == query[k]);
+        if (k == 0) {
+          // The first match counts its bonus twice, so the query is anchored where it starts
+          best = gain + bonus;
+        } else {
+          best = std::max(previous[i - 1] + 6, gapped);
+          best = best <= kNone / 2 ? kNone : best + gain;
+        }
+      }
+      if (k > 0) gapped = std::max(gapped, previous[i - 1]) - 1;
+      current[i] = best;
+    }
+    std::swap(previous, current);
+  }
+
+  const int best = *std::max_element(previous + earliest[m - 1], previous + n);
+  return std::max(best, 0);
+}
+
+void SymbolArena::reserve(std::size_t words, std::size_t units) {
+  arena.reserve(units);
+  offsets.reserve(words + 1);
+  masks.reserve(words);
+  counts.reserve(words);
+}
+
+void SymbolArena::add(std::u16string_view word, std::uint32_t references) {
+  arena.append(word);
+  offsets.push_back(static_cast<std::uint32_t>(arena.size()));
+  masks.push_back(symbolMask(word));
+  counts.push_back(references);
+}
+
+bool SymbolArena::better(const Match &a, const Match &b) const {
+  if (a.score != b.score) return a.score > b.score;
+  const std::size_t aLength = offsets[a.symbol + 1] - offsets[a.symbol];
+  const std::size_t bLength = offsets[b.symbol + 1] - offsets[b.symbol];
+  if (aLength != bLength) return aLength < bLength;
+  return a.symbol < b.symbol;
+}
+
+// Words used more often rank a little higher
+auto SymbolArena::scorer(std::u16string_view query) const {
+  return [this, query](std::uint32_t i) {
+    const int score = symbolScore(query, word(i));
+    if (score < 0) return -1;
+    return score + 2 * static_cast<int>(std::min<std::uint32_t>(counts[i], 8));
+  };
+}
+
+std::vector<SymbolArena::Match> SymbolArena::search(std::u16string_view query,
+                                                    std::size_t limit, std::size_t first,
+                                                    std::size_t last,
+                                                    std::vector<std::uint32_t> *matched) const {
+  const std::uint64_t required = symbolMask(query);
+  return topMatches<Match>(
+      limit,
+      [this, first, last, required](const auto &visit) {
+        // The masks are filtered a chunk at a time, so the indexes stay in cache
+        constexpr std::size_t chunk = 4096;
+        std::uint32_t passed[chunk];
+        for (std::size_t from = first; from < last; from += chunk) {
+          const std::size_t to    = std::min(last, from + chunk);
+          const std::size_t count = scan::filterMasks(masks.data(), from, to, required, passed);
+          for (std::size_t k = 0; k < count; ++k) visit(passed[k]);
+        }
+      },
+      scorer(query), ranks(), matched);
+}
+
+std::vector<SymbolArena::Match> SymbolArena::search(std::u16string_view query,
+                                                    std::size_t limit,
+                                                    const std::vector<std::uint32_t> &within,
+                                                    std::vector<std::uint32_t> *matched) const {
+  return topMatches<Match>(limit, eachOf(within), scorer(query), ranks(), matched);
+}
+
+std::vector<SymbolArena::Match> SymbolArena::merge(std::vector<std::vector<Match>> parts,
+                                                   std::size_t limit) const {
+  return mergeMatches(std::move(parts), limit, ranks());
+}
@@ -0,0 +1,66 @@
+#ifndef BC38C833_2019_49C0_988A_E5069D00D198
+#define BC38C833_2019_49C0_988A_E5069D00D198
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Words to complete, packed end to end in one UTF-16 arena with an offset per word, plus a
+// 64-bit mask of the characters in each. A search first keeps the words whose masks have
+// every character of the query, a vectorized pass over the masks, and only scores those.
+class SymbolArena {
+public:
+  struct Match {
+    std::uint32_t symbol;
+    int score;
+  };
+
+  [[nodiscard]] std::size_t size() const { return offsets.size() - 1; }
+  [[nodiscard]] std::u16string_view word(std::size_t i) const {
+    return std::u16string_view(arena).substr(offsets[i], offsets[i + 1] - offsets[i]);
+  }
+  // How often word i occurs where it was found
+  [[nodiscard]] std::uint32_t references(std::size_t i) const { return counts[i]; }
+
+  void reserve(std::size_t words, std::size_t units);
+  void add(std::u16string_view word, std::uint32_t references);
+
+  // The best `limit` matches of `query` among words [first, last), best first. Every word that
+  // matches is appended to `matched`, if given: a query that extends this one can only match
+  // those, and can search just them with the overload below.
+  [[nodiscard]] std::vector<Match> search(std::u16string_view query, std::size_t limit,
+                                          std::size_t first, std::size_t last,
+                                          std::vector<std::uint32_t> *matched = nullptr) const;
+  [[nodiscard]] std::vector<Match> search(std::u16string_view query, std::size_t limit,
+                                          const std::vector<std::uint32_t> &within,
+                                          std::vector<std::uint32_t> *matched = nullptr) const;
+  // Merges results of search() over disjoint ranges into the best `limit`, best first.
+  [[nodiscard]] std::vector<Match> merge(std::vector<std::vector<Match>> parts,
+                                         std::size_t limit) const;
+
+private:
+  std::u16string arena;
+  std::vector<std::uint32_t> offsets{0};
+  std::vector<std::uint64_t> masks;
+  std::vector<std::uint32_t> counts;
+
+  [[nodiscard]] bool better(const Match &a, const Match &b) const;
+  [[nodiscard]] auto ranks() const {
+    return [this](const Match &a, const Match &b) { return better(a, b); };
+  }
+  // symbolScore() of word i for `query`, raised by how often it is used, or -1, as
+  // topMatches() takes it
+  [[nodiscard]] auto scorer(std::u16string_view query) const;
+};
+
+// Bit of each character class that search() requires; ASCII letters ignore case.
+std::uint64_t symbolMask(std::u16string_view text);
+
+// Scores `word` for `query`, whose characters must appear in it in order ignoring ASCII case,
+// or returns -1. The best alignment is found: matches that start the word or a part of it
+// (after '_', at a lower to upper case step or at a digit) and runs of consecutive matches
+// score higher, gaps cost a little, and matches in the query's case add a point.
+int symbolScore(std::u16string_view query, std::u16string_view word);
+
+#endif /* BC38C833_2019_49C0_988A_E5069D00D198 */
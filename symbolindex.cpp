@@ -0,0 +1,225 @@
+#include "symbolindex.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+
+namespace {
+
+constexpr std::uint32_t kMagic   = 0x4d595345; // "ESYM"
+constexpr std::uint32_t kVersion = 1;
+
+// The file is a Header, a FileRecord per file, a SymbolRecord per symbol in file order, the
+// index of each symbol in order of name, and then the strings the records point into.
+struct Header {
+  std::uint32_t magic;
+  std::uint32_t version;
+  std::uint32_t files;
+  std::uint32_t symbols;
+  std::uint32_t stringBytes;
+  std::uint32_t reserved;
+};
+
+struct FileRecord {
+  std::int64_t modified;
+  std::int64_t size;
+  std::uint32_t path;
+  std::uint32_t pathLength;
+  std::uint32_t firstSymbol;
+  std::uint32_t symbolCount;
+};
+
+struct SymbolRecord {
+  std::uint32_t name;
+  std::uint32_t file;
+  std::uint32_t line;
+  std::uint32_t column;
+  std::uint16_t nameLength;
+  std::uint8_t kind;
+  std::uint8_t definition;
+};
+
+static_assert(sizeof(Header) == 24 && sizeof(FileRecord) == 32 && sizeof(SymbolRecord) == 20);
+
+template <typename T>
+void append(std::vector<std::uint8_t> &out, const T &value) {
+  const auto *bytes = reinterpret_cast<const std::uint8_t *>(&value);
+  out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+// Record i of an array that starts at `records`, which need not be aligned
+template <typename T>
+T recordAt(const std::uint8_t *records, std::size_t i) {
+  T value;
+  std::memcpy(&value, records + i * sizeof(T), sizeof(T));
+  return value;
+}
+
+} // namespace
+
+void FileSymbols::add(const Declaration &declaration) {
+  if (declaration.name.size() > UINT16_MAX) return;
+  symbols.push_back({static_cast<std::uint32_t>(names.size()),
+                     static_cast<std::uint16_t>(declaration.name.size()), declaration.kind,
+                     declaration.definition, declaration.line, declaration.column});
+  names.append(declaration.name);
+}
+
+std::vector<std::uint8_t> SymbolIndex::serialize(const std::vector<FileSymbols> &files) {
+  std::string strings;
+  std::unordered_map<std::string, std::uint32_t> interned;
+  const auto intern = [&](std::string_view text) {
+    const auto [at, added] =
+        interned.try_emplace(std::string(text), static_cast<std::uint32_t>(strings.size()));
+    if (added) strings.append(text);
+    return at->second;
+  };
+
+  std::vector<FileRecord> fileRecords;
+  std::vector<SymbolRecord> symbolRecords;
+  fileRecords.reserve(files.size());
+  for (const FileSymbols &file : files) {
+    const auto index = static_cast<std::uint32_t>(fileRecords.size());
+    fileRecords.push_back({file.modified, file.size, intern(file.path),
+                           static_cast<std::uint32_t>(file.path.size()),
+                           static_cast<std::uint32_t>(symbolRecords.size()),
+                           static_cast<std::uint32_t>(file.symbols.size())});
+    for (const FileSymbols::Symbol &symbol : file.symbols) {
+      symbolRecords.push_back({intern(file.name(symbol)), index, symbol.line, symbol.column,
+                               symbol.nameLength, static_cast<std::uint8_t>(symbol.kind),
+                               static_cast<std::uint8_t>(symbol.definition)});
+    }
+  }
+
+  // Equal names keep file order, so a name's symbols come out as they were found
+  const auto nameOf = [&](std::uint32_t i) {
+    return std::string_view(strings).substr(symbolRecords[i].name, symbolRecords[i].nameLength);
+  };
+  std::vector<std::uint32_t> byName(symbolRecords.size());
+  for (std::size_t i = 0; i < byName.size(); ++i) byName[i] = static_cast<std::uint32_t>(i);
+  std::stable_sort(byName.begin(), byName.end(),
+                   [&](std::uint32_t a, std::uint32_t b) { return nameOf(a) < nameOf(b); });
+
+  std::vector<std::uint8_t> out;
+  out.reserve(sizeof(Header) + fileRecords.size() * sizeof(FileRecord) +
+              symbolRecords.size() * (sizeof(SymbolRecord) + sizeof(std::uint32_t)) +
+              strings.size());
+  append(out, Header{kMagic, kVersion, static_cast<std::uint32_t>(fileRecords.size()),
+                     static_cast<std::uint32_t>(symbolRecords.size()),
+                     static_cast<std::uint32_t>(strings.size()), 0});
+  for (const FileRecord &record : fileRecords) append(out, record);
+  for (const SymbolRecord &record : symbolRecords) append(out, record);
+  for (const std::uint32_t symbol : byName) append(out, symbol);
+  out.insert(out.end(), strings.begin(), strings.end());
+  return out;
+}
+
+bool SymbolIndex::open(const std::uint8_t *data, std::size_t size) {
+  *this = SymbolIndex();
+  if (size < sizeof(Header)) return false;
+  const auto header = recordAt<Header>(data, 0);
+  if (header.magic != kMagic || header.version != kVersion) return false;
+
+  const std::size_t expected =
+      sizeof(Header) + std::size_t{header.files} * sizeof(FileRecord) +
+      std::size_t{header.symbols} * (sizeof(SymbolRecord) + sizeof(std::uint32_t)) +
+      header.stringBytes;
+  if (size != expected) return false;
+
+  SymbolIndex index;
+  index.files         = header.files;
+  index.symbols       = header.symbols;
+  index.fileRecords   = data + sizeof(Header);
+  index.symbolRecords = index.fileRecords + index.files * sizeof(FileRecord);
+  index.byName        = index.symbolRecords + index.symbols * sizeof(SymbolRecord);
+  index.strings       = reinterpret_cast<const char *>(data) + (size - header.stringBytes);
+  const auto inStrings = [&](std::uint32_t offset, std::uint32_t length) {
+    return offset <= header.stringBytes && length <= header.stringBytes - offset;
+  };
+
+  // The files' symbols follow each other, in file order
+  std::uint32_t next = 0;
+  for (std::size_t i = 0; i < index.files; ++i) {
+    const auto file = recordAt<FileRecord>(index.fileRecords, i);
+    if (!inStrings(file.path, file.pathLength) || file.firstSymbol != next ||
+        file.symbolCount > header.symbols - next) {
+      return false;
+    }
+    for (std::uint32_t k = next; k < next + file.symbolCount; ++k) {
+      const auto symbol = recordAt<SymbolRecord>(index.symbolRecords, k);
+      if (!inStrings(symbol.name, symbol.nameLength) || symbol.file != i ||
+          symbol.kind > static_cast<std::uint8_t>(Declaration::Kind::Macro) ||
+          symbol.definition > 1) {
+        return false;
+      }
+    }
+    next += file.symbolCount;
+  }
+  if (next != header.symbols) return false;
+
+  // find() relies on the order
+  for (std::size_t i = 0; i < index.symbols; ++i) {
+    const auto symbol = recordAt<std::uint32_t>(index.byName, i);
+    if (symbol >= header.symbols) return false;
+    if (i > 0 && index.nameOf(symbol) < index.nameOf(index.symbolByName(i - 1))) return false;
+  }
+
+  *this = index;
+  return true;
+}
+
+SymbolIndex::File SymbolIndex::file(std::size_t i) const {
+  const auto record = recordAt<FileRecord>(fileRecords, i);
+  return {std::string_view(strings + record.path, record.pathLength), record.modified,
+          record.size, record.firstSymbol, record.symbolCount};
+}
+
+SymbolIndex::Symbol SymbolIndex::symbol(std::size_t i) const {
+  const auto record = recordAt<SymbolRecord>(symbolRecords, i);
+  return {std::string_view(strings + record.name, record.nameLength),
+          record.file,
+          record.line,
+          record.column,
+          static_cast<Declaration::Kind>(record.kind),
+          record.definition != 0};
+}
+
+std::uint32_t SymbolIndex::symbolByName(std::size_t i) const {
+  return recordAt<std::uint32_t>(byName, i);
+}
+
+std::string_view SymbolIndex::nameOf(std::uint32_t symbol) const {
+  const auto record = recordAt<SymbolRecord>(symbolRecords, symbol);
+  return std::string_view(strings + record.name, record.nameLength);
+}
+
+std::vector<std::uint32_t> SymbolIndex::find(std::string_view name) const {
+  std::size_t low = 0, high = symbols;
+  while (low < high) {
+    const std::size_t middle = low + (high - low) / 2;
+    if (nameOf(symbolByName(middle)) < name) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  std::vector<std::uint32_t> found;
+  for (; low < symbols && nameOf(symbolByName(low)) == name; ++low) {
+    found.push_back(symbolByName(low));
+  }
+  return found;
+}
+
+FileSymbols SymbolIndex::fileSymbols(std::size_t i) const {
+  const File from = file(i);
+  FileSymbols copy;
+  copy.path     = from.path;
+  copy.modified = from.modified;
+  copy.size     = from.size;
+  copy.symbols.reserve(from.symbolCount);
+  for (std::uint32_t k = from.firstSymbol; k < from.firstSymbol + from.symbolCount; ++k) {
+    const Symbol found = symbol(k);
+    copy.add({found.name, found.kind, found.definition, found.line, found.column});
+  }
+  return copy;
+}
@@ -0,0 +1,91 @@
+#ifndef DD8C398B_DB90_48AA_840F_B94FEB7DA76E
+#define DD8C398B_DB90_48AA_840F_B94FEB7DA76E
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "declscanner.hpp"
+
+// The declarations found in one file, with their names copied out of its text.
+struct FileSymbols {
+  struct Symbol {
+    std::uint32_t name; // offset in `names`
+    std::uint16_t nameLength;
+    Declaration::Kind kind;
+    bool definition;
+    std::uint32_t line;
+    std::uint32_t column;
+  };
+
+  std::string path;
+  std::int64_t modified = 0; // ms since the epoch
+  std::int64_t size     = 0;
+  std::string names; // end to end
+  std::vector<Symbol> symbols;
+
+  void add(const Declaration &declaration);
+  [[nodiscard]] std::string_view name(const Symbol &symbol) const {
+    return std::string_view(names).substr(symbol.name, symbol.nameLength);
+  }
+};
+
+// A read-only view of the symbol index file of a project: its files with the modification
+// time and size they were scanned at, their symbols in file order, the symbols again sorted
+// by name, and the strings. open() checks every offset once, so lookups read the records in
+// place and a file that is mapped into memory needs no parsing before it can be queried.
+class SymbolIndex {
+public:
+  static constexpr std::uint32_t npos = UINT32_MAX;
+
+  struct File {
+    std::string_view path;
+    std::int64_t modified;
+    std::int64_t size;
+    std::uint32_t firstSymbol;
+    std::uint32_t symbolCount;
+  };
+
+  struct Symbol {
+    std::string_view name;
+    std::uint32_t file;
+    std::uint32_t line;
+    std::uint32_t column;
+    Declaration::Kind kind;
+    bool definition;
+  };
+
+  // The bytes of `files` in index form. Names that repeat are stored once.
+  [[nodiscard]] static std::vector<std::uint8_t> serialize(const std::vector<FileSymbols> &files);
+
+  // Views the index in `data`, which has to stay valid and unchanged for as long as this is
+  // used. Returns false, leaving the index empty, if it is truncated, of another version or
+  // has an offset out of range.
+  bool open(const std::uint8_t *data, std::size_t size);
+
+  [[nodiscard]] std::size_t fileCount() const { return files; }
+  [[nodiscard]] File file(std::size_t i) const;
+  [[nodiscard]] std::size_t symbolCount() const { return symbols; }
+  [[nodiscard]] Symbol symbol(std::size_t i) const;
+  // The i-th symbol in order of name; symbols with the same name are next to each other.
+  [[nodiscard]] std::uint32_t symbolByName(std::size_t i) const;
+
+  // The symbols called `name`, by binary search over the sorted names.
+  [[nodiscard]] std::vector<std::uint32_t> find(std::string_view name) const;
+
+  // The symbols of file i, as scanned, to carry them over to a new index unchanged.
+  [[nodiscard]] FileSymbols fileSymbols(std::size_t i) const;
+
+private:
+  const std::uint8_t *fileRecords   = nullptr;
+  const std::uint8_t *symbolRecords = nullptr;
+  const std::uint8_t *byName        = nullptr;
+  const char *strings               = nullptr;
+  std::size_t files                 = 0;
+  std::size_t symbols               = 0;
+
+  [[nodiscard]] std::string_view nameOf(std::uint32_t symbol) const;
+};
+
+#endif /* DD8C398B_DB90_48AA_840F_B94FEB7DA76E */
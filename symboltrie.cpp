@@ -0,0 +1,63 @@
+#include "symboltrie.hpp"
+
+SymbolTrie::SymbolTrie() : nodes(1) {}
+
+SymbolTrie::Id SymbolTrie::childOf(Id node, char16_t unit) {
+  // Siblings are sorted, so the search stops at the first larger unit
+  Id previous = none;
+  Id child    = nodes[node].child;
+  for (; child != none && nodes[child].unit < unit; child = nodes[child].sibling) {
+    previous = child;
+  }
+  if (child != none && nodes[child].unit == unit) return child;
+
+  Id added;
+  if (unused.empty()) {
+    added = static_cast<Id>(nodes.size());
+    nodes.emplace_back();
+  } else {
+    added = unused.back();
+    unused.pop_back();
+    nodes[added] = Node();
+  }
+  nodes[added].unit    = unit;
+  nodes[added].parent  = node;
+  nodes[added].sibling = child;
+  (previous == none ? nodes[node].child : nodes[previous].sibling) = added;
+  return added;
+}
+
+SymbolTrie::Id SymbolTrie::add(std::u16string_view word) {
+  Id node = none;
+  for (const char16_t unit : word) node = childOf(node, unit);
+  if (nodes[node].count++ == 0) {
+    for (Id up = node; up != none; up = nodes[up].parent) ++nodes[up].words;
+    ++nodes[none].words;
+  }
+  return node;
+}
+
+void SymbolTrie::release(Id id) {
+  if (--nodes[id].count > 0) return;
+
+  --nodes[none].words;
+  for (Id node = id; node != none;) {
+    const Id parent = nodes[node].parent;
+    if (--nodes[node].words > 0) {
+      node = parent;
+      continue;
+    }
+    // Nothing is left below `node`, so its children were unlinked already
+    Id *link = &nodes[parent].child;
+    while (*link != node) link = &nodes[*link].sibling;
+    *link = nodes[node].sibling;
+    unused.push_back(node);
+    node = parent;
+  }
+}
+
+std::u16string SymbolTrie::word(Id id) const {
+  std::u16string text;
+  for (Id node = id; node != none; node = nodes[node].parent) text.push_back(nodes[node].unit);
+  return {text.rbegin(), text.rend()};
+}
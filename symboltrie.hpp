@@ -0,0 +1,51 @@
+#ifndef D7A2F19C_3B84_4E5D_A6C1_58E90B7D24F3
+#define D7A2F19C_3B84_4E5D_A6C1_58E90B7D24F3
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Set of words with a reference count each, for completing identifiers. The nodes of the trie
+// live in one vector and link to their parent, first child and next sibling, siblings in code
+// unit order. Every node counts the distinct words below it, and nodes whose count drops to
+// zero are unlinked and reused, so the trie holds only the branches that lead to words and
+// adding a word costs its length times the siblings passed on the way.
+class SymbolTrie {
+public:
+  using Id = std::uint32_t; // of a word, valid while it has references
+
+  SymbolTrie();
+
+  // Adds a reference to `word`, which must not be empty, and returns its id.
+  Id add(std::u16string_view word);
+  // Drops a reference added by add(); the word is removed with its last one.
+  void release(Id id);
+
+  [[nodiscard]] std::size_t size() const { return nodes[0].words; } // distinct words
+
+  // The word of `id` and its references, which are 0 once release() dropped the last one. An
+  // id stays readable until the next add() may reuse its nodes.
+  [[nodiscard]] std::u16string word(Id id) const;
+  [[nodiscard]] std::uint32_t references(Id id) const { return nodes[id].count; }
+
+private:
+  static constexpr Id none = 0; // the root, which is nobody's child or sibling
+
+  struct Node {
+    char16_t unit       = 0;
+    Id parent           = none;
+    Id child            = none;
+    Id sibling          = none;
+    std::uint32_t count = 0; // references to the word ending here
+    std::uint32_t words = 0; // words ending here or below
+  };
+
+  std::vector<Node> nodes; // nodes[0] is the root
+  std::vector<Id> unused;  // unlinked nodes to reuse
+
+  // The child of `node` for `unit`, added if there is none
+  Id childOf(Id node, char16_t unit);
+};
+
+#endif /* D7A2F19C_3B84_4E5D_A6C1_58E90B7D24F3 */
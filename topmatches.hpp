@@ -0,0 +1,60 @@
+#ifndef A928A0F6_9DDB_489E_A7E2_4E5FA02041BC
+#define A928A0F6_9DDB_489E_A7E2_4E5FA02041BC
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// The fuzzy search shared by PathIndex and SymbolArena, whose matches are {index, score}
+// pairs ranked by `better(a, b)`, true if `a` ranks above `b`.
+//
+// The best `limit` of the entries `entries` visits, best first. `entries` is called with a
+// visitor to call with each index to score, such as those of a range or of the matches of a
+// shorter query. `score` returns the score of an index, or -1 if it does not match. Every index
+// that matches is appended to `matched`, if given.
+template <typename Match, typename Entries, typename Score, typename Better>
+std::vector<Match> topMatches(std::size_t limit, const Entries &entries, const Score &score,
+                              const Better &better, std::vector<std::uint32_t> *matched) {
+  // A heap of the best matches so far, with the worst of them on top
+  std::vector<Match> best;
+  best.reserve(limit + 1);
+  entries([&](std::uint32_t i) {
+    const int scored = score(i);
+    if (scored < 0) return;
+    if (matched) matched->push_back(i);
+
+    const Match match{i, scored};
+    if (best.size() == limit) {
+      if (limit == 0 || !better(match, best.front())) return;
+      std::pop_heap(best.begin(), best.end(), better);
+      best.pop_back();
+    }
+    best.push_back(match);
+    std::push_heap(best.begin(), best.end(), better);
+  });
+  std::sort_heap(best.begin(), best.end(), better);
+  return best;
+}
+
+// Entries for topMatches(): the indexes in `within`, such as those a shorter query matched,
+// which are all a query that extends it can match.
+inline auto eachOf(const std::vector<std::uint32_t> &within) {
+  return [&within](const auto &visit) {
+    for (const std::uint32_t i : within) visit(i);
+  };
+}
+
+// Merges results of topMatches() over disjoint entries into the best `limit`, best first.
+template <typename Match, typename Better>
+std::vector<Match> mergeMatches(std::vector<std::vector<Match>> parts, std::size_t limit,
+                                const Better &better) {
+  std::vector<Match> all;
+  for (auto &part : parts) all.insert(all.end(), part.begin(), part.end());
+  const auto end = all.begin() + static_cast<std::ptrdiff_t>(std::min(limit, all.size()));
+  std::partial_sort(all.begin(), end, all.end(), better);
+  all.erase(end, all.end());
+  return all;
+}
+
+#endif /* A928A0F6_9DDB_489E_A7E2_4E5FA02041BC */
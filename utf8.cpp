@@ -0,0 +1,140 @@
+#include "utf8.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include "scan.hpp"
+
+namespace {
+
+constexpr char16_t kReplacement = 0xFFFD;
+
+// Decodes the sequence at `s`. Returns its length, 0 if the `n` bytes are a valid but
+// incomplete prefix, or minus the length of the malformed prefix, which is replaced by one
+// U+FFFD (see the well-formed byte sequences table in chapter 3 of the Unicode standard).
+int decodeOne(const unsigned char *s, std::size_t n, char32_t &codePoint) {
+  const unsigned char lead = s[0];
+  int length               = 0;
+  unsigned char low        = 0x80; // range of the second byte
+  unsigned char high       = 0xBF;
+
+  if (lead < 0x80) {
+    codePoint = lead;
+    return 1;
+  } else if (lead >= 0xC2 && lead <= 0xDF) {
+    length    = 2;
+    codePoint = lead & 0x1F;
+  } else if (lead >= 0xE0 && lead <= 0xEF) {
+    length    = 3;
+    codePoint = lead & 0x0F;
+    if (lead == 0xE0) low = 0xA0;
+    if (lead == 0xED) high = 0x9F; // no surrogates
+  } else if (lead >= 0xF0 && lead <= 0xF4) {
+    length    = 4;
+    codePoint = lead & 0x07;
+    if (lead == 0xF0) low = 0x90;
+    if (lead == 0xF4) high = 0x8F; // nothing above U+10FFFF
+  } else {
+    return -1;
+  }
+
+  for (int i = 1; i < length; ++i) {
+    if (static_cast<std::size_t>(i) >= n) return 0;
+    const unsigned char byte = s[i];
+    if (byte < (i == 1 ? low : 0x80) || byte > (i == 1 ? high : 0xBF)) return -i;
+    codePoint = codePoint << 6 | (byte & 0x3F);
+  }
+  return length;
+}
+
+std::size_t encode(char32_t codePoint, char16_t *out) {
+  if (codePoint < 0x10000) {
+    out[0] = static_cast<char16_t>(codePoint);
+    return 1;
+  }
+  codePoint -= 0x10000;
+  out[0] = static_cast<char16_t>(0xD800 + (codePoint >> 10));
+  out[1] = static_cast<char16_t>(0xDC00 + (codePoint & 0x3FF));
+  return 2;
+}
+
+} // namespace
+
+std::size_t Utf8Decoder::decode(const char *data, std::size_t length, char16_t *out) {
+  const auto *bytes = reinterpret_cast<const unsigned char *>(data);
+  std::size_t i     = 0;
+  std::size_t o     = 0;
+  char32_t codePoint;
+
+  // Complete the sequence left over from the previous chunk
+  if (pendingLength > 0) {
+    unsigned char joined[4];
+    const std::size_t taken = std::min(sizeof joined - pendingLength, length);
+    std::memcpy(joined, pending, pendingLength);
+    std::memcpy(joined + pendingLength, bytes, taken);
+
+    const int used = decodeOne(joined, pendingLength + taken, codePoint);
+    if (used == 0) {
+      std::memcpy(pending + pendingLength, bytes, taken);
+      pendingLength += taken;
+      return 0;
+    }
+    if (used > 0) {
+      o += encode(codePoint, out);
+      i = static_cast<std::size_t>(used) - pendingLength;
+    } else {
+      out[o++] = kReplacement;
+      invalid  = true;
+      i        = static_cast<std::size_t>(-used) - pendingLength;
+    }
+    pendingLength = 0;
+  }
+
+  while (i < length) {
+    const std::size_t ascii = scan::widenAscii(data + i, length - i, out + o);
+    i += ascii;
+    o += ascii;
+    if (i == length) break;
+
+    const int used = decodeOne(bytes + i, length - i, codePoint);
+    if (used > 0) {
+      o += encode(codePoint, out + o);
+      i += static_cast<std::size_t>(used);
+    } else if (used == 0) {
+      pendingLength = length - i;
+      std::memcpy(pending, bytes + i, pendingLength);
+      break;
+    } else {
+      out[o++] = kReplacement;
+      invalid  = true;
+      i += static_cast<std::size_t>(-used);
+    }
+  }
+  return o;
+}
+
+std::size_t Utf8Decoder::finish(char16_t *out) {
+  if (pendingLength == 0) return 0;
+  pendingLength = 0;
+  invalid       = true;
+  out[0]        = kReplacement;
+  return 1;
+}
+
+std::size_t utf16Length(const char *data, std::size_t length) {
+  std::size_t units = 0;
+  for (std::size_t i = 0; i < length; ++i) {
+    const auto byte = static_cast<unsigned char>(data[i]);
+    units += (byte & 0xC0) != 0x80; // every byte but continuation bytes starts a code point
+    units += byte >= 0xF0;          // which needs a surrogate pair
+  }
+  return units;
+}
+
+std::size_t utf8Sequence(const char *data, std::size_t length, char32_t &codePoint) {
+  const int used = decodeOne(reinterpret_cast<const unsigned char *>(data), length, codePoint);
+  if (used > 0) return static_cast<std::size_t>(used);
+
+  codePoint = kReplacement;
+  return used == 0 ? length : static_cast<std::size_t>(-used);
+}
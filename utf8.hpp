@@ -0,0 +1,39 @@
+#ifndef E757432B_1658_4352_A1A8_8F6466FFEC08
+#define E757432B_1658_4352_A1A8_8F6466FFEC08
+
+#include <cstddef>
+
+// Incremental UTF-8 to UTF-16 decoder for text that arrives in chunks. A sequence split
+// between chunks is carried over to the next call. ASCII runs, the bulk of source files, are
+// copied with scan::widenAscii; other sequences are validated one by one. Malformed input is
+// decoded to U+FFFD, as QString::fromUtf8 does, and remembered in malformed().
+class Utf8Decoder {
+public:
+  // Longest incomplete sequence that can be carried between chunks.
+  static constexpr std::size_t kMaxPending = 3;
+
+  // Decodes `length` bytes to `out`, which needs room for `length + kMaxPending` code
+  // units, and returns the number of code units written.
+  std::size_t decode(const char *data, std::size_t length, char16_t *out);
+  // Flushes a sequence left incomplete at the end of the input; `out` needs one code unit.
+  std::size_t finish(char16_t *out);
+
+  [[nodiscard]] bool malformed() const { return invalid; }
+
+private:
+  unsigned char pending[kMaxPending] = {};
+  std::size_t pendingLength          = 0;
+  bool invalid                       = false;
+};
+
+// Number of UTF-16 code units `length` bytes of valid UTF-8 decode to, e.g. to turn byte
+// offsets reported by external tools into QString positions.
+std::size_t utf16Length(const char *data, std::size_t length);
+
+// Length in bytes of the UTF-8 sequence at the start of `length` bytes, at least 1, with
+// `codePoint` set to what it decodes to. A malformed sequence, or one cut short by the end of
+// the input, decodes to U+FFFD, as with Utf8Decoder; so walking a text with this splits it
+// into the same code points the decoder produces.
+std::size_t utf8Sequence(const char *data, std::size_t length, char32_t &codePoint);
+
+#endif /* E757432B_1658_4352_A1A8_8F6466FFEC08 */